@@ -0,0 +1,717 @@
+/*
+ * Copyright (c) 2025 amigazen project
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * GenBench - Throughput benchmark for the Gen tools
+ *
+ * Writes a synthetic corpus at scale and times the tools on it:
+ * - GenDo on source files with many autodocs each
+ * - GenMaki on GNU makefiles with thousands of rules and variables
+ * - GenIn on a spec file with thousands of icons
+ *
+ * Each tool is run as a separate process. Wall time comes from the
+ * E-clock, peak memory from the lowest AvailMem() seen while it runs.
+ */
+
+#include <exec/types.h>
+#include <exec/memory.h>
+#include <dos/dos.h>
+#include <dos/dosextens.h>
+#include <dos/dostags.h>
+#include <utility/tagitem.h>
+#include <string.h>
+
+#include <proto/exec.h>
+#include <proto/dos.h>
+#include <proto/utility.h>
+
+#include "genlib.h"
+
+/* Version and stack information - referenced to avoid warnings */
+static const char *verstag = "$VER: GenBench 1.0 (14/10/26)";
+static const char *stack_cookie = "$STACK: 8192";
+
+/* Global library bases */
+struct Library *UtilityBase = NULL;
+
+/* Maximum sizes and limits */
+#define MAX_PATH_LENGTH 256
+#define MAX_COMMAND_LENGTH 1024
+#define NUMBER_LENGTH 12
+
+/* Default corpus size */
+#define DEFAULT_FILES 50
+#define DEFAULT_AUTODOCS 20
+#define DEFAULT_MAKEFILES 10
+#define DEFAULT_RULES 1000
+#define DEFAULT_VARIABLES 500
+#define DEFAULT_ICONS 2000
+
+/* The tools GenBench knows how to drive */
+#define TOOL_GENDO 1
+#define TOOL_GENMAKI 2
+#define TOOL_GENIN 4
+#define TOOL_ALL (TOOL_GENDO | TOOL_GENMAKI | TOOL_GENIN)
+
+/* Configuration structure */
+typedef struct {
+    STRPTR dir;             /* corpus directory */
+    STRPTR tool_dir;        /* where the tools are, "" for the path */
+    LONG tools;             /* TOOL_ flags */
+    BOOL generate;
+    BOOL run;
+    LONG files;
+    LONG autodocs;
+    LONG makefiles;
+    LONG rules;
+    LONG variables;
+    LONG icons;
+} Config;
+
+/* One timed tool run - done is set last by the process's exit code */
+typedef struct {
+    struct Task *task;
+    LONG signal_mask;
+    volatile BOOL done;
+    LONG return_code;
+} Run;
+
+/* Result of one tool on the corpus */
+typedef struct {
+    STRPTR tool;
+    LONG items;             /* files or icons processed */
+    ULONG ms;
+    ULONG peak;             /* bytes, from AvailMem() */
+    LONG return_code;
+} Result;
+
+/* Function prototypes */
+BOOL parse_arguments(Config *config);
+LONG parse_tool_names(STRPTR names);
+void print_usage(void);
+BOOL make_path(STRPTR dest, STRPTR dir, STRPTR name);
+BOOL make_dir(STRPTR path);
+void format_number(STRPTR dest, LONG value, LONG digits);
+BOOL generate_sources(Config *config);
+BOOL generate_makefiles(Config *config);
+BOOL generate_specs(Config *config);
+BOOL write_source(BPTR file, Config *config, LONG file_index);
+BOOL write_makefile(BPTR file, Config *config);
+BOOL write_spec(BPTR file, Config *config);
+BOOL run_tool(GenClock *clock, Config *config, STRPTR tool, STRPTR args, LONG items, Result *result);
+void __saveds __asm run_exit(register __d0 LONG return_code, register __d1 Run *run);
+void print_results(Config *config, Result *results, LONG count);
+
+int main(int argc, char *argv[])
+{
+    Config config;
+    GenClock clock;
+    Result results[3];
+    LONG result_count = 0;
+    UBYTE args[MAX_COMMAND_LENGTH];
+    UBYTE path[MAX_PATH_LENGTH];
+    int return_code = RETURN_OK;
+    
+    memset(&clock, 0, sizeof(GenClock));
+    
+    UtilityBase = OpenLibrary("utility.library", 37);
+    if (!UtilityBase) {
+        Printf("GenBench: Requires utility.library v37+\n");
+        return RETURN_FAIL;
+    }
+    
+    if (!parse_arguments(&config)) {
+        return_code = RETURN_ERROR;
+        goto cleanup;
+    }
+    
+    if (!make_dir(config.dir)) {
+        Printf("GenBench: Could not create '%s'\n", config.dir);
+        return_code = RETURN_ERROR;
+        goto cleanup;
+    }
+    
+    if (config.generate) {
+        if (((config.tools & TOOL_GENDO) && !generate_sources(&config)) ||
+            ((config.tools & TOOL_GENMAKI) && !generate_makefiles(&config)) ||
+            ((config.tools & TOOL_GENIN) && !generate_specs(&config))) {
+            return_code = RETURN_ERROR;
+            goto cleanup;
+        }
+        Printf("GenBench: Corpus written to '%s'\n", config.dir);
+    }
+    
+    if (!config.run) {
+        goto cleanup;
+    }
+    
+    if (!gen_clock_open(&clock)) {
+        Printf("GenBench: Could not open %s\n", TIMERNAME);
+        return_code = RETURN_ERROR;
+        goto cleanup;
+    }
+    
+    /* Each run reads everything the generator wrote for its tool */
+    if (config.tools & TOOL_GENDO) {
+        make_path(path, config.dir, "out");
+        make_dir(path);
+        gen_strcpy(args, "FILES ");
+        make_path(path, config.dir, "src/#?.c");
+        strcat(args, path);
+        strcat(args, " TO ");
+        make_path(path, config.dir, "out/bench.doc");
+        strcat(args, path);
+        strcat(args, " AMIGAGUIDE HTML");
+        if (!run_tool(&clock, &config, "GenDo", args, config.files, &results[result_count])) {
+            return_code = RETURN_ERROR;
+            goto cleanup;
+        }
+        result_count++;
+    }
+    
+    if (config.tools & TOOL_GENMAKI) {
+        gen_strcpy(args, "FROM ");
+        make_path(path, config.dir, "mk/#?/Makefile");
+        strcat(args, path);
+        strcat(args, " TO SMakefile FILETYPE sasc");
+        if (!run_tool(&clock, &config, "GenMaki", args, config.makefiles, &results[result_count])) {
+            return_code = RETURN_ERROR;
+            goto cleanup;
+        }
+        result_count++;
+    }
+    
+    if (config.tools & TOOL_GENIN) {
+        gen_strcpy(args, "SPECFILE ");
+        make_path(path, config.dir, "icons.spec");
+        strcat(args, path);
+        strcat(args, " FORCE");
+        if (!run_tool(&clock, &config, "GenIn", args, config.icons, &results[result_count])) {
+            return_code = RETURN_ERROR;
+            goto cleanup;
+        }
+        result_count++;
+    }
+    
+    print_results(&config, results, result_count);
+    for (result_count--; result_count >= 0; result_count--) {
+        if (results[result_count].return_code != RETURN_OK) {
+            return_code = RETURN_WARN;
+        }
+    }
+    
+cleanup:
+    gen_clock_close(&clock);
+    if (UtilityBase) {
+        CloseLibrary(UtilityBase);
+    }
+    return return_code;
+}
+
+/* Parse command line arguments using ReadArgs */
+BOOL parse_arguments(Config *config)
+{
+    static UBYTE template[] = "DIR/A,GENERATE/S,RUN/S,TOOL/K,TOOLDIR/K,FILES/N,AUTODOCS/N,MAKEFILES/N,RULES/N,VARIABLES/N,ICONS/N,HELP/S";
+    static UBYTE dir[MAX_PATH_LENGTH];
+    static UBYTE tool_dir[MAX_PATH_LENGTH];
+    LONG args[12];
+    struct RDArgs *rdargs;
+    LONG i;
+    
+    for (i = 0; i < 12; i++) {
+        args[i] = 0;
+    }
+    
+    memset(config, 0, sizeof(Config));
+    config->files = DEFAULT_FILES;
+    config->autodocs = DEFAULT_AUTODOCS;
+    config->makefiles = DEFAULT_MAKEFILES;
+    config->rules = DEFAULT_RULES;
+    config->variables = DEFAULT_VARIABLES;
+    config->icons = DEFAULT_ICONS;
+    config->tools = TOOL_ALL;
+    config->tool_dir = "";
+    
+    rdargs = ReadArgs(template, args, NULL);
+    if (!rdargs) {
+        print_usage();
+        return FALSE;
+    }
+    if (args[11]) {
+        print_usage();
+        FreeArgs(rdargs);
+        return FALSE;
+    }
+    
+    /* The strings are copied so the arguments can be freed straight away */
+    if (gen_strlen((STRPTR)args[0]) >= MAX_PATH_LENGTH ||
+        (args[4] && gen_strlen((STRPTR)args[4]) >= MAX_PATH_LENGTH)) {
+        Printf("GenBench: Path too long\n");
+        FreeArgs(rdargs);
+        return FALSE;
+    }
+    gen_strcpy(dir, (STRPTR)args[0]);
+    config->dir = dir;
+    if (args[4]) {
+        gen_strcpy(tool_dir, (STRPTR)args[4]);
+        config->tool_dir = tool_dir;
+    }
+    
+    config->generate = args[1] ? TRUE : FALSE;
+    config->run = args[2] ? TRUE : FALSE;
+    if (!config->generate && !config->run) {
+        config->generate = TRUE;
+        config->run = TRUE;
+    }
+    
+    if (args[3]) {
+        config->tools = parse_tool_names((STRPTR)args[3]);
+    }
+    if (args[5]) config->files = *(LONG *)args[5];
+    if (args[6]) config->autodocs = *(LONG *)args[6];
+    if (args[7]) config->makefiles = *(LONG *)args[7];
+    if (args[8]) config->rules = *(LONG *)args[8];
+    if (args[9]) config->variables = *(LONG *)args[9];
+    if (args[10]) config->icons = *(LONG *)args[10];
+    FreeArgs(rdargs);
+    
+    if (!config->tools) {
+        Printf("GenBench: TOOL must name GenDo, GenMaki or GenIn\n");
+        return FALSE;
+    }
+    if (config->files < 1 || config->autodocs < 1 || config->makefiles < 1 ||
+        config->rules < 1 || config->variables < 1 || config->icons < 1) {
+        Printf("GenBench: Corpus sizes must be at least 1\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Comma separated tool names to TOOL_ flags, 0 if any name is unknown */
+LONG parse_tool_names(STRPTR names)
+{
+    LONG tools = 0;
+    LONG length;
+    STRPTR end;
+    
+    while (*names) {
+        for (end = names; *end && *end != ','; end++);
+        length = end - names;
+        if (length == 5 && Strnicmp(names, "GenDo", 5) == 0) {
+            tools |= TOOL_GENDO;
+        } else if (length == 7 && Strnicmp(names, "GenMaki", 7) == 0) {
+            tools |= TOOL_GENMAKI;
+        } else if (length == 5 && Strnicmp(names, "GenIn", 5) == 0) {
+            tools |= TOOL_GENIN;
+        } else {
+            return 0;
+        }
+        names = *end ? end + 1 : end;
+    }
+    return tools;
+}
+
+void print_usage(void)
+{
+    Printf("Usage: GenBench DIR=dir [GENERATE] [RUN] [TOOL=names] [TOOLDIR=dir]\n");
+    Printf("                [FILES=n] [AUTODOCS=n] [MAKEFILES=n] [RULES=n] [VARIABLES=n] [ICONS=n] [HELP]\n");
+    Printf("\n");
+    Printf("Arguments:\n");
+    Printf("  DIR=dir        - Directory for the synthetic corpus and the outputs\n");
+    Printf("  GENERATE       - Write the corpus (with neither GENERATE nor RUN, both)\n");
+    Printf("  RUN            - Run the tools on the corpus and report the results\n");
+    Printf("  TOOL=names     - Comma separated tools to benchmark (default GenDo,GenMaki,GenIn)\n");
+    Printf("  TOOLDIR=dir    - Directory holding the tools (default: the current one and the path)\n");
+    Printf("  FILES=n        - Source files for GenDo (default %ld)\n", (LONG)DEFAULT_FILES);
+    Printf("  AUTODOCS=n     - Autodocs in each source file (default %ld)\n", (LONG)DEFAULT_AUTODOCS);
+    Printf("  MAKEFILES=n    - Makefiles for GenMaki (default %ld)\n", (LONG)DEFAULT_MAKEFILES);
+    Printf("  RULES=n        - Rules in each makefile (default %ld)\n", (LONG)DEFAULT_RULES);
+    Printf("  VARIABLES=n    - Variables in each makefile (default %ld)\n", (LONG)DEFAULT_VARIABLES);
+    Printf("  ICONS=n        - Icons in the spec file for GenIn (default %ld)\n", (LONG)DEFAULT_ICONS);
+    Printf("  HELP           - Show this help message\n");
+    Printf("\n");
+    Printf("Examples:\n");
+    Printf("  GenBench T:GenBench\n");
+    Printf("  GenBench T:GenBench RUN TOOL=GenDo TOOLDIR=Work:Gen/Source/GenDo\n");
+    Printf("  GenBench RAM:Bench GENERATE FILES=200 AUTODOCS=50\n");
+}
+
+/* dir and name joined into dest, which holds MAX_PATH_LENGTH bytes */
+BOOL make_path(STRPTR dest, STRPTR dir, STRPTR name)
+{
+    gen_strcpy(dest, dir);
+    return AddPart(dest, name, MAX_PATH_LENGTH) ? TRUE : FALSE;
+}
+
+/* Create a directory unless it already exists */
+BOOL make_dir(STRPTR path)
+{
+    BPTR lock;
+    
+    lock = Lock(path, ACCESS_READ);
+    if (!lock) {
+        lock = CreateDir(path);
+    }
+    if (!lock) {
+        return FALSE;
+    }
+    UnLock(lock);
+    return TRUE;
+}
+
+/* Decimal value padded with zeros to at least digits places */
+void format_number(STRPTR dest, LONG value, LONG digits)
+{
+    UBYTE buffer[NUMBER_LENGTH];
+    LONG length = 0;
+    
+    do {
+        buffer[length++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0 && length < NUMBER_LENGTH);
+    while (length < digits && length < NUMBER_LENGTH) {
+        buffer[length++] = '0';
+    }
+    while (length > 0) {
+        *dest++ = buffer[--length];
+    }
+    *dest = '\0';
+}
+
+/* FILES sources in DIR/src, AUTODOCS autodocs in each */
+BOOL generate_sources(Config *config)
+{
+    UBYTE path[MAX_PATH_LENGTH];
+    UBYTE name[NUMBER_LENGTH + 8];
+    BPTR file;
+    LONG i;
+    BOOL ok;
+    
+    make_path(path, config->dir, "src");
+    if (!make_dir(path)) {
+        Printf("GenBench: Could not create '%s'\n", path);
+        return FALSE;
+    }
+    
+    for (i = 0; i < config->files; i++) {
+        gen_strcpy(name, "bench");
+        format_number(name + 5, i, 4);
+        strcat(name, ".c");
+        make_path(path, config->dir, "src");
+        AddPart(path, name, MAX_PATH_LENGTH);
+    
+        file = Open(path, MODE_NEWFILE);
+        if (!file) {
+            Printf("GenBench: Could not create '%s'\n", path);
+            return FALSE;
+        }
+        ok = write_source(file, config, i);
+        Close(file);
+        if (!ok) {
+            Printf("GenBench: Could not write '%s'\n", path);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* One source file. Every autodoc has the usual sections with a few
+ * lines each, and some code between them for the parser to skip. */
+BOOL write_source(BPTR file, Config *config, LONG file_index)
+{
+    UBYTE name[NUMBER_LENGTH + 8];
+    LONG i;
+    LONG number;
+    
+    FPrintf(file, "/* Generated by GenBench - file %ld */\n\n#include <exec/types.h>\n\n", file_index);
+    for (i = 0; i < config->autodocs; i++) {
+        number = file_index * config->autodocs + i;
+        gen_strcpy(name, "Bench");
+        format_number(name + 5, number, 6);
+    
+        FPrintf(file, "/****** bench.library/%s ******************************************\n", name);
+        FPrintf(file, "*\n*   NAME\n*       %s -- benchmark function %ld (V%ld)\n*\n", name, number, 36 + i % 10);
+        FPrintf(file, "*   SYNOPSIS\n*       result = %s(object, flags)\n*       D0          A0      D0\n*\n", name);
+        FPrintf(file, "*       LONG %s(APTR, ULONG);\n*\n", name);
+        FPrintf(file, "*   FUNCTION\n*       Performs operation %ld on the given object. The flags select\n", number);
+        FPrintf(file, "*       how the object is treated, and unknown flags are ignored so\n");
+        FPrintf(file, "*       that later versions can add more of them without breaking\n");
+        FPrintf(file, "*       older callers.\n*\n");
+        FPrintf(file, "*   INPUTS\n*       object - the object to work on, may not be NULL\n");
+        FPrintf(file, "*       flags  - BENCHF_ flags\n*\n");
+        FPrintf(file, "*   RESULT\n*       result - zero for success, else an error code\n*\n");
+        FPrintf(file, "*   EXAMPLE\n*       if (%s(object, 0) != 0) {\n*           Printf(\"failed\\n\");\n*       }\n*\n", name);
+        FPrintf(file, "*   NOTES\n*       May be called from a task.\n*\n");
+        FPrintf(file, "*   BUGS\n*       None known.\n*\n");
+        if (number > 0) {
+            format_number(name + 5, number - 1, 6);
+            FPrintf(file, "*   SEE ALSO\n*       %s()\n*\n", name);
+            format_number(name + 5, number, 6);
+        }
+        FPrintf(file, "******************************************************************************\n*/\n\n");
+        FPrintf(file, "LONG %s(APTR object, ULONG flags)\n{\n    return object ? (LONG)(flags & %ld) : -1;\n}\n\n", name, number);
+    }
+    
+    return Flush(file) ? TRUE : FALSE;
+}
+
+/* MAKEFILES GNU makefiles, each in a drawer of its own under DIR/mk so
+ * the converted SMakefiles do not overwrite one another */
+BOOL generate_makefiles(Config *config)
+{
+    UBYTE path[MAX_PATH_LENGTH];
+    UBYTE name[NUMBER_LENGTH + 8];
+    BPTR file;
+    LONG i;
+    BOOL ok;
+    
+    make_path(path, config->dir, "mk");
+    if (!make_dir(path)) {
+        Printf("GenBench: Could not create '%s'\n", path);
+        return FALSE;
+    }
+    
+    for (i = 0; i < config->makefiles; i++) {
+        gen_strcpy(name, "project");
+        format_number(name + 7, i, 3);
+        make_path(path, config->dir, "mk");
+        AddPart(path, name, MAX_PATH_LENGTH);
+        if (!make_dir(path)) {
+            Printf("GenBench: Could not create '%s'\n", path);
+            return FALSE;
+        }
+        AddPart(path, "Makefile", MAX_PATH_LENGTH);
+    
+        file = Open(path, MODE_NEWFILE);
+        if (!file) {
+            Printf("GenBench: Could not create '%s'\n", path);
+            return FALSE;
+        }
+        ok = write_makefile(file, config);
+        Close(file);
+        if (!ok) {
+            Printf("GenBench: Could not write '%s'\n", path);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* One makefile. Variables refer to the one before them in runs of eight,
+ * so expansion has work to do without the values growing without bound.
+ * Every rule's command carries compiler options to map. */
+BOOL write_makefile(BPTR file, Config *config)
+{
+    LONG i;
+    
+    FPrintf(file, "# Generated by GenBench\n\nCC = gcc\nCFLAGS = -O2 -g -Iinclude -DBENCH=1 -m68000 -w\n\n");
+    for (i = 0; i < config->variables; i++) {
+        if (i % 8 == 0) {
+            FPrintf(file, "VAR%ld = value%ld\n", i, i);
+        } else {
+            FPrintf(file, "VAR%ld = value%ld $(VAR%ld)\n", i, i, i - 1);
+        }
+    }
+    
+    FPrintf(file, "\nall: obj0.o\n\n");
+    for (i = 0; i < config->rules; i++) {
+        FPrintf(file, "obj%ld.o: src%ld.c inc%ld.h\n", i, i, i % 50);
+        FPrintf(file, "\t$(CC) $(CFLAGS) -DMODULE=%ld -Imodule%ld -DNAME=$(VAR%ld) -c src%ld.c -o obj%ld.o\n\n",
+                i, i % 20, i % config->variables, i, i);
+    }
+    FPrintf(file, "clean:\n\trm -f *.o\n");
+    
+    return Flush(file) ? TRUE : FALSE;
+}
+
+/* DIR/icons.spec with ICONS definitions, and the files they are for in
+ * DIR/icons */
+BOOL generate_specs(Config *config)
+{
+    UBYTE path[MAX_PATH_LENGTH];
+    UBYTE target_dir[MAX_PATH_LENGTH];
+    UBYTE name[NUMBER_LENGTH + 8];
+    BPTR file;
+    LONG i;
+    BOOL ok;
+    
+    make_path(target_dir, config->dir, "icons");
+    if (!make_dir(target_dir)) {
+        Printf("GenBench: Could not create '%s'\n", target_dir);
+        return FALSE;
+    }
+    
+    /* The targets are empty files - only their icons are written */
+    for (i = 0; i < config->icons; i++) {
+        gen_strcpy(name, "file");
+        format_number(name + 4, i, 5);
+        make_path(path, target_dir, name);
+        file = Open(path, MODE_NEWFILE);
+        if (!file) {
+            Printf("GenBench: Could not create '%s'\n", path);
+            return FALSE;
+        }
+        Close(file);
+    }
+    
+    make_path(path, config->dir, "icons.spec");
+    file = Open(path, MODE_NEWFILE);
+    if (!file) {
+        Printf("GenBench: Could not create '%s'\n", path);
+        return FALSE;
+    }
+    ok = write_spec(file, config);
+    Close(file);
+    if (!ok) {
+        Printf("GenBench: Could not write '%s'\n", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* One spec file, alternating tool and project icons with tooltypes.
+ * GenIn takes the targets relative to the spec file's directory. */
+BOOL write_spec(BPTR file, Config *config)
+{
+    UBYTE name[NUMBER_LENGTH + 8];
+    LONG i;
+    
+    FPrintf(file, "; Generated by GenBench\n\n");
+    for (i = 0; i < config->icons; i++) {
+        gen_strcpy(name, "file");
+        format_number(name + 4, i, 5);
+    
+        if (i % 2 == 0) {
+            FPrintf(file, "TYPE=tool\nTARGET=icons/%s\nSTACK=%ld\n", name, 4096 + (i % 8) * 1024);
+            FPrintf(file, "TOOLTYPE=DONOTWAIT\nTOOLTYPE=PRIORITY=%ld\n\n", i % 5);
+        } else {
+            FPrintf(file, "TYPE=project\nTARGET=icons/%s\n", name);
+            FPrintf(file, "TOOLTYPE=FILETYPE=text\nTOOLTYPE=INDEX=%ld\n\n", i);
+        }
+    }
+    
+    return Flush(file) ? TRUE : FALSE;
+}
+
+/* Run one tool with its output to NIL:, watching AvailMem() every tick
+ * until its exit code reports that it has finished */
+BOOL run_tool(GenClock *clock, Config *config, STRPTR tool, STRPTR args, LONG items, Result *result)
+{
+    UBYTE command[MAX_COMMAND_LENGTH];
+    struct EClockVal start;
+    struct EClockVal end;
+    struct EClockVal elapsed;
+    ULONG before;
+    ULONG lowest;
+    ULONG avail;
+    BPTR input;
+    BPTR output;
+    BYTE signal;
+    Run run;
+    
+    gen_strcpy(command, config->tool_dir);
+    if (!AddPart(command, tool, MAX_COMMAND_LENGTH) ||
+        gen_strlen(command) + gen_strlen(args) + 2 > MAX_COMMAND_LENGTH) {
+        Printf("GenBench: Command for %s too long\n", tool);
+        return FALSE;
+    }
+    strcat(command, " ");
+    strcat(command, args);
+    
+    signal = AllocSignal(-1);
+    if (signal == -1) {
+        Printf("GenBench: No free signal\n");
+        return FALSE;
+    }
+    run.task = FindTask(NULL);
+    run.signal_mask = 1L << signal;
+    run.done = FALSE;
+    run.return_code = 0;
+    
+    Printf("GenBench: Running %s\n", command);
+    
+    /* The process closes its input and output as it ends */
+    input = Open("NIL:", MODE_OLDFILE);
+    output = Open("NIL:", MODE_NEWFILE);
+    before = AvailMem(MEMF_ANY);
+    lowest = before;
+    gen_clock_now(clock, &start);
+    if (!input || !output ||
+        SystemTags(command,
+                   SYS_Input, input,
+                   SYS_Output, output,
+                   SYS_Asynch, TRUE,
+                   SYS_UserShell, TRUE,
+                   NP_ExitCode, (ULONG)run_exit,
+                   NP_ExitData, (ULONG)&run,
+                   TAG_DONE) == -1) {
+        if (input) Close(input);
+        if (output) Close(output);
+        FreeSignal(signal);
+        Printf("GenBench: Unable to run '%s'\n", command);
+        return FALSE;
+    }
+    
+    while (!run.done) {
+        avail = AvailMem(MEMF_ANY);
+        if (avail < lowest) {
+            lowest = avail;
+        }
+        Delay(1);
+    }
+    gen_clock_now(clock, &end);
+    
+    /* Signalled before done was set, so this returns at once */
+    Wait(run.signal_mask);
+    FreeSignal(signal);
+    
+    elapsed.ev_hi = 0;
+    elapsed.ev_lo = 0;
+    gen_clock_add(&elapsed, &start, &end);
+    result->tool = tool;
+    result->items = items;
+    result->ms = gen_clock_ms(clock, &elapsed, NULL);
+    result->peak = before - lowest;
+    result->return_code = run.return_code;
+    if (run.return_code != RETURN_OK) {
+        Printf("GenBench: %s returned %ld\n", tool, run.return_code);
+    }
+    return TRUE;
+}
+
+/* NP_ExitCode of a timed tool, called as its process ends with the
+ * return code in D0 and NP_ExitData in D1. It runs on that process but
+ * in our seglist; the Forbid() is broken when it exits, so run_tool()
+ * cannot see done and return while this is still running. */
+void __saveds __asm run_exit(register __d0 LONG return_code, register __d1 Run *run)
+{
+    Forbid();
+    run->return_code = return_code;
+    Signal(run->task, run->signal_mask);
+    run->done = TRUE;
+}
+
+/* One line per tool. Rates are given to a tenth of a file per second. */
+void print_results(Config *config, Result *results, LONG count)
+{
+    LONG i;
+    ULONG rate;
+    
+    Printf("\n");
+    Printf("Tool       Files    Time (s)    Files/s   Peak memory\n");
+    Printf("-------  -------  ----------  ---------  ------------\n");
+    for (i = 0; i < count; i++) {
+        rate = results[i].ms ? (ULONG)results[i].items * 10000 / results[i].ms : 0;
+        Printf("%-7s  %7ld  %6ld.%03ld  %7ld.%ld  %12ld\n",
+               results[i].tool, results[i].items,
+               results[i].ms / 1000, results[i].ms % 1000,
+               rate / 10, rate % 10, results[i].peak);
+    }
+    Printf("\n");
+    Printf("Corpus: %ld autodocs in %ld files, %ld rules and %ld variables in each of\n",
+           config->files * config->autodocs, config->files, config->rules, config->variables);
+    Printf("%ld makefiles, %ld icons\n", config->makefiles, config->icons);
+    Printf("Peak memory is the largest drop in AvailMem() seen during the run,\n");
+    Printf("so other tasks allocating at the same time are counted too.\n");
+}
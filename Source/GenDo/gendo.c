@@ -23,6 +23,8 @@
 #include <exec/memory.h>
 #include <dos/dos.h>
 #include <dos/dosextens.h>
+#include <dos/dostags.h>
+#include <exec/ports.h>
 #include <utility/tagitem.h>
 #include <utility/utility.h>
 
@@ -34,6 +36,8 @@
 #include <proto/dos.h>
 #include <proto/utility.h>
 
+#include "genlib.h"
+
 /* Version and stack information */
 static const char *verstag = "$VER: GenDo 1.1 (02/10/25)";
 static const char *stack_cookie = "$STACK: 8192";
@@ -44,9 +48,56 @@ struct Library *UtilityBase = NULL;
 /* Maximum sizes and limits */
 #define MAX_LINE_LENGTH 512
 #define MAX_FILENAME_LENGTH 256
-#define MAX_AUTODOCS 256
 #define MAX_FILES 64
 #define MAX_STRING_LENGTH 1024
+#define DEFAULT_BLOCK_SIZE 65536
+#define AUTODOC_CHUNK_MIN 32
+#define POOL_PUDDLE_SIZE 16384
+#define MAX_EMITTERS 3
+#define CACHE_MAGIC "GENDOCACHE 2\n"
+#define CACHE_STRINGS (10 + MAX_EXTRA_SECTIONS)
+#define PAGE_BUFFER_SIZE 4096
+#define SECTION_BUFFER_SIZE 4096
+#define MAX_JOBS 16
+#define WORKER_STACK_SIZE 16384
+
+/* Phases timed by STATS */
+#define PHASE_WILDCARD 0
+#define PHASE_PARSE 1
+#define PHASE_SORT 2
+#define PHASE_DOC 3
+#define PHASE_GUIDE 4
+#define PHASE_HTML 5
+#define PHASE_COUNT 6
+
+/* Autodoc section slots, in .doc output order */
+#define SECTION_NAME 0
+#define SECTION_SYNOPSIS 1
+#define SECTION_FUNCTION 2
+#define SECTION_INPUTS 3
+#define SECTION_RESULT 4
+#define SECTION_EXAMPLE 5
+#define SECTION_NOTES 6
+#define SECTION_BUGS 7
+#define SECTION_SEE_ALSO 8
+#define SECTION_COUNT 9
+#define SECTION_NONE -1        /* not a section header */
+#define SECTION_OTHER -2       /* header of a section that is not kept */
+#define MAX_EXTRA_SECTIONS 8
+#define MAX_SECTIONS (SECTION_COUNT + MAX_EXTRA_SECTIONS)
+#define MAX_SECTION_KEYWORDS 32
+#define MAX_SECTION_NAME 32
+
+/* HTML body styles for a section */
+#define HTML_STYLE_TEXT 0   /* plain text followed by a blank line */
+#define HTML_STYLE_CODE 1   /* preformatted code block */
+#define HTML_STYLE_LIST 2   /* definition list */
+
+/* Per-section formatting information shared by all back-ends */
+typedef struct {
+    const char *title;
+    LONG html_style;
+} SectionInfo;
 
 /* Autodoc structure */
 typedef struct {
@@ -61,18 +112,110 @@ typedef struct {
     STRPTR notes;
     STRPTR bugs;
     STRPTR see_also;
+    STRPTR extra[MAX_EXTRA_SECTIONS];  /* sections added with SECTIONS */
     BOOL is_internal;
     BOOL is_obsolete;
     LONG line_number;
 } Autodoc;
 
+/* Chunk of autodoc entries - each new chunk is as large as all the
+ * previous ones together, so capacity doubles without copying entries */
+typedef struct AutodocChunk {
+    struct AutodocChunk *next;
+    LONG capacity;
+    LONG used;
+    Autodoc *entries;
+} AutodocChunk;
+
+/* Arena of a parsing worker, kept until the store is freed */
+typedef struct ArenaLink {
+    struct ArenaLink *next;
+    GenArena arena;
+} ArenaLink;
+
+/* Growable autodoc store - entries and their strings live in one arena
+ * and are released together */
+typedef struct {
+    GenArena *arena;
+    AutodocChunk *first;
+    AutodocChunk *last;
+    LONG count;
+    ArenaLink *worker_arenas;   /* arenas holding strings of merged entries */
+} AutodocStore;
+
 /* File structure for tracking source files */
 typedef struct {
     STRPTR filename;
     BPTR file_handle;
     LONG line_count;
+    LONG size;              /* from the directory scan, for the cache */
+    struct DateStamp date;
+    LONG autodoc_count;     /* entries this file added to the store */
+    BOOL parsed;            /* parsed or restored successfully */
+    struct CacheFile *cached;   /* matching cache record if unchanged */
 } SourceFile;
 
+/* One source file's entries as recorded in the autodoc cache */
+typedef struct CacheFile {
+    struct CacheFile *next;     /* hash chain */
+    STRPTR path;
+    LONG size;
+    struct DateStamp date;
+    LONG autodoc_count;
+    Autodoc *entries;
+} CacheFile;
+
+/* Autodoc cache loaded from CACHE=file - the file image, its records and
+ * all strings live in the store's pool, so strings are used in place */
+typedef struct {
+    CacheFile *files;
+    LONG file_count;
+    CacheFile **buckets;
+    LONG bucket_count;          /* power of two */
+} AutodocCache;
+
+/* Growable text accumulator for the section being read */
+typedef struct {
+    STRPTR data;
+    LONG length;
+    LONG size;
+} SectionBuffer;
+
+/* Source reader - GenLib's block-buffered line reader, with the section
+ * text buffer reused for every section read through it */
+typedef struct {
+    GenReader lines;
+    SectionBuffer section;
+} SourceReader;
+
+/* Section header keyword - keywords sharing a first letter are chained,
+ * so a line is only compared with headers that could match it */
+typedef struct {
+    const char *keyword;
+    LONG length;
+    LONG slot;
+    LONG next;              /* next keyword with the same first letter, -1 at end */
+} SectionKeyword;
+
+/* Section headers, titles and output order - built once before parsing */
+typedef struct {
+    SectionKeyword keywords[MAX_SECTION_KEYWORDS];
+    LONG keyword_count;
+    LONG first[26];         /* first keyword for each letter A-Z, -1 if none */
+    SectionInfo info[MAX_SECTIONS];
+    LONG section_count;     /* built-in plus extra sections */
+    LONG doc_order[MAX_SECTIONS];
+    LONG html_order[MAX_SECTIONS];
+    char extra_names[MAX_EXTRA_SECTIONS][MAX_SECTION_NAME];
+} SectionTable;
+
+/* Wildcard pattern tokenized once and matched against many names */
+typedef struct {
+    STRPTR source;          /* pattern as given */
+    STRPTR tokens;          /* ParsePatternNoCase() output, NULL if not compiled */
+    BOOL wild;              /* pattern contains wildcards */
+} CompiledPattern;
+
 /* Configuration structure */
 typedef struct {
     STRPTR output_doc;
@@ -80,7 +223,9 @@ typedef struct {
     STRPTR output_html_dir;
     SourceFile *source_files;
     LONG file_count;
-    Autodoc *autodocs;
+    GenArena arena;         /* backs the store */
+    AutodocStore store;
+    Autodoc **autodocs;     /* index over store, built after parsing */
     LONG autodoc_count;
     BOOL generate_guide;
     BOOL generate_html;
@@ -91,44 +236,140 @@ typedef struct {
     BOOL no_form_feed;
     BOOL no_toc;
     BOOL preserve_order;
+    LONG block_size;
+    STRPTR cache_file;
+    BOOL cache_failed;      /* CACHE could not be written - output is still made */
+    BOOL html_update;
+    LONG jobs;
+    STRPTR sections_spec;   /* SECTIONS argument as given, for the cache */
+    SectionTable sections;
+    CompiledPattern exclude;  /* EXCLUDE pattern, tokens NULL if not given */
+    GenStats stats;         /* enabled by STATS or STATSFILE */
+    STRPTR stats_file;
 } Config;
 
+/* Parse job sent to a worker; a NULL file asks the worker to quit */
+typedef struct {
+    struct Message msg;
+    Config *config;
+    SourceFile *file;
+    AutodocStore result;    /* entries of file, in the worker's pool */
+    BOOL success;
+    LONG worker;            /* index of the worker handling the job */
+} JobMessage;
+
+/* Startup message of a worker process - job_port is set by the worker,
+ * or left NULL if it could not get going */
+typedef struct {
+    struct Message msg;
+    Config *config;
+    GenArena *arena;
+    struct MsgPort *job_port;
+    JobMessage quit;
+} WorkerStartup;
+
+/* One autodoc prepared for output - sections are resolved into slots and
+ * neighbours looked up once, then handed to every active back-end */
+typedef struct {
+    Autodoc *doc;
+    LONG index;
+    BOOL is_first;
+    BOOL is_last;
+    STRPTR prev_name;
+    STRPTR next_name;
+    STRPTR sections[MAX_SECTIONS];
+} FormattedDoc;
+
+/* Growable in-memory page, reused for every HTML page */
+typedef struct {
+    STRPTR data;
+    LONG length;
+    LONG size;
+    BOOL failed;            /* an append ran out of memory */
+} PageBuffer;
+
+/* Output back-end - begin writes headers and tables of contents, entry
+ * writes one prepared autodoc, end finishes and closes the output */
+typedef struct Emitter {
+    const char *failure_message;
+    BOOL (*begin)(struct Emitter *emitter, Config *config);
+    BOOL (*entry)(struct Emitter *emitter, Config *config, FormattedDoc *entry);
+    void (*end)(struct Emitter *emitter, Config *config);
+    LONG phase;             /* PHASE_ the back-end is timed as */
+    BPTR file_handle;
+    STRPTR path;            /* scratch path buffer for multi-file output */
+    LONG path_len;
+    PageBuffer page;        /* page being built for multi-file output */
+    LONG pages_written;
+    LONG pages_skipped;     /* left alone by HTMLUPDATE */
+} Emitter;
+
 /* Function prototypes */
 LONG parse_command_line(Config *config, LONG argc, STRPTR *argv);
 BOOL process_source_files(Config *config);
 STRPTR process_output_filename(const char *filename);
 STRPTR get_base_name(const char *filename);
 void sort_autodocs(Config *config);
-BOOL parse_autodoc_from_file(SourceFile *file, Config *config);
+LONG compare_names(const char *a, const char *b);
+LONG compare_autodocs(const Autodoc *a, const Autodoc *b);
+BOOL parse_autodoc_from_file(SourceFile *file, Config *config, AutodocStore *store, SourceReader *reader);
+BOOL finish_autodoc(AutodocStore *store, Autodoc *doc);
 BOOL is_autodoc_start(const char *line);
 BOOL is_autodoc_end(const char *line);
 BOOL is_internal_autodoc(const char *line);
 BOOL is_obsolete_autodoc(const char *line);
-STRPTR extract_module_function(const char *line);
-STRPTR is_section_header(const char *line);
-BOOL parse_autodoc_section(BPTR file, Autodoc *autodoc, STRPTR line);
-void store_section_content(Autodoc *autodoc, const char *section, const char *content);
-STRPTR read_autodoc_line(BPTR file);
-BOOL generate_doc_output(Config *config);
-BOOL generate_guide_output(Config *config);
-BOOL generate_html_output(Config *config);
+STRPTR extract_module_function(AutodocStore *store, const char *line);
+LONG is_section_header(const SectionTable *table, const char *line);
+BOOL section_table_add_keyword(SectionTable *table, const char *keyword, LONG slot);
+BOOL section_table_init(SectionTable *table, const char *spec);
+STRPTR *autodoc_section_field(Autodoc *autodoc, LONG slot);
+BOOL parse_autodoc_section(SourceReader *reader, AutodocStore *store, const SectionTable *table, Autodoc *autodoc, STRPTR line);
+void store_section_content(AutodocStore *store, Autodoc *autodoc, LONG slot, SectionBuffer *content);
+LONG clean_content(STRPTR content, LONG len);
+BOOL section_buffer_add_line(SectionBuffer *section, const char *text, LONG len);
+void autodoc_store_init(AutodocStore *store, GenArena *arena);
+STRPTR autodoc_store_string(AutodocStore *store, const char *str, LONG len);
+Autodoc *autodoc_store_add(AutodocStore *store, Autodoc *doc);
+BOOL build_autodoc_index(Config *config);
+void autodoc_store_free(AutodocStore *store);
+GenArena *autodoc_store_worker_arena(AutodocStore *store);
+BOOL autodoc_store_merge(AutodocStore *store, AutodocStore *part);
+void __saveds parse_worker(void);
+BOOL dispatch_parse_job(Config *config, JobMessage *jobs, LONG *next, WorkerStartup *worker, LONG worker_index);
+BOOL parse_files_parallel(Config *config, JobMessage *jobs);
+void cache_fields(Autodoc *doc, STRPTR **fields);
+ULONG cache_hash(const char *path);
+BOOL cache_read_number(STRPTR *cursor, STRPTR end, LONG *value);
+BOOL cache_read_string(STRPTR *cursor, STRPTR end, STRPTR *string);
+BOOL cache_load(Config *config, AutodocCache *cache);
+CacheFile *cache_find(AutodocCache *cache, const char *path);
+BOOL cache_restore(Config *config, CacheFile *cached);
+BOOL cache_save(Config *config);
+BOOL source_reader_init(SourceReader *reader, LONG block_size);
+void source_reader_free(SourceReader *reader);
+void format_autodoc(Config *config, LONG index, FormattedDoc *entry);
+BOOL run_emitters(Config *config, Emitter *emitters, LONG emitter_count);
+BOOL doc_emit_begin(Emitter *emitter, Config *config);
+BOOL doc_emit_entry(Emitter *emitter, Config *config, FormattedDoc *entry);
+void doc_emit_end(Emitter *emitter, Config *config);
+BOOL guide_emit_begin(Emitter *emitter, Config *config);
+BOOL guide_emit_entry(Emitter *emitter, Config *config, FormattedDoc *entry);
+void guide_emit_end(Emitter *emitter, Config *config);
+BOOL html_emit_begin(Emitter *emitter, Config *config);
+BOOL html_emit_entry(Emitter *emitter, Config *config, FormattedDoc *entry);
+void html_emit_end(Emitter *emitter, Config *config);
+BOOL page_puts(PageBuffer *page, const char *text);
+BOOL page_tag(PageBuffer *page, const char *open, const char *text, const char *close);
+BOOL page_unchanged(PageBuffer *page, STRPTR path);
+BOOL page_write(Emitter *emitter, Config *config, STRPTR path);
 void cleanup_config(Config *config);
 void print_usage(void);
 LONG expand_wildcards(Config *config, STRPTR *file_array, LONG file_count);
-BOOL match_pattern(const char *pattern, const char *filename);
+BOOL compile_pattern(CompiledPattern *pattern, const char *source);
+BOOL match_pattern(const CompiledPattern *pattern, const char *filename);
+void free_pattern(CompiledPattern *pattern);
 int main(int argc, char *argv[]);
 
-/* Helper function for string duplication using Amiga memory allocation */
-STRPTR strdup_amiga(const char *str)
-{
-    LONG len = strlen(str);
-    STRPTR copy = AllocVec(len + 1, MEMF_CLEAR);
-    if (copy) {
-        strcpy(copy, str);
-    }
-    return copy;
-}
-
 /* Helper function to extract base name and validate filename */
 STRPTR process_output_filename(const char *filename)
 {
@@ -193,150 +434,773 @@ STRPTR get_base_name(const char *filename)
     return result;
 }
 
-/* Check if line is a section header and return the section name */
-STRPTR is_section_header(const char *line)
+/* Built-in section headers; several spellings share a slot */
+static const SectionKeyword builtin_keywords[] = {
+    { "NAME",        0, SECTION_NAME,     -1 },
+    { "SYNOPSIS",    0, SECTION_SYNOPSIS, -1 },
+    { "FUNCTION",    0, SECTION_FUNCTION, -1 },
+    { "DESCRIPTION", 0, SECTION_FUNCTION, -1 },
+    { "INPUTS",      0, SECTION_INPUTS,   -1 },
+    { "PARAMETERS",  0, SECTION_INPUTS,   -1 },
+    { "RESULT",      0, SECTION_RESULT,   -1 },
+    { "RETURNS",     0, SECTION_RESULT,   -1 },
+    { "EXAMPLE",     0, SECTION_EXAMPLE,  -1 },
+    { "EXAMPLES",    0, SECTION_EXAMPLE,  -1 },
+    { "NOTES",       0, SECTION_NOTES,    -1 },
+    { "BUGS",        0, SECTION_BUGS,     -1 },
+    { "SEE ALSO",    0, SECTION_SEE_ALSO, -1 },
+    { "WARNING",     0, SECTION_NOTES,    -1 },
+    { "WARNINGS",    0, SECTION_NOTES,    -1 }
+};
+
+/* Section titles and HTML styles, indexed by section slot */
+static const SectionInfo section_info[SECTION_COUNT] = {
+    { "NAME",     HTML_STYLE_TEXT },
+    { "SYNOPSIS", HTML_STYLE_CODE },
+    { "FUNCTION", HTML_STYLE_TEXT },
+    { "INPUTS",   HTML_STYLE_LIST },
+    { "RESULT",   HTML_STYLE_LIST },
+    { "EXAMPLE",  HTML_STYLE_CODE },
+    { "NOTES",    HTML_STYLE_TEXT },
+    { "BUGS",     HTML_STYLE_TEXT },
+    { "SEE ALSO", HTML_STYLE_TEXT }
+};
+
+/* HTML pages put NOTES and BUGS ahead of the example */
+static const LONG html_section_order[SECTION_COUNT] = {
+    SECTION_NAME, SECTION_SYNOPSIS, SECTION_FUNCTION, SECTION_INPUTS,
+    SECTION_RESULT, SECTION_NOTES, SECTION_BUGS, SECTION_EXAMPLE,
+    SECTION_SEE_ALSO
+};
+
+/* Add a header keyword; later keywords take precedence over earlier ones */
+BOOL section_table_add_keyword(SectionTable *table, const char *keyword, LONG slot)
+{
+    SectionKeyword *entry;
+    LONG letter = keyword[0] - 'A';
+    
+    if (table->keyword_count >= MAX_SECTION_KEYWORDS || letter < 0 || letter >= 26) {
+        return FALSE;
+    }
+    
+    entry = &table->keywords[table->keyword_count];
+    entry->keyword = keyword;
+    entry->length = strlen(keyword);
+    entry->slot = slot;
+    entry->next = table->first[letter];
+    table->first[letter] = table->keyword_count;
+    table->keyword_count++;
+    return TRUE;
+}
+
+/* Build the section table from the built-in headers and SECTIONS=a,b,... */
+BOOL section_table_init(SectionTable *table, const char *spec)
+{
+    const char *p = spec;
+    char *name;
+    LONG i, len, slot, doc_count, html_count;
+    LONG extra_count = 0;
+    
+    memset(table, 0, sizeof(SectionTable));
+    for (i = 0; i < 26; i++) {
+        table->first[i] = -1;
+    }
+    
+    for (i = 0; i < (LONG)(sizeof(builtin_keywords) / sizeof(builtin_keywords[0])); i++) {
+        section_table_add_keyword(table, builtin_keywords[i].keyword, builtin_keywords[i].slot);
+    }
+    for (i = 0; i < SECTION_COUNT; i++) {
+        table->info[i] = section_info[i];
+    }
+    
+    /* Extra sections - an extra header also overrides a built-in spelling */
+    while (p && *p) {
+        while (*p == ',' || *p == ' ') p++;
+        if (!*p) break;
+        
+        if (extra_count >= MAX_EXTRA_SECTIONS) {
+            Printf("GenDo: Too many SECTIONS (maximum %ld)\n", (LONG)MAX_EXTRA_SECTIONS);
+            return FALSE;
+        }
+        
+        name = table->extra_names[extra_count];
+        len = 0;
+        while (*p && *p != ',') {
+            if (len >= MAX_SECTION_NAME - 1) {
+                Printf("GenDo: Section name too long in SECTIONS\n");
+                return FALSE;
+            }
+            name[len++] = ToUpper((UBYTE)*p);
+            p++;
+        }
+        while (len > 0 && name[len - 1] == ' ') len--;
+        name[len] = '\0';
+        
+        /* Headers are recognised as upper case letters and spaces */
+        for (i = 0; i < len; i++) {
+            if (!((name[i] >= 'A' && name[i] <= 'Z') || (i > 0 && name[i] == ' '))) {
+                Printf("GenDo: Invalid section name in SECTIONS: %s\n", name);
+                return FALSE;
+            }
+        }
+        
+        slot = SECTION_COUNT + extra_count;
+        if (!section_table_add_keyword(table, name, slot)) {
+            Printf("GenDo: Too many section headers\n");
+            return FALSE;
+        }
+        table->info[slot].title = name;
+        table->info[slot].html_style = HTML_STYLE_TEXT;
+        extra_count++;
+    }
+    table->section_count = SECTION_COUNT + extra_count;
+    
+    /* Extra sections go just before SEE ALSO in every format */
+    doc_count = 0;
+    html_count = 0;
+    for (i = 0; i < SECTION_COUNT; i++) {
+        if (i != SECTION_SEE_ALSO) {
+            table->doc_order[doc_count++] = i;
+        }
+        if (html_section_order[i] != SECTION_SEE_ALSO) {
+            table->html_order[html_count++] = html_section_order[i];
+        }
+    }
+    for (i = 0; i < extra_count; i++) {
+        table->doc_order[doc_count++] = SECTION_COUNT + i;
+        table->html_order[html_count++] = SECTION_COUNT + i;
+    }
+    table->doc_order[doc_count] = SECTION_SEE_ALSO;
+    table->html_order[html_count] = SECTION_SEE_ALSO;
+    
+    return TRUE;
+}
+
+/* Return the autodoc field that holds a section slot */
+STRPTR *autodoc_section_field(Autodoc *autodoc, LONG slot)
+{
+    switch (slot) {
+        case SECTION_NAME:     return &autodoc->name;
+        case SECTION_SYNOPSIS: return &autodoc->synopsis;
+        case SECTION_FUNCTION: return &autodoc->function_desc;
+        case SECTION_INPUTS:   return &autodoc->inputs;
+        case SECTION_RESULT:   return &autodoc->result;
+        case SECTION_EXAMPLE:  return &autodoc->example;
+        case SECTION_NOTES:    return &autodoc->notes;
+        case SECTION_BUGS:     return &autodoc->bugs;
+        case SECTION_SEE_ALSO: return &autodoc->see_also;
+    }
+    if (slot >= SECTION_COUNT && slot < MAX_SECTIONS) {
+        return &autodoc->extra[slot - SECTION_COUNT];
+    }
+    return NULL;
+}
+
+/* Check if line is a section header and return its slot, SECTION_OTHER
+ * for an unknown header or SECTION_NONE for ordinary text */
+LONG is_section_header(const SectionTable *table, const char *line)
 {
     const char *p = line;
-    const char *start, *end;
-    LONG len;
-    STRPTR result;
+    const char *start;
+    const SectionKeyword *entry;
+    LONG index;
+    char c;
     
     /* Skip leading whitespace */
     while (*p == ' ' || *p == '\t') p++;
     
     /* Must start with asterisk */
-    if (*p != '*') return NULL;
+    if (*p != '*') return SECTION_NONE;
     p++;
     
     /* Skip spaces after asterisk */
     while (*p == ' ') p++;
     
-    /* Check for known section headers */
-    if (strncmp(p, "NAME", 4) == 0 && (p[4] == ' ' || p[4] == '\t' || p[4] == '\n' || p[4] == '\r')) {
-        return "NAME";
+    /* Headers are upper case, so most text lines stop here */
+    if (*p < 'A' || *p > 'Z') return SECTION_NONE;
+    
+    /* Only keywords with the same first letter are compared */
+    for (index = table->first[*p - 'A']; index >= 0; index = entry->next) {
+        entry = &table->keywords[index];
+        if (strncmp(p, entry->keyword, entry->length) == 0) {
+            c = p[entry->length];
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\0') {
+                return entry->slot;
+            }
+        }
     }
-    if (strncmp(p, "SYNOPSIS", 8) == 0 && (p[8] == ' ' || p[8] == '\t' || p[8] == '\n' || p[8] == '\r')) {
-        return "SYNOPSIS";
+    
+    /* Any other upper case word of two or more letters starts a section
+     * that is not kept */
+    start = p;
+    while (*p >= 'A' && *p <= 'Z') p++;
+    if (p - start >= 2 && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '\0')) {
+        return SECTION_OTHER;
     }
-    if (strncmp(p, "FUNCTION", 8) == 0 && (p[8] == ' ' || p[8] == '\t' || p[8] == '\n' || p[8] == '\r')) {
-        return "FUNCTION";
+    
+    return SECTION_NONE;
+}
+
+/* Start an empty store in arena */
+void autodoc_store_init(AutodocStore *store, GenArena *arena)
+{
+    store->first = NULL;
+    store->last = NULL;
+    store->count = 0;
+    store->worker_arenas = NULL;
+    store->arena = arena;
+    gen_arena_init(arena, POOL_PUDDLE_SIZE);
+}
+
+/* Copy len bytes of str into the store as a NUL-terminated string */
+STRPTR autodoc_store_string(AutodocStore *store, const char *str, LONG len)
+{
+    return gen_arena_string(store->arena, str, len);
+}
+
+/* Append a copy of doc to the store, growing it by a new chunk if full */
+Autodoc *autodoc_store_add(AutodocStore *store, Autodoc *doc)
+{
+    AutodocChunk *chunk = store->last;
+    Autodoc *entry;
+    
+    if (!chunk || chunk->used >= chunk->capacity) {
+        LONG capacity = store->count;
+        if (capacity < AUTODOC_CHUNK_MIN) {
+            capacity = AUTODOC_CHUNK_MIN;
+        }
+        
+        chunk = gen_alloc(store->arena, sizeof(AutodocChunk) + capacity * sizeof(Autodoc));
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = NULL;
+        chunk->capacity = capacity;
+        chunk->used = 0;
+        chunk->entries = (Autodoc *)(chunk + 1);
+        
+        if (store->last) {
+            store->last->next = chunk;
+        } else {
+            store->first = chunk;
+        }
+        store->last = chunk;
     }
-    if (strncmp(p, "DESCRIPTION", 11) == 0 && (p[11] == ' ' || p[11] == '\t' || p[11] == '\n' || p[11] == '\r')) {
-        return "FUNCTION"; /* Map DESCRIPTION to FUNCTION */
+    
+    entry = &chunk->entries[chunk->used++];
+    *entry = *doc;
+    store->count++;
+    return entry;
+}
+
+/* Build the flat index over the store used for sorting and output */
+BOOL build_autodoc_index(Config *config)
+{
+    AutodocChunk *chunk;
+    LONG i, n = 0;
+    
+    config->autodoc_count = config->store.count;
+    if (config->store.count == 0) {
+        return TRUE;
     }
-    if (strncmp(p, "INPUTS", 6) == 0 && (p[6] == ' ' || p[6] == '\t' || p[6] == '\n' || p[6] == '\r')) {
-        return "INPUTS";
+    
+    config->autodocs = gen_alloc(config->store.arena, config->store.count * sizeof(Autodoc *));
+    if (!config->autodocs) {
+        return FALSE;
     }
-    if (strncmp(p, "PARAMETERS", 10) == 0 && (p[10] == ' ' || p[10] == '\t' || p[10] == '\n' || p[10] == '\r')) {
-        return "INPUTS"; /* Map PARAMETERS to INPUTS */
+    
+    for (chunk = config->store.first; chunk; chunk = chunk->next) {
+        for (i = 0; i < chunk->used; i++) {
+            config->autodocs[n++] = &chunk->entries[i];
+        }
     }
-    if (strncmp(p, "RESULT", 6) == 0 && (p[6] == ' ' || p[6] == '\t' || p[6] == '\n' || p[6] == '\r')) {
-        return "RESULT";
+    
+    return TRUE;
+}
+
+/* A new arena for a worker, which the store frees with its own */
+GenArena *autodoc_store_worker_arena(AutodocStore *store)
+{
+    ArenaLink *link = gen_alloc(store->arena, sizeof(ArenaLink));
+    if (!link) {
+        return NULL;
     }
-    if (strncmp(p, "RETURNS", 7) == 0 && (p[7] == ' ' || p[7] == '\t' || p[7] == '\n' || p[7] == '\r')) {
-        return "RESULT"; /* Map RETURNS to RESULT */
+    gen_arena_init(&link->arena, POOL_PUDDLE_SIZE);
+    link->next = store->worker_arenas;
+    store->worker_arenas = link;
+    return &link->arena;
+}
+
+/* Append copies of every entry of part; their strings stay where they are */
+BOOL autodoc_store_merge(AutodocStore *store, AutodocStore *part)
+{
+    AutodocChunk *chunk;
+    LONG i;
+    
+    for (chunk = part->first; chunk; chunk = chunk->next) {
+        for (i = 0; i < chunk->used; i++) {
+            if (!autodoc_store_add(store, &chunk->entries[i])) {
+                return FALSE;
+            }
+        }
     }
-    if (strncmp(p, "EXAMPLE", 7) == 0 && (p[7] == ' ' || p[7] == '\t' || p[7] == '\n' || p[7] == '\r')) {
-        return "EXAMPLE";
+    return TRUE;
+}
+
+/* Release every entry, string and the index in one call */
+void autodoc_store_free(AutodocStore *store)
+{
+    ArenaLink *link;
+    
+    /* Links live in the main arena, so worker arenas go first */
+    for (link = store->worker_arenas; link; link = link->next) {
+        gen_arena_free(&link->arena);
     }
-    if (strncmp(p, "EXAMPLES", 8) == 0 && (p[8] == ' ' || p[8] == '\t' || p[8] == '\n' || p[8] == '\r')) {
-        return "EXAMPLE"; /* Map EXAMPLES to EXAMPLE */
+    store->worker_arenas = NULL;
+    
+    if (store->arena) {
+        gen_arena_free(store->arena);
     }
-    if (strncmp(p, "NOTES", 5) == 0 && (p[5] == ' ' || p[5] == '\t' || p[5] == '\n' || p[5] == '\r')) {
-        return "NOTES";
+    store->first = NULL;
+    store->last = NULL;
+    store->count = 0;
+}
+
+/* Point fields at the string members of doc, in cache record order */
+void cache_fields(Autodoc *doc, STRPTR **fields)
+{
+    LONG i;
+    
+    fields[0] = &doc->module_name;
+    fields[1] = &doc->name;
+    fields[2] = &doc->synopsis;
+    fields[3] = &doc->function_desc;
+    fields[4] = &doc->inputs;
+    fields[5] = &doc->result;
+    fields[6] = &doc->example;
+    fields[7] = &doc->notes;
+    fields[8] = &doc->bugs;
+    fields[9] = &doc->see_also;
+    for (i = 0; i < MAX_EXTRA_SECTIONS; i++) {
+        fields[10 + i] = &doc->extra[i];
     }
-    if (strncmp(p, "BUGS", 4) == 0 && (p[4] == ' ' || p[4] == '\t' || p[4] == '\n' || p[4] == '\r')) {
-        return "BUGS";
+}
+
+/* Hash a path without regard to case, as AmigaDOS compares names */
+ULONG cache_hash(const char *path)
+{
+    ULONG hash = 5381;
+    
+    while (*path) {
+        hash = hash * 33 + ToLower((UBYTE)*path);
+        path++;
     }
-    if (strncmp(p, "SEE ALSO", 8) == 0 && (p[8] == ' ' || p[8] == '\t' || p[8] == '\n' || p[8] == '\r')) {
-        return "SEE ALSO";
+    return hash;
+}
+
+/* Read a decimal number from the cache image, skipping leading blanks */
+BOOL cache_read_number(STRPTR *cursor, STRPTR end, LONG *value)
+{
+    STRPTR p = *cursor;
+    BOOL negative = FALSE;
+    LONG result = 0;
+    
+    while (p < end && *p == ' ') p++;
+    if (p < end && *p == '-') {
+        negative = TRUE;
+        p++;
     }
-    if (strncmp(p, "WARNING", 7) == 0 && (p[7] == ' ' || p[7] == '\t' || p[7] == '\n' || p[7] == '\r')) {
-        return "NOTES"; /* Map WARNING to NOTES */
+    if (p >= end || *p < '0' || *p > '9') {
+        return FALSE;
     }
-    if (strncmp(p, "WARNINGS", 8) == 0 && (p[8] == ' ' || p[8] == '\t' || p[8] == '\n' || p[8] == '\r')) {
-        return "NOTES"; /* Map WARNINGS to NOTES */
+    while (p < end && *p >= '0' && *p <= '9') {
+        result = result * 10 + (*p - '0');
+        p++;
     }
     
-    /* Check for flexible section header pattern: * SECTION_NAME */
-    start = p;
-    while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
-    end = p;
+    *value = negative ? -result : result;
+    *cursor = p;
+    return TRUE;
+}
+
+/* Read a length-prefixed string and terminate it in place; -1 is NULL */
+BOOL cache_read_string(STRPTR *cursor, STRPTR end, STRPTR *string)
+{
+    STRPTR p;
+    LONG len;
     
-    /* Must have at least 2 characters for section name */
-    len = end - start;
-    if (len >= 2) {
-        /* Check if it looks like a section name (all uppercase letters and spaces) */
-        BOOL valid = TRUE;
-        const char *check = start;
-        while (check < end) {
-            if (!((*check >= 'A' && *check <= 'Z') || *check == ' ')) {
-                valid = FALSE;
-                break;
+    if (!cache_read_number(cursor, end, &len)) {
+        return FALSE;
+    }
+    p = *cursor;
+    
+    if (len < 0) {
+        *string = NULL;
+    } else {
+        if (p >= end || *p != ' ') return FALSE;
+        p++;
+        if (len >= end - p) return FALSE;
+        *string = p;
+        p += len;
+    }
+    
+    if (p >= end || *p != '\n') {
+        return FALSE;
+    }
+    *p++ = '\0';
+    *cursor = p;
+    return TRUE;
+}
+
+/* Load CACHE=file into the store's pool; FALSE leaves the cache empty */
+BOOL cache_load(Config *config, AutodocCache *cache)
+{
+    BPTR file_handle;
+    GenArena *arena = config->store.arena;
+    STRPTR buffer, cursor, end;
+    STRPTR sections_spec;
+    STRPTR *fields[CACHE_STRINGS];
+    CacheFile *cached;
+    Autodoc *doc;
+    LONG length, magic_len, file_count, number, fn_offset;
+    LONG i, j, k;
+    ULONG bucket;
+    
+    memset(cache, 0, sizeof(AutodocCache));
+    
+    file_handle = Open(config->cache_file, MODE_OLDFILE);
+    if (!file_handle) {
+        if (config->verbose) {
+            Printf("GenDo: No autodoc cache yet: %s\n", config->cache_file);
+        }
+        return FALSE;
+    }
+    
+    /* Read the whole cache image in one go */
+    Seek(file_handle, 0, OFFSET_END);
+    length = Seek(file_handle, 0, OFFSET_BEGINNING);
+    buffer = (length > 0) ? gen_alloc(arena, length + 1) : NULL;
+    if (!buffer || Read(file_handle, buffer, length) != length) {
+        Close(file_handle);
+        Printf("GenDo: Warning: Cannot read cache file %s\n", config->cache_file);
+        return FALSE;
+    }
+    Close(file_handle);
+    buffer[length] = '\0';
+    end = buffer + length;
+    
+    magic_len = strlen(CACHE_MAGIC);
+    if (length < magic_len || strncmp(buffer, CACHE_MAGIC, magic_len) != 0) {
+        goto damaged;
+    }
+    cursor = buffer + magic_len;
+    
+    /* Entries parsed with other SECTIONS would have other fields */
+    if (!cache_read_string(&cursor, end, &sections_spec)) {
+        goto damaged;
+    }
+    if (compare_names(sections_spec, config->sections_spec) != 0) {
+        if (config->verbose) {
+            Printf("GenDo: SECTIONS changed, not using cache %s\n", config->cache_file);
+        }
+        memset(cache, 0, sizeof(AutodocCache));
+        return FALSE;
+    }
+    
+    if (!cache_read_number(&cursor, end, &file_count) || file_count < 0 ||
+        cursor >= end || *cursor++ != '\n') {
+        goto damaged;
+    }
+    
+    for (cache->bucket_count = 16; cache->bucket_count < file_count; cache->bucket_count *= 2);
+    cache->buckets = gen_alloc(arena, cache->bucket_count * sizeof(CacheFile *));
+    cache->files = gen_alloc(arena, (file_count + 1) * sizeof(CacheFile));
+    if (!cache->buckets || !cache->files) {
+        goto damaged;
+    }
+    memset(cache->buckets, 0, cache->bucket_count * sizeof(CacheFile *));
+    
+    for (i = 0; i < file_count; i++) {
+        cached = &cache->files[i];
+        memset(cached, 0, sizeof(CacheFile));
+        
+        /* F <size> <days> <minute> <tick> <count> <path> */
+        if (cursor >= end || *cursor++ != 'F' ||
+            !cache_read_number(&cursor, end, &cached->size) ||
+            !cache_read_number(&cursor, end, &cached->date.ds_Days) ||
+            !cache_read_number(&cursor, end, &cached->date.ds_Minute) ||
+            !cache_read_number(&cursor, end, &cached->date.ds_Tick) ||
+            !cache_read_number(&cursor, end, &cached->autodoc_count) ||
+            cached->autodoc_count < 0 || cursor >= end || *cursor++ != ' ') {
+            goto damaged;
+        }
+        cached->path = cursor;
+        while (cursor < end && *cursor != '\n') cursor++;
+        if (cursor >= end) {
+            goto damaged;
+        }
+        *cursor++ = '\0';
+        
+        if (cached->autodoc_count > 0) {
+            cached->entries = gen_alloc(arena, cached->autodoc_count * sizeof(Autodoc));
+            if (!cached->entries) {
+                goto damaged;
             }
-            check++;
         }
         
-        if (valid) {
-            result = AllocVec(len + 1, MEMF_CLEAR);
-            if (result) {
-                strncpy(result, start, len);
-                result[len] = '\0';
+        for (j = 0; j < cached->autodoc_count; j++) {
+            doc = &cached->entries[j];
+            memset(doc, 0, sizeof(Autodoc));
+            
+            /* A <line> <internal> <obsolete> <function name offset> */
+            if (cursor >= end || *cursor++ != 'A' ||
+                !cache_read_number(&cursor, end, &doc->line_number) ||
+                !cache_read_number(&cursor, end, &number)) {
+                goto damaged;
+            }
+            doc->is_internal = (BOOL)(number != 0);
+            if (!cache_read_number(&cursor, end, &number)) {
+                goto damaged;
+            }
+            doc->is_obsolete = (BOOL)(number != 0);
+            if (!cache_read_number(&cursor, end, &fn_offset) ||
+                cursor >= end || *cursor++ != '\n') {
+                goto damaged;
+            }
+            
+            cache_fields(doc, fields);
+            for (k = 0; k < CACHE_STRINGS; k++) {
+                if (!cache_read_string(&cursor, end, fields[k])) {
+                    goto damaged;
+                }
+            }
+            
+            /* The function name shares the module string */
+            if (doc->module_name && fn_offset >= 0 && fn_offset <= (LONG)strlen(doc->module_name)) {
+                doc->function_name = doc->module_name + fn_offset;
             }
-            return result;
         }
+        
+        bucket = cache_hash(cached->path) & (cache->bucket_count - 1);
+        cached->next = cache->buckets[bucket];
+        cache->buckets[bucket] = cached;
+    }
+    
+    cache->file_count = file_count;
+    if (config->verbose) {
+        Printf("GenDo: Loaded cache %s (%ld files)\n", config->cache_file, file_count);
     }
+    return TRUE;
+    
+damaged:
+    /* Anything unreadable just means a full rescan */
+    Printf("GenDo: Warning: Ignoring damaged cache file %s\n", config->cache_file);
+    memset(cache, 0, sizeof(AutodocCache));
+    return FALSE;
+}
+
+/* Look up a source file's cache record by path */
+CacheFile *cache_find(AutodocCache *cache, const char *path)
+{
+    CacheFile *cached;
     
+    if (cache->bucket_count == 0) {
+        return NULL;
+    }
+    
+    for (cached = cache->buckets[cache_hash(path) & (cache->bucket_count - 1)]; cached; cached = cached->next) {
+        if (Stricmp((STRPTR)cached->path, (STRPTR)path) == 0) {
+            return cached;
+        }
+    }
     return NULL;
 }
 
-/* Match a filename against a wildcard pattern using Amiga DOS APIs */
-BOOL match_pattern(const char *pattern, const char *filename)
+/* Add a cached file's entries to the store */
+BOOL cache_restore(Config *config, CacheFile *cached)
 {
-    STRPTR tokenized_pattern;
-    LONG pattern_len;
-    LONG result;
+    LONG i;
+    
+    for (i = 0; i < cached->autodoc_count; i++) {
+        if (!autodoc_store_add(&config->store, &cached->entries[i])) {
+            Printf("GenDo: Out of memory restoring %s from cache\n", cached->path);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Write every parsed source file's entries to CACHE=file. A cache cut
+ * short by a write error is deleted, so the next run parses everything. */
+BOOL cache_save(Config *config)
+{
+    BPTR file_handle;
+    SourceFile *file;
+    AutodocChunk *chunk = config->store.first;
+    STRPTR *fields[CACHE_STRINGS];
+    Autodoc *doc;
+    LONG index = 0;
+    LONG cached_count = 0;
+    LONG i, j, k;
     
-    /* Allocate buffer for tokenized pattern (2x source length + 2 bytes as per docs) */
-    pattern_len = strlen(pattern);
-    tokenized_pattern = AllocVec(pattern_len * 2 + 2, MEMF_CLEAR);
-    if (!tokenized_pattern) {
+    file_handle = Open(config->cache_file, MODE_NEWFILE);
+    if (!file_handle) {
+        Printf("GenDo: Cannot write cache file %s (Error: %ld)\n", config->cache_file, IoErr());
         return FALSE;
     }
     
-    /* Parse the pattern using Amiga DOS ParsePattern */
-    result = ParsePattern((STRPTR)pattern, tokenized_pattern, pattern_len * 2 + 2);
+    for (i = 0; i < config->file_count; i++) {
+        if (config->source_files[i].parsed) cached_count++;
+    }
+    if (FPrintf(file_handle, CACHE_MAGIC) < 0) {
+        goto write_failed;
+    }
+    if (config->sections_spec) {
+        if (FPrintf(file_handle, "%ld %s\n", (LONG)strlen(config->sections_spec), config->sections_spec) < 0) {
+            goto write_failed;
+        }
+    } else if (FPrintf(file_handle, "-1\n") < 0) {
+        goto write_failed;
+    }
+    if (FPrintf(file_handle, "%ld\n", cached_count) < 0) {
+        goto write_failed;
+    }
     
+    /* The store holds each file's entries contiguously, in file order */
+    for (i = 0; i < config->file_count; i++) {
+        file = &config->source_files[i];
+        
+        if (file->parsed &&
+            FPrintf(file_handle, "F %ld %ld %ld %ld %ld %s\n", file->size,
+                    file->date.ds_Days, file->date.ds_Minute, file->date.ds_Tick,
+                    file->autodoc_count, file->filename) < 0) {
+            goto write_failed;
+        }
+        
+        for (j = 0; j < file->autodoc_count; j++) {
+            if (index >= chunk->used) {
+                chunk = chunk->next;
+                index = 0;
+            }
+            doc = &chunk->entries[index++];
+            if (!file->parsed) continue;
+            
+            if (FPrintf(file_handle, "A %ld %ld %ld %ld\n", doc->line_number,
+                        (LONG)(doc->is_internal ? 1 : 0), (LONG)(doc->is_obsolete ? 1 : 0),
+                        (doc->module_name && doc->function_name) ? (LONG)(doc->function_name - doc->module_name) : -1L) < 0) {
+                goto write_failed;
+            }
+            
+            cache_fields(doc, fields);
+            for (k = 0; k < CACHE_STRINGS; k++) {
+                if (*fields[k]) {
+                    if (FPrintf(file_handle, "%ld %s\n", (LONG)strlen(*fields[k]), *fields[k]) < 0) {
+                        goto write_failed;
+                    }
+                } else if (FPrintf(file_handle, "-1\n") < 0) {
+                    goto write_failed;
+                }
+            }
+        }
+    }
+    
+    /* Buffered data can still fail to go out when it is flushed */
+    if (!Flush(file_handle)) {
+        goto write_failed;
+    }
+    if (!Close(file_handle)) {
+        file_handle = 0;
+        goto write_failed;
+    }
+    
+    if (config->verbose) {
+        Printf("GenDo: Wrote cache %s (%ld files)\n", config->cache_file, cached_count);
+    }
+    return TRUE;
+    
+write_failed:
+    if (file_handle) {
+        Close(file_handle);
+    }
+    DeleteFile(config->cache_file);
+    Printf("GenDo: Error writing cache file %s, cache deleted\n", config->cache_file);
+    return FALSE;
+}
+
+/* Tokenize a wildcard pattern once so it can be matched against many names */
+BOOL compile_pattern(CompiledPattern *pattern, const char *source)
+{
+    LONG buffer_size;
+    LONG result;
+    
+    pattern->source = (STRPTR)source;
+    pattern->tokens = NULL;
+    pattern->wild = FALSE;
+    
+    /* Buffer for tokenized pattern (2x source length + 2 bytes as per docs) */
+    buffer_size = strlen(source) * 2 + 2;
+    pattern->tokens = AllocVec(buffer_size, MEMF_CLEAR);
+    if (!pattern->tokens) {
+        return FALSE;
+    }
+    
+    /* Not case sensitive, as MatchFirst() is */
+    result = ParsePatternNoCase((STRPTR)source, pattern->tokens, buffer_size);
     if (result == -1) {
         /* Error in pattern parsing */
-        FreeVec(tokenized_pattern);
+        FreeVec(pattern->tokens);
+        pattern->tokens = NULL;
         return FALSE;
     }
     
-    /* Use MatchPattern to check if filename matches the tokenized pattern */
-    result = MatchPattern(tokenized_pattern, (STRPTR)filename);
+    pattern->wild = (result == 1);
+    return TRUE;
+}
+
+/* Match a filename against a compiled pattern */
+BOOL match_pattern(const CompiledPattern *pattern, const char *filename)
+{
+    if (!pattern->tokens) {
+        return FALSE;
+    }
     
-    FreeVec(tokenized_pattern);
-    if (result == 1) {
+    /* A pattern without wildcards is a plain name */
+    if (!pattern->wild) {
+        return (BOOL)(Stricmp(pattern->source, (STRPTR)filename) == 0);
+    }
+    
+    if (MatchPatternNoCase(pattern->tokens, (STRPTR)filename)) {
         return TRUE;
     } else {
         return FALSE;
     }
 }
 
+/* Free the tokens of a compiled pattern */
+void free_pattern(CompiledPattern *pattern)
+{
+    if (pattern->tokens) {
+        FreeVec(pattern->tokens);
+        pattern->tokens = NULL;
+    }
+}
+
 /* Expand wildcards in file patterns and populate config->source_files */
 LONG expand_wildcards(Config *config, STRPTR *file_array, LONG file_count)
 {
     struct AnchorPath *ap;
-    STRPTR *expanded_files;
+    CompiledPattern file_pattern;
+    BOOL is_wild;
+    SourceFile *expanded_files;
     LONG expanded_count = 0;
     LONG max_files = file_count * 1000; /* Allow for wildcard expansion - very generous limit */
+    LONG excluded_count = 0;
     LONG i;
     LONG err;
     LONG j;
     
     /* Allocate space for expanded file list */
-    expanded_files = (STRPTR*)AllocVec(max_files * sizeof(STRPTR), MEMF_CLEAR);
+    expanded_files = (SourceFile*)AllocVec(max_files * sizeof(SourceFile), MEMF_CLEAR);
     if (!expanded_files) {
         Printf("GenDo: Out of memory for file expansion\n");
         return 0;
@@ -361,20 +1225,40 @@ LONG expand_wildcards(Config *config, STRPTR *file_array, LONG file_count)
             Printf("GenDo: Expanding pattern '%s'\n", file_array[i]);
         }
         
+        /* Only the wildcard flag is wanted here, so a plain name skips the
+           directory scan; MatchFirst() has to parse a pattern again itself */
+        if (compile_pattern(&file_pattern, file_array[i])) {
+            is_wild = file_pattern.wild;
+            free_pattern(&file_pattern);
+        } else {
+            is_wild = TRUE; /* let MatchFirst report it */
+        }
+        
         /* Use MatchFirst to scan for files matching the pattern */
-        err = MatchFirst(file_array[i], ap);
+        err = is_wild ? MatchFirst(file_array[i], ap) : ERROR_OBJECT_NOT_FOUND;
         if (err == 0) {
             do {
                 if (ap->ap_Info.fib_DirEntryType < 0) { /* Regular file */
+                    STRPTR full_path;
+                    
+                    /* Filter out excluded names before anything is allocated for them */
+                    if (match_pattern(&config->exclude, ap->ap_Info.fib_FileName)) {
+                        excluded_count++;
+                        if (config->verbose) {
+                            Printf("GenDo: Excluded file '%s'\n", ap->ap_Buf);
+                        }
+                        continue;
+                    }
+                    
                     /* Build full path from ap->ap_Buf which contains the full path */
-                    STRPTR full_path = AllocVec(strlen(ap->ap_Buf) + 1, MEMF_CLEAR);
+                    full_path = AllocVec(strlen(ap->ap_Buf) + 1, MEMF_CLEAR);
                     if (full_path) {
                         strcpy(full_path, ap->ap_Buf);
                         
                         if (expanded_count >= max_files) {
                             /* Reallocate with more space */
                             LONG new_max = max_files * 2;
-                            STRPTR *new_files = (STRPTR*)AllocVec(new_max * sizeof(STRPTR), MEMF_CLEAR);
+                            SourceFile *new_files = (SourceFile*)AllocVec(new_max * sizeof(SourceFile), MEMF_CLEAR);
                             if (new_files) {
                                 /* Copy existing files */
                                 for (j = 0; j < expanded_count; j++) {
@@ -394,7 +1278,10 @@ LONG expand_wildcards(Config *config, STRPTR *file_array, LONG file_count)
                             }
                         }
                         
-                        expanded_files[expanded_count] = full_path;
+                        /* Keep size and datestamp for the autodoc cache */
+                        expanded_files[expanded_count].filename = full_path;
+                        expanded_files[expanded_count].size = ap->ap_Info.fib_Size;
+                        expanded_files[expanded_count].date = ap->ap_Info.fib_Date;
                         expanded_count++;
                         
                         if (config->verbose) {
@@ -407,17 +1294,42 @@ LONG expand_wildcards(Config *config, STRPTR *file_array, LONG file_count)
             if (err == ERROR_NO_MORE_ENTRIES) {
                 err = 0; /* Normal completion */
             }
+        }
+        
+        /* Every MatchFirst() needs its MatchEnd(), even a failed one */
+        if (is_wild) {
+            MatchEnd(ap);
+        }
+        
+        if (err == ERROR_BREAK) {
+            Printf("GenDo: ***Break\n");
+            for (j = 0; j < expanded_count; j++) {
+                FreeVec(expanded_files[j].filename);
+            }
+            FreeVec(expanded_files);
+            FreeVec(ap);
+            return 0;
         } else if (err == ERROR_OBJECT_NOT_FOUND) {
             /* Pattern doesn't match anything, try as literal filename */
-            BPTR fh = Open(file_array[i], MODE_OLDFILE);
+            BPTR fh;
             STRPTR file_path = NULL;
+            if (match_pattern(&config->exclude, FilePart(file_array[i]))) {
+                excluded_count++;
+                if (config->verbose) {
+                    Printf("GenDo: Excluded file '%s'\n", file_array[i]);
+                }
+                continue;
+            }
+            fh = Open(file_array[i], MODE_OLDFILE);
             if (fh) {
+                /* AnchorPath's FileInfoBlock is free here and suitably aligned */
+                BOOL have_info = ExamineFH(fh, &ap->ap_Info);
                 Close(fh);
                 /* File exists, add it directly */
                 if (expanded_count >= max_files) {
                     /* Reallocate with more space */
                     LONG new_max = max_files * 2;
-                    STRPTR *new_files = (STRPTR*)AllocVec(new_max * sizeof(STRPTR), MEMF_CLEAR);
+                    SourceFile *new_files = (SourceFile*)AllocVec(new_max * sizeof(SourceFile), MEMF_CLEAR);
                     if (new_files) {
                         /* Copy existing files */
                         for (j = 0; j < expanded_count; j++) {
@@ -439,7 +1351,11 @@ LONG expand_wildcards(Config *config, STRPTR *file_array, LONG file_count)
                 file_path = AllocVec(strlen(file_array[i]) + 1, MEMF_CLEAR);
                 if (file_path) {
                     strcpy(file_path, file_array[i]);
-                    expanded_files[expanded_count] = file_path;
+                    expanded_files[expanded_count].filename = file_path;
+                    if (have_info) {
+                        expanded_files[expanded_count].size = ap->ap_Info.fib_Size;
+                        expanded_files[expanded_count].date = ap->ap_Info.fib_Date;
+                    }
                 } else {
                     /* Out of memory, skip this file */
                     continue;
@@ -456,51 +1372,102 @@ LONG expand_wildcards(Config *config, STRPTR *file_array, LONG file_count)
     /* Clean up */
     FreeVec(ap);
     
+    if (config->verbose && excluded_count > 0) {
+        Printf("GenDo: Excluded %ld files\n", excluded_count);
+    }
+    
     if (expanded_count == 0) {
         Printf("GenDo: No files found matching the specified patterns\n");
         FreeVec(expanded_files);
         return 0;
     }
     
-    /* Allocate and populate source_files */
+    /* The expanded list becomes config->source_files */
     config->file_count = expanded_count;
-    config->source_files = (SourceFile*)AllocVec(expanded_count * sizeof(SourceFile), MEMF_CLEAR);
-    if (config->source_files) {
-        for (i = 0; i < expanded_count; i++) {
-            config->source_files[i].filename = expanded_files[i];
-            config->source_files[i].file_handle = 0;
-            config->source_files[i].line_count = 0;
-        }
-    }
-    
-    FreeVec(expanded_files);
+    config->source_files = expanded_files;
     return expanded_count;
 }
 
+/* Compare two possibly NULL strings, NULL sorting first */
+LONG compare_names(const char *a, const char *b)
+{
+    if (a == b) return 0;
+    if (!a) return -1;
+    if (!b) return 1;
+    return strcmp(a, b);
+}
+
+/* Order autodocs by function name, then module name, then source line */
+LONG compare_autodocs(const Autodoc *a, const Autodoc *b)
+{
+    LONG result = compare_names(a->function_name, b->function_name);
+    if (result == 0) {
+        result = compare_names(a->module_name, b->module_name);
+    }
+    if (result == 0) {
+        result = a->line_number - b->line_number;
+    }
+    return result;
+}
+
 /* Sort autodocs alphabetically by function name */
 void sort_autodocs(Config *config)
 {
-    LONG i, j;
-    Autodoc *temp;
-    
-    if (!config->autodocs || config->autodoc_count <= 1) {
+    Autodoc **src;
+    Autodoc **dst;
+    Autodoc **temp;
+    Autodoc **scratch;
+    LONG count = config->autodoc_count;
+    LONG width, left, mid, right, i, j, k;
+    
+    if (!config->autodocs || count <= 1) {
         return; /* Nothing to sort */
     }
     
-    /* Simple bubble sort - stable and easy to understand */
-    for (i = 0; i < config->autodoc_count - 1; i++) {
-        for (j = 0; j < config->autodoc_count - 1 - i; j++) {
-            if (strcmp(config->autodocs[j].function_name, config->autodocs[j + 1].function_name) > 0) {
-                /* Swap the autodocs */
-                temp = (Autodoc*)AllocVec(sizeof(Autodoc), MEMF_CLEAR);
-                if (temp) {
-                    *temp = config->autodocs[j];
-                    config->autodocs[j] = config->autodocs[j + 1];
-                    config->autodocs[j + 1] = *temp;
-                    FreeVec(temp);
+    scratch = (Autodoc **)AllocVec(count * sizeof(Autodoc *), MEMF_ANY);
+    if (!scratch) {
+        /* Low memory - fall back to an in-place insertion sort, also stable */
+        for (i = 1; i < count; i++) {
+            Autodoc *doc = config->autodocs[i];
+            for (j = i; j > 0 && compare_autodocs(config->autodocs[j - 1], doc) > 0; j--) {
+                config->autodocs[j] = config->autodocs[j - 1];
+            }
+            config->autodocs[j] = doc;
+        }
+    } else {
+        /* Bottom-up merge sort over the index; ties keep their parse order */
+        src = config->autodocs;
+        dst = scratch;
+        for (width = 1; width < count; width *= 2) {
+            for (left = 0; left < count; left += 2 * width) {
+                mid = left + width;
+                right = mid + width;
+                if (mid > count) mid = count;
+                if (right > count) right = count;
+                
+                i = left;
+                j = mid;
+                k = left;
+                while (i < mid && j < right) {
+                    if (compare_autodocs(src[j], src[i]) < 0) {
+                        dst[k++] = src[j++];
+                    } else {
+                        dst[k++] = src[i++];
+                    }
                 }
+                while (i < mid) dst[k++] = src[i++];
+                while (j < right) dst[k++] = src[j++];
             }
+            temp = src;
+            src = dst;
+            dst = temp;
+        }
+        
+        /* Result ended up in the scratch buffer - copy it back */
+        if (src != config->autodocs) {
+            CopyMem(src, config->autodocs, count * sizeof(Autodoc *));
         }
+        FreeVec(scratch);
     }
     
     if (config->verbose) {
@@ -514,8 +1481,9 @@ LONG parse_command_line(Config *config, LONG argc, STRPTR *argv)
     struct RDArgs *rdargs;
     
     /* Template for ReadArgs */
-    static UBYTE template[] = "FILES/M/A,TO/K,AMIGAGUIDE/S,HTML/S,VERBOSE/S,LINELENGTH/N,WORDWRAP/S,CONVERTCOMMENTS/S,NOFORMFEED/S,NOTOC/S,PRESERVEORDER/S";
-    LONG args[11] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; /* files, to, amigaguide, html, verbose, linelength, wordwrap, convertcomments, noformfeed, notoc, preserveorder */
+    static UBYTE template[] = "FILES/M,TO/K,AMIGAGUIDE/S,HTML/S,VERBOSE/S,LINELENGTH/N,WORDWRAP/S,CONVERTCOMMENTS/S,NOFORMFEED/S,NOTOC/S,PRESERVEORDER/S,BLOCKSIZE/N,CACHE/K,HTMLUPDATE/S,JOBS/N,SECTIONS/K,EXCLUDE/K,STATS/S,STATSFILE/K";
+    static STRPTR phase_names[PHASE_COUNT] = { "wildcard", "parse", "sort", "doc", "guide", "html" };
+    LONG args[19] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; /* files, to, amigaguide, html, verbose, linelength, wordwrap, convertcomments, noformfeed, notoc, preserveorder, blocksize, cache, htmlupdate, jobs, sections, exclude, stats, statsfile */
     
     /* Initialize config */
     config->output_doc = NULL;
@@ -533,6 +1501,12 @@ LONG parse_command_line(Config *config, LONG argc, STRPTR *argv)
     config->convert_comments = TRUE;
     config->no_form_feed = FALSE;
     config->no_toc = FALSE;
+    config->block_size = DEFAULT_BLOCK_SIZE;
+    config->cache_file = NULL;
+    config->cache_failed = FALSE;
+    config->html_update = FALSE;
+    config->jobs = 1;
+    config->sections_spec = NULL;
     
     /* Parse arguments */
     rdargs = ReadArgs(template, args, NULL);
@@ -541,6 +1515,31 @@ LONG parse_command_line(Config *config, LONG argc, STRPTR *argv)
         return RETURN_FAIL;
     }
     
+    /* VERBOSE, EXCLUDE and STATS are needed while FILES is expanded */
+    if (args[4]) config->verbose = TRUE;
+    gen_stats_init(&config->stats, "GenDo", phase_names, PHASE_COUNT, (BOOL)(args[17] || args[18]), (BOOL)(args[17] != 0));
+    if (args[18]) {
+        config->stats_file = gen_strdup((STRPTR)args[18]);
+        if (!config->stats_file) {
+            Printf("GenDo: Out of memory\n");
+            FreeArgs(rdargs);
+            return RETURN_FAIL;
+        }
+    }
+    if (args[16]) {
+        config->exclude.source = gen_strdup((STRPTR)args[16]);
+        if (!config->exclude.source) {
+            Printf("GenDo: Out of memory\n");
+            FreeArgs(rdargs);
+            return RETURN_FAIL;
+        }
+        if (!compile_pattern(&config->exclude, config->exclude.source)) {
+            Printf("GenDo: Invalid EXCLUDE pattern: %s\n", config->exclude.source);
+            FreeArgs(rdargs);
+            return RETURN_FAIL;
+        }
+    }
+    
     /* Process FILES argument */
     if (args[0]) { /* FILES argument */
         STRPTR *file_array = (STRPTR*)args[0];
@@ -553,7 +1552,11 @@ LONG parse_command_line(Config *config, LONG argc, STRPTR *argv)
         
         if (file_count > 0) {
             /* Expand wildcards and populate source_files */
-            LONG expanded_count = expand_wildcards(config, file_array, file_count);
+            LONG expanded_count;
+            
+            gen_stats_begin(&config->stats, PHASE_WILDCARD);
+            expanded_count = expand_wildcards(config, file_array, file_count);
+            gen_stats_end(&config->stats, PHASE_WILDCARD, expanded_count);
             if (expanded_count == 0) {
                 FreeArgs(rdargs);
                 return RETURN_FAIL;
@@ -577,13 +1580,42 @@ LONG parse_command_line(Config *config, LONG argc, STRPTR *argv)
     
     if (args[2]) config->generate_guide = TRUE;
     if (args[3]) config->generate_html = TRUE;
-    if (args[4]) config->verbose = TRUE;
     if (args[5]) config->line_length = (LONG)args[5];
     if (args[6]) config->word_wrap = TRUE;
     if (args[7]) config->convert_comments = TRUE;
     if (args[8]) config->no_form_feed = TRUE;
     if (args[9]) config->no_toc = TRUE;
     if (args[10]) config->preserve_order = TRUE;
+    if (args[11]) config->block_size = *(LONG *)args[11];
+    if (args[13]) config->html_update = TRUE;
+    if (args[14]) {
+        config->jobs = *(LONG *)args[14];
+        if (config->jobs < 1 || config->jobs > MAX_JOBS) {
+            Printf("GenDo: JOBS must be from 1 to %ld\n", (LONG)MAX_JOBS);
+            FreeArgs(rdargs);
+            return RETURN_FAIL;
+        }
+    }
+    if (args[15]) {
+        config->sections_spec = gen_strdup((STRPTR)args[15]);
+        if (!config->sections_spec) {
+            Printf("GenDo: Out of memory\n");
+            FreeArgs(rdargs);
+            return RETURN_FAIL;
+        }
+    }
+    if (!section_table_init(&config->sections, config->sections_spec)) {
+        FreeArgs(rdargs);
+        return RETURN_FAIL;
+    }
+    if (args[12]) {
+        config->cache_file = gen_strdup((STRPTR)args[12]);
+        if (!config->cache_file) {
+            Printf("GenDo: Out of memory\n");
+            FreeArgs(rdargs);
+            return RETURN_FAIL;
+        }
+    }
     
     /* Validate required arguments - output_doc already validated above */
     
@@ -628,104 +1660,398 @@ LONG parse_command_line(Config *config, LONG argc, STRPTR *argv)
     return RETURN_OK;
 }
 
+/* Allocate the block buffer and section buffer of a source reader */
+BOOL source_reader_init(SourceReader *reader, LONG block_size)
+{
+    reader->section.data = NULL;
+    reader->section.length = 0;
+    reader->section.size = 0;
+    
+    return gen_reader_init(&reader->lines, block_size);
+}
+
+/* Release the block buffer and section buffer */
+void source_reader_free(SourceReader *reader)
+{
+    gen_reader_free(&reader->lines);
+    if (reader->section.data) {
+        FreeVec(reader->section.data);
+        reader->section.data = NULL;
+    }
+}
+
+/* Entry point of a parsing worker process started by parse_files_parallel */
+void __saveds parse_worker(void)
+{
+    struct Process *proc = (struct Process *)FindTask(NULL);
+    WorkerStartup *startup;
+    JobMessage *job;
+    JobMessage *quit = NULL;
+    struct MsgPort *port;
+    SourceReader reader;
+    GenArena *arena;
+    
+    WaitPort(&proc->pr_MsgPort);
+    startup = (WorkerStartup *)GetMsg(&proc->pr_MsgPort);
+    arena = startup->arena;
+    
+    port = CreateMsgPort();
+    if (port && !source_reader_init(&reader, startup->config->block_size)) {
+        DeleteMsgPort(port);
+        port = NULL;
+    }
+    startup->job_port = port;
+    
+    if (!port) {
+        /* Stay in Forbid so our code is not unloaded before we exit */
+        Forbid();
+        ReplyMsg(&startup->msg);
+        return;
+    }
+    ReplyMsg(&startup->msg);
+    
+    while (!quit) {
+        WaitPort(port);
+        while (!quit && (job = (JobMessage *)GetMsg(port)) != NULL) {
+            if (!job->file) {
+                quit = job;
+                break;
+            }
+            
+            /* Every job's entries go to the worker's own arena */
+            job->result.arena = arena;
+            job->result.first = NULL;
+            job->result.last = NULL;
+            job->result.count = 0;
+            job->result.worker_arenas = NULL;
+            job->success = parse_autodoc_from_file(job->file, job->config, &job->result, &reader);
+            ReplyMsg(&job->msg);
+        }
+    }
+    
+    source_reader_free(&reader);
+    DeleteMsgPort(port);
+    
+    Forbid();
+    ReplyMsg(&quit->msg);
+}
+
+/* Send the next file that needs parsing to a worker; FALSE when none left */
+BOOL dispatch_parse_job(Config *config, JobMessage *jobs, LONG *next, WorkerStartup *worker, LONG worker_index)
+{
+    while (*next < config->file_count && config->source_files[*next].cached) {
+        (*next)++;
+    }
+    if (*next >= config->file_count) {
+        return FALSE;
+    }
+    
+    if (config->verbose) {
+        Printf("GenDo: Processing file: %s\n", config->source_files[*next].filename);
+    }
+    
+    jobs[*next].worker = worker_index;
+    PutMsg(worker->job_port, &jobs[*next].msg);
+    (*next)++;
+    return TRUE;
+}
+
+/* Parse every file the cache could not supply on JOBS worker processes.
+ * Results stay in jobs[], one per file, to be merged in file order.
+ * Returns FALSE if no worker could be started. */
+BOOL parse_files_parallel(Config *config, JobMessage *jobs)
+{
+    struct MsgPort *reply_port;
+    struct Process *proc;
+    WorkerStartup *workers;
+    GenArena *arena;
+    LONG worker_count = 0;
+    LONG pending = 0;
+    LONG next = 0;
+    LONG i;
+    JobMessage *job;
+    
+    reply_port = CreateMsgPort();
+    if (!reply_port) {
+        return FALSE;
+    }
+    workers = AllocVec(config->jobs * sizeof(WorkerStartup), MEMF_CLEAR);
+    if (!workers) {
+        DeleteMsgPort(reply_port);
+        return FALSE;
+    }
+    
+    /* Start the workers, each with a private arena owned by the store */
+    for (i = 0; i < config->jobs; i++) {
+        arena = autodoc_store_worker_arena(&config->store);
+        if (!arena) break;
+        
+        workers[worker_count].msg.mn_ReplyPort = reply_port;
+        workers[worker_count].msg.mn_Length = sizeof(WorkerStartup);
+        workers[worker_count].config = config;
+        workers[worker_count].arena = arena;
+        workers[worker_count].quit.msg.mn_ReplyPort = reply_port;
+        workers[worker_count].quit.msg.mn_Length = sizeof(JobMessage);
+        
+        proc = CreateNewProcTags(NP_Entry, (ULONG)parse_worker,
+                                 NP_Name, (ULONG)"GenDo parser",
+                                 NP_StackSize, WORKER_STACK_SIZE,
+                                 NP_Output, (ULONG)Output(),
+                                 NP_CloseOutput, FALSE,
+                                 TAG_DONE);
+        if (!proc) break;
+        
+        PutMsg(&proc->pr_MsgPort, &workers[worker_count].msg);
+        WaitPort(reply_port);
+        GetMsg(reply_port);
+        if (!workers[worker_count].job_port) break;
+        worker_count++;
+    }
+    
+    if (worker_count == 0) {
+        FreeVec(workers);
+        DeleteMsgPort(reply_port);
+        return FALSE;
+    }
+    
+    if (config->verbose) {
+        Printf("GenDo: Parsing with %ld worker processes\n", worker_count);
+    }
+    
+    for (i = 0; i < config->file_count; i++) {
+        jobs[i].msg.mn_ReplyPort = reply_port;
+        jobs[i].msg.mn_Length = sizeof(JobMessage);
+        jobs[i].config = config;
+        jobs[i].file = &config->source_files[i];
+    }
+    
+    /* Keep every worker busy - a worker gets its next file as soon as it replies */
+    for (i = 0; i < worker_count; i++) {
+        if (dispatch_parse_job(config, jobs, &next, &workers[i], i)) {
+            pending++;
+        }
+    }
+    while (pending > 0) {
+        WaitPort(reply_port);
+        while ((job = (JobMessage *)GetMsg(reply_port)) != NULL) {
+            pending--;
+            if (dispatch_parse_job(config, jobs, &next, &workers[job->worker], job->worker)) {
+                pending++;
+            }
+        }
+    }
+    
+    /* Shut the workers down and wait until each has let go of its port */
+    for (i = 0; i < worker_count; i++) {
+        PutMsg(workers[i].job_port, &workers[i].quit.msg);
+    }
+    for (i = 0; i < worker_count; i++) {
+        WaitPort(reply_port);
+        GetMsg(reply_port);
+    }
+    
+    FreeVec(workers);
+    DeleteMsgPort(reply_port);
+    return TRUE;
+}
+
 /* Process all source files and extract autodocs */
 BOOL process_source_files(Config *config)
 {
     LONG i;
     BOOL success = TRUE;
+    SourceReader reader;
+    AutodocCache cache;
+    CacheFile *cached;
+    SourceFile *file;
+    JobMessage *jobs = NULL;
+    LONG before;
+    LONG reused = 0;
+    LONG to_parse = 0;
+    BOOL loaded;
+    
+    memset(&cache, 0, sizeof(AutodocCache));
+    if (config->cache_file) {
+        loaded = cache_load(config, &cache);
+        
+        /* Without FILES, regenerate straight from the cache */
+        if (config->file_count == 0) {
+            if (!loaded) {
+                Printf("GenDo: Cannot use cache %s and no source files specified\n", config->cache_file);
+                return FALSE;
+            }
+            for (i = 0; i < cache.file_count; i++) {
+                if (!cache_restore(config, &cache.files[i])) {
+                    return FALSE;
+                }
+            }
+            if (config->verbose) {
+                Printf("GenDo: Restored %ld autodocs from cache\n", config->store.count);
+            }
+            return TRUE;
+        }
+    }
     
     if (config->verbose) {
         Printf("GenDo: Processing %ld source files\n", config->file_count);
     }
     
+    /* Files unchanged since the cache was written are not parsed again */
     for (i = 0; i < config->file_count; i++) {
-        if (config->verbose) {
-            Printf("GenDo: Processing file: %s\n", config->source_files[i].filename);
+        file = &config->source_files[i];
+        cached = cache_find(&cache, file->filename);
+        if (cached && cached->size == file->size && CompareDates(&cached->date, &file->date) == 0) {
+            file->cached = cached;
+        } else {
+            file->cached = NULL;
+            to_parse++;
+        }
+    }
+    
+    /* Parse on worker processes when asked to; fall back to this process */
+    if (config->jobs > 1 && to_parse > 1) {
+        jobs = AllocVec(config->file_count * sizeof(JobMessage), MEMF_CLEAR);
+        if (jobs && !parse_files_parallel(config, jobs)) {
+            FreeVec(jobs);
+            jobs = NULL;
+        }
+    }
+    
+    /* One block buffer is shared by every source file */
+    if (!jobs && !source_reader_init(&reader, config->block_size)) {
+        Printf("GenDo: Out of memory for %ld byte read buffer\n", config->block_size);
+        return FALSE;
+    }
+    
+    /* Entries are added in file order, however the files were parsed */
+    for (i = 0; i < config->file_count; i++) {
+        file = &config->source_files[i];
+        before = config->store.count;
+        
+        if (file->cached) {
+            if (config->verbose) {
+                Printf("GenDo: Unchanged, using cache: %s\n", file->filename);
+            }
+            if (!cache_restore(config, file->cached)) {
+                success = FALSE;
+                break;
+            }
+            file->autodoc_count = config->store.count - before;
+            file->parsed = TRUE;
+            reused++;
+            continue;
+        }
+        
+        if (jobs) {
+            if (!autodoc_store_merge(&config->store, &jobs[i].result)) {
+                Printf("GenDo: Out of memory merging autodocs of %s\n", file->filename);
+                success = FALSE;
+                break;
+            }
+            file->parsed = jobs[i].success;
+        } else {
+            if (config->verbose) {
+                Printf("GenDo: Processing file: %s\n", file->filename);
+            }
+            file->parsed = parse_autodoc_from_file(file, config, &config->store, &reader);
         }
         
-        if (!parse_autodoc_from_file(&config->source_files[i], config)) {
+        if (!file->parsed) {
             Printf("GenDo: Warning: Failed to process file %s\n", 
-                   config->source_files[i].filename);
+                   file->filename);
             success = FALSE;
         }
+        file->autodoc_count = config->store.count - before;
+    }
+    
+    if (jobs) {
+        FreeVec(jobs);
+    } else {
+        source_reader_free(&reader);
     }
+    config->autodoc_count = config->store.count;
     
     if (config->verbose) {
         Printf("GenDo: Extracted %ld autodocs\n", config->autodoc_count);
+        if (config->cache_file) {
+            Printf("GenDo: %ld of %ld files reused from cache\n", reused, config->file_count);
+        }
+    }
+    
+    /* Rewrite the cache unless it already describes exactly these files */
+    if (config->cache_file && i == config->file_count &&
+        (reused != config->file_count || cache.file_count != config->file_count) &&
+        !cache_save(config)) {
+        config->cache_failed = TRUE;
     }
     
     return success;
 }
 
-/* Parse autodoc from a single source file */
-BOOL parse_autodoc_from_file(SourceFile *file, Config *config)
+/* Hand a finished autodoc to the store; entries without a NAME are dropped */
+BOOL finish_autodoc(AutodocStore *store, Autodoc *doc)
 {
-    BPTR file_handle;
-    char line[MAX_LINE_LENGTH];
-    LONG line_number = 0;
+    BOOL success = TRUE;
+    
+    if (doc->name) {
+        if (!autodoc_store_add(store, doc)) {
+            Printf("GenDo: Out of memory storing autodoc %s\n",
+                   doc->function_name ? (char *)doc->function_name : "(unnamed)");
+            success = FALSE;
+        }
+    }
+    
+    /* Strings belong to the store's pool, so only the slot is reset */
+    memset(doc, 0, sizeof(Autodoc));
+    return success;
+}
+
+/* Parse autodoc from a single source file into store */
+BOOL parse_autodoc_from_file(SourceFile *file, Config *config, AutodocStore *store, SourceReader *reader)
+{
+    STRPTR line;
+    LONG line_len;
     BOOL in_autodoc = FALSE;
     Autodoc current_autodoc;
     STRPTR module_func;
     char *slash;
     
     /* Open the source file */
-    file_handle = Open(file->filename, MODE_OLDFILE);
-    if (!file_handle) {
+    if (!gen_reader_open(&reader->lines, file->filename)) {
         Printf("GenDo: Cannot open file: %s\n", file->filename);
         return FALSE;
     }
     
     /* Initialize current autodoc */
-    current_autodoc.module_name = NULL;
-    current_autodoc.function_name = NULL;
-    current_autodoc.name = NULL;
-    current_autodoc.synopsis = NULL;
-    current_autodoc.function_desc = NULL;
-    current_autodoc.inputs = NULL;
-    current_autodoc.result = NULL;
-    current_autodoc.example = NULL;
-    current_autodoc.notes = NULL;
-    current_autodoc.bugs = NULL;
-    current_autodoc.see_also = NULL;
-    current_autodoc.is_internal = FALSE;
-    current_autodoc.is_obsolete = FALSE;
-    current_autodoc.line_number = 0;
+    memset(&current_autodoc, 0, sizeof(Autodoc));
     
     /* Read file line by line */
-    while (FGets(file_handle, line, sizeof(line))) {
-        line_number++;
-        
+    while ((line = gen_reader_next_line(&reader->lines, &line_len)) != NULL) {
         /* Check for autodoc start */
         if (is_autodoc_start(line)) {
             if (in_autodoc) {
                 /* Finish previous autodoc */
-                if (current_autodoc.name) {
-                    /* Add to config autodocs array */
-                    if (config->autodoc_count < MAX_AUTODOCS) {
-                        config->autodocs[config->autodoc_count] = current_autodoc;
-                        config->autodoc_count++;
-                    }
-                }
+                finish_autodoc(store, &current_autodoc);
             }
             
             /* Start new autodoc */
             in_autodoc = TRUE;
-            current_autodoc.line_number = line_number;
+            current_autodoc.line_number = reader->lines.line_number;
             current_autodoc.is_internal = is_internal_autodoc(line);
             current_autodoc.is_obsolete = is_obsolete_autodoc(line);
             
             /* Extract module/function name */
-            module_func = extract_module_function(line);
+            module_func = extract_module_function(store, line);
             if (module_func) {
                 current_autodoc.module_name = module_func;
                 /* Try to split module and function */
                 slash = strchr(module_func, '/');
                 if (slash) {
-                    /* Make a copy of the function name part */
-                    current_autodoc.function_name = strdup_amiga(slash + 1);
+                    /* The function name shares the module string */
+                    current_autodoc.function_name = slash + 1;
                 } else {
                     /* No slash found, use the whole module name as function name */
-                    current_autodoc.function_name = strdup_amiga(module_func);
+                    current_autodoc.function_name = module_func;
                 }
                 
                 /* Debug output */
@@ -750,20 +2076,14 @@ BOOL parse_autodoc_from_file(SourceFile *file, Config *config)
             }
             
             /* Parse autodoc content */
-            if (!parse_autodoc_section(file_handle, &current_autodoc, line)) {
+            if (!parse_autodoc_section(reader, store, &config->sections, &current_autodoc, line)) {
                 in_autodoc = FALSE;
             }
         }
         /* Check for autodoc end */
         else if (in_autodoc && is_autodoc_end(line)) {
             /* Finish current autodoc */
-            if (current_autodoc.name) {
-                /* Add to config autodocs array */
-                if (config->autodoc_count < MAX_AUTODOCS) {
-                    config->autodocs[config->autodoc_count] = current_autodoc;
-                    config->autodoc_count++;
-                }
-            }
+            finish_autodoc(store, &current_autodoc);
             in_autodoc = FALSE;
         }
         /* Process autodoc content */
@@ -773,14 +2093,11 @@ BOOL parse_autodoc_from_file(SourceFile *file, Config *config)
     }
     
     /* Finish last autodoc if file ended while in one */
-    if (in_autodoc && current_autodoc.name) {
-        if (config->autodoc_count < MAX_AUTODOCS) {
-            config->autodocs[config->autodoc_count] = current_autodoc;
-            config->autodoc_count++;
-        }
+    if (in_autodoc) {
+        finish_autodoc(store, &current_autodoc);
     }
     
-    Close(file_handle);
+    gen_reader_close(&reader->lines);
     return TRUE;
 }
 
@@ -885,12 +2202,11 @@ BOOL is_obsolete_autodoc(const char *line)
 }
 
 /* Extract module/function name from autodoc header line */
-STRPTR extract_module_function(const char *line)
+STRPTR extract_module_function(AutodocStore *store, const char *line)
 {
     const char *start = line;
     const char *end;
     LONG len;
-    STRPTR result;
     
     /* Skip leading whitespace */
     while (*start == ' ' || *start == '\t') start++;
@@ -923,39 +2239,31 @@ STRPTR extract_module_function(const char *line)
     len = end - start;
     if (len > 0 && len < 100) {
         /* Create a properly null-terminated string */
-        result = AllocVec(len + 1, MEMF_CLEAR);
-        if (result) {
-            strncpy(result, start, len);
-            result[len] = '\0';
-        }
-        return result;
+        return autodoc_store_string(store, start, len);
     }
     
     return NULL;
 }
 
-/* Clean up content by removing excessive newlines and normalizing whitespace */
-STRPTR clean_content(const char *content)
+/* Clean up content by removing excessive newlines and normalizing whitespace.
+ * Works in place - the result is never longer - and returns its length. */
+LONG clean_content(STRPTR content, LONG len)
 {
-    LONG len;
-    STRPTR cleaned;
     const char *src;
+    const char *end;
     char *dst;
     BOOL last_was_newline;
     BOOL last_was_cr;
     BOOL last_was_space;
     
-    len = strlen(content);
-    cleaned = AllocVec(len + 1, MEMF_CLEAR);
-    if (!cleaned) return NULL;
-    
-    src = content;
-    dst = (char*)cleaned;
+    src = (const char *)content;
+    end = src + len;
+    dst = (char*)content;
     last_was_newline = FALSE;
     last_was_cr = FALSE;
     last_was_space = FALSE;
     
-    while (*src) {
+    while (src < end) {
         if (*src == '\n') {
             if (!last_was_newline) {
                 *dst++ = *src;
@@ -1016,66 +2324,69 @@ STRPTR clean_content(const char *content)
     }
     
     /* Remove trailing whitespace and newlines */
-    while (dst > (char*)cleaned && (dst[-1] == '\n' || dst[-1] == '\r' || 
+    while (dst > (char*)content && (dst[-1] == '\n' || dst[-1] == '\r' || 
            dst[-1] == ' ' || dst[-1] == '\t')) {
         dst--;
     }
     *dst = '\0';
     
-    return cleaned;
+    return (LONG)(dst - (char*)content);
 }
 
-/* Store section content in the appropriate autodoc field */
-void store_section_content(Autodoc *autodoc, const char *section, const char *content)
+/* Append a line and its newline to the section text, growing it as needed */
+BOOL section_buffer_add_line(SectionBuffer *section, const char *text, LONG len)
 {
-    STRPTR cleaned = clean_content(content);
-    if (!cleaned) return;
-    
-    if (strcmp(section, "NAME") == 0) {
-        autodoc->name = cleaned;
-    }
-    else if (strcmp(section, "SYNOPSIS") == 0) {
-        autodoc->synopsis = cleaned;
-    }
-    else if (strcmp(section, "FUNCTION") == 0) {
-        autodoc->function_desc = cleaned;
-    }
-    else if (strcmp(section, "INPUTS") == 0) {
-        autodoc->inputs = cleaned;
-    }
-    else if (strcmp(section, "RESULT") == 0) {
-        autodoc->result = cleaned;
-    }
-    else if (strcmp(section, "EXAMPLE") == 0) {
-        autodoc->example = cleaned;
-    }
-    else if (strcmp(section, "NOTES") == 0) {
-        autodoc->notes = cleaned;
-    }
-    else if (strcmp(section, "BUGS") == 0) {
-        autodoc->bugs = cleaned;
-    }
-    else if (strcmp(section, "SEE ALSO") == 0) {
-        autodoc->see_also = cleaned;
+    if (section->length + len + 2 > section->size) {
+        LONG new_size = section->size ? section->size : SECTION_BUFFER_SIZE;
+        STRPTR new_data;
+        
+        while (new_size < section->length + len + 2) {
+            new_size *= 2;
+        }
+        new_data = AllocVec(new_size, MEMF_ANY);
+        if (!new_data) {
+            return FALSE;
+        }
+        if (section->data) {
+            CopyMem(section->data, new_data, section->length);
+            FreeVec(section->data);
+        }
+        section->data = new_data;
+        section->size = new_size;
     }
-    else {
-        /* Free cleaned content if section not recognized */
-        FreeVec(cleaned);
+    
+    if (len > 0) {
+        CopyMem((APTR)text, section->data + section->length, len);
+        section->length += len;
     }
+    section->data[section->length++] = '\n';
+    return TRUE;
+}
+
+/* Store section content in the autodoc field of its slot */
+void store_section_content(AutodocStore *store, Autodoc *autodoc, LONG slot, SectionBuffer *content)
+{
+    STRPTR *field = autodoc_section_field(autodoc, slot);
+    
+    /* Unrecognised sections are read but not kept */
+    if (!field) return;
+    
+    /* Clean in the accumulator, then keep an exact-size copy in the pool */
+    content->length = clean_content(content->data, content->length);
+    *field = autodoc_store_string(store, content->data, content->length);
 }
 
 /* Parse autodoc section content */
-BOOL parse_autodoc_section(BPTR file, Autodoc *autodoc, STRPTR line)
+BOOL parse_autodoc_section(SourceReader *reader, AutodocStore *store, const SectionTable *table, Autodoc *autodoc, STRPTR line)
 {
-    char current_line[MAX_LINE_LENGTH];
-    STRPTR current_section = NULL;
-    STRPTR section_content = NULL;
-    LONG content_len = 0;
-    LONG max_content = 4096;
+    STRPTR current_line;
+    LONG current_section = SECTION_NONE;
+    LONG section_slot;
+    SectionBuffer *section_content = &reader->section;
+    BOOL success = TRUE;
     
-    /* Allocate initial content buffer */
-    section_content = AllocMem(max_content, MEMF_CLEAR);
-    if (!section_content) return FALSE;
+    /* The accumulator keeps its memory from one section to the next */
+    section_content->length = 0;
     
     /* Process the header line first */
     if (strlen(line) > 0) {
@@ -1083,26 +2394,25 @@ BOOL parse_autodoc_section(BPTR file, Autodoc *autodoc, STRPTR line)
     }
     
     /* Read autodoc content until we hit the end */
-    while (FGets(file, current_line, sizeof(current_line))) {
+    while ((current_line = gen_reader_next_line(&reader->lines, NULL)) != NULL) {
         /* Process line content */
         
         /* Check for section headers using flexible recognition */
-        STRPTR section_name = is_section_header(current_line);
-        if (section_name) {
+        section_slot = is_section_header(table, current_line);
+        if (section_slot != SECTION_NONE) {
             /* Store previous section if it had content */
-            if (current_section && content_len > 0) {
-                section_content[content_len] = '\0';
-                store_section_content(autodoc, current_section, section_content);
+            if (current_section != SECTION_NONE && section_content->length > 0) {
+                store_section_content(store, autodoc, current_section, section_content);
             }
-            current_section = section_name;
-            content_len = 0;
+            current_section = section_slot;
+            section_content->length = 0;
         }
         /* Check for autodoc end */
         else if (is_autodoc_end(current_line)) {
             break;
         }
         /* Process content line */
-        else if (current_section) {
+        else if (current_section != SECTION_NONE) {
             /* Handle lines that start with asterisk (standard autodoc format) */
             if (strncmp(current_line, "*", 1) == 0) {
                 /* Skip the leading "*" and preserve original indentation */
@@ -1121,14 +2431,10 @@ BOOL parse_autodoc_section(BPTR file, Autodoc *autodoc, STRPTR line)
                     line_len--;
                 }
                 
-                /* Add the line if it has content or if it's an empty line (preserve structure) */
-                if (content_len + line_len + 2 < max_content) {
-                    if (line_len > 0) {
-                        strncpy(section_content + content_len, content, line_len);
-                        content_len += line_len;
-                    }
-                    section_content[content_len] = '\n';
-                    content_len++;
+                /* Add the line even if empty, to preserve structure */
+                if (!section_buffer_add_line(section_content, content, line_len)) {
+                    success = FALSE;
+                    break;
                 }
             }
             /* Handle lines that don't start with asterisk but are still content */
@@ -1148,33 +2454,95 @@ BOOL parse_autodoc_section(BPTR file, Autodoc *autodoc, STRPTR line)
                     }
                     
                     /* Add the line if there's content */
-                    if (line_len > 0 && content_len + line_len + 2 < max_content) {
-                        strncpy(section_content + content_len, content, line_len);
-                        content_len += line_len;
-                        section_content[content_len] = '\n';
-                        content_len++;
+                    if (line_len > 0 && !section_buffer_add_line(section_content, content, line_len)) {
+                        success = FALSE;
+                        break;
                     }
                 }
             }
         }
     }
     
+    if (!success) {
+        Printf("GenDo: Out of memory for section text at line %ld\n", reader->lines.line_number);
+    }
+    
     /* Store the last section if it had content */
-    if (current_section && content_len > 0) {
-        section_content[content_len] = '\0';
-        store_section_content(autodoc, current_section, section_content);
+    if (current_section != SECTION_NONE && section_content->length > 0) {
+        store_section_content(store, autodoc, current_section, section_content);
     }
     
-    FreeMem(section_content, max_content);
-    return TRUE;
+    return success;
+}
+
+/* Prepare one autodoc for the back-ends */
+void format_autodoc(Config *config, LONG index, FormattedDoc *entry)
+{
+    Autodoc *doc = config->autodocs[index];
+    LONG s;
+    
+    entry->doc = doc;
+    entry->index = index;
+    entry->is_first = (index == 0);
+    entry->is_last = (index == config->autodoc_count - 1);
+    entry->prev_name = entry->is_first ? NULL : config->autodocs[index - 1]->function_name;
+    entry->next_name = entry->is_last ? NULL : config->autodocs[index + 1]->function_name;
+    
+    for (s = 0; s < config->sections.section_count; s++) {
+        entry->sections[s] = *autodoc_section_field(doc, s);
+    }
+}
+
+/* Write all registered output formats in a single pass over the autodocs */
+BOOL run_emitters(Config *config, Emitter *emitters, LONG emitter_count)
+{
+    FormattedDoc entry;
+    LONG i, e;
+    LONG started = 0;
+    BOOL success = TRUE;
+    
+    /* Headers and tables of contents */
+    for (e = 0; e < emitter_count; e++) {
+        /* end also runs for a back-end whose begin failed part way */
+        started++;
+        gen_stats_begin(&config->stats, emitters[e].phase);
+        if (!emitters[e].begin(&emitters[e], config)) {
+            gen_stats_end(&config->stats, emitters[e].phase, 0);
+            Printf("%s\n", emitters[e].failure_message);
+            success = FALSE;
+            break;
+        }
+        gen_stats_end(&config->stats, emitters[e].phase, 0);
+    }
+    
+    /* Bodies - each autodoc is prepared once for all back-ends */
+    for (i = 0; success && i < config->autodoc_count; i++) {
+        format_autodoc(config, i, &entry);
+        for (e = 0; e < emitter_count; e++) {
+            gen_stats_begin(&config->stats, emitters[e].phase);
+            success = emitters[e].entry(&emitters[e], config, &entry);
+            gen_stats_end(&config->stats, emitters[e].phase, 1);
+            if (!success) {
+                Printf("%s\n", emitters[e].failure_message);
+                break;
+            }
+        }
+    }
+    
+    for (e = 0; e < started; e++) {
+        gen_stats_begin(&config->stats, emitters[e].phase);
+        emitters[e].end(&emitters[e], config);
+        gen_stats_end(&config->stats, emitters[e].phase, 0);
+    }
+    
+    return success;
 }
 
-/* Generate .doc format output */
-BOOL generate_doc_output(Config *config)
+/* .doc back-end: open the file and write the table of contents */
+BOOL doc_emit_begin(Emitter *emitter, Config *config)
 {
     BPTR file_handle;
     LONG i;
-    Autodoc *doc;
     
     /* Open output file */
     file_handle = Open(config->output_doc, MODE_NEWFILE);
@@ -1193,14 +2561,15 @@ BOOL generate_doc_output(Config *config)
         }
         return FALSE;
     }
+    emitter->file_handle = file_handle;
     
     /* Write table of contents if not disabled */
     if (!config->no_toc) {
         FPrintf(file_handle, "TABLE OF CONTENTS\n\n");
         
         for (i = 0; i < config->autodoc_count; i++) {
-            if (config->autodocs[i].module_name) {
-                FPrintf(file_handle, "%s\n", config->autodocs[i].module_name);
+            if (config->autodocs[i]->module_name) {
+                FPrintf(file_handle, "%s\n", config->autodocs[i]->module_name);
             }
         }
         FPrintf(file_handle, "\n");
@@ -1211,73 +2580,48 @@ BOOL generate_doc_output(Config *config)
         }
     }
     
-    /* Write autodocs */
-    for (i = 0; i < config->autodoc_count; i++) {
-        doc = &config->autodocs[i];
-        
-        if (doc->module_name) {
-            FPrintf(file_handle, "\f%s                                                       %s\n", doc->module_name, doc->module_name);
-            FPrintf(file_handle, " \n");
-            
-            if (doc->name) {
-                FPrintf(file_handle, "   NAME\n");
-                FPrintf(file_handle, "%s\n\n", doc->name);
-            }
-            
-            if (doc->synopsis) {
-                FPrintf(file_handle, "   SYNOPSIS\n");
-                FPrintf(file_handle, "%s\n\n", doc->synopsis);
-            }
-            
-            if (doc->function_desc) {
-                FPrintf(file_handle, "   FUNCTION\n");
-                FPrintf(file_handle, "%s\n\n", doc->function_desc);
-            }
-            
-            if (doc->inputs) {
-                FPrintf(file_handle, "   INPUTS\n");
-                FPrintf(file_handle, "%s\n\n", doc->inputs);
-            }
-            
-            if (doc->result) {
-                FPrintf(file_handle, "   RESULT\n");
-                FPrintf(file_handle, "%s\n\n", doc->result);
-            }
-            
-            if (doc->example) {
-                FPrintf(file_handle, "   EXAMPLE\n");
-                FPrintf(file_handle, "%s\n\n", doc->example);
-            }
-            
-            if (doc->notes) {
-                FPrintf(file_handle, "   NOTES\n");
-                FPrintf(file_handle, "%s\n\n", doc->notes);
-            }
-            
-            if (doc->bugs) {
-                FPrintf(file_handle, "   BUGS\n");
-                FPrintf(file_handle, "%s\n\n", doc->bugs);
-            }
-            
-            if (doc->see_also) {
-                FPrintf(file_handle, "   SEE ALSO\n");
-                FPrintf(file_handle, "%s\n\n", doc->see_also);
-            }
-            
-            FPrintf(file_handle, " \n");
+    return TRUE;
+}
+
+/* .doc back-end: write one autodoc */
+BOOL doc_emit_entry(Emitter *emitter, Config *config, FormattedDoc *entry)
+{
+    BPTR file_handle = emitter->file_handle;
+    Autodoc *doc = entry->doc;
+    LONG s, slot;
+    
+    if (!doc->module_name) return TRUE;
+    
+    FPrintf(file_handle, "\f%s                                                       %s\n", doc->module_name, doc->module_name);
+    FPrintf(file_handle, " \n");
+    
+    for (s = 0; s < config->sections.section_count; s++) {
+        slot = config->sections.doc_order[s];
+        if (entry->sections[slot]) {
+            FPrintf(file_handle, "   %s\n", config->sections.info[slot].title);
+            FPrintf(file_handle, "%s\n\n", entry->sections[slot]);
         }
     }
     
-    Close(file_handle);
+    FPrintf(file_handle, " \n");
     return TRUE;
 }
 
-/* Generate AmigaGuide format output */
-BOOL generate_guide_output(Config *config)
+/* .doc back-end: close the file */
+void doc_emit_end(Emitter *emitter, Config *config)
+{
+    if (emitter->file_handle) {
+        gen_counters.written += Seek(emitter->file_handle, 0, OFFSET_CURRENT);
+        Close(emitter->file_handle);
+        emitter->file_handle = 0;
+    }
+}
+
+/* AmigaGuide back-end: write the main and table of contents nodes */
+BOOL guide_emit_begin(Emitter *emitter, Config *config)
 {
     BPTR file_handle;
     LONG i;
-    Autodoc *doc;
     
     if (!config->output_guide) return TRUE;
     
@@ -1287,6 +2631,7 @@ BOOL generate_guide_output(Config *config)
         Printf("GenDo: Cannot create guide file: %s\n", config->output_guide);
         return FALSE;
     }
+    emitter->file_handle = file_handle;
     
     /* Write AmigaGuide header */
     FPrintf(file_handle, "@database %s\n", config->output_guide);
@@ -1309,8 +2654,8 @@ BOOL generate_guide_output(Config *config)
     
     /* Write function links with proper formatting */
     for (i = 0; i < config->autodoc_count; i++) {
-        if (config->autodocs[i].function_name) {
-            FPrintf(file_handle, "@{\"%s\" link \"%s\"}\n", config->autodocs[i].function_name, config->autodocs[i].function_name);
+        if (config->autodocs[i]->function_name) {
+            FPrintf(file_handle, "@{\"%s\" link \"%s\"}\n", config->autodocs[i]->function_name, config->autodocs[i]->function_name);
         }
     }
     
@@ -1326,8 +2671,8 @@ BOOL generate_guide_output(Config *config)
     FPrintf(file_handle, "\n");
     
     for (i = 0; i < config->autodoc_count; i++) {
-        if (config->autodocs[i].function_name) {
-            FPrintf(file_handle, "@{\"%s\" link \"%s\"}\n", config->autodocs[i].function_name, config->autodocs[i].function_name);
+        if (config->autodocs[i]->function_name) {
+            FPrintf(file_handle, "@{\"%s\" link \"%s\"}\n", config->autodocs[i]->function_name, config->autodocs[i]->function_name);
         }
     }
     
@@ -1336,92 +2681,173 @@ BOOL generate_guide_output(Config *config)
     FPrintf(file_handle, "\n");
     FPrintf(file_handle, "@EndNode\n");
     
-    /* Write function nodes */
-    for (i = 0; i < config->autodoc_count; i++) {
-        doc = &config->autodocs[i];
-        
-        if (doc->function_name) {
-            FPrintf(file_handle, "@Node %s \"%s\"\n", doc->function_name, doc->function_name);
-            
-            /* Set next link - last function links back to main */
-            if (i == config->autodoc_count - 1) {
-                FPrintf(file_handle, "@Next \"main\"\n");
-            } else {
-                FPrintf(file_handle, "@Next \"%s\"\n", config->autodocs[i + 1].function_name);
-            }
-            
-            /* Set previous link - first function links back to main */
-            if (i == 0) {
-                FPrintf(file_handle, "@Prev \"main\"\n");
-            } else {
-                FPrintf(file_handle, "@Prev \"%s\"\n", config->autodocs[i - 1].function_name);
-            }
-            
-            FPrintf(file_handle, "\n");
-            
-            FPrintf(file_handle, "@{b}%s@{ub}\n", doc->function_name);
-            FPrintf(file_handle, "\n");
-            
-            if (doc->synopsis) {
-                FPrintf(file_handle, "@{b}SYNOPSIS@{ub}\n");
-                FPrintf(file_handle, "%s\n\n", doc->synopsis);
-            }
-            
-            if (doc->function_desc) {
-                FPrintf(file_handle, "@{b}FUNCTION@{ub}\n");
-                FPrintf(file_handle, "%s\n\n", doc->function_desc);
-            }
-            
-            if (doc->inputs) {
-                FPrintf(file_handle, "@{b}INPUTS@{ub}\n");
-                FPrintf(file_handle, "%s\n\n", doc->inputs);
-            }
-            
-            if (doc->result) {
-                FPrintf(file_handle, "@{b}RESULT@{ub}\n");
-                FPrintf(file_handle, "%s\n\n", doc->result);
-            }
-            
-            if (doc->example) {
-                FPrintf(file_handle, "@{b}EXAMPLE@{ub}\n");
-                FPrintf(file_handle, "%s\n\n", doc->example);
-            }
-            
-            if (doc->notes) {
-                FPrintf(file_handle, "@{b}NOTES@{ub}\n");
-                FPrintf(file_handle, "%s\n\n", doc->notes);
-            }
-            
-            if (doc->bugs) {
-                FPrintf(file_handle, "@{b}BUGS@{ub}\n");
-                FPrintf(file_handle, "%s\n\n", doc->bugs);
-            }
-            
-            if (doc->see_also) {
+    return TRUE;
+}
+
+/* AmigaGuide back-end: write one function node */
+BOOL guide_emit_entry(Emitter *emitter, Config *config, FormattedDoc *entry)
+{
+    BPTR file_handle = emitter->file_handle;
+    Autodoc *doc = entry->doc;
+    LONG s, slot;
+    
+    if (!file_handle || !doc->function_name) return TRUE;
+    
+    FPrintf(file_handle, "@Node %s \"%s\"\n", doc->function_name, doc->function_name);
+    
+    /* Set next link - last function links back to main */
+    if (entry->is_last) {
+        FPrintf(file_handle, "@Next \"main\"\n");
+    } else {
+        FPrintf(file_handle, "@Next \"%s\"\n", entry->next_name);
+    }
+    
+    /* Set previous link - first function links back to main */
+    if (entry->is_first) {
+        FPrintf(file_handle, "@Prev \"main\"\n");
+    } else {
+        FPrintf(file_handle, "@Prev \"%s\"\n", entry->prev_name);
+    }
+    
+    FPrintf(file_handle, "\n");
+    
+    FPrintf(file_handle, "@{b}%s@{ub}\n", doc->function_name);
+    FPrintf(file_handle, "\n");
+    
+    /* The node title already carries the name */
+    for (s = 0; s < config->sections.section_count; s++) {
+        slot = config->sections.doc_order[s];
+        if (slot != SECTION_NAME && entry->sections[slot]) {
+            if (slot == SECTION_SEE_ALSO) {
                 FPrintf(file_handle, "\n");
-                FPrintf(file_handle, "@{b}SEE ALSO@{ub}\n");
-                FPrintf(file_handle, "%s\n\n", doc->see_also);
             }
-            
-            FPrintf(file_handle, "@{\"main\" link \"Back to Main\"}\n");
-            FPrintf(file_handle, "\n");
-            FPrintf(file_handle, "@EndNode\n");
+            FPrintf(file_handle, "@{b}%s@{ub}\n", config->sections.info[slot].title);
+            FPrintf(file_handle, "%s\n\n", entry->sections[slot]);
         }
     }
     
-    Close(file_handle);
+    FPrintf(file_handle, "@{\"main\" link \"Back to Main\"}\n");
+    FPrintf(file_handle, "\n");
+    FPrintf(file_handle, "@EndNode\n");
+    return TRUE;
+}
+
+/* AmigaGuide back-end: close the file */
+void guide_emit_end(Emitter *emitter, Config *config)
+{
+    if (emitter->file_handle) {
+        gen_counters.written += Seek(emitter->file_handle, 0, OFFSET_CURRENT);
+        Close(emitter->file_handle);
+        emitter->file_handle = 0;
+    }
+}
+
+/* Append text to a page buffer, growing it when needed */
+BOOL page_puts(PageBuffer *page, const char *text)
+{
+    LONG len = strlen(text);
+    
+    if (page->length + len > page->size) {
+        LONG new_size = page->size ? page->size : PAGE_BUFFER_SIZE;
+        STRPTR new_data;
+        
+        while (new_size < page->length + len) {
+            new_size *= 2;
+        }
+        new_data = AllocVec(new_size, MEMF_ANY);
+        if (!new_data) {
+            page->failed = TRUE;
+            return FALSE;
+        }
+        if (page->data) {
+            CopyMem(page->data, new_data, page->length);
+            FreeVec(page->data);
+        }
+        page->data = new_data;
+        page->size = new_size;
+    }
+    
+    CopyMem((APTR)text, page->data + page->length, len);
+    page->length += len;
     return TRUE;
 }
 
-/* Generate HTML output */
-BOOL generate_html_output(Config *config)
+/* Append open, text and close to a page buffer */
+BOOL page_tag(PageBuffer *page, const char *open, const char *text, const char *close)
+{
+    return (BOOL)(page_puts(page, open) && page_puts(page, text) && page_puts(page, close));
+}
+
+/* Check whether the file at path already holds exactly the page contents */
+BOOL page_unchanged(PageBuffer *page, STRPTR path)
+{
+    BPTR file_handle;
+    UBYTE block[512];
+    LONG offset = 0;
+    LONG chunk;
+    BOOL same = FALSE;
+    
+    file_handle = Open(path, MODE_OLDFILE);
+    if (!file_handle) {
+        return FALSE;
+    }
+    
+    /* Different sizes can never match, so only equal sizes are read */
+    Seek(file_handle, 0, OFFSET_END);
+    if (Seek(file_handle, 0, OFFSET_BEGINNING) == page->length) {
+        same = TRUE;
+        while (same && offset < page->length) {
+            chunk = page->length - offset;
+            if (chunk > (LONG)sizeof(block)) chunk = sizeof(block);
+            if (Read(file_handle, block, chunk) != chunk ||
+                memcmp(block, page->data + offset, chunk) != 0) {
+                same = FALSE;
+            }
+            offset += chunk;
+        }
+    }
+    
+    Close(file_handle);
+    return same;
+}
+
+/* Write the page buffer to path, unless HTMLUPDATE finds it unchanged */
+BOOL page_write(Emitter *emitter, Config *config, STRPTR path)
 {
     BPTR file_handle;
+    PageBuffer *page = &emitter->page;
+    BOOL success;
+    
+    if (page->failed) {
+        Printf("GenDo: Out of memory for HTML page %s\n", path);
+        return FALSE;
+    }
+    
+    if (config->html_update && page_unchanged(page, path)) {
+        emitter->pages_skipped++;
+        return TRUE;
+    }
+    
+    file_handle = Open(path, MODE_NEWFILE);
+    if (!file_handle) {
+        return FALSE;
+    }
+    success = (BOOL)(Write(file_handle, page->data, page->length) == page->length);
+    Close(file_handle);
+    
+    if (success) {
+        emitter->pages_written++;
+        gen_counters.written += page->length;
+    }
+    return success;
+}
+
+/* HTML back-end: create the directory and write index.html */
+BOOL html_emit_begin(Emitter *emitter, Config *config)
+{
+    PageBuffer *page = &emitter->page;
     LONG i, j;
-    Autodoc *doc;
-    char *index_path;
-    char *function_path;
-    LONG index_len, function_len;
+    LONG name_len, max_name_len;
     
     /* Create HTML directory */
     BPTR dir_lock = Lock(config->output_html_dir, ACCESS_READ);
@@ -1446,196 +2872,151 @@ BOOL generate_html_output(Config *config)
         }
     }
     
-    /* Generate index.html path */
-    index_len = strlen(config->output_html_dir) + 12; /* "/index.html" + null terminator */
-    index_path = AllocVec(index_len, MEMF_CLEAR);
-    if (!index_path) {
-        Printf("GenDo: Out of memory\n");
-        return FALSE;
+    /* One path buffer serves index.html and every function page */
+    max_name_len = 5; /* "index" */
+    for (i = 0; i < config->autodoc_count; i++) {
+        if (config->autodocs[i]->function_name) {
+            name_len = strlen(config->autodocs[i]->function_name);
+            if (name_len > max_name_len) max_name_len = name_len;
+        }
     }
-    SNPrintf(index_path, index_len, "%s/index.html", config->output_html_dir);
-    
-    /* Create index.html */
-    file_handle = Open(index_path, MODE_NEWFILE);
-    if (!file_handle) {
-        Printf("GenDo: Failed to create index.html (Error: %ld)\n", IoErr());
-        FreeVec(index_path);
+    emitter->path_len = strlen(config->output_html_dir) + max_name_len + 7; /* "/.html" + null terminator */
+    emitter->path = AllocVec(emitter->path_len, MEMF_CLEAR);
+    if (!emitter->path) {
+        Printf("GenDo: Out of memory\n");
         return FALSE;
     }
-    
-    /* Write HTML header */
-    FPrintf(file_handle, "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 3.2//EN\">\n");
-    FPrintf(file_handle, "<html>\n");
-    FPrintf(file_handle, "<head>\n");
-    FPrintf(file_handle, "<title>%s</title>\n", config->output_doc);
-    FPrintf(file_handle, "</head>\n");
-    FPrintf(file_handle, "<body>\n");
-    FPrintf(file_handle, "<h1>%s</h1>\n", config->output_doc);
-    FPrintf(file_handle, "<h3>FUNCTIONS</h3>\n");
-    FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-    FPrintf(file_handle, "<table width=\"100%%\">\n");
+    SNPrintf(emitter->path, emitter->path_len, "%s/index.html", config->output_html_dir);
+    
+    /* Build index.html in the page buffer */
+    page->length = 0;
+    page_puts(page, "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 3.2//EN\">\n");
+    page_puts(page, "<html>\n");
+    page_puts(page, "<head>\n");
+    page_tag(page, "<title>", config->output_doc, "</title>\n");
+    page_puts(page, "</head>\n");
+    page_puts(page, "<body>\n");
+    page_tag(page, "<h1>", config->output_doc, "</h1>\n");
+    page_puts(page, "<h3>FUNCTIONS</h3>\n");
+    page_puts(page, "<div class=\"sectionbody\">\n");
+    page_puts(page, "<table width=\"100%\">\n");
     
     /* Write function table - 5 columns */
     for (i = 0; i < config->autodoc_count; i += 5) {
-        FPrintf(file_handle, "<tr>\n");
+        page_puts(page, "<tr>\n");
         for (j = 0; j < 5 && (i + j) < config->autodoc_count; j++) {
-            if (config->autodocs[i + j].function_name) {
-                FPrintf(file_handle, "<td width=\"20%%\"><a href=\"%s.html\">%s</a></td>\n", 
-                        config->autodocs[i + j].function_name, 
-                        config->autodocs[i + j].function_name);
+            if (config->autodocs[i + j]->function_name) {
+                page_tag(page, "<td width=\"20%\"><a href=\"", config->autodocs[i + j]->function_name, ".html\">");
+                page_tag(page, "", config->autodocs[i + j]->function_name, "</a></td>\n");
             } else {
-                FPrintf(file_handle, "<td width=\"20%%\"></td>\n");
+                page_puts(page, "<td width=\"20%\"></td>\n");
             }
         }
         /* Fill remaining columns if needed */
         for (; j < 5; j++) {
-            FPrintf(file_handle, "<td width=\"20%%\"></td>\n");
+            page_puts(page, "<td width=\"20%\"></td>\n");
         }
-        FPrintf(file_handle, "</tr>\n");
+        page_puts(page, "</tr>\n");
     }
     
-    FPrintf(file_handle, "</table>\n");
-    FPrintf(file_handle, "</div><br>\n");
-    FPrintf(file_handle, "</body>\n");
-    FPrintf(file_handle, "</html>\n");
+    page_puts(page, "</table>\n");
+    page_puts(page, "</div><br>\n");
+    page_puts(page, "</body>\n");
+    page_puts(page, "</html>\n");
     
-    Close(file_handle);
-    FreeVec(index_path);
+    if (!page_write(emitter, config, emitter->path)) {
+        Printf("GenDo: Failed to create index.html (Error: %ld)\n", IoErr());
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* HTML back-end: write one function page */
+BOOL html_emit_entry(Emitter *emitter, Config *config, FormattedDoc *entry)
+{
+    PageBuffer *page = &emitter->page;
+    Autodoc *doc = entry->doc;
+    STRPTR content;
+    LONG s, slot;
     
-    /* Generate individual function pages */
-    for (i = 0; i < config->autodoc_count; i++) {
-        doc = &config->autodocs[i];
-        
-        if (!doc->function_name) continue;
-        
-        /* Generate function HTML path */
-        function_len = strlen(config->output_html_dir) + strlen(doc->function_name) + 7; /* "/.html" + null terminator */
-        function_path = AllocVec(function_len, MEMF_CLEAR);
-        if (!function_path) {
-            Printf("GenDo: Out of memory for function %s\n", doc->function_name);
-            continue;
-        }
-        SNPrintf(function_path, function_len, "%s/%s.html", config->output_html_dir, doc->function_name);
-        
-        /* Create function HTML file */
-        file_handle = Open(function_path, MODE_NEWFILE);
-        if (!file_handle) {
-            Printf("GenDo: Failed to create %s.html (Error: %ld)\n", doc->function_name, IoErr());
-            FreeVec(function_path);
-            continue;
-        }
-        
-        /* Write HTML header */
-        FPrintf(file_handle, "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 3.2//EN\">\n");
-        FPrintf(file_handle, "<html>\n");
-        FPrintf(file_handle, "<head>\n");
-        FPrintf(file_handle, "<title>%s</title>\n", doc->function_name);
-        FPrintf(file_handle, "</head>\n");
-        FPrintf(file_handle, "<body>\n");
-        
-        /* Write NAME section */
-        if (doc->name) {
-            FPrintf(file_handle, "<h3>NAME</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "<dl>\n");
-            FPrintf(file_handle, "<dt>%s</dt>\n", doc->function_name);
-            FPrintf(file_handle, "<dd>\n");
-            FPrintf(file_handle, "%s<br><br>\n", doc->name);
-            FPrintf(file_handle, "</dd>\n");
-            FPrintf(file_handle, "</dl>\n");
-            FPrintf(file_handle, "</div>\n");
-        }
-        
-        /* Write SYNOPSIS section */
-        if (doc->synopsis) {
-            FPrintf(file_handle, "<h3>SYNOPSIS</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "<div class=\"codesectionbody\">\n");
-            FPrintf(file_handle, "%s<br><br>\n", doc->synopsis);
-            FPrintf(file_handle, "</div>\n");
-            FPrintf(file_handle, "</div>\n");
-        }
-        
-        /* Write FUNCTION section */
-        if (doc->function_desc) {
-            FPrintf(file_handle, "<h3>FUNCTION</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "%s<br><br>\n", doc->function_desc);
-            FPrintf(file_handle, "</div>\n");
-        }
-        
-        /* Write INPUTS section */
-        if (doc->inputs) {
-            FPrintf(file_handle, "<h3>INPUTS</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "<dl>\n");
-            FPrintf(file_handle, "%s\n", doc->inputs);
-            FPrintf(file_handle, "</dl>\n");
-            FPrintf(file_handle, "</div>\n");
-        }
-        
-        /* Write RESULT section */
-        if (doc->result) {
-            FPrintf(file_handle, "<h3>RESULT</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "<dl>\n");
-            FPrintf(file_handle, "%s\n", doc->result);
-            FPrintf(file_handle, "</dl>\n");
-            FPrintf(file_handle, "</div>\n");
-        }
-        
-        /* Write NOTES section */
-        if (doc->notes) {
-            FPrintf(file_handle, "<h3>NOTES</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "%s<br><br>\n", doc->notes);
-            FPrintf(file_handle, "</div>\n");
-        }
-        
-        /* Write BUGS section */
-        if (doc->bugs) {
-            FPrintf(file_handle, "<h3>BUGS</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "%s<br><br>\n", doc->bugs);
-            FPrintf(file_handle, "</div>\n");
-        }
+    if (!doc->function_name) return TRUE;
+    
+    /* Write HTML header */
+    page->length = 0;
+    page_puts(page, "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 3.2//EN\">\n");
+    page_puts(page, "<html>\n");
+    page_puts(page, "<head>\n");
+    page_tag(page, "<title>", doc->function_name, "</title>\n");
+    page_puts(page, "</head>\n");
+    page_puts(page, "<body>\n");
+    
+    for (s = 0; s < config->sections.section_count; s++) {
+        slot = config->sections.html_order[s];
+        content = entry->sections[slot];
+        if (!content) continue;
         
-        /* Write EXAMPLE section */
-        if (doc->example) {
-            FPrintf(file_handle, "<h3>EXAMPLE</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "<div class=\"codesectionbody\">\n");
-            FPrintf(file_handle, "%s<br><br>\n", doc->example);
-            FPrintf(file_handle, "</div>\n");
-            FPrintf(file_handle, "</div>\n");
-        }
+        page_tag(page, "<h3>", config->sections.info[slot].title, "</h3>\n");
+        page_puts(page, "<div class=\"sectionbody\">\n");
         
-        /* Write SEE ALSO section */
-        if (doc->see_also) {
-            FPrintf(file_handle, "<h3>SEE ALSO</h3>\n");
-            FPrintf(file_handle, "<div class=\"sectionbody\">\n");
-            FPrintf(file_handle, "%s<br><br>\n", doc->see_also);
-            FPrintf(file_handle, "</div>\n");
+        if (slot == SECTION_NAME) {
+            /* NAME is shown as a definition of the function */
+            page_puts(page, "<dl>\n");
+            page_tag(page, "<dt>", doc->function_name, "</dt>\n");
+            page_puts(page, "<dd>\n");
+            page_tag(page, "", content, "<br><br>\n");
+            page_puts(page, "</dd>\n");
+            page_puts(page, "</dl>\n");
+        } else if (config->sections.info[slot].html_style == HTML_STYLE_CODE) {
+            page_puts(page, "<div class=\"codesectionbody\">\n");
+            page_tag(page, "", content, "<br><br>\n");
+            page_puts(page, "</div>\n");
+        } else if (config->sections.info[slot].html_style == HTML_STYLE_LIST) {
+            page_puts(page, "<dl>\n");
+            page_tag(page, "", content, "\n");
+            page_puts(page, "</dl>\n");
+        } else {
+            page_tag(page, "", content, "<br><br>\n");
         }
         
-        FPrintf(file_handle, "</body>\n");
-        FPrintf(file_handle, "</html>\n");
-        
-        Close(file_handle);
-        FreeVec(function_path);
+        page_puts(page, "</div>\n");
     }
     
+    page_puts(page, "</body>\n");
+    page_puts(page, "</html>\n");
+    
+    SNPrintf(emitter->path, emitter->path_len, "%s/%s.html", config->output_html_dir, doc->function_name);
+    if (!page_write(emitter, config, emitter->path)) {
+        /* A single unwritable page does not stop the run */
+        Printf("GenDo: Failed to create %s.html (Error: %ld)\n", doc->function_name, IoErr());
+        page->failed = FALSE;
+    }
     return TRUE;
 }
 
+/* HTML back-end: report page counts and release the buffers */
+void html_emit_end(Emitter *emitter, Config *config)
+{
+    if (config->verbose) {
+        Printf("GenDo: HTML pages written: %ld, unchanged: %ld\n",
+               emitter->pages_written, emitter->pages_skipped);
+    }
+    
+    if (emitter->page.data) {
+        FreeVec(emitter->page.data);
+        emitter->page.data = NULL;
+    }
+    if (emitter->path) {
+        FreeVec(emitter->path);
+        emitter->path = NULL;
+    }
+}
+
 /* Clean up configuration and allocated memory */
 void cleanup_config(Config *config)
 {
     LONG i;
-    Autodoc *doc;
     
-    /* Free output_guide and output_html_dir - they are allocated with AllocVec() */
-    /* Note: output_doc comes from ReadArgs and is freed by FreeArgs() */
+    /* Free output_doc, output_guide and output_html_dir - they are allocated with AllocVec() */
     if (config->output_guide) {
         FreeVec(config->output_guide);
     }
@@ -1653,27 +3034,32 @@ void cleanup_config(Config *config)
         FreeVec(config->source_files);
     }
     
-    if (config->autodocs) {
-        for (i = 0; i < config->autodoc_count; i++) {
-            doc = &config->autodocs[i];
-            if (doc->module_name) FreeVec(doc->module_name);
-            if (doc->function_name) FreeVec(doc->function_name);
-            if (doc->name) FreeVec(doc->name);
-            if (doc->synopsis) FreeVec(doc->synopsis);
-            if (doc->function_desc) FreeVec(doc->function_desc);
-            if (doc->inputs) FreeVec(doc->inputs);
-            if (doc->result) FreeVec(doc->result);
-            if (doc->example) FreeVec(doc->example);
-            if (doc->notes) FreeVec(doc->notes);
-            if (doc->bugs) FreeVec(doc->bugs);
-            if (doc->see_also) FreeVec(doc->see_also);
-        }
-        FreeVec(config->autodocs);
+    /* Entries, their strings and the index all live in the store's arena */
+    autodoc_store_free(&config->store);
+    config->autodocs = NULL;
+    config->autodoc_count = 0;
+    
+    if (config->output_doc) {
+        FreeVec(config->output_doc);
     }
     
-    if (config->output_guide) {
-        FreeVec(config->output_guide);
+    if (config->cache_file) {
+        FreeVec(config->cache_file);
+    }
+    
+    if (config->sections_spec) {
+        FreeVec(config->sections_spec);
     }
+    
+    free_pattern(&config->exclude);
+    if (config->exclude.source) {
+        FreeVec(config->exclude.source);
+    }
+    
+    if (config->stats_file) {
+        FreeVec(config->stats_file);
+    }
+    gen_stats_free(&config->stats);
 }
 
 /* Print usage information */
@@ -1694,6 +3080,14 @@ void print_usage(void)
     Printf("  NOFORMFEED            Disable form feeds\n");
     Printf("  NOTOC                 Disable table of contents\n");
     Printf("  PRESERVEORDER         Preserve original order (don't sort alphabetically)\n");
+    Printf("  BLOCKSIZE=n           Source read buffer size in bytes (default: 65536)\n");
+    Printf("  CACHE=file            Reuse autodocs of unchanged files from this cache\n");
+    Printf("  HTMLUPDATE            Only rewrite HTML pages whose content changed\n");
+    Printf("  JOBS=n                Parse source files with n processes (1 to %ld, default: 1)\n", (LONG)MAX_JOBS);
+    Printf("  SECTIONS=a,b,...      Keep extra autodoc sections such as TAGS\n");
+    Printf("  EXCLUDE=pattern       Skip files whose names match this pattern\n");
+    Printf("  STATS                 Print time and counters per phase at the end\n");
+    Printf("  STATSFILE=file        Write them to file as comma separated lines\n");
 
 }
 
@@ -1701,7 +3095,10 @@ void print_usage(void)
 int main(int argc, char *argv[])
 {
     Config config;
+    Emitter emitters[MAX_EMITTERS];
+    LONG emitter_count;
     LONG result = RETURN_OK;
+    BOOL success;
     
     /* Open required libraries */
     UtilityBase = OpenLibrary("utility.library", 37);
@@ -1720,31 +3117,37 @@ int main(int argc, char *argv[])
         goto cleanup;
     }
     
-    /* Allocate memory for autodocs */
-    config.autodocs = AllocVec(MAX_AUTODOCS * sizeof(Autodoc), MEMF_CLEAR);
-    if (!config.autodocs) {
-        Printf("GenDo: Out of memory\n");
-        result = RETURN_FAIL;
-        goto cleanup;
-    }
+    /* Create the autodoc store */
+    autodoc_store_init(&config.store, &config.arena);
     
-    /* Process source files */
-    if (config.file_count == 0) {
+    /* Process source files - a cache alone is enough to regenerate from */
+    if (config.file_count == 0 && !config.cache_file) {
         Printf("GenDo: No source files specified\n");
         result = RETURN_FAIL;
         goto cleanup;
     }
     
-    if (!process_source_files(&config)) {
+    gen_stats_begin(&config.stats, PHASE_PARSE);
+    success = process_source_files(&config);
+    gen_stats_end(&config.stats, PHASE_PARSE, config.file_count);
+    if (!success) {
         Printf("GenDo: Failed to process source files\n");
         result = RETURN_FAIL;
         goto cleanup;
     }
     
-    /* Sort autodocs alphabetically unless preserve order is requested */
-    if (!config.preserve_order) {
+    /* Index and sort the autodocs - alphabetically unless preserve order is requested */
+    gen_stats_begin(&config.stats, PHASE_SORT);
+    success = build_autodoc_index(&config);
+    if (success && !config.preserve_order) {
         sort_autodocs(&config);
     }
+    gen_stats_end(&config.stats, PHASE_SORT, config.autodoc_count);
+    if (!success) {
+        Printf("GenDo: Out of memory\n");
+        result = RETURN_FAIL;
+        goto cleanup;
+    }
     
     /* Check if any autodocs were found */
     if (config.autodoc_count == 0) {
@@ -1755,28 +3158,42 @@ int main(int argc, char *argv[])
         goto cleanup;
     }
     
-    /* Generate output files */
-    if (!generate_doc_output(&config)) {
-        Printf("GenDo: Failed to generate .doc output\n");
+    /* Register output back-ends and write them all in one pass */
+    memset(emitters, 0, sizeof(emitters));
+    emitter_count = 0;
+    emitters[emitter_count].failure_message = "GenDo: Failed to generate .doc output";
+    emitters[emitter_count].begin = doc_emit_begin;
+    emitters[emitter_count].entry = doc_emit_entry;
+    emitters[emitter_count].end = doc_emit_end;
+    emitters[emitter_count].phase = PHASE_DOC;
+    emitter_count++;
+    if (config.generate_guide) {
+        emitters[emitter_count].failure_message = "GenDo: Failed to generate AmigaGuide output";
+        emitters[emitter_count].begin = guide_emit_begin;
+        emitters[emitter_count].entry = guide_emit_entry;
+        emitters[emitter_count].end = guide_emit_end;
+        emitters[emitter_count].phase = PHASE_GUIDE;
+        emitter_count++;
+    }
+    if (config.generate_html) {
+        emitters[emitter_count].failure_message = "GenDo: Failed to generate HTML output";
+        emitters[emitter_count].begin = html_emit_begin;
+        emitters[emitter_count].entry = html_emit_entry;
+        emitters[emitter_count].end = html_emit_end;
+        emitters[emitter_count].phase = PHASE_HTML;
+        emitter_count++;
+    }
+    
+    if (!run_emitters(&config, emitters, emitter_count)) {
         result = RETURN_FAIL;
         goto cleanup;
     }
     
     if (config.generate_guide) {
-        if (!generate_guide_output(&config)) {
-            Printf("GenDo: Failed to generate AmigaGuide output\n");
-            result = RETURN_FAIL;
-            goto cleanup;
-        }
         Printf("GenDo: Generated %s and %s\n", config.output_doc, config.output_guide);
     }
     
     if (config.generate_html) {
-        if (!generate_html_output(&config)) {
-            Printf("GenDo: Failed to generate HTML output\n");
-            result = RETURN_FAIL;
-            goto cleanup;
-        }
         Printf("GenDo: Generated HTML documentation in %s/\n", config.output_html_dir);
     }
     
@@ -1784,7 +3201,17 @@ int main(int argc, char *argv[])
         Printf("GenDo: Generated %s\n", config.output_doc);
     }
     
+    if (config.cache_failed) {
+        result = RETURN_ERROR;
+    }
+    
 cleanup:
+    /* Statistics cover the run up to here, even if it failed */
+    gen_stats_print(&config.stats);
+    if (config.stats_file && !gen_stats_write(&config.stats, config.stats_file)) {
+        result = RETURN_FAIL;
+    }
+    
     /* Clean up */
     cleanup_config(&config);
     
@@ -13,6 +13,8 @@
 #include <exec/memory.h>
 #include <dos/dos.h>
 #include <dos/dosextens.h>
+#include <dos/dosasl.h>
+#include <dos/doshunks.h>
 #include <intuition/intuition.h>
 #include <intuition/intuitionbase.h>
 #include <intuition/classes.h>
@@ -20,6 +22,7 @@
 #include <intuition/gadgetclass.h>
 #include <intuition/imageclass.h>
 #include <workbench/workbench.h>
+#include <workbench/icon.h>
 #include <datatypes/datatypes.h>
 #include <datatypes/datatypesclass.h>
 #include <datatypes/pictureclass.h>
@@ -42,23 +45,70 @@
 #include <proto/datatypes.h>
 #include <proto/utility.h>
 
+#include "genlib.h"
+
 static const char *verstag = "$VER: GenIn 1.0 (01/09/25)";
 static const char *stack_cookie = "$STACK: 4096";
 
-/* Simple strlen function since utility.library doesn't have it */
-LONG my_strlen(const char *str)
-{
-    const char *s = str;
-    while (*s) s++;
-    return s - str;
-}
-
 /* Maximum sizes and limits */
-#define MAX_LINE_LENGTH 256
 #define MAX_PARAM_LENGTH 128
-#define MAX_VALUE_LENGTH 256
 #define MAX_TOOLTYPES 16
+#define TOOLTYPE_BUCKETS 32     /* Duplicate key table, power of two above MAX_TOOLTYPES */
+#define SPEC_ARENA_BLOCK 8192
+#define TREE_PATH_LENGTH 512    /* Longest path TREE mode can visit */
+#define TREE_PATTERN_LENGTH 64
+
+/* Default tool for AmigaGuide documents found by TREE */
+#define GUIDE_TOOL "SYS:Utilities/MultiView"
 #define ICON_SIZE 128
+#define ICON_HEADER_SIZE 78     /* Fixed part of a .info file (DiskObject) */
+#define ICON_DRAWER_SIZE 56     /* Old DrawerData following the header */
+#define ICON_IMAGE_SIZE 20      /* struct Image ahead of its planes */
+
+/* Offsets of the fields VERIFY=FAST reads from a .info header */
+#define INFO_GADGET_RENDER 22
+#define INFO_SELECT_RENDER 26
+#define INFO_TYPE 48
+#define INFO_DEFAULT_TOOL 50
+#define INFO_TOOLTYPES 54
+#define INFO_DRAWER_DATA 66
+#define INFO_STACK_SIZE 74
+
+/* Verification levels for VERIFY= */
+#define VERIFY_NONE 0           /* Write without checking */
+#define VERIFY_FAST 1           /* Read the written file back and check its fields */
+#define VERIFY_FULL 2           /* Also load the written file back */
+
+/* What to do about a target's existing .info */
+#define ICON_WRITE 0            /* Missing, changed or FORCE - write it */
+#define ICON_CURRENT 1          /* UPDATE found it already matches */
+#define ICON_EXISTS 2           /* Present without FORCE or UPDATE */
+#define ICON_SKIPPED 3          /* Present, and TREE leaves it alone */
+
+/* Phases timed by STATS */
+#define PHASE_PARSE 0           /* Reading the spec file or scanning the TREE */
+#define PHASE_IMAGE 1
+#define PHASE_DEFICON 2
+#define PHASE_CHECK 3
+#define PHASE_WRITE 4
+#define PHASE_VERIFY 5
+#define PHASE_COUNT 6
+
+/* Image conversion */
+#define ICON_DEPTH 3                            /* Planes in the classic image */
+#define ICON_COLOURS (1 << ICON_DEPTH)
+#define GLOW_RED_LEVELS 6                       /* OS3.5 colour cube */
+#define GLOW_GREEN_LEVELS 7
+#define GLOW_BLUE_LEVELS 6
+#define GLOW_TRANSPARENT (GLOW_RED_LEVELS * GLOW_GREEN_LEVELS * GLOW_BLUE_LEVELS)
+#define GLOW_COLOURS (GLOW_TRANSPARENT + 1)
+#define IMAGE_PLANE_SIZE(w, h) ((((w) + 15) >> 4) * 2 * (h))    /* Bytes per plane */
+#define IMAGE_CACHE_MAGIC 0x47494332                            /* 'GIC2' - bump if the conversion changes */
+
+/* How quantize_pixels() finds the transparent pixels of a picture */
+#define CLEAR_NONE 0            /* Opaque - alpha is not reliable without a mask */
+#define CLEAR_ALPHA 1           /* mskHasAlpha - alpha below half */
+#define CLEAR_COLOUR 2          /* mskHasTransparentColor - that colour's RGB */
 
 /* Parameter types */
 typedef enum {
@@ -81,42 +131,143 @@ typedef struct {
     STRPTR resolved_target;
     STRPTR image;
     STRPTR deficon;
+    STRPTR default_tool;            /* NULL uses the target itself */
     BOOL force;
+    BOOL update;
+    BOOL skip_existing;             /* TREE - an existing icon is not an error */
+    LONG verify;
 } Config;
 
+/* One icon definition from a spec file, allocated in the spec's arena */
+typedef struct IconDef {
+    struct IconDef *next;
+    Config config;                  /* Strings point into the spec text */
+} IconDef;
+
+/* A parsed spec file - the text and all its definitions share one arena */
+typedef struct {
+    GenArena arena;
+    STRPTR text;
+    IconDef *first;
+    LONG count;
+} SpecFile;
+
+/* Deficon cache entry - each template is loaded once per run and shared */
+typedef struct DeficonEntry {
+    struct DeficonEntry *next;
+    STRPTR key;                     /* DEFICON name or TYPE */
+    BOOL standard;                  /* TRUE if key is a TYPE for GetDefDiskObject */
+    struct DiskObject *diskobj;     /* NULL records a miss */
+} DeficonEntry;
+
+/* Colour lookup tables, built once per run when the first IMAGE is converted */
+typedef struct {
+    UBYTE classic_pens[4096];       /* 12-bit RGB -> nearest icon palette pen */
+    UBYTE glow_red[256];            /* Channel -> colour cube index, pre-scaled */
+    UBYTE glow_green[256];
+    UBYTE glow_blue[256];
+    struct ColorRegister glow_palette[GLOW_COLOURS];
+    ULONG plane_bits[ICON_COLOURS]; /* Pen -> bit 0 of each plane's byte, for c2p */
+} ColourTables;
+
+/* Converted IMAGE, ready to attach to a DiskObject */
+typedef struct {
+    LONG width;
+    LONG height;
+    UBYTE *glow_pens;               /* Palette-mapped OS3.5 image, width * height */
+    struct ColorRegister *palette;  /* Colour cube for glow_pens, owned by the cache */
+    UWORD *planes;                  /* Classic planar image data in chip memory */
+    struct Image image;
+} IconImage;
+
+/* Converted image cache entry, keyed by full path, datestamp and size */
+typedef struct ImageEntry {
+    struct ImageEntry *next;
+    STRPTR path;
+    struct DateStamp date;
+    LONG size;
+    IconImage *image;
+} ImageEntry;
+
+/* Header of an IMAGECACHE file, followed by the path, planes and OS3.5 pens */
+typedef struct {
+    ULONG magic;                    /* IMAGE_CACHE_MAGIC */
+    struct DateStamp date;          /* Source image datestamp and size */
+    LONG size;
+    LONG width;
+    LONG height;
+    LONG path_length;
+} ImageCacheHeader;
+
+/* Templates and tables shared by every icon generated in one run */
+typedef struct {
+    DeficonEntry *deficons;
+    ColourTables *colours;
+    ImageEntry *images;
+    STRPTR image_dir;               /* IMAGECACHE directory, or NULL */
+    GenArena arena;                 /* cache entries and their keys */
+    GenStats stats;                 /* enabled by STATS or STATSFILE */
+    LONG skipped;                   /* existing icons left alone */
+} IconCache;
+
 /* Function prototypes */
-LONG my_strlen(const char *str);
 ParamType parse_param_type(STRPTR param);
-BOOL parse_config_file(STRPTR filename, Config *config);
-BOOL parse_single_icon_config(BPTR file, Config *config);
+BOOL parse_config_file(STRPTR filename, Config *config, IconCache *cache);
+BOOL read_spec_file(STRPTR filename, Config *defaults, SpecFile *spec);
+BOOL parse_spec_text(SpecFile *spec, Config *defaults, LONG length);
+BOOL set_param(Config *config, ParamType param_type, STRPTR value, UBYTE *key_slots, BOOL *stack_set);
+BOOL add_tooltype_key(Config *config, STRPTR value, UBYTE *key_slots);
+void free_spec_file(SpecFile *spec);
+BOOL process_icon(Config *config, STRPTR spec_file, IconCache *cache);
+BOOL generate_tree(STRPTR dir, Config *defaults, IconCache *cache);
+BOOL scan_tree(STRPTR dir, Config *defaults, SpecFile *spec);
+STRPTR tree_icon_type(struct AnchorPath *anchor, UBYTE *guide_pattern, STRPTR *default_tool);
+BOOL is_executable(STRPTR path);
+STRPTR icon_default_tool(Config *config);
 BOOL validate_config(Config *config);
 struct DiskObject *load_default_icon(STRPTR deficon);
 struct DiskObject *load_standard_deficon(STRPTR type);
-STRPTR load_and_process_image(STRPTR image_path);
-BOOL create_info_file(Config *config, struct DiskObject *source_diskobj);
-void cleanup_config(Config *config);
+struct DiskObject *cached_deficon(IconCache *cache, STRPTR key, BOOL standard);
+struct DiskObject *find_source_icon(IconCache *cache, Config *config);
+void free_icon_cache(IconCache *cache);
+ColourTables *build_colour_tables(void);
+ColourTables *colour_tables(IconCache *cache);
+IconImage *alloc_icon_image(IconCache *cache, LONG width, LONG height);
+IconImage *cached_image(IconCache *cache, STRPTR image_path);
+BOOL image_cache_name(IconCache *cache, STRPTR path, STRPTR buffer, LONG size);
+IconImage *read_image_cache(IconCache *cache, ImageEntry *entry);
+void write_image_cache(IconCache *cache, ImageEntry *entry);
+IconImage *load_and_process_image(IconCache *cache, STRPTR image_path);
+void quantize_pixels(ColourTables *tables, ULONG *argb, LONG count, LONG clear, ULONG clear_rgb, UBYTE *classic, UBYTE *glow);
+void chunky_to_planar(ColourTables *tables, UBYTE *chunky, LONG width, LONG height, UWORD *planes);
+void free_icon_image(IconImage *icon_image);
+BOOL create_info_file(Config *config, struct DiskObject *source_diskobj, IconImage *icon_image, GenStats *stats);
+LONG check_existing_icon(Config *config, struct DiskObject *source_diskobj, IconImage *icon_image);
+BOOL icon_matches(struct DiskObject *existing, Config *config, struct DiskObject *source_diskobj, IconImage *icon_image);
+BOOL same_string(STRPTR a, STRPTR b);
+BOOL same_image(struct Image *a, struct Image *b);
+LONG icon_type_for(STRPTR type);
+BOOL make_info_path(STRPTR name, STRPTR buffer, LONG size);
+BOOL verify_diskobject(struct DiskObject *diskobj, Config *config, LONG expected_type);
+UWORD info_word(UBYTE *p);
+ULONG info_long(UBYTE *p);
+LONG skip_info_image(UBYTE *data, LONG size, LONG offset);
+LONG read_info_string(UBYTE *data, LONG size, LONG offset, STRPTR *text);
+BOOL verify_info_data(UBYTE *data, LONG size, Config *config, LONG expected_type);
+BOOL check_written_icon(STRPTR info_path, Config *config, LONG expected_type);
 void print_usage(void);
 STRPTR resolve_target_path(STRPTR spec_file, STRPTR target);
 BOOL validate_filename(STRPTR filename);
 STRPTR strip_info_extension(STRPTR filename);
 
-// Helper to trim whitespace in-place (returns pointer to trimmed string)
-char *trim_whitespace(char *str) {
-    char *end;
-    while (*str == ' ' || *str == '\t') str++;
-    if (*str == 0) return str;
-    end = str + my_strlen(str) - 1;
-    while (end > str && (*end == ' ' || *end == '\t')) end--;
-    *(end+1) = 0;
-    return str;
-}
-
 int main(int argc, char *argv[])
 {
     struct RDArgs *rda;
     Config config;
     STRPTR spec_file = NULL;
-    struct DiskObject *source_diskobj = NULL;
+    STRPTR tree_dir = NULL;
+    STRPTR stats_file = NULL;
+    IconCache cache;
     LONG retcode = RETURN_OK;
     BOOL success = FALSE;
     
@@ -129,17 +280,26 @@ int main(int argc, char *argv[])
         }
     }
     
-    /* Set default stack size */
+    cache.deficons = NULL;
+    cache.colours = NULL;
+    cache.images = NULL;
+    cache.image_dir = NULL;
+    cache.skipped = 0;
+    gen_arena_init(&cache.arena, SPEC_ARENA_BLOCK);
+    
+    /* Set default stack size and verification level */
     config.stack = 4096;
+    config.verify = VERIFY_FAST;
     
     /* Parse command line arguments */
     {
-        static UBYTE template[] = "SPECFILE/K,TYPE/K,STACK/K,TARGET/K,IMAGE/K,DEFICON/K,TOOLTYPE/K,FORCE/S,HELP/S";
-        LONG args[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0}; /* spec_file, type, stack, target, image, deficon, tooltype, force, help */
+        static UBYTE template[] = "SPECFILE/K,TYPE/K,STACK/K,TARGET/K,IMAGE/K,DEFICON/K,TOOLTYPE/K,FORCE/S,VERIFY/K,IMAGECACHE/K,UPDATE/S,TREE/K,STATS/S,STATSFILE/K,HELP/S";
+        static STRPTR phase_names[PHASE_COUNT] = { "parse", "image", "deficon", "check", "write", "verify" };
+        LONG args[15] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; /* spec_file, type, stack, target, image, deficon, tooltype, force, verify, imagecache, update, tree, stats, statsfile, help */
         rda = ReadArgs(template, args, NULL);
         
         /* Check if help was requested */
-        if (args[8] != 0) {
+        if (args[14] != 0) {
             print_usage();
             return RETURN_OK;
         }
@@ -150,14 +310,40 @@ int main(int argc, char *argv[])
             return RETURN_ERROR;
         }
         
-        /* Either SPECFILE or TARGET must be provided */
-        if (args[0] == 0 && args[3] == 0) {
-            Printf("GenIn: Either SPECFILE or TARGET argument is required\n");
+        /* Exactly one of SPECFILE, TARGET or TREE must be provided */
+        if (args[0] == 0 && args[3] == 0 && args[11] == 0) {
+            Printf("GenIn: Either SPECFILE, TARGET or TREE argument is required\n");
+            FreeArgs(rda);
+            return RETURN_ERROR;
+        }
+        if (args[11] != 0 && (args[0] != 0 || args[3] != 0)) {
+            Printf("GenIn: TREE cannot be combined with SPECFILE or TARGET\n");
+            FreeArgs(rda);
             return RETURN_ERROR;
         }
         
         spec_file = (STRPTR)args[0];
+        tree_dir = (STRPTR)args[11];
         config.force = (args[7] != 0);
+        config.update = (args[10] != 0);
+        
+        /* VERIFY level: NONE, FAST (default) or FULL */
+        if (args[8]) {
+            if (Stricmp((STRPTR)args[8], "NONE") == 0) {
+                config.verify = VERIFY_NONE;
+            } else if (Stricmp((STRPTR)args[8], "FAST") == 0) {
+                config.verify = VERIFY_FAST;
+            } else if (Stricmp((STRPTR)args[8], "FULL") == 0) {
+                config.verify = VERIFY_FULL;
+            } else {
+                Printf("GenIn: VERIFY must be NONE, FAST or FULL\n");
+                FreeArgs(rda);
+                return RETURN_ERROR;
+            }
+        }
+        
+        /* IMAGECACHE directory keeps converted images between runs */
+        cache.image_dir = (STRPTR)args[9];
         
         /* Set command line parameters if provided */
         if (args[1]) config.type = (STRPTR)args[1];
@@ -185,6 +371,10 @@ int main(int argc, char *argv[])
                 config.tooltype_count++;
             }
         }
+        
+        /* STATSFILE collects the same figures as STATS; the name lives until FreeArgs() */
+        stats_file = (STRPTR)args[13];
+        gen_stats_init(&cache.stats, "GenIn", phase_names, PHASE_COUNT, (BOOL)(args[12] || args[13]), (BOOL)(args[12] != 0));
     }
     
     /* Open required libraries */
@@ -199,114 +389,48 @@ int main(int argc, char *argv[])
         goto cleanup;
     }
     
-    /* Parse configuration file if provided, otherwise use command line parameters */
-    if (spec_file) {
-        if (!parse_config_file(spec_file, &config)) {
-            Printf("GenIn: Failed to parse configuration file '%s'\n", spec_file);
-            goto cleanup;
-        }
-    } else {
-        /* Use command line parameters directly */
-        if (!validate_config(&config)) {
-            Printf("GenIn: Invalid configuration\n");
-            goto cleanup;
+    /* Create the image cache directory on first use */
+    if (cache.image_dir) {
+        BPTR dir_lock = Lock(cache.image_dir, ACCESS_READ);
+        if (!dir_lock) {
+            dir_lock = CreateDir(cache.image_dir);
         }
-        
-        /* Resolve target path for command line target */
-        config.resolved_target = AllocVec(my_strlen(config.target) + 1, MEMF_CLEAR);
-        if (config.resolved_target) {
-            Strncpy((char *)config.resolved_target, (char *)config.target, my_strlen(config.target));
-            config.resolved_target[my_strlen(config.target)] = '\0';
+        if (dir_lock) {
+            UnLock(dir_lock);
         } else {
-            Printf("GenIn: Failed to resolve target path\n");
-            goto cleanup;
-        }
-        
-        /* Strip .info extension from resolved target */
-        {
-            STRPTR stripped_target = strip_info_extension(config.resolved_target);
-            if (stripped_target) {
-                FreeVec(config.resolved_target);
-                config.resolved_target = stripped_target;
-            } else {
-                Printf("GenIn: Failed to process target filename\n");
-                goto cleanup;
-            }
+            Printf("GenIn: Warning - Could not use IMAGECACHE '%s', images will not be cached on disk\n", cache.image_dir);
+            cache.image_dir = NULL;
         }
-        
-        Printf("GenIn: Resolved target path: '%s'\n", config.resolved_target);
-        
-        /* Check if target file already exists */
-        if (!config.force) {
-            UBYTE target_path[512];
-            BPTR file;
-            
-            /* Construct full path with .info extension for existence check */
-            Strncpy((char *)target_path, (char *)config.resolved_target, sizeof(target_path) - 1);
-            target_path[sizeof(target_path) - 1] = '\0';
-            if (!AddPart((char *)target_path, ".info", sizeof(target_path))) {
-                Printf("GenIn: Path too long when checking target existence\n");
-                retcode = RETURN_ERROR;
-                goto cleanup;
-            }
-            
-            file = Open((STRPTR)target_path, MODE_OLDFILE);
-            if (file) {
-                Close(file);
-                Printf("GenIn: Target file '%s' already exists. Use FORCE to overwrite.\n", (char *)target_path);
-                retcode = RETURN_ERROR;
-                goto cleanup;
-            }
-        }
-        
-        /* Load icon image */
-        if (config.image) {
-            /* TODO: Implement image loading and conversion to DiskObject */
-            Printf("GenIn: Image loading not yet implemented\n");
+    }
+    
+    /* Walk a TREE, parse a configuration file, or use command line parameters */
+    if (tree_dir) {
+        if (!generate_tree(tree_dir, &config, &cache)) {
+            retcode = RETURN_ERROR;
             goto cleanup;
-        } else if (config.deficon) {
-            /* Try ENVARC:Sys/def_ first, then fall back to standard deficon using TYPE */
-            source_diskobj = load_default_icon(config.deficon);
-                            if (!source_diskobj) {
-                    /* Fall back to standard deficon using TYPE */
-                    Printf("GenIn: Falling back to standard deficon using TYPE '%s'\n", config.type);
-                    source_diskobj = load_standard_deficon(config.type);
-                    if (!source_diskobj) {
-                        Printf("GenIn: Failed to load any deficon for '%s'\n", config.deficon);
-                        goto cleanup;
-                    }
-                }
-        } else {
-            /* No DEFICON specified, use TYPE for standard deficon */
-            Printf("GenIn: No DEFICON specified, using TYPE '%s' for standard deficon\n", config.type);
-            source_diskobj = load_standard_deficon(config.type);
-            if (!source_diskobj) {
-                Printf("GenIn: Failed to load standard deficon for type '%s'\n", config.type);
-                goto cleanup;
-            }
         }
-        
-        /* Create .info file */
-        if (!create_info_file(&config, source_diskobj)) {
-            Printf("GenIn: Failed to create .info file\n");
+    } else if (spec_file) {
+        if (!parse_config_file(spec_file, &config, &cache)) {
+            Printf("GenIn: Failed to parse configuration file '%s'\n", spec_file);
             retcode = RETURN_ERROR;
             goto cleanup;
         }
-        
-        Printf("GenIn: Successfully created '%s.info'\n", config.resolved_target);
-        success = TRUE;
+    } else if (!process_icon(&config, NULL, &cache)) {
+        retcode = RETURN_ERROR;
         goto cleanup;
     }
     
-    /* All processing is now handled in parse_config_file or the command line branch above */
     success = TRUE;
     
 cleanup:
-    /* Cleanup */
-    if (source_diskobj) {
-        FreeDiskObject(source_diskobj);
+    /* Statistics cover the run up to here, even if it failed */
+    gen_stats_print(&cache.stats);
+    if (stats_file && !gen_stats_write(&cache.stats, stats_file)) {
+        retcode = RETURN_ERROR;
     }
-    cleanup_config(&config);
+    
+    /* Cleanup - command line strings belong to ReadArgs, icons to the cache */
+    free_icon_cache(&cache);
     
     if (rda) {
         FreeArgs(rda);
@@ -332,484 +456,567 @@ ParamType parse_param_type(STRPTR param)
     return PARAM_UNKNOWN;
 }
 
-BOOL parse_config_file(STRPTR filename, Config *config)
+BOOL parse_config_file(STRPTR filename, Config *config, IconCache *cache)
 {
-    BPTR file;
-    BOOL success = TRUE;
-    
-    file = Open(filename, MODE_OLDFILE);
-    if (!file) {
-        return FALSE;
+    SpecFile spec;
+    IconDef *def;
+    BOOL success;
+    
+    /* Parse every definition first, then create the icons in order */
+    gen_stats_begin(&cache->stats, PHASE_PARSE);
+    success = read_spec_file(filename, config, &spec);
+    gen_stats_end(&cache->stats, PHASE_PARSE, spec.count);
+    if (success && spec.count == 0) {
+        Printf("GenIn: No icon definitions in '%s'\n", filename);
+        success = FALSE;
     }
     
-    /* Parse multiple icon definitions */
-    while (success) {
-        /* Parse a single icon definition */
-        success = parse_single_icon_config(file, config);
-        
-        if (success) {
-            /* Create the icon */
-            struct DiskObject *source_diskobj = NULL;
-            
-            /* Validate configuration */
-            if (!validate_config(config)) {
-                Printf("GenIn: Invalid configuration\n");
-                success = FALSE;
-                break;
-            }
-            
-            /* Resolve target path */
-            if (filename) {
-                /* Resolve relative to spec file location */
-                config->resolved_target = resolve_target_path(filename, config->target);
-            } else {
-                /* Command line target - use as-is */
-                config->resolved_target = AllocVec(my_strlen(config->target) + 1, MEMF_CLEAR);
-                if (config->resolved_target) {
-                    Strncpy((char *)config->resolved_target, (char *)config->target, my_strlen(config->target));
-                    config->resolved_target[my_strlen(config->target)] = '\0';
-                }
-            }
-            
-            if (!config->resolved_target) {
-                Printf("GenIn: Failed to resolve target path\n");
-                success = FALSE;
-                break;
-            }
-            
-            /* Strip .info extension from resolved target */
-            {
-                STRPTR stripped_target = strip_info_extension(config->resolved_target);
-                if (stripped_target) {
-                    FreeVec(config->resolved_target);
-                    config->resolved_target = stripped_target;
-                } else {
-                    Printf("GenIn: Failed to process target filename\n");
-                    success = FALSE;
-                    break;
-                }
-            }
-            
-            Printf("GenIn: Resolved target path: '%s'\n", config->resolved_target);
-            
-            /* Check if target file already exists */
-            if (!config->force) {
-                UBYTE target_path[512];
-                BPTR check_file;
-                
-                /* Construct full path with .info extension for existence check */
-                Strncpy((char *)target_path, (char *)config->resolved_target, sizeof(target_path) - 1);
-                target_path[sizeof(target_path) - 1] = '\0';
-                if (!AddPart((char *)target_path, ".info", sizeof(target_path))) {
-                    Printf("GenIn: Path too long when checking target existence\n");
-                    success = FALSE;
-                    break;
-                }
-                
-                check_file = Open((STRPTR)target_path, MODE_OLDFILE);
-                if (check_file) {
-                    Close(check_file);
-                    Printf("GenIn: Target file '%s' already exists. Use FORCE to overwrite.\n", (char *)target_path);
-                    success = FALSE;
-                    break;
-                }
-            }
-            
-            /* Load icon image */
-            if (config->image) {
-                /* TODO: Implement image loading and conversion to DiskObject */
-                Printf("GenIn: Image loading not yet implemented\n");
-                success = FALSE;
-                break;
-            } else if (config->deficon) {
-                /* Try ENVARC:Sys/def_ first, then fall back to standard deficon using TYPE */
-                source_diskobj = load_default_icon(config->deficon);
-                if (!source_diskobj) {
-                    /* Fall back to standard deficon using TYPE */
-                    Printf("GenIn: Falling back to standard deficon using TYPE '%s'\n", config->type);
-                    source_diskobj = load_standard_deficon(config->type);
-                    if (!source_diskobj) {
-                        Printf("GenIn: Failed to load any deficon for '%s'\n", config->deficon);
-                        success = FALSE;
-                        break;
-                    }
-                }
-            } else {
-                /* No DEFICON specified, use TYPE for standard deficon */
-                Printf("GenIn: No DEFICON specified, using TYPE '%s' for standard deficon\n", config->type);
-                source_diskobj = load_standard_deficon(config->type);
-                if (!source_diskobj) {
-                    Printf("GenIn: Failed to load standard deficon for type '%s'\n", config->type);
-                    success = FALSE;
-                    break;
-                }
-            }
-            
-            /* Create .info file */
-            if (!create_info_file(config, source_diskobj)) {
-                Printf("GenIn: Failed to create .info file\n");
-                success = FALSE;
-                break;
-            }
-            
-            Printf("GenIn: Successfully created '%s.info'\n", config->resolved_target);
-            
-            /* Cleanup for this icon */
-            if (source_diskobj) {
-                FreeDiskObject(source_diskobj);
-            }
-            cleanup_config(config);
-            
-            /* Reset config for next icon */
-            {
-                UBYTE *ptr = (UBYTE *)config;
-                LONG i;
-                for (i = 0; i < sizeof(Config); i++) {
-                    ptr[i] = 0;
-                }
-            }
-        }
+    for (def = spec.first; success && def; def = def->next) {
+        success = process_icon(&def->config, filename, cache);
     }
     
-    Close(file);
+    free_spec_file(&spec);
     return success;
 }
 
-BOOL parse_single_icon_config(BPTR file, Config *config)
+BOOL read_spec_file(STRPTR filename, Config *defaults, SpecFile *spec)
 {
-    UBYTE line[MAX_LINE_LENGTH];
-    UBYTE param[MAX_PARAM_LENGTH];
-    UBYTE value[MAX_VALUE_LENGTH];
-    LONG len;
+    LONG length;
+    
+    gen_arena_init(&spec->arena, SPEC_ARENA_BLOCK);
+    spec->first = NULL;
+    spec->count = 0;
+    
+    /* Read the whole spec with one Read() into the arena that holds its definitions */
+    spec->text = gen_read_file(&spec->arena, filename, &length);
+    if (!spec->text) {
+        Printf("GenIn: Could not read '%s'\n", filename);
+        return FALSE;
+    }
+    
+    return parse_spec_text(spec, defaults, length);
+}
+
+BOOL parse_spec_text(SpecFile *spec, Config *defaults, LONG length)
+{
+    STRPTR line = spec->text;
+    STRPTR end = spec->text + length;
+    STRPTR next;
     STRPTR equals_pos;
-    STRPTR value_start;
-    STRPTR comment_pos;
+    STRPTR value;
+    STRPTR name;
+    IconDef *def = NULL;
+    IconDef **tail = &spec->first;
+    UBYTE key_slots[TOOLTYPE_BUCKETS];
+    BOOL stack_set = FALSE;
     ParamType param_type;
-    BOOL found_any_params = FALSE;
-    char *trimmed_param;
-    char *trimmed_value;
+    LONG len;
+    LONG i;
     
-    while (FGets(file, line, sizeof(line))) {
-        /* Get length of the line */
-        len = my_strlen((char *)line);
+    /* Lines are terminated and trimmed in place, so values point into the text */
+    for (; line < end; line = next) {
+        for (next = line; next < end && *next != '\n'; next++);
+        *next++ = '\0';
+        len = next - line - 1;
         
-        /* Remove newline and carriage return */
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
-            len--;
-        }
+        /* Remove carriage return */
         if (len > 0 && line[len-1] == '\r') {
-            line[len-1] = '\0';
-            len--;
+            line[--len] = '\0';
         }
         
-        /* Skip empty lines */
+        /* An empty line ends the current icon definition */
         if (len == 0) {
-            /* If we found any parameters, this empty line ends the icon definition */
-            if (found_any_params) {
-                return TRUE;
-            }
+            def = NULL;
             continue;
         }
         
-        /* Handle comments - find ';' and truncate line */
-        comment_pos = NULL;
-        {
-            LONG i;
-            for (i = 0; line[i] != '\0'; i++) {
-                if (line[i] == ';') {
-                    comment_pos = &line[i];
-                    break;
-                }
+        /* Handle comments - ';' truncates the line */
+        equals_pos = NULL;
+        for (i = 0; line[i] != '\0'; i++) {
+            if (line[i] == ';') {
+                line[i] = '\0';
+                break;
+            }
+            if (line[i] == '=' && !equals_pos) {
+                equals_pos = &line[i];
             }
         }
-        if (comment_pos) {
-            *comment_pos = '\0';
-            len = comment_pos - (STRPTR)line;
+        if (!equals_pos) {
+            continue;
         }
         
-        /* Skip lines that are only comments or whitespace */
-        if (len == 0) {
+        /* Parameter name */
+        if (equals_pos - line >= MAX_PARAM_LENGTH) {
             continue;
         }
+        *equals_pos = '\0';
+        name = gen_trim((char *)line);
         
-        /* Find equals sign */
-        {
-            LONG i;
-            equals_pos = NULL;
-            for (i = 0; line[i] != '\0'; i++) {
-                if (line[i] == '=') {
-                    equals_pos = &line[i];
-                    break;
-                }
+        /* Value, with surrounding quotes removed */
+        value = gen_trim((char *)equals_pos + 1);
+        if (*value == '"') {
+            value++;
+            len = gen_strlen((char *)value);
+            if (len > 0 && value[len-1] == '"') {
+                value[len-1] = '\0';
             }
         }
-        if (!equals_pos) {
-            continue;
-        }
         
-        /* Extract parameter name */
-        len = equals_pos - (STRPTR)line;
-        if (len >= sizeof(param)) {
+        param_type = parse_param_type(name);
+        if (param_type == PARAM_UNKNOWN) {
+            Printf("GenIn: Unknown parameter '%s'\n", (char *)name);
             continue;
         }
-        CopyMem(line, param, len);
-        param[len] = '\0';
-        
-        /* Extract value */
-        value_start = equals_pos + 1;
-        while (*value_start == ' ' || *value_start == '\t') {
-            value_start++;
-        }
         
-        /* Handle quoted values */
-        if (*value_start == '"') {
-            value_start++; /* Skip opening quote */
-            {
-                LONG value_len = my_strlen((char *)value_start);
-                if (value_len > 0 && value_start[value_len-1] == '"') {
-                    /* Temporarily null-terminate before the closing quote */
-                    value_start[value_len-1] = '\0';
-                }
+        /* The first known parameter starts a new icon definition */
+        if (!def) {
+            def = gen_alloc_clear(&spec->arena, sizeof(IconDef));
+            if (!def) {
+                Printf("GenIn: Out of memory parsing spec file\n");
+                return FALSE;
             }
+            def->config.force = defaults->force;
+            def->config.update = defaults->update;
+            def->config.verify = defaults->verify;
+            def->config.stack = 4096;
+            *tail = def;
+            tail = &def->next;
+            spec->count++;
+            for (i = 0; i < TOOLTYPE_BUCKETS; i++) {
+                key_slots[i] = 0;
+            }
+            stack_set = FALSE;
         }
         
-        /* Copy value */
-        Strncpy((char *)value, (char *)value_start, sizeof(value) - 1);
-        value[sizeof(value) - 1] = '\0';
-        
-        /* Trim whitespace from parameter and value */
-        trimmed_param = trim_whitespace((char *)param);
-        trimmed_value = trim_whitespace((char *)value);
-        
-        /* Parse parameter */
-        param_type = parse_param_type(trimmed_param);
-        switch (param_type) {
-            case PARAM_TYPE:
-                if (config->type) {
-                    Printf("GenIn: Multiple TYPE parameters specified\n");
-                    return FALSE;
-                }
-                {
-                    LONG value_len = my_strlen(trimmed_value);
-                    config->type = AllocVec(value_len + 1, MEMF_CLEAR);
-                    {
-                        LONG i;
-                        for (i = 0; i < value_len; i++) {
-                            config->type[i] = trimmed_value[i];
-                        }
-                        config->type[value_len] = '\0';
-                    }
-                }
-                Printf("GenIn: Parsed TYPE = '%s'\n", config->type);
-                found_any_params = TRUE;
-                break;
-                
-            case PARAM_STACK:
-                if (config->stack != 4096) {
-                    Printf("GenIn: Multiple STACK parameters specified\n");
-                    return FALSE;
-                }
-                config->stack = 0;
-                {
-                    LONG i;
-                    for (i = 0; trimmed_value[i] != '\0'; i++) {
-                        if (trimmed_value[i] >= '0' && trimmed_value[i] <= '9') {
-                            config->stack = config->stack * 10 + (trimmed_value[i] - '0');
-                        }
-                    }
-                }
-                Printf("GenIn: Parsed STACK = %ld\n", config->stack);
-                found_any_params = TRUE;
-                break;
-                
-            case PARAM_TOOLTYPE:
-                if (config->tooltype_count >= MAX_TOOLTYPES) {
-                    Printf("GenIn: Too many TOOLTYPE entries\n");
-                    return FALSE;
-                }
-                
-                /* Check if this is a key=value format */
-                {
-                    STRPTR key_end = NULL;
-                    LONG i;
-                    for (i = 0; trimmed_value[i] != '\0'; i++) {
-                        if (trimmed_value[i] == '=') {
-                            key_end = &trimmed_value[i];
-                            break;
-                        }
-                    }
-                    if (key_end) {
-                        /* Extract key for uniqueness check */
-                        LONG key_len = key_end - (char *)trimmed_value;
-                        UBYTE key[MAX_PARAM_LENGTH];
-                        LONG i;
-                        
-                        if (key_len >= sizeof(key)) {
-                            Printf("GenIn: TOOLTYPE key too long\n");
-                            return FALSE;
-                        }
-                        
-                        CopyMem(trimmed_value, key, key_len);
-                        key[key_len] = '\0';
-                        
-                        /* Check for duplicate keys */
-                        for (i = 0; i < config->tooltype_count; i++) {
-                            STRPTR existing_key_end = NULL;
-                            LONG j;
-                            for (j = 0; config->tooltypes[i][j] != '\0'; j++) {
-                                if (config->tooltypes[i][j] == '=') {
-                                    existing_key_end = &config->tooltypes[i][j];
-                                    break;
-                                }
-                            }
-                            if (existing_key_end) {
-                                LONG existing_key_len = existing_key_end - config->tooltypes[i];
-                                if (existing_key_len == key_len && 
-                                    Stricmp((char *)key, config->tooltypes[i]) == 0) {
-                                    Printf("GenIn: Duplicate TOOLTYPE key '%s'\n", (char *)key);
-                                    return FALSE;
-                                }
-                            }
-                        }
-                    }
-                }
-                
-                {
-                    LONG value_len = my_strlen(trimmed_value);
-                    config->tooltypes[config->tooltype_count] = AllocVec(value_len + 1, MEMF_CLEAR);
-                    {
-                        LONG i;
-                        for (i = 0; i < value_len; i++) {
-                            config->tooltypes[config->tooltype_count][i] = trimmed_value[i];
-                        }
-                        config->tooltypes[config->tooltype_count][value_len] = '\0';
-                    }
-                    config->tooltype_count++;
-                }
-                Printf("GenIn: Parsed TOOLTYPE[%ld] = '%s'\n", config->tooltype_count - 1, config->tooltypes[config->tooltype_count - 1]);
-                found_any_params = TRUE;
-                break;
-                
-            case PARAM_TARGET:
-                if (config->target) {
-                    Printf("GenIn: Multiple TARGET parameters specified\n");
-                    return FALSE;
-                }
-                {
-                    LONG value_len = my_strlen(trimmed_value);
-                    config->target = AllocVec(value_len + 1, MEMF_CLEAR);
-                    {
-                        LONG i;
-                        for (i = 0; i < value_len; i++) {
-                            config->target[i] = trimmed_value[i];
-                        }
-                        config->target[value_len] = '\0';
-                    }
-                }
-                Printf("GenIn: Parsed TARGET = '%s'\n", config->target);
-                found_any_params = TRUE;
-                break;
-                
-            case PARAM_IMAGE:
-                if (config->image) {
-                    Printf("GenIn: Multiple IMAGE parameters specified\n");
-                    return FALSE;
-                }
-                {
-                    LONG value_len = my_strlen(trimmed_value);
-                    config->image = AllocVec(value_len + 1, MEMF_CLEAR);
-                    {
-                        LONG i;
-                        for (i = 0; i < value_len; i++) {
-                            config->image[i] = trimmed_value[i];
-                        }
-                        config->image[value_len] = '\0';
-                    }
-                }
-                Printf("GenIn: Parsed IMAGE = '%s'\n", config->image);
-                found_any_params = TRUE;
-                break;
-                
-            case PARAM_DEFICON:
-                if (config->deficon) {
-                    Printf("GenIn: Multiple DEFICON parameters specified\n");
-                    return FALSE;
-                }
-                {
-                    LONG value_len = my_strlen(trimmed_value);
-                    config->deficon = AllocVec(value_len + 1, MEMF_CLEAR);
-                    {
-                        LONG i;
-                        for (i = 0; i < value_len; i++) {
-                            config->deficon[i] = trimmed_value[i];
-                        }
-                        config->deficon[value_len] = '\0';
-                    }
-                }
-                Printf("GenIn: Parsed DEFICON = '%s'\n", config->deficon);
-                found_any_params = TRUE;
-                break;
-                
-            default:
-                Printf("GenIn: Unknown parameter '%s'\n", (char *)trimmed_param);
-                break;
+        if (!set_param(&def->config, param_type, value, key_slots, &stack_set)) {
+            return FALSE;
         }
     }
     
-    /* End of file - return TRUE if we found any parameters */
-    return found_any_params;
+    return TRUE;
 }
 
-BOOL validate_config(Config *config)
+BOOL set_param(Config *config, ParamType param_type, STRPTR value, UBYTE *key_slots, BOOL *stack_set)
 {
-    STRPTR stripped_target;
-    STRPTR filename_part;
     LONG i;
-    LONG last_slash;
     
-    if (!config->type) {
-        Printf("GenIn: TYPE parameter is mandatory\n");
-        return FALSE;
+    switch (param_type) {
+        case PARAM_TYPE:
+            if (config->type) {
+                Printf("GenIn: Multiple TYPE parameters specified\n");
+                return FALSE;
+            }
+            config->type = value;
+            Printf("GenIn: Parsed TYPE = '%s'\n", config->type);
+            break;
+            
+        case PARAM_STACK:
+            if (*stack_set) {
+                Printf("GenIn: Multiple STACK parameters specified\n");
+                return FALSE;
+            }
+            *stack_set = TRUE;
+            config->stack = 0;
+            for (i = 0; value[i] != '\0'; i++) {
+                if (value[i] >= '0' && value[i] <= '9') {
+                    config->stack = config->stack * 10 + (value[i] - '0');
+                }
+            }
+            Printf("GenIn: Parsed STACK = %ld\n", config->stack);
+            break;
+            
+        case PARAM_TOOLTYPE:
+            if (config->tooltype_count >= MAX_TOOLTYPES) {
+                Printf("GenIn: Too many TOOLTYPE entries\n");
+                return FALSE;
+            }
+            if (!add_tooltype_key(config, value, key_slots)) {
+                return FALSE;
+            }
+            config->tooltypes[config->tooltype_count++] = value;
+            Printf("GenIn: Parsed TOOLTYPE[%ld] = '%s'\n", config->tooltype_count - 1, config->tooltypes[config->tooltype_count - 1]);
+            break;
+            
+        case PARAM_TARGET:
+            if (config->target) {
+                Printf("GenIn: Multiple TARGET parameters specified\n");
+                return FALSE;
+            }
+            config->target = value;
+            Printf("GenIn: Parsed TARGET = '%s'\n", config->target);
+            break;
+            
+        case PARAM_IMAGE:
+            if (config->image) {
+                Printf("GenIn: Multiple IMAGE parameters specified\n");
+                return FALSE;
+            }
+            config->image = value;
+            Printf("GenIn: Parsed IMAGE = '%s'\n", config->image);
+            break;
+            
+        case PARAM_DEFICON:
+            if (config->deficon) {
+                Printf("GenIn: Multiple DEFICON parameters specified\n");
+                return FALSE;
+            }
+            config->deficon = value;
+            Printf("GenIn: Parsed DEFICON = '%s'\n", config->deficon);
+            break;
     }
     
-    if (!config->target) {
-        Printf("GenIn: TARGET parameter is mandatory\n");
+    return TRUE;
+}
+
+BOOL add_tooltype_key(Config *config, STRPTR value, UBYTE *key_slots)
+{
+    LONG key_len;
+    LONG slot;
+    STRPTR existing;
+    
+    /* Only key=value tooltypes take part in the uniqueness check */
+    for (key_len = 0; value[key_len] != '\0' && value[key_len] != '='; key_len++);
+    if (value[key_len] != '=') {
+        return TRUE;
+    }
+    if (key_len >= MAX_PARAM_LENGTH) {
+        Printf("GenIn: TOOLTYPE key too long\n");
         return FALSE;
     }
     
-    if (!config->type) {
-        Printf("GenIn: TYPE parameter is mandatory\n");
-        return FALSE;
+    /* Open addressing - each slot holds a tooltype index + 1 */
+    for (slot = gen_hash_nocase(value, key_len) & (TOOLTYPE_BUCKETS - 1); key_slots[slot]; slot = (slot + 1) & (TOOLTYPE_BUCKETS - 1)) {
+        existing = config->tooltypes[key_slots[slot] - 1];
+        if (existing[key_len] == '=' && Strnicmp(existing, value, key_len) == 0) {
+            Printf("GenIn: Duplicate TOOLTYPE key in '%s'\n", (char *)value);
+            return FALSE;
+        }
     }
+    key_slots[slot] = config->tooltype_count + 1;
+    return TRUE;
+}
+
+void free_spec_file(SpecFile *spec)
+{
+    gen_arena_free(&spec->arena);
+    spec->text = NULL;
+    spec->first = NULL;
+    spec->count = 0;
+}
+
+BOOL process_icon(Config *config, STRPTR spec_file, IconCache *cache)
+{
+    struct DiskObject *source_diskobj;
+    IconImage *icon_image = NULL;
+    STRPTR path;
+    BOOL success = FALSE;
+    LONG existing;
     
-    if (config->image && config->deficon) {
-        Printf("GenIn: IMAGE and DEFICON cannot be specified together\n");
+    /* Validate configuration */
+    if (!validate_config(config)) {
+        Printf("GenIn: Invalid configuration\n");
         return FALSE;
     }
     
-    /* Strip .info extension from target for validation */
-    stripped_target = strip_info_extension(config->target);
-    if (!stripped_target) {
+    /* Resolve relative to the spec file location - command line targets are used as-is */
+    if (spec_file) {
+        path = resolve_target_path(spec_file, config->target);
+        if (!path) {
+            Printf("GenIn: Failed to resolve target path\n");
+            return FALSE;
+        }
+        config->resolved_target = strip_info_extension(path);
+        FreeVec(path);
+    } else {
+        config->resolved_target = strip_info_extension(config->target);
+    }
+    if (!config->resolved_target) {
         Printf("GenIn: Failed to process target filename\n");
         return FALSE;
     }
     
-    /* Extract filename part for validation */
-    filename_part = stripped_target;
-    last_slash = -1;
-    for (i = 0; stripped_target[i] != '\0'; i++) {
-        if (stripped_target[i] == '/' || stripped_target[i] == ':') {
-            last_slash = i;
+    Printf("GenIn: Resolved target path: '%s'\n", config->resolved_target);
+    
+    /* Load icon image, relative to the spec file like TARGET */
+    if (config->image) {
+        gen_stats_begin(&cache->stats, PHASE_IMAGE);
+        if (spec_file) {
+            path = resolve_target_path(spec_file, config->image);
+            if (path) {
+                icon_image = cached_image(cache, path);
+                FreeVec(path);
+            }
+        } else {
+            icon_image = cached_image(cache, config->image);
+        }
+        gen_stats_end(&cache->stats, PHASE_IMAGE, 1);
+        if (!icon_image) {
+            Printf("GenIn: Failed to load image '%s'\n", config->image);
+            goto done;
         }
     }
-    if (last_slash >= 0) {
-        filename_part = &stripped_target[last_slash + 1];
+    
+    /* The TYPE deficon supplies everything the image does not */
+    gen_stats_begin(&cache->stats, PHASE_DEFICON);
+    source_diskobj = find_source_icon(cache, config);
+    gen_stats_end(&cache->stats, PHASE_DEFICON, 1);
+    if (!source_diskobj) {
+        goto done;
     }
     
-    /* Validate filename */
-    if (!validate_filename(filename_part)) {
-        Printf("GenIn: Invalid filename '%s' in TARGET\n", filename_part);
+    /* Check an existing .info - refuse, skip it if current, or replace it */
+    gen_stats_begin(&cache->stats, PHASE_CHECK);
+    existing = check_existing_icon(config, source_diskobj, icon_image);
+    gen_stats_end(&cache->stats, PHASE_CHECK, 1);
+    if (existing == ICON_EXISTS) {
+        goto done;
+    }
+    if (existing == ICON_SKIPPED) {
+        cache->skipped++;
+        success = TRUE;
+        goto done;
+    }
+    if (existing == ICON_CURRENT) {
+        Printf("GenIn: '%s.info' is up to date\n", config->resolved_target);
+        success = TRUE;
+        goto done;
+    }
+    
+    /* Create .info file */
+    if (!create_info_file(config, source_diskobj, icon_image, &cache->stats)) {
+        Printf("GenIn: Failed to create .info file\n");
+        goto done;
+    }
+    
+    Printf("GenIn: Successfully created '%s.info'\n", config->resolved_target);
+    success = TRUE;
+    
+done:
+    /* The source and image stay in the cache */
+    FreeVec(config->resolved_target);
+    config->resolved_target = NULL;
+    return success;
+}
+
+BOOL generate_tree(STRPTR dir, Config *defaults, IconCache *cache)
+{
+    SpecFile tree;
+    IconDef *def;
+    LONG failed = 0;
+    LONG skipped = cache->skipped;
+    
+    /* Collect the whole tree first - writing .info files while
+       MatchNext() is still scanning a directory could upset the scan */
+    gen_stats_begin(&cache->stats, PHASE_PARSE);
+    if (!scan_tree(dir, defaults, &tree)) {
+        gen_stats_end(&cache->stats, PHASE_PARSE, tree.count);
+        free_spec_file(&tree);
+        return FALSE;
+    }
+    gen_stats_end(&cache->stats, PHASE_PARSE, tree.count);
+    
+    for (def = tree.first; def; def = def->next) {
+        if (SetSignal(0, SIGBREAKF_CTRL_C) & SIGBREAKF_CTRL_C) {
+            Printf("GenIn: ***Break\n");
+            failed++;
+            break;
+        }
+        if (!process_icon(&def->config, NULL, cache)) {
+            failed++;
+        }
+    }
+    
+    skipped = cache->skipped - skipped;
+    Printf("GenIn: %ld icons in '%s', %ld skipped, %ld failed\n", tree.count, dir, skipped, failed);
+    free_spec_file(&tree);
+    return failed == 0;
+}
+
+BOOL scan_tree(STRPTR dir, Config *defaults, SpecFile *spec)
+{
+    struct AnchorPath *anchor;
+    UBYTE pattern[TREE_PATH_LENGTH];
+    UBYTE guide_pattern[TREE_PATTERN_LENGTH];
+    IconDef **tail = &spec->first;
+    IconDef *def;
+    STRPTR type;
+    STRPTR default_tool;
+    LONG length;
+    LONG error;
+    BOOL success = TRUE;
+    
+    gen_arena_init(&spec->arena, SPEC_ARENA_BLOCK);
+    spec->text = NULL;
+    spec->first = NULL;
+    spec->count = 0;
+    anchor = AllocVec(sizeof(struct AnchorPath) + TREE_PATH_LENGTH, MEMF_CLEAR);
+    if (!anchor) {
+        Printf("GenIn: Out of memory\n");
+        return FALSE;
+    }
+    anchor->ap_Strlen = TREE_PATH_LENGTH;
+    anchor->ap_BreakBits = SIGBREAKF_CTRL_C;
+    
+    ParsePatternNoCase("#?.guide", guide_pattern, sizeof(guide_pattern));
+    
+    /* Everything below dir, but not dir itself - its icon lives in the parent */
+    pattern[0] = '\0';
+    if (!AddPart(pattern, dir, sizeof(pattern)) || !AddPart(pattern, "#?", sizeof(pattern))) {
+        Printf("GenIn: TREE path too long\n");
+        FreeVec(anchor);
+        return FALSE;
+    }
+    
+    error = MatchFirst(pattern, anchor);
+    while (!error) {
+        type = NULL;
+        if (anchor->ap_Info.fib_DirEntryType > 0) {
+            /* Enter each drawer once, skip it on the way back out */
+            if (anchor->ap_Flags & APF_DIDDIR) {
+                anchor->ap_Flags &= ~APF_DIDDIR;
+            } else {
+                anchor->ap_Flags |= APF_DODIR;
+                type = "drawer";
+                default_tool = NULL;
+            }
+        } else {
+            type = tree_icon_type(anchor, guide_pattern, &default_tool);
+        }
+        
+        if (type) {
+            length = gen_strlen((char *)anchor->ap_Buf);
+            def = gen_alloc_clear(&spec->arena, sizeof(IconDef) + length + 1);
+            if (!def) {
+                Printf("GenIn: Out of memory scanning '%s'\n", dir);
+                success = FALSE;
+                break;
+            }
+            
+            /* The path lives in the arena straight after its definition */
+            def->config.target = (STRPTR)(def + 1);
+            CopyMem(anchor->ap_Buf, def->config.target, length + 1);
+            def->config.type = type;
+            def->config.default_tool = default_tool;
+            def->config.stack = defaults->stack;
+            def->config.force = defaults->force;
+            def->config.update = defaults->update;
+            def->config.skip_existing = TRUE;
+            def->config.verify = defaults->verify;
+            *tail = def;
+            tail = &def->next;
+            spec->count++;
+        }
+        error = MatchNext(anchor);
+    }
+    MatchEnd(anchor);
+    
+    if (error == ERROR_BREAK) {
+        Printf("GenIn: ***Break\n");
+        success = FALSE;
+    } else if (success && error != ERROR_NO_MORE_ENTRIES) {
+        Printf("GenIn: Could not scan TREE '%s'\n", dir);
+        success = FALSE;
+    }
+    
+    FreeVec(anchor);
+    return success;
+}
+
+STRPTR tree_icon_type(struct AnchorPath *anchor, UBYTE *guide_pattern, STRPTR *default_tool)
+{
+    STRPTR name = anchor->ap_Info.fib_FileName;
+    LONG length = gen_strlen((char *)name);
+    
+    *default_tool = NULL;
+    
+    /* Existing icons are targets' icons, not targets */
+    if (length >= 5 && Stricmp(name + length - 5, ".info") == 0) {
+        return NULL;
+    }
+    if (MatchPatternNoCase(guide_pattern, name)) {
+        *default_tool = GUIDE_TOOL;
+        return "project";
+    }
+    if (is_executable((STRPTR)anchor->ap_Buf)) {
+        return "tool";
+    }
+    
+    /* No rule for anything else */
+    return NULL;
+}
+
+BOOL is_executable(STRPTR path)
+{
+    BPTR file;
+    ULONG hunk = 0;
+    
+    /* AmigaDOS load files start with a HUNK_HEADER longword */
+    file = Open(path, MODE_OLDFILE);
+    if (!file) {
+        return FALSE;
+    }
+    if (Read(file, &hunk, sizeof(hunk)) != sizeof(hunk)) {
+        hunk = 0;
+    }
+    Close(file);
+    
+    return hunk == HUNK_HEADER;
+}
+
+STRPTR icon_default_tool(Config *config)
+{
+    return config->default_tool ? config->default_tool : config->resolved_target;
+}
+
+BOOL validate_config(Config *config)
+{
+    STRPTR stripped_target;
+    STRPTR filename_part;
+    LONG i;
+    LONG last_slash;
+    
+    if (!config->type) {
+        Printf("GenIn: TYPE parameter is mandatory\n");
+        return FALSE;
+    }
+    
+    if (!config->target) {
+        Printf("GenIn: TARGET parameter is mandatory\n");
+        return FALSE;
+    }
+    
+    if (!config->type) {
+        Printf("GenIn: TYPE parameter is mandatory\n");
+        return FALSE;
+    }
+    
+    if (config->image && config->deficon) {
+        Printf("GenIn: IMAGE and DEFICON cannot be specified together\n");
+        return FALSE;
+    }
+    
+    /* Strip .info extension from target for validation */
+    stripped_target = strip_info_extension(config->target);
+    if (!stripped_target) {
+        Printf("GenIn: Failed to process target filename\n");
+        return FALSE;
+    }
+    
+    /* Extract filename part for validation */
+    filename_part = stripped_target;
+    last_slash = -1;
+    for (i = 0; stripped_target[i] != '\0'; i++) {
+        if (stripped_target[i] == '/' || stripped_target[i] == ':') {
+            last_slash = i;
+        }
+    }
+    if (last_slash >= 0) {
+        filename_part = &stripped_target[last_slash + 1];
+    }
+    
+    /* Validate filename */
+    if (!validate_filename(filename_part)) {
+        Printf("GenIn: Invalid filename '%s' in TARGET\n", filename_part);
         FreeVec(stripped_target);
         return FALSE;
     }
@@ -887,46 +1094,827 @@ struct DiskObject *load_standard_deficon(STRPTR type)
     return diskobj;
 }
 
-STRPTR load_and_process_image(STRPTR image_path)
+struct DiskObject *cached_deficon(IconCache *cache, STRPTR key, BOOL standard)
+{
+    DeficonEntry *entry;
+    
+    /* Return the cached result, including a remembered miss */
+    for (entry = cache->deficons; entry; entry = entry->next) {
+        if (entry->standard == standard && Stricmp(entry->key, key) == 0) {
+            if (entry->diskobj) {
+                Printf("GenIn: Using cached deficon '%s'\n", key);
+            }
+            return entry->diskobj;
+        }
+    }
+    
+    entry = gen_alloc(&cache->arena, sizeof(DeficonEntry));
+    if (entry) {
+        entry->key = gen_arena_string(&cache->arena, key, gen_strlen(key));
+    }
+    if (!entry || !entry->key) {
+        Printf("GenIn: Out of memory caching deficon '%s'\n", key);
+        return NULL;
+    }
+    entry->standard = standard;
+    
+    if (standard) {
+        entry->diskobj = load_standard_deficon(key);
+    } else {
+        entry->diskobj = load_default_icon(key);
+    }
+    
+    entry->next = cache->deficons;
+    cache->deficons = entry;
+    return entry->diskobj;
+}
+
+struct DiskObject *find_source_icon(IconCache *cache, Config *config)
+{
+    struct DiskObject *source_diskobj;
+    
+    if (config->deficon) {
+        /* Try ENVARC:Sys/def_ first, then fall back to standard deficon using TYPE */
+        source_diskobj = cached_deficon(cache, config->deficon, FALSE);
+        if (!source_diskobj) {
+            /* Fall back to standard deficon using TYPE */
+            Printf("GenIn: Falling back to standard deficon using TYPE '%s'\n", config->type);
+            source_diskobj = cached_deficon(cache, config->type, TRUE);
+            if (!source_diskobj) {
+                Printf("GenIn: Failed to load any deficon for '%s'\n", config->deficon);
+            }
+        }
+    } else {
+        /* No DEFICON specified, use TYPE for standard deficon */
+        Printf("GenIn: No DEFICON specified, using TYPE '%s' for standard deficon\n", config->type);
+        source_diskobj = cached_deficon(cache, config->type, TRUE);
+        if (!source_diskobj) {
+            Printf("GenIn: Failed to load standard deficon for type '%s'\n", config->type);
+        }
+    }
+    
+    return source_diskobj;
+}
+
+void free_icon_cache(IconCache *cache)
+{
+    DeficonEntry *entry;
+    ImageEntry *image_entry;
+    
+    /* The entries themselves go with the arena */
+    for (entry = cache->deficons; entry; entry = entry->next) {
+        if (entry->diskobj) FreeDiskObject(entry->diskobj);
+    }
+    cache->deficons = NULL;
+    
+    for (image_entry = cache->images; image_entry; image_entry = image_entry->next) {
+        free_icon_image(image_entry->image);
+    }
+    cache->images = NULL;
+    
+    if (cache->colours) {
+        FreeVec(cache->colours);
+        cache->colours = NULL;
+    }
+    gen_arena_free(&cache->arena);
+}
+
+/* Classic icon palette (MagicWB, first four are the Workbench pens) */
+static const UBYTE icon_palette[ICON_COLOURS][3] = {
+    {0x95, 0x95, 0x95}, {0x00, 0x00, 0x00}, {0xff, 0xff, 0xff}, {0x3b, 0x67, 0xa2},
+    {0x7b, 0x7b, 0x7b}, {0xaf, 0xaf, 0xaf}, {0xaa, 0x90, 0x7c}, {0xff, 0xa9, 0x97}
+};
+
+ColourTables *build_colour_tables(void)
+{
+    ColourTables *tables;
+    LONG i, p, r, g, b;
+    
+    tables = AllocVec(sizeof(ColourTables), MEMF_CLEAR);
+    if (!tables) {
+        return NULL;
+    }
+    
+    /* Nearest classic pen for every 12-bit colour, so pixels never search */
+    for (i = 0; i < 4096; i++) {
+        LONG best_pen = 0;
+        LONG best_distance = 0x7fffffff;
+        r = ((i >> 8) & 0x0f) * 0x11;
+        g = ((i >> 4) & 0x0f) * 0x11;
+        b = (i & 0x0f) * 0x11;
+        for (p = 0; p < ICON_COLOURS; p++) {
+            LONG dr = r - icon_palette[p][0];
+            LONG dg = g - icon_palette[p][1];
+            LONG db = b - icon_palette[p][2];
+            LONG distance = dr * dr * 3 + dg * dg * 4 + db * db * 2;
+            if (distance < best_distance) {
+                best_distance = distance;
+                best_pen = p;
+            }
+        }
+        tables->classic_pens[i] = best_pen;
+    }
+    
+    /* OS3.5 colour cube - each channel maps straight to its pre-scaled index */
+    for (i = 0; i < 256; i++) {
+        tables->glow_red[i] = ((i * (GLOW_RED_LEVELS - 1) + 127) / 255) * (GLOW_GREEN_LEVELS * GLOW_BLUE_LEVELS);
+        tables->glow_green[i] = ((i * (GLOW_GREEN_LEVELS - 1) + 127) / 255) * GLOW_BLUE_LEVELS;
+        tables->glow_blue[i] = (i * (GLOW_BLUE_LEVELS - 1) + 127) / 255;
+    }
+    for (r = 0; r < GLOW_RED_LEVELS; r++) {
+        for (g = 0; g < GLOW_GREEN_LEVELS; g++) {
+            for (b = 0; b < GLOW_BLUE_LEVELS; b++) {
+                struct ColorRegister *colour = &tables->glow_palette[(r * GLOW_GREEN_LEVELS + g) * GLOW_BLUE_LEVELS + b];
+                colour->red = r * 255 / (GLOW_RED_LEVELS - 1);
+                colour->green = g * 255 / (GLOW_GREEN_LEVELS - 1);
+                colour->blue = b * 255 / (GLOW_BLUE_LEVELS - 1);
+            }
+        }
+    }
+    
+    /* Spread each pen's plane bits into bit 0 of one byte per plane */
+    for (p = 0; p < ICON_COLOURS; p++) {
+        ULONG bits = 0;
+        for (i = 0; i < ICON_DEPTH; i++) {
+            if (p & (1 << i)) {
+                bits |= 1UL << (24 - i * 8);
+            }
+        }
+        tables->plane_bits[p] = bits;
+    }
+    
+    return tables;
+}
+
+void quantize_pixels(ColourTables *tables, ULONG *argb, LONG count, LONG clear, ULONG clear_rgb, UBYTE *classic, UBYTE *glow)
+{
+    ULONG pixel;
+    UBYTE r, g, b;
+    
+    while (count-- > 0) {
+        pixel = *argb++;
+        if ((clear == CLEAR_ALPHA && pixel < 0x80000000UL) ||
+            (clear == CLEAR_COLOUR && (pixel & 0x00ffffffUL) == clear_rgb)) {
+            /* Mostly transparent - background pen and the cube's clear colour */
+            *classic++ = 0;
+            *glow++ = GLOW_TRANSPARENT;
+            continue;
+        }
+        r = (UBYTE)(pixel >> 16);
+        g = (UBYTE)(pixel >> 8);
+        b = (UBYTE)pixel;
+        *classic++ = tables->classic_pens[((r & 0xf0) << 4) | (g & 0xf0) | (b >> 4)];
+        *glow++ = tables->glow_red[r] + tables->glow_green[g] + tables->glow_blue[b];
+    }
+}
+
+void chunky_to_planar(ColourTables *tables, UBYTE *chunky, LONG width, LONG height, UWORD *planes)
+{
+    UBYTE *plane[ICON_DEPTH];
+    LONG row_bytes = ((width + 15) >> 4) << 1;
+    LONG plane_size = IMAGE_PLANE_SIZE(width, height);
+    LONG full_groups = width >> 3;
+    LONG x, y, i;
+    ULONG bits;
+    
+    for (i = 0; i < ICON_DEPTH; i++) {
+        plane[i] = (UBYTE *)planes + i * plane_size;
+    }
+    
+    /* Eight pixels per step: shift in one bit per plane, then store a byte per plane */
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < full_groups; x++) {
+            bits = tables->plane_bits[chunky[0]];
+            bits = (bits << 1) | tables->plane_bits[chunky[1]];
+            bits = (bits << 1) | tables->plane_bits[chunky[2]];
+            bits = (bits << 1) | tables->plane_bits[chunky[3]];
+            bits = (bits << 1) | tables->plane_bits[chunky[4]];
+            bits = (bits << 1) | tables->plane_bits[chunky[5]];
+            bits = (bits << 1) | tables->plane_bits[chunky[6]];
+            bits = (bits << 1) | tables->plane_bits[chunky[7]];
+            chunky += 8;
+            for (i = 0; i < ICON_DEPTH; i++) {
+                plane[i][x] = (UBYTE)(bits >> (24 - i * 8));
+            }
+        }
+        if (width & 7) {
+            /* Partial group at the end of the row, padded with pen 0 */
+            bits = 0;
+            for (i = 0; i < 8; i++) {
+                bits <<= 1;
+                if (i < (width & 7)) {
+                    bits |= tables->plane_bits[*chunky++];
+                }
+            }
+            for (i = 0; i < ICON_DEPTH; i++) {
+                plane[i][x] = (UBYTE)(bits >> (24 - i * 8));
+            }
+        }
+        for (i = 0; i < ICON_DEPTH; i++) {
+            plane[i] += row_bytes;
+        }
+    }
+}
+
+ColourTables *colour_tables(IconCache *cache)
+{
+    if (!cache->colours) {
+        cache->colours = build_colour_tables();
+        if (!cache->colours) {
+            Printf("GenIn: Out of memory building colour tables\n");
+        }
+    }
+    return cache->colours;
+}
+
+IconImage *alloc_icon_image(IconCache *cache, LONG width, LONG height)
+{
+    IconImage *icon_image;
+    
+    icon_image = AllocVec(sizeof(IconImage), MEMF_CLEAR);
+    if (!icon_image) {
+        return NULL;
+    }
+    icon_image->width = width;
+    icon_image->height = height;
+    icon_image->glow_pens = AllocVec(width * height, MEMF_ANY);
+    icon_image->planes = AllocVec(IMAGE_PLANE_SIZE(width, height) * ICON_DEPTH, MEMF_CHIP | MEMF_CLEAR);
+    if (!icon_image->glow_pens || !icon_image->planes) {
+        free_icon_image(icon_image);
+        return NULL;
+    }
+    
+    icon_image->image.LeftEdge = 0;
+    icon_image->image.TopEdge = 0;
+    icon_image->image.Width = width;
+    icon_image->image.Height = height;
+    icon_image->image.Depth = ICON_DEPTH;
+    icon_image->image.ImageData = icon_image->planes;
+    icon_image->image.PlanePick = ICON_COLOURS - 1;
+    icon_image->image.PlaneOnOff = 0;
+    icon_image->image.NextImage = NULL;
+    icon_image->palette = cache->colours->glow_palette;
+    
+    return icon_image;
+}
+
+IconImage *cached_image(IconCache *cache, STRPTR image_path)
+{
+    struct FileInfoBlock *fib;
+    ImageEntry *entry;
+    BPTR lock;
+    UBYTE full_path[512];
+    
+    /* The key is the full path plus the file's datestamp and size */
+    lock = Lock(image_path, ACCESS_READ);
+    if (!lock) {
+        Printf("GenIn: Image '%s' not found\n", image_path);
+        return NULL;
+    }
+    fib = AllocDosObject(DOS_FIB, NULL);
+    if (!fib || !Examine(lock, fib) || !NameFromLock(lock, (STRPTR)full_path, sizeof(full_path))) {
+        Printf("GenIn: Could not examine image '%s'\n", image_path);
+        if (fib) FreeDosObject(DOS_FIB, fib);
+        UnLock(lock);
+        return NULL;
+    }
+    UnLock(lock);
+    
+    for (entry = cache->images; entry; entry = entry->next) {
+        if (Stricmp(entry->path, (STRPTR)full_path) == 0 &&
+            entry->size == fib->fib_Size &&
+            CompareDates(&entry->date, &fib->fib_Date) == 0) {
+            Printf("GenIn: Using cached image '%s'\n", image_path);
+            FreeDosObject(DOS_FIB, fib);
+            return entry->image;
+        }
+    }
+    
+    entry = gen_alloc_clear(&cache->arena, sizeof(ImageEntry));
+    if (entry) {
+        entry->path = gen_arena_string(&cache->arena, (char *)full_path, gen_strlen((char *)full_path));
+    }
+    if (!entry || !entry->path) {
+        Printf("GenIn: Out of memory caching image '%s'\n", image_path);
+        FreeDosObject(DOS_FIB, fib);
+        return NULL;
+    }
+    entry->date = fib->fib_Date;
+    entry->size = fib->fib_Size;
+    FreeDosObject(DOS_FIB, fib);
+    
+    /* Only decode through datatypes when the disk cache has no current copy */
+    if (cache->image_dir) {
+        entry->image = read_image_cache(cache, entry);
+    }
+    if (!entry->image) {
+        entry->image = load_and_process_image(cache, image_path);
+        if (entry->image && cache->image_dir) {
+            write_image_cache(cache, entry);
+        }
+    }
+    if (!entry->image) {
+        return NULL;
+    }
+    
+    entry->next = cache->images;
+    cache->images = entry;
+    return entry->image;
+}
+
+BOOL image_cache_name(IconCache *cache, STRPTR path, STRPTR buffer, LONG size)
+{
+    static const char hex[] = "0123456789abcdef";
+    UBYTE name[16];
+    ULONG hash;
+    LONG i;
+    
+    /* One file per source path, so changed artwork replaces its old entry */
+    hash = gen_hash_nocase(path, gen_strlen(path));
+    for (i = 0; i < 8; i++) {
+        name[i] = hex[(hash >> (28 - i * 4)) & 0x0f];
+    }
+    CopyMem(".image", &name[8], 7);
+    
+    Strncpy((char *)buffer, (char *)cache->image_dir, size - 1);
+    buffer[size - 1] = '\0';
+    return AddPart((char *)buffer, (char *)name, size);
+}
+
+IconImage *read_image_cache(IconCache *cache, ImageEntry *entry)
+{
+    ImageCacheHeader header;
+    IconImage *icon_image = NULL;
+    UBYTE cache_path[512];
+    UBYTE stored_path[512];
+    LONG plane_bytes;
+    BPTR file;
+    
+    if (!image_cache_name(cache, entry->path, cache_path, sizeof(cache_path))) {
+        return NULL;
+    }
+    file = Open((STRPTR)cache_path, MODE_OLDFILE);
+    if (!file) {
+        return NULL;
+    }
+    
+    /* Any mismatch in the header is a miss - the entry is rewritten after decoding */
+    if (Read(file, &header, sizeof(header)) == sizeof(header) &&
+        header.magic == IMAGE_CACHE_MAGIC &&
+        header.size == entry->size &&
+        CompareDates(&header.date, &entry->date) == 0 &&
+        header.path_length == gen_strlen(entry->path) &&
+        header.path_length < sizeof(stored_path) &&
+        header.width > 0 && header.width <= ICON_SIZE &&
+        header.height > 0 && header.height <= ICON_SIZE &&
+        Read(file, stored_path, header.path_length) == header.path_length) {
+        stored_path[header.path_length] = '\0';
+        if (Stricmp((STRPTR)stored_path, entry->path) == 0 && colour_tables(cache)) {
+            icon_image = alloc_icon_image(cache, header.width, header.height);
+            if (icon_image) {
+                plane_bytes = IMAGE_PLANE_SIZE(header.width, header.height) * ICON_DEPTH;
+                if (Read(file, icon_image->planes, plane_bytes) != plane_bytes ||
+                    Read(file, icon_image->glow_pens, header.width * header.height) != header.width * header.height) {
+                    free_icon_image(icon_image);
+                    icon_image = NULL;
+                }
+            }
+        }
+    }
+    Close(file);
+    
+    if (icon_image) {
+        Printf("GenIn: Loaded image '%s' from image cache\n", entry->path);
+    }
+    return icon_image;
+}
+
+void write_image_cache(IconCache *cache, ImageEntry *entry)
+{
+    ImageCacheHeader header;
+    IconImage *icon_image = entry->image;
+    UBYTE cache_path[512];
+    LONG plane_bytes;
+    BOOL written;
+    BPTR file;
+    
+    if (!image_cache_name(cache, entry->path, cache_path, sizeof(cache_path))) {
+        return;
+    }
+    file = Open((STRPTR)cache_path, MODE_NEWFILE);
+    if (!file) {
+        Printf("GenIn: Warning - Could not write image cache '%s'\n", (char *)cache_path);
+        return;
+    }
+    
+    header.magic = IMAGE_CACHE_MAGIC;
+    header.date = entry->date;
+    header.size = entry->size;
+    header.width = icon_image->width;
+    header.height = icon_image->height;
+    header.path_length = gen_strlen(entry->path);
+    plane_bytes = IMAGE_PLANE_SIZE(icon_image->width, icon_image->height) * ICON_DEPTH;
+    
+    written = Write(file, &header, sizeof(header)) == sizeof(header) &&
+              Write(file, entry->path, header.path_length) == header.path_length &&
+              Write(file, icon_image->planes, plane_bytes) == plane_bytes &&
+              Write(file, icon_image->glow_pens, icon_image->width * icon_image->height) == icon_image->width * icon_image->height;
+    Close(file);
+    
+    /* Never leave a partial entry behind */
+    if (!written) {
+        Printf("GenIn: Warning - Could not write image cache '%s'\n", (char *)cache_path);
+        DeleteFile((STRPTR)cache_path);
+    }
+}
+
+IconImage *load_and_process_image(IconCache *cache, STRPTR image_path)
 {
     Object *dt_object;
-    STRPTR icon_data;
-    LONG icon_size;
+    struct BitMapHeader *bmhd = NULL;
+    struct pdtBlitPixelArray read_pixels;
+    struct gpLayout layout;
+    IconImage *icon_image;
+    ULONG *argb;
+    UBYTE *classic;
+    LONG width, height;
+    LONG clear = CLEAR_NONE;
+    ULONG clear_rgb = 0;
+    
+    if (!colour_tables(cache)) {
+        return NULL;
+    }
     
-    /* Load image using datatypes */
+    /* Load image using datatypes, keeping true colour data (V43 picture.datatype) */
     dt_object = NewDTObject(image_path,
                            DTA_SourceType, DTST_FILE,
                            DTA_GroupID, GID_PICTURE,
+                           PDTA_DestMode, PMODE_V43,
+                           PDTA_Remap, FALSE,
                            TAG_END);
     
     if (!dt_object) {
+        Printf("GenIn: Could not open image '%s' as a picture\n", image_path);
         return NULL;
     }
     
     /* Get bitmap header */
-    /* TODO: Implement proper datatypes bitmap extraction */
-    /* For now, we'll create a basic icon structure */
+    if (GetDTAttrs(dt_object, PDTA_BitMapHeader, &bmhd, TAG_END) == 0 || !bmhd) {
+        Printf("GenIn: No bitmap header in image '%s'\n", image_path);
+        DisposeDTObject(dt_object);
+        return NULL;
+    }
+    width = bmhd->bmh_Width;
+    height = bmhd->bmh_Height;
+    
+    /* Only a picture with a mask says which pixels are clear */
+    if (bmhd->bmh_Masking == mskHasAlpha) {
+        clear = CLEAR_ALPHA;
+    } else if (bmhd->bmh_Masking == mskHasTransparentColor) {
+        struct ColorRegister *colours = NULL;
+        ULONG colour_count = 0;
+        
+        if (GetDTAttrs(dt_object, PDTA_ColorRegisters, &colours, PDTA_NumColors, &colour_count, TAG_END) == 2 &&
+            colours && bmhd->bmh_Transparent < colour_count) {
+            clear = CLEAR_COLOUR;
+            clear_rgb = ((ULONG)colours[bmhd->bmh_Transparent].red << 16) |
+                        ((ULONG)colours[bmhd->bmh_Transparent].green << 8) |
+                        colours[bmhd->bmh_Transparent].blue;
+        }
+    }
     
-    /* Create basic icon data */
-    icon_size = sizeof(struct DiskObject) + (ICON_SIZE * ICON_SIZE / 8); /* Basic icon data */
-    icon_data = AllocVec(icon_size, MEMF_CLEAR);
-    if (!icon_data) {
+    if (width <= 0 || height <= 0 || width > ICON_SIZE || height > ICON_SIZE) {
+        Printf("GenIn: Image '%s' is %ldx%ld, icons must be %ldx%ld or smaller\n",
+               image_path, width, height, (LONG)ICON_SIZE, (LONG)ICON_SIZE);
         DisposeDTObject(dt_object);
         return NULL;
     }
     
-    /* TODO: Implement proper bitmap to icon conversion */
-    /* This would involve:
-       - Converting to Amiga palette (4 colors for standard icons)
-       - Creating proper icon bitmap planes
-       - Handling transparency
-       - Scaling if needed */
+    icon_image = alloc_icon_image(cache, width, height);
+    argb = AllocVec(width * height * 4, MEMF_ANY);
+    classic = AllocVec(width * height, MEMF_ANY);
+    if (!icon_image || !argb || !classic) {
+        Printf("GenIn: Out of memory converting image '%s'\n", image_path);
+        if (argb) FreeVec(argb);
+        if (classic) FreeVec(classic);
+        free_icon_image(icon_image);
+        DisposeDTObject(dt_object);
+        return NULL;
+    }
     
+    /* Decode the picture and read it back as ARGB */
+    layout.MethodID = DTM_PROCLAYOUT;
+    layout.gpl_GInfo = NULL;
+    layout.gpl_Initial = 1;
+    DoDTMethodA(dt_object, NULL, NULL, (Msg)&layout);
+    read_pixels.MethodID = PDTM_READPIXELARRAY;
+    read_pixels.pbpa_PixelData = argb;
+    read_pixels.pbpa_PixelFormat = PBPAFMT_ARGB;
+    read_pixels.pbpa_PixelArrayMod = width * 4;
+    read_pixels.pbpa_Left = 0;
+    read_pixels.pbpa_Top = 0;
+    read_pixels.pbpa_Width = width;
+    read_pixels.pbpa_Height = height;
+    if (!DoDTMethodA(dt_object, NULL, NULL, (Msg)&read_pixels)) {
+        Printf("GenIn: Could not read pixels from '%s' (picture.datatype V43 required)\n", image_path);
+        FreeVec(argb);
+        FreeVec(classic);
+        free_icon_image(icon_image);
+        DisposeDTObject(dt_object);
+        return NULL;
+    }
     DisposeDTObject(dt_object);
-    return icon_data;
+    
+    /* Map to both palettes in one pass, then build the classic planes */
+    quantize_pixels(cache->colours, argb, width * height, clear, clear_rgb, classic, icon_image->glow_pens);
+    chunky_to_planar(cache->colours, classic, width, height, icon_image->planes);
+    FreeVec(argb);
+    FreeVec(classic);
+    
+    Printf("GenIn: Converted image '%s' (%ldx%ld)\n", image_path, width, height);
+    return icon_image;
+}
+
+void free_icon_image(IconImage *icon_image)
+{
+    if (!icon_image) {
+        return;
+    }
+    if (icon_image->glow_pens) FreeVec(icon_image->glow_pens);
+    if (icon_image->planes) FreeVec(icon_image->planes);
+    FreeVec(icon_image);
+}
+
+LONG icon_type_for(STRPTR type)
+{
+    if (Stricmp(type, "tool") == 0) return WBTOOL;
+    if (Stricmp(type, "project") == 0) return WBPROJECT;
+    if (Stricmp(type, "drawer") == 0) return WBDRAWER;
+    return WBDISK;
+}
+
+BOOL make_info_path(STRPTR name, STRPTR buffer, LONG size)
+{
+    LONG len = gen_strlen(name);
+    
+    /* Append .info directly - AddPart() would insert a path separator */
+    if (len + 6 > size) {
+        return FALSE;
+    }
+    CopyMem(name, buffer, len);
+    CopyMem(".info", buffer + len, 6);
+    return TRUE;
+}
+
+BOOL verify_diskobject(struct DiskObject *diskobj, Config *config, LONG expected_type)
+{
+    BOOL valid = TRUE;
+    LONG loaded_count;
+    LONG i;
+    
+    /* Check magic and version */
+    if (diskobj->do_Magic != WB_DISKMAGIC || diskobj->do_Version != WB_DISKVERSION) {
+        Printf("GenIn: Warning - Invalid magic/version\n");
+        valid = FALSE;
+    }
+    
+    /* Check type */
+    if (diskobj->do_Type != expected_type) {
+        Printf("GenIn: Warning - Type mismatch (expected %ld, got %ld)\n", expected_type, (LONG)diskobj->do_Type);
+        valid = FALSE;
+    }
+    
+    /* Check stack size */
+    if (diskobj->do_StackSize != config->stack) {
+        Printf("GenIn: Warning - Stack size mismatch (expected %ld, got %ld)\n", config->stack, diskobj->do_StackSize);
+        valid = FALSE;
+    }
+    
+    /* Check tooltype count and content */
+    if (config->tooltype_count > 0) {
+        loaded_count = 0;
+        if (diskobj->do_ToolTypes) {
+            while (diskobj->do_ToolTypes[loaded_count] != NULL) {
+                loaded_count++;
+            }
+        }
+        if (loaded_count != config->tooltype_count) {
+            Printf("GenIn: Warning - Tooltype count mismatch (expected %ld, got %ld)\n", config->tooltype_count, loaded_count);
+            valid = FALSE;
+        } else {
+            /* Check each tooltype string */
+            for (i = 0; i < config->tooltype_count; i++) {
+                if (!diskobj->do_ToolTypes[i] || Stricmp(diskobj->do_ToolTypes[i], config->tooltypes[i]) != 0) {
+                    Printf("GenIn: Warning - Tooltype mismatch at index %ld\n", i);
+                    valid = FALSE;
+                    break;
+                }
+            }
+        }
+    }
+    
+    /* Check default tool */
+    if (!diskobj->do_DefaultTool || Stricmp(diskobj->do_DefaultTool, icon_default_tool(config)) != 0) {
+        Printf("GenIn: Warning - Default tool mismatch\n");
+        valid = FALSE;
+    }
+    
+    return valid;
+}
+
+UWORD info_word(UBYTE *p)
+{
+    /* .info files are big-endian, so read them a byte at a time */
+    return (UWORD)((p[0] << 8) | p[1]);
+}
+
+ULONG info_long(UBYTE *p)
+{
+    return ((ULONG)p[0] << 24) | ((ULONG)p[1] << 16) | ((ULONG)p[2] << 8) | (ULONG)p[3];
+}
+
+LONG skip_info_image(UBYTE *data, LONG size, LONG offset)
+{
+    UBYTE *image;
+    LONG plane_size;
+    
+    /* Step over an Image and its planes without decoding them; -1 if truncated */
+    if (offset + ICON_IMAGE_SIZE > size) {
+        return -1;
+    }
+    image = data + offset;
+    offset += ICON_IMAGE_SIZE;
+    if (info_long(image + 10)) {
+        plane_size = (((LONG)info_word(image + 4) + 15) >> 4) * 2 * (LONG)info_word(image + 6);
+        offset += plane_size * (LONG)info_word(image + 8);
+        if (offset > size) {
+            return -1;
+        }
+    }
+    return offset;
 }
 
-BOOL create_info_file(Config *config, struct DiskObject *source_diskobj)
+LONG read_info_string(UBYTE *data, LONG size, LONG offset, STRPTR *text)
+{
+    LONG length;
+    
+    /* A length longword counting the NUL, then the text; -1 if truncated */
+    if (offset + 4 > size) {
+        return -1;
+    }
+    length = (LONG)info_long(data + offset);
+    offset += 4;
+    if (length < 1 || length > size - offset || data[offset + length - 1] != '\0') {
+        return -1;
+    }
+    *text = (STRPTR)(data + offset);
+    return offset + length;
+}
+
+BOOL verify_info_data(UBYTE *data, LONG size, Config *config, LONG expected_type)
+{
+    BOOL valid = TRUE;
+    STRPTR text;
+    LONG offset;
+    LONG loaded_count;
+    LONG i;
+    
+    /* Check magic and version */
+    if (info_word(data) != WB_DISKMAGIC || info_word(data + 2) != WB_DISKVERSION) {
+        Printf("GenIn: Warning - Invalid magic/version\n");
+        return FALSE;
+    }
+    
+    /* Check type */
+    if ((LONG)data[INFO_TYPE] != expected_type) {
+        Printf("GenIn: Warning - Type mismatch (expected %ld, got %ld)\n", expected_type, (LONG)data[INFO_TYPE]);
+        valid = FALSE;
+    }
+    
+    /* Check stack size */
+    if ((LONG)info_long(data + INFO_STACK_SIZE) != config->stack) {
+        Printf("GenIn: Warning - Stack size mismatch (expected %ld, got %ld)\n", config->stack, (LONG)info_long(data + INFO_STACK_SIZE));
+        valid = FALSE;
+    }
+    
+    /* The strings follow the drawer data and the images */
+    offset = ICON_HEADER_SIZE;
+    if (info_long(data + INFO_DRAWER_DATA)) {
+        offset += ICON_DRAWER_SIZE;
+        if (offset > size) {
+            offset = -1;
+        }
+    }
+    if (offset >= 0 && info_long(data + INFO_GADGET_RENDER)) {
+        offset = skip_info_image(data, size, offset);
+    }
+    if (offset >= 0 && info_long(data + INFO_SELECT_RENDER)) {
+        offset = skip_info_image(data, size, offset);
+    }
+    
+    /* Check default tool */
+    if (offset >= 0) {
+        if (info_long(data + INFO_DEFAULT_TOOL)) {
+            offset = read_info_string(data, size, offset, &text);
+            if (offset >= 0 && Stricmp(text, icon_default_tool(config)) != 0) {
+                Printf("GenIn: Warning - Default tool mismatch\n");
+                valid = FALSE;
+            }
+        } else {
+            Printf("GenIn: Warning - Default tool mismatch\n");
+            valid = FALSE;
+        }
+    }
+    
+    /* Check tooltype count and content */
+    if (offset >= 0 && config->tooltype_count > 0) {
+        loaded_count = 0;
+        if (info_long(data + INFO_TOOLTYPES)) {
+            if (offset + 4 > size) {
+                offset = -1;
+            } else {
+                /* Stored as the byte size of the NULL-terminated array */
+                loaded_count = (LONG)(info_long(data + offset) / 4) - 1;
+                offset += 4;
+            }
+        }
+        if (offset >= 0 && loaded_count != config->tooltype_count) {
+            Printf("GenIn: Warning - Tooltype count mismatch (expected %ld, got %ld)\n", config->tooltype_count, loaded_count);
+            valid = FALSE;
+        } else {
+            /* Check each tooltype string */
+            for (i = 0; offset >= 0 && i < config->tooltype_count; i++) {
+                offset = read_info_string(data, size, offset, &text);
+                if (offset >= 0 && Stricmp(text, config->tooltypes[i]) != 0) {
+                    Printf("GenIn: Warning - Tooltype mismatch at index %ld\n", i);
+                    valid = FALSE;
+                    break;
+                }
+            }
+        }
+    }
+    
+    if (offset < 0) {
+        Printf("GenIn: Warning - Written file is truncated (%ld bytes)\n", size);
+        valid = FALSE;
+    }
+    
+    return valid;
+}
+
+BOOL check_written_icon(STRPTR info_path, Config *config, LONG expected_type)
+{
+    struct FileInfoBlock *fib;
+    BPTR lock;
+    BPTR file;
+    UBYTE *data;
+    LONG size = -1;
+    BOOL valid = FALSE;
+    
+    lock = Lock(info_path, ACCESS_READ);
+    if (!lock) {
+        Printf("GenIn: Warning - Could not find written file '%s'\n", info_path);
+        return FALSE;
+    }
+    
+    fib = AllocDosObject(DOS_FIB, NULL);
+    if (fib) {
+        if (Examine(lock, fib)) {
+            size = fib->fib_Size;
+        }
+        FreeDosObject(DOS_FIB, fib);
+    }
+    UnLock(lock);
+    
+    if (size < ICON_HEADER_SIZE) {
+        Printf("GenIn: Warning - Written file is truncated (%ld bytes)\n", size);
+        return FALSE;
+    }
+    
+    /* Bring the whole file in with one Read() and check it there */
+    data = (UBYTE *)AllocVec(size, MEMF_ANY);
+    if (!data) {
+        Printf("GenIn: Out of memory for validation\n");
+        return FALSE;
+    }
+    
+    file = Open(info_path, MODE_OLDFILE);
+    if (file) {
+        if (Read(file, data, size) == size) {
+            valid = verify_info_data(data, size, config, expected_type);
+        } else {
+            Printf("GenIn: Warning - Could not read written file '%s'\n", info_path);
+        }
+        Close(file);
+    } else {
+        Printf("GenIn: Warning - Could not read written file '%s'\n", info_path);
+    }
+    
+    FreeVec(data);
+    return valid;
+}
+
+BOOL create_info_file(Config *config, struct DiskObject *source_diskobj, IconImage *icon_image, GenStats *stats)
 {
     struct DiskObject *diskobj;
     struct DiskObject *test_obj;
@@ -934,32 +1922,21 @@ BOOL create_info_file(Config *config, struct DiskObject *source_diskobj)
     UBYTE target_path[512];
     STRPTR *tooltype_array = NULL;
     BOOL result;
-    BOOL valid;
     LONG expected_type;
-    LONG loaded_count;
     
-    /* Use resolved target path and add .info extension */
-    Strncpy((char *)target_path, (char *)config->resolved_target, sizeof(target_path) - 1);
-    target_path[sizeof(target_path) - 1] = '\0';
-    
-    /* Add .info extension */
-    if (!AddPart((char *)target_path, ".info", sizeof(target_path))) {
+    /* Path of the file icon.library writes, for FAST verification */
+    if (!make_info_path(config->resolved_target, target_path, sizeof(target_path))) {
         Printf("GenIn: Path too long when constructing target path\n");
         return FALSE;
     }
     
     /* Create disk object using icon.library */
-    if (Stricmp(config->type, "tool") == 0) {
-        diskobj = NewDiskObject(WBTOOL);
-    } else if (Stricmp(config->type, "project") == 0) {
-        diskobj = NewDiskObject(WBPROJECT);
-    } else if (Stricmp(config->type, "drawer") == 0) {
-        diskobj = NewDiskObject(WBDRAWER);
-    } else {
-        diskobj = NewDiskObject(WBDISK);
-    }
+    gen_stats_begin(stats, PHASE_WRITE);
+    expected_type = icon_type_for(config->type);
+    diskobj = NewDiskObject(expected_type);
     
     if (!diskobj) {
+        gen_stats_end(stats, PHASE_WRITE, 0);
         return FALSE;
     }
     
@@ -974,6 +1951,27 @@ BOOL create_info_file(Config *config, struct DiskObject *source_diskobj)
         Printf("GenIn: Copied icon data from source deficon\n");
     }
     
+    /* A converted IMAGE replaces the deficon's image */
+    if (icon_image) {
+        diskobj->do_Gadget.Width = icon_image->width;
+        diskobj->do_Gadget.Height = icon_image->height;
+        diskobj->do_Gadget.Flags = GFLG_GADGIMAGE | GFLG_GADGHCOMP;
+        diskobj->do_Gadget.GadgetRender = &icon_image->image;
+        diskobj->do_Gadget.SelectRender = NULL;
+        
+        /* icon.library V44 also stores the palette-mapped OS3.5 image */
+        if (IconBase->lib_Version >= 44) {
+            IconControl(diskobj,
+                        ICONCTRLA_SetWidth, icon_image->width,
+                        ICONCTRLA_SetHeight, icon_image->height,
+                        ICONCTRLA_SetImageData1, icon_image->glow_pens,
+                        ICONCTRLA_SetPalette1, icon_image->palette,
+                        ICONCTRLA_SetPaletteSize1, GLOW_COLOURS,
+                        ICONCTRLA_SetTransparentColor1, GLOW_TRANSPARENT,
+                        TAG_END);
+        }
+    }
+    
     /* Set stack (always has a default value now) */
     diskobj->do_StackSize = config->stack;
     
@@ -981,133 +1979,221 @@ BOOL create_info_file(Config *config, struct DiskObject *source_diskobj)
     if (config->tooltype_count > 0) {
         /* Create NULL-terminated tooltype array */
         tooltype_array = (STRPTR *)AllocVec(sizeof(STRPTR) * (config->tooltype_count + 1), MEMF_CLEAR);
-        if (tooltype_array) {
-            for (i = 0; i < config->tooltype_count; i++) {
-                tooltype_array[i] = config->tooltypes[i];
-            }
-            tooltype_array[config->tooltype_count] = NULL; /* NULL terminate */
-            diskobj->do_ToolTypes = tooltype_array;
+        if (!tooltype_array) {
+            Printf("GenIn: Out of memory for tooltypes\n");
+            FreeDiskObject(diskobj);
+            gen_stats_end(stats, PHASE_WRITE, 0);
+            return FALSE;
         }
+        for (i = 0; i < config->tooltype_count; i++) {
+            tooltype_array[i] = config->tooltypes[i];
+        }
+        tooltype_array[config->tooltype_count] = NULL; /* NULL terminate */
     }
     
     /* Set default tool */
-    diskobj->do_DefaultTool = config->resolved_target;
+    diskobj->do_DefaultTool = icon_default_tool(config);
     
     /* Set position */
     diskobj->do_CurrentX = NO_ICON_POSITION;
     diskobj->do_CurrentY = NO_ICON_POSITION;
     
-    /* Set drawer */
-    diskobj->do_DrawerData = NULL;
+    /* Set drawer - drawer icons keep the DrawerData NewDiskObject() made */
+    if (expected_type != WBDRAWER) {
+        diskobj->do_DrawerData = NULL;
+    }
     
     /* Set tool types */
     diskobj->do_ToolTypes = tooltype_array;
     
-    /* Create .info file using icon.library */
-    result = PutDiskObject((STRPTR)target_path, diskobj);
+    /* Create .info file using icon.library, which adds the .info suffix */
+    result = PutDiskObject(config->resolved_target, diskobj);
     
     /* Cleanup */
     if (tooltype_array) {
         FreeVec(tooltype_array);
     }
     FreeDiskObject(diskobj);
+    gen_stats_end(stats, PHASE_WRITE, result ? 1 : 0);
     
-    /* Validate the saved file by loading it back */
-    if (result) {
-        test_obj = GetDiskObject((STRPTR)target_path);
-        if (!test_obj) {
-            Printf("GenIn: Warning - Created file but could not load it back for validation\n");
+    if (!result) {
+        return FALSE;
+    }
+    
+    if (config->verify == VERIFY_FAST) {
+        /* Read the written file back and check its header and strings */
+        gen_stats_begin(stats, PHASE_VERIFY);
+        result = check_written_icon((STRPTR)target_path, config, expected_type);
+        gen_stats_end(stats, PHASE_VERIFY, 1);
+        if (!result) {
+            Printf("GenIn: Validation failed - file may be corrupted\n");
             return FALSE;
         }
-        
-        /* Validate basic properties */
-        valid = TRUE;
-        
-        /* Check magic and version */
-        if (test_obj->do_Magic != WB_DISKMAGIC || test_obj->do_Version != WB_DISKVERSION) {
-            Printf("GenIn: Warning - Invalid magic/version in saved file\n");
-            valid = FALSE;
+        Printf("GenIn: File validation successful\n");
+    } else if (config->verify == VERIFY_FULL) {
+        /* Validate the saved file by loading it back */
+        gen_stats_begin(stats, PHASE_VERIFY);
+        test_obj = GetDiskObject(config->resolved_target);
+        if (test_obj) {
+            result = verify_diskobject(test_obj, config, expected_type);
+            FreeDiskObject(test_obj);
         }
+        gen_stats_end(stats, PHASE_VERIFY, 1);
         
-        /* Check type */
-        if (Stricmp(config->type, "tool") == 0) {
-            expected_type = WBTOOL;
-        } else if (Stricmp(config->type, "project") == 0) {
-            expected_type = WBPROJECT;
-        } else if (Stricmp(config->type, "drawer") == 0) {
-            expected_type = WBDRAWER;
-        } else {
-            expected_type = WBPROJECT;
+        if (!test_obj) {
+            Printf("GenIn: Warning - Created file but could not load it back for validation\n");
+            return FALSE;
         }
-        
-        if (test_obj->do_Type != expected_type) {
-            Printf("GenIn: Warning - Type mismatch in saved file (expected %ld, got %ld)\n", expected_type, test_obj->do_Type);
-            valid = FALSE;
+        if (!result) {
+            Printf("GenIn: Validation failed - file may be corrupted\n");
+            return FALSE;
         }
         
-        /* Check stack size */
-        if (test_obj->do_StackSize != config->stack) {
-            Printf("GenIn: Warning - Stack size mismatch in saved file (expected %ld, got %ld)\n", config->stack, test_obj->do_StackSize);
-            valid = FALSE;
+        Printf("GenIn: File validation successful\n");
+    }
+    
+    return TRUE;
+}
+
+LONG check_existing_icon(Config *config, struct DiskObject *source_diskobj, IconImage *icon_image)
+{
+    UBYTE target_path[512];
+    struct DiskObject *existing;
+    BPTR lock;
+    BOOL matches;
+    
+    if (config->force && !config->update) {
+        return ICON_WRITE;
+    }
+    
+    if (!make_info_path(config->resolved_target, target_path, sizeof(target_path))) {
+        Printf("GenIn: Path too long when checking target existence\n");
+        return ICON_EXISTS;
+    }
+    
+    /* A Lock() is enough to tell whether the .info is there */
+    lock = Lock((STRPTR)target_path, ACCESS_READ);
+    if (!lock) {
+        return ICON_WRITE;
+    }
+    UnLock(lock);
+    
+    if (!config->update) {
+        if (config->skip_existing) {
+            Printf("GenIn: '%s' already exists, skipped\n", (char *)target_path);
+            return ICON_SKIPPED;
         }
-        
-        /* Check tooltype count and content */
-        if (config->tooltype_count > 0) {
-            loaded_count = 0;
-            if (test_obj->do_ToolTypes) {
-                while (test_obj->do_ToolTypes[loaded_count] != NULL) {
-                    loaded_count++;
-                }
-            }
-            if (loaded_count != config->tooltype_count) {
-                Printf("GenIn: Warning - Tooltype count mismatch (expected %ld, got %ld)\n", config->tooltype_count, loaded_count);
-                valid = FALSE;
-            } else {
-                /* Check each tooltype string */
-                for (i = 0; i < config->tooltype_count; i++) {
-                    if (!test_obj->do_ToolTypes[i] || Stricmp(test_obj->do_ToolTypes[i], config->tooltypes[i]) != 0) {
-                        Printf("GenIn: Warning - Tooltype mismatch at index %ld\n", i);
-                        valid = FALSE;
-                        break;
-                    }
-                }
-            }
+        Printf("GenIn: Target file '%s' already exists. Use FORCE to overwrite or UPDATE to replace changed icons.\n", (char *)target_path);
+        return ICON_EXISTS;
+    }
+    
+    /* UPDATE - only rewrite the icon if it differs from the request */
+    existing = GetDiskObject(config->resolved_target);
+    if (!existing) {
+        return ICON_WRITE;
+    }
+    matches = icon_matches(existing, config, source_diskobj, icon_image);
+    FreeDiskObject(existing);
+    
+    return matches ? ICON_CURRENT : ICON_WRITE;
+}
+
+BOOL icon_matches(struct DiskObject *existing, Config *config, struct DiskObject *source_diskobj, IconImage *icon_image)
+{
+    struct Image *wanted_image = NULL;
+    LONG count;
+    LONG i;
+    
+    if (existing->do_Type != icon_type_for(config->type) ||
+        existing->do_StackSize != config->stack ||
+        !same_string(existing->do_DefaultTool, icon_default_tool(config))) {
+        return FALSE;
+    }
+    
+    /* Same tooltypes in the same order */
+    count = 0;
+    if (existing->do_ToolTypes) {
+        while (existing->do_ToolTypes[count] != NULL) {
+            count++;
         }
-        
-        /* Check default tool */
-        if (test_obj->do_DefaultTool && Stricmp(test_obj->do_DefaultTool, config->target) != 0) {
-            Printf("GenIn: Warning - Default tool mismatch in saved file\n");
-            valid = FALSE;
+    }
+    if (count != config->tooltype_count) {
+        return FALSE;
+    }
+    for (i = 0; i < count; i++) {
+        if (!same_string(existing->do_ToolTypes[i], config->tooltypes[i])) {
+            return FALSE;
         }
+    }
+    
+    /* Same image as create_info_file() would write */
+    if (icon_image) {
+        wanted_image = &icon_image->image;
+    } else if (source_diskobj->do_Gadget.Flags & GFLG_GADGIMAGE) {
+        wanted_image = (struct Image *)source_diskobj->do_Gadget.GadgetRender;
+    }
+    if (!same_image((existing->do_Gadget.Flags & GFLG_GADGIMAGE) ? (struct Image *)existing->do_Gadget.GadgetRender : NULL,
+                    wanted_image)) {
+        return FALSE;
+    }
+    
+    /* And the same OS3.5 image where icon.library keeps one */
+    if (icon_image && IconBase->lib_Version >= 44) {
+        UBYTE *pens = NULL;
+        LONG pen_count = icon_image->width * icon_image->height;
         
-        FreeDiskObject(test_obj);
-        
-        if (!valid) {
-            Printf("GenIn: Validation failed - file may be corrupted\n");
+        IconControl(existing, ICONCTRLA_GetImageData1, &pens, TAG_END);
+        if (!pens) {
             return FALSE;
         }
-        
-        Printf("GenIn: File validation successful\n");
+        for (i = 0; i < pen_count; i++) {
+            if (pens[i] != icon_image->glow_pens[i]) {
+                return FALSE;
+            }
+        }
     }
     
-    return result;
+    return TRUE;
 }
 
-void cleanup_config(Config *config)
+BOOL same_string(STRPTR a, STRPTR b)
 {
+    if (!a || !b) {
+        return a == b;
+    }
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+BOOL same_image(struct Image *a, struct Image *b)
+{
+    UBYTE *data_a;
+    UBYTE *data_b;
+    LONG size;
     LONG i;
     
-    if (config->type) FreeVec(config->type);
-    if (config->target) FreeVec(config->target);
-    if (config->resolved_target) FreeVec(config->resolved_target);
-    if (config->image) FreeVec(config->image);
-    if (config->deficon) FreeVec(config->deficon);
+    if (!a || !b) {
+        return a == b;
+    }
+    if (a->Width != b->Width || a->Height != b->Height || a->Depth != b->Depth) {
+        return FALSE;
+    }
     
-    for (i = 0; i < config->tooltype_count; i++) {
-        if (config->tooltypes[i]) {
-            FreeVec(config->tooltypes[i]);
+    data_a = (UBYTE *)a->ImageData;
+    data_b = (UBYTE *)b->ImageData;
+    if (!data_a || !data_b) {
+        return data_a == data_b;
+    }
+    size = IMAGE_PLANE_SIZE(a->Width, a->Height) * a->Depth;
+    for (i = 0; i < size; i++) {
+        if (data_a[i] != data_b[i]) {
+            return FALSE;
         }
     }
+    return TRUE;
 }
 
 STRPTR strip_info_extension(STRPTR filename)
@@ -1119,7 +2205,7 @@ STRPTR strip_info_extension(STRPTR filename)
         return NULL;
     }
     
-    len = my_strlen(filename);
+    len = gen_strlen(filename);
     
     /* Check if filename ends with .info */
     if (len >= 5 && Stricmp(&filename[len-5], ".info") == 0) {
@@ -1148,7 +2234,7 @@ BOOL validate_filename(STRPTR filename)
     LONG i;
     UBYTE c;
     
-    if (!filename || my_strlen(filename) == 0) {
+    if (!filename || gen_strlen(filename) == 0) {
         return FALSE;
     }
     
@@ -1225,10 +2311,10 @@ STRPTR resolve_target_path(STRPTR spec_file, STRPTR target)
     }
     
     /* Allocate and return resolved path */
-    result = AllocVec(my_strlen((char *)resolved_path) + 1, MEMF_CLEAR);
+    result = AllocVec(gen_strlen((char *)resolved_path) + 1, MEMF_CLEAR);
     if (result) {
-        Strncpy((char *)result, (char *)resolved_path, my_strlen((char *)resolved_path));
-        result[my_strlen((char *)resolved_path)] = '\0';
+        Strncpy((char *)result, (char *)resolved_path, gen_strlen((char *)resolved_path));
+        result[gen_strlen((char *)resolved_path)] = '\0';
         return result;
     }
     
@@ -1237,7 +2323,7 @@ STRPTR resolve_target_path(STRPTR spec_file, STRPTR target)
 
 void print_usage(void)
 {
-    Printf("Usage: GenIn [SPECFILE=file] [TYPE=type] [STACK=size] [TARGET=name] [IMAGE=file] [DEFICON=name] [TOOLTYPE=key=value] [FORCE] [HELP]\n");
+    Printf("Usage: GenIn [SPECFILE=file] [TYPE=type] [STACK=size] [TARGET=name] [IMAGE=file] [DEFICON=name] [TOOLTYPE=key=value] [FORCE] [UPDATE] [VERIFY=level] [IMAGECACHE=dir] [TREE=dir] [STATS] [STATSFILE=file] [HELP]\n");
     Printf("\n");
     Printf("Arguments:\n");
     Printf("  SPECFILE=file  - Specification file - uses same arguments\n");
@@ -1248,6 +2334,12 @@ void print_usage(void)
     Printf("  DEFICON=name   - Default icon name to use\n");
     Printf("  TOOLTYPE=key=value - Tooltype entry (can be specified multiple times)\n");
     Printf("  FORCE          - Overwrite existing file\n");
+    Printf("  UPDATE         - Only rewrite existing icons that differ from the request\n");
+    Printf("  VERIFY=level   - Check written icons: NONE, FAST (default) or FULL\n");
+    Printf("  IMAGECACHE=dir - Keep converted images in dir between runs\n");
+    Printf("  TREE=dir       - Create icons for drawers, executables and guides below dir\n");
+    Printf("  STATS          - Print time and counters for each phase at the end\n");
+    Printf("  STATSFILE=file - Write the STATS figures to file as CSV\n");
     Printf("  HELP           - Show this help message\n");
     Printf("\n");
     Printf("Multiple icon definitions in spec file:\n");
@@ -1255,9 +2347,11 @@ void print_usage(void)
     Printf("  Comments start with ';' and continue to end of line\n");
     Printf("\n");
     Printf("Notes:\n");
-    Printf("  - One of SPECFILE or TARGET must be provided\n");
+    Printf("  - One of SPECFILE, TARGET or TREE must be provided\n");
     Printf("  - TYPE is mandatory and used as fallback for DEFICON\n");
     Printf("  - IMAGE and DEFICON cannot be specified together\n");
     Printf("  - TOOLTYPE keys must each be unique\n");
     Printf("  - DEFICON tries ENVARC:Sys/def_ first, then falls back to TYPE\n");
+    Printf("  - VERIFY=FAST reads the written file and checks its header and strings;\n");
+    Printf("    FULL loads the written icon back through icon.library\n");
 } 
\ No newline at end of file
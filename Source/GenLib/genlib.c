@@ -0,0 +1,706 @@
+/*
+ * Copyright (c) 2025 amigazen project
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * GenLib - runtime shared by the Gen tools
+ *
+ * The tools open utility.library into UtilityBase before calling
+ * gen_hash_nocase().
+ */
+
+#include <exec/types.h>
+#include <exec/memory.h>
+#include <dos/dos.h>
+#include <devices/timer.h>
+#include <string.h>
+
+#include <proto/exec.h>
+#include <proto/dos.h>
+#include <proto/utility.h>
+#include <proto/timer.h>
+
+#include "genlib.h"
+
+/* Set while a GenClock is open */
+struct Device *TimerBase = NULL;
+
+GenCounters gen_counters;
+
+/* Arena blocks are rounded to this so any type can be stored in them */
+#define GEN_ALIGN(size) (((size) + 7) & ~7)
+
+void gen_arena_init(GenArena *arena, LONG block_size)
+{
+    arena->pool = NULL;
+    arena->first = NULL;
+    arena->last = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size > 0 ? block_size : GEN_ARENA_BLOCK_SIZE;
+}
+
+/* Memory from the first block at or after the current one with room,
+ * adding a block at the end when none has */
+APTR gen_alloc(GenArena *arena, LONG size)
+{
+    LONG header = GEN_ALIGN(sizeof(GenBlock));
+    GenBlock *block = arena->current;
+    APTR memory;
+    
+    size = GEN_ALIGN(size);
+    while (block && block->size - block->used < size) {
+        block = block->next;
+    }
+    
+    if (!block) {
+        LONG block_size = size > arena->block_size ? size : arena->block_size;
+    
+        /* Ordinary blocks fill one puddle each, larger ones get their own */
+        if (!arena->pool) {
+            arena->pool = CreatePool(MEMF_ANY, header + arena->block_size, header + arena->block_size);
+            if (!arena->pool) {
+                return NULL;
+            }
+        }
+        block = AllocPooled(arena->pool, header + block_size);
+        if (!block) {
+            return NULL;
+        }
+        block->next = NULL;
+        block->size = block_size;
+        block->used = 0;
+        if (arena->last) {
+            arena->last->next = block;
+        } else {
+            arena->first = block;
+        }
+        arena->last = block;
+    }
+    
+    arena->current = block;
+    memory = (UBYTE *)block + header + block->used;
+    block->used += size;
+    gen_counters.allocations++;
+    gen_counters.allocated += size;
+    return memory;
+}
+
+APTR gen_alloc_clear(GenArena *arena, LONG size)
+{
+    UBYTE *memory = gen_alloc(arena, size);
+    
+    if (memory) {
+        memset(memory, 0, size);
+    }
+    return memory;
+}
+
+/* Copy length bytes of text into the arena as a NUL-terminated string */
+STRPTR gen_arena_string(GenArena *arena, const char *text, LONG length)
+{
+    STRPTR copy = gen_alloc(arena, length + 1);
+    
+    if (copy) {
+        CopyMem((APTR)text, copy, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/* Forget everything allocated, keeping the blocks for reuse */
+void gen_arena_reset(GenArena *arena)
+{
+    GenBlock *block;
+    
+    for (block = arena->first; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+void gen_arena_free(GenArena *arena)
+{
+    if (arena->pool) {
+        DeletePool(arena->pool);
+    }
+    gen_arena_init(arena, arena->block_size);
+}
+
+/* Read a whole file into the arena with a single Read(). The text is
+ * NUL-terminated; NULL if the file cannot be read. */
+STRPTR gen_read_file(GenArena *arena, STRPTR filename, LONG *length)
+{
+    BPTR file;
+    STRPTR text = NULL;
+    LONG size;
+    
+    file = Open(filename, MODE_OLDFILE);
+    if (!file) {
+        return NULL;
+    }
+    
+    Seek(file, 0, OFFSET_END);
+    size = Seek(file, 0, OFFSET_BEGINNING);
+    if (size >= 0) {
+        text = gen_alloc(arena, size + 1);
+    }
+    if (text && Read(file, text, size) == size) {
+        text[size] = '\0';
+        gen_counters.read += size;
+        if (length) {
+            *length = size;
+        }
+    } else {
+        text = NULL;
+    }
+    
+    Close(file);
+    return text;
+}
+
+BOOL gen_strings_init(GenStrings *strings, GenArena *arena, LONG bucket_count)
+{
+    LONG count;
+    
+    for (count = 16; count < bucket_count; count *= 2);
+    
+    strings->arena = arena;
+    strings->count = 0;
+    strings->bucket_count = count;
+    strings->buckets = gen_alloc_clear(arena, count * sizeof(GenString *));
+    return (BOOL)(strings->buckets != NULL);
+}
+
+/* The one copy of the first length bytes of text */
+STRPTR gen_intern(GenStrings *strings, const char *text, LONG length)
+{
+    GenString *string;
+    ULONG hash = gen_hash(text, length);
+    LONG bucket = hash & (strings->bucket_count - 1);
+    
+    for (string = strings->buckets[bucket]; string; string = string->next) {
+        if (string->hash == hash && string->length == length &&
+            memcmp(string->text, text, length) == 0) {
+            return string->text;
+        }
+    }
+    
+    string = gen_alloc(strings->arena, sizeof(GenString) + length);
+    if (!string) {
+        return NULL;
+    }
+    string->hash = hash;
+    string->length = length;
+    CopyMem((APTR)text, string->text, length);
+    string->text[length] = '\0';
+    string->next = strings->buckets[bucket];
+    strings->buckets[bucket] = string;
+    strings->count++;
+    return string->text;
+}
+
+/* Allocate the block buffer of a reader */
+BOOL gen_reader_init(GenReader *reader, LONG block_size)
+{
+    if (block_size < GEN_READER_MIN_BLOCK) {
+        block_size = GEN_READER_MIN_BLOCK;
+    }
+    
+    reader->file = 0;
+    reader->buffer = AllocVec(block_size + 1, MEMF_ANY);
+    reader->buffer_size = block_size;
+    reader->data_len = 0;
+    reader->pos = 0;
+    reader->line_number = 0;
+    reader->saved_pos = -1;
+    reader->eof = TRUE;
+    
+    return (BOOL)(reader->buffer != NULL);
+}
+
+/* Open a file for reading through the block buffer */
+BOOL gen_reader_open(GenReader *reader, STRPTR filename)
+{
+    reader->file = Open(filename, MODE_OLDFILE);
+    if (!reader->file) {
+        return FALSE;
+    }
+    
+    reader->data_len = 0;
+    reader->pos = 0;
+    reader->line_number = 0;
+    reader->saved_pos = -1;
+    reader->eof = FALSE;
+    
+    return TRUE;
+}
+
+/* Return the next line (including its newline) as a NUL-terminated slice
+ * of the block buffer. Lines longer than the buffer grow it rather than
+ * being split. Returns NULL at end of file. */
+STRPTR gen_reader_next_line(GenReader *reader, LONG *length)
+{
+    STRPTR line;
+    char *newline = NULL;
+    LONG remaining;
+    LONG bytes_read;
+    LONG line_len;
+    
+    /* Restore the byte the previous line's terminator replaced */
+    if (reader->saved_pos >= 0) {
+        reader->buffer[reader->saved_pos] = reader->saved_char;
+        reader->saved_pos = -1;
+    }
+    
+    for (;;) {
+        remaining = reader->data_len - reader->pos;
+        if (remaining > 0) {
+            newline = memchr(reader->buffer + reader->pos, '\n', remaining);
+            if (newline || reader->eof) {
+                break;
+            }
+        } else if (reader->eof) {
+            return NULL;
+        }
+    
+        /* Need more data - keep the partial line at the start of the buffer */
+        if (reader->pos > 0) {
+            if (remaining > 0) {
+                memmove(reader->buffer, reader->buffer + reader->pos, remaining);
+            }
+            reader->data_len = remaining;
+            reader->pos = 0;
+        }
+    
+        /* A single line fills the whole buffer - grow it */
+        if (reader->data_len == reader->buffer_size) {
+            LONG new_size = reader->buffer_size * 2;
+            STRPTR new_buffer = AllocVec(new_size + 1, MEMF_ANY);
+            if (!new_buffer) {
+                /* Out of memory - hand back what we have as one line */
+                newline = NULL;
+                break;
+            }
+            CopyMem(reader->buffer, new_buffer, reader->data_len);
+            FreeVec(reader->buffer);
+            reader->buffer = new_buffer;
+            reader->buffer_size = new_size;
+        }
+    
+        bytes_read = Read(reader->file, reader->buffer + reader->data_len,
+                          reader->buffer_size - reader->data_len);
+        if (bytes_read <= 0) {
+            reader->eof = TRUE;
+        } else {
+            reader->data_len += bytes_read;
+            gen_counters.read += bytes_read;
+        }
+    }
+    
+    line = reader->buffer + reader->pos;
+    if (newline) {
+        line_len = (newline - (char *)line) + 1;
+    } else {
+        line_len = reader->data_len - reader->pos;
+    }
+    reader->pos += line_len;
+    
+    /* Terminate the slice, remembering the byte we overwrite */
+    reader->saved_pos = reader->pos;
+    reader->saved_char = reader->buffer[reader->pos];
+    reader->buffer[reader->pos] = '\0';
+    
+    reader->line_number++;
+    if (length) {
+        *length = line_len;
+    }
+    return line;
+}
+
+/* Close the current file, keeping the buffer for the next one */
+void gen_reader_close(GenReader *reader)
+{
+    if (reader->file) {
+        Close(reader->file);
+        reader->file = 0;
+    }
+    reader->data_len = 0;
+    reader->pos = 0;
+    reader->saved_pos = -1;
+    reader->eof = TRUE;
+}
+
+/* Release the block buffer */
+void gen_reader_free(GenReader *reader)
+{
+    gen_reader_close(reader);
+    if (reader->buffer) {
+        FreeVec(reader->buffer);
+        reader->buffer = NULL;
+    }
+}
+
+void gen_writer_init(GenWriter *writer)
+{
+    writer->file = 0;
+    writer->data = NULL;
+    writer->length = 0;
+    writer->size = 0;
+    writer->failed = FALSE;
+}
+
+/* Start writing to file. The buffer is allocated on first use and kept
+ * for every later file. */
+BOOL gen_writer_open(GenWriter *writer, BPTR file)
+{
+    if (!writer->data) {
+        writer->data = AllocVec(GEN_WRITER_SIZE, MEMF_ANY);
+        if (!writer->data) {
+            return FALSE;
+        }
+        writer->size = GEN_WRITER_SIZE;
+    }
+    writer->file = file;
+    writer->length = 0;
+    writer->failed = FALSE;
+    return TRUE;
+}
+
+void gen_write(GenWriter *writer, const char *text, LONG length)
+{
+    if (writer->failed || length <= 0) {
+        return;
+    }
+    
+    if (writer->length + length > writer->size) {
+        if (!gen_writer_flush(writer)) {
+            return;
+        }
+        /* Too big to be worth copying, write it as it is */
+        if (length >= writer->size) {
+            if (Write(writer->file, (APTR)text, length) != length) {
+                writer->failed = TRUE;
+            }
+            gen_counters.written += length;
+            return;
+        }
+    }
+    
+    CopyMem((APTR)text, writer->data + writer->length, length);
+    writer->length += length;
+}
+
+void gen_write_string(GenWriter *writer, const char *text)
+{
+    if (text) {
+        gen_write(writer, text, gen_strlen(text));
+    }
+}
+
+/* Write out what is buffered. Returns FALSE if any write has failed. */
+BOOL gen_writer_flush(GenWriter *writer)
+{
+    if (!writer->failed && writer->length > 0) {
+        if (Write(writer->file, writer->data, writer->length) != writer->length) {
+            writer->failed = TRUE;
+        }
+        gen_counters.written += writer->length;
+    }
+    writer->length = 0;
+    return !writer->failed;
+}
+
+void gen_writer_free(GenWriter *writer)
+{
+    if (writer->data) {
+        FreeVec(writer->data);
+    }
+    gen_writer_init(writer);
+}
+
+BOOL gen_clock_open(GenClock *clock)
+{
+    struct EClockVal now;
+    
+    clock->frequency = 0;
+    clock->request = NULL;
+    clock->port = CreateMsgPort();
+    if (clock->port) {
+        clock->request = (struct timerequest *)CreateIORequest(clock->port, sizeof(struct timerequest));
+    }
+    if (!clock->request || OpenDevice(TIMERNAME, UNIT_ECLOCK, &clock->request->tr_node, 0) != 0) {
+        gen_clock_close(clock);
+        return FALSE;
+    }
+    
+    TimerBase = clock->request->tr_node.io_Device;
+    clock->frequency = ReadEClock(&now);
+    return TRUE;
+}
+
+void gen_clock_close(GenClock *clock)
+{
+    if (clock->frequency) {
+        CloseDevice(&clock->request->tr_node);
+        TimerBase = NULL;
+    }
+    if (clock->request) {
+        DeleteIORequest((struct IORequest *)clock->request);
+    }
+    if (clock->port) {
+        DeleteMsgPort(clock->port);
+    }
+    clock->port = NULL;
+    clock->request = NULL;
+    clock->frequency = 0;
+}
+
+/* Current E-clock time, or zero when the clock is not open */
+void gen_clock_now(GenClock *clock, struct EClockVal *now)
+{
+    if (clock->frequency) {
+        ReadEClock(now);
+    } else {
+        now->ev_hi = 0;
+        now->ev_lo = 0;
+    }
+}
+
+/* Add the time from start to end to total */
+void gen_clock_add(struct EClockVal *total, struct EClockVal *start, struct EClockVal *end)
+{
+    ULONG lo = end->ev_lo - start->ev_lo;
+    ULONG hi = end->ev_hi - start->ev_hi - (end->ev_lo < start->ev_lo ? 1 : 0);
+    
+    total->ev_lo += lo;
+    total->ev_hi += hi + (total->ev_lo < lo ? 1 : 0);
+}
+
+/* Ticks in milliseconds, with the microseconds beyond them in micros
+ * if it is not NULL. The 64-bit count is divided a bit at a time, as
+ * there is no 64-bit arithmetic to hand. */
+ULONG gen_clock_ms(GenClock *clock, struct EClockVal *ticks, ULONG *micros)
+{
+    ULONG seconds = 0;
+    ULONG rest = ticks->ev_hi;
+    LONG bit;
+    
+    if (micros) {
+        *micros = 0;
+    }
+    if (!clock->frequency) {
+        return 0;
+    }
+    
+    rest %= clock->frequency;
+    for (bit = 31; bit >= 0; bit--) {
+        rest = (rest << 1) | ((ticks->ev_lo >> bit) & 1);
+        seconds <<= 1;
+        if (rest >= clock->frequency) {
+            rest -= clock->frequency;
+            seconds |= 1;
+        }
+    }
+    if (micros) {
+        *micros = (rest * 1000 % clock->frequency) * 1000 / clock->frequency;
+    }
+    return seconds * 1000 + rest * 1000 / clock->frequency;
+}
+
+/* Difference of two counter snapshots added to total */
+static void gen_counters_add(GenCounters *total, GenCounters *start, GenCounters *end)
+{
+    total->allocations += end->allocations - start->allocations;
+    total->allocated += end->allocated - start->allocated;
+    total->read += end->read - start->read;
+    total->written += end->written - start->written;
+}
+
+/* Set up the phases called names[0..count-1]. A failure to open the
+ * clock is not fatal - the counters are still kept, the times read 0. */
+void gen_stats_init(GenStats *stats, STRPTR tool, STRPTR *names, LONG count, BOOL enabled, BOOL print)
+{
+    LONG i;
+    
+    memset(stats, 0, sizeof(GenStats));
+    stats->tool = tool;
+    stats->enabled = enabled;
+    stats->print = (BOOL)(enabled && print);
+    stats->phase_count = count < GEN_MAX_PHASES ? count : GEN_MAX_PHASES;
+    for (i = 0; i < stats->phase_count; i++) {
+        stats->phases[i].name = names[i];
+    }
+    if (enabled && !gen_clock_open(&stats->clock)) {
+        Printf("%s: Could not open %s, STATS will show no times\n", tool, TIMERNAME);
+    }
+}
+
+void gen_stats_begin(GenStats *stats, LONG phase)
+{
+    GenPhase *entry;
+    
+    if (!stats->enabled) {
+        return;
+    }
+    entry = &stats->phases[phase];
+    entry->at_start = gen_counters;
+    gen_clock_now(&stats->clock, &entry->start);
+}
+
+/* End a call of phase that handled items files, rules or icons */
+void gen_stats_end(GenStats *stats, LONG phase, LONG items)
+{
+    GenPhase *entry;
+    struct EClockVal now;
+    
+    if (!stats->enabled) {
+        return;
+    }
+    entry = &stats->phases[phase];
+    gen_clock_now(&stats->clock, &now);
+    gen_clock_add(&entry->ticks, &entry->start, &now);
+    gen_counters_add(&entry->totals, &entry->at_start, &gen_counters);
+    entry->calls++;
+    entry->items += items;
+}
+
+/* One table of every phase that ran, with times to the microsecond */
+void gen_stats_print(GenStats *stats)
+{
+    GenPhase *entry;
+    ULONG ms;
+    ULONG micros;
+    LONG i;
+    
+    if (!stats->print) {
+        return;
+    }
+    
+    Printf("\n%s statistics:\n", stats->tool);
+    Printf("Phase        Calls   Items    Time (ms)       Read    Written   Allocs  Alloc bytes\n");
+    Printf("----------  ------  ------  -----------  ---------  ---------  -------  -----------\n");
+    for (i = 0; i < stats->phase_count; i++) {
+        entry = &stats->phases[i];
+        if (entry->calls == 0) {
+            continue;
+        }
+        ms = gen_clock_ms(&stats->clock, &entry->ticks, &micros);
+        Printf("%-10s  %6ld  %6ld  %7ld.%03ld  %9ld  %9ld  %7ld  %11ld\n",
+               entry->name, entry->calls, entry->items, ms, micros,
+               entry->totals.read, entry->totals.written,
+               entry->totals.allocations, entry->totals.allocated);
+    }
+}
+
+/* The same figures as comma separated lines for scripts, one per phase:
+ * tool,phase,calls,items,ms,read,written,allocations,allocated */
+BOOL gen_stats_write(GenStats *stats, STRPTR filename)
+{
+    GenPhase *entry;
+    BPTR file;
+    ULONG ms;
+    ULONG micros;
+    LONG i;
+    BOOL success;
+    
+    if (!stats->enabled) {
+        return TRUE;
+    }
+    
+    file = Open(filename, MODE_NEWFILE);
+    if (!file) {
+        Printf("%s: Could not create '%s'\n", stats->tool, filename);
+        return FALSE;
+    }
+    FPrintf(file, "tool,phase,calls,items,ms,read,written,allocations,allocated\n");
+    for (i = 0; i < stats->phase_count; i++) {
+        entry = &stats->phases[i];
+        ms = gen_clock_ms(&stats->clock, &entry->ticks, &micros);
+        FPrintf(file, "%s,%s,%ld,%ld,%ld.%03ld,%ld,%ld,%ld,%ld\n",
+                stats->tool, entry->name, entry->calls, entry->items,
+                ms, micros, entry->totals.read, entry->totals.written,
+                entry->totals.allocations, entry->totals.allocated);
+    }
+    success = Flush(file) ? TRUE : FALSE;
+    Close(file);
+    if (!success) {
+        Printf("%s: Could not write '%s'\n", stats->tool, filename);
+    }
+    return success;
+}
+
+void gen_stats_free(GenStats *stats)
+{
+    gen_clock_close(&stats->clock);
+    stats->enabled = FALSE;
+    stats->print = FALSE;
+}
+
+LONG gen_strlen(const char *str)
+{
+    const char *s = str;
+    while (*s) s++;
+    return s - str;
+}
+
+void gen_strcpy(char *dest, const char *src)
+{
+    while (*src) {
+        *dest++ = *src++;
+    }
+    *dest = '\0';
+}
+
+/* Copy of str with AllocVec(), for strings that outlive any arena */
+STRPTR gen_strdup(const char *str)
+{
+    LONG len = gen_strlen(str);
+    STRPTR copy = AllocVec(len + 1, MEMF_ANY);
+    
+    if (copy) {
+        CopyMem((APTR)str, copy, len + 1);
+    }
+    return copy;
+}
+
+/* Trim blanks in place, returning the first non-blank character */
+char *gen_trim(char *str)
+{
+    char *end;
+    
+    while (*str == ' ' || *str == '\t') str++;
+    if (*str == 0) return str;
+    end = str + gen_strlen(str) - 1;
+    while (end > str && (*end == ' ' || *end == '\t')) end--;
+    *(end+1) = 0;
+    return str;
+}
+
+char *gen_skip_blanks(char *str)
+{
+    while (*str == ' ' || *str == '\t') str++;
+    return str;
+}
+
+ULONG gen_hash(const char *text, LONG length)
+{
+    ULONG hash = 0;
+    LONG i;
+    
+    for (i = 0; i < length; i++) {
+        hash = hash * 31 + (UBYTE)text[i];
+    }
+    return hash;
+}
+
+/* The same hash for text compared without regard to case */
+ULONG gen_hash_nocase(const char *text, LONG length)
+{
+    ULONG hash = 0;
+    LONG i;
+    
+    for (i = 0; i < length; i++) {
+        hash = hash * 31 + ToUpper((UBYTE)text[i]);
+    }
+    return hash;
+}
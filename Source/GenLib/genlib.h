@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2025 amigazen project
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * GenLib - runtime shared by the Gen tools
+ *
+ * The pieces every tool needs:
+ * - an arena allocator on an exec memory pool
+ * - a block-buffered line reader and a buffered writer
+ * - interned strings and string helpers
+ * - an E-clock timer and per-phase statistics for STATS
+ *
+ * There is no library to link; each tool's SMakefile compiles genlib.c
+ * into its own genlib.o with the tool's compiler options.
+ *
+ * Every allocation can fail; functions report it by returning NULL or
+ * FALSE and leave what they were given in a state that can be freed.
+ */
+
+#ifndef GENLIB_H
+#define GENLIB_H
+
+#include <exec/types.h>
+#include <dos/dos.h>
+#include <devices/timer.h>
+
+#define GEN_ARENA_BLOCK_SIZE 8192
+#define GEN_READER_MIN_BLOCK 1024
+#define GEN_WRITER_SIZE 16384
+#define GEN_MAX_PHASES 8
+
+/* Memory handed out in blocks taken from one exec pool. Resetting keeps
+ * the blocks, so reusing an arena for each input file costs no new
+ * allocations; freeing deletes the pool and everything with it. */
+typedef struct GenBlock {
+    struct GenBlock *next;
+    LONG size;
+    LONG used;
+} GenBlock;
+
+typedef struct {
+    APTR pool;          /* created on first allocation */
+    GenBlock *first;
+    GenBlock *last;
+    GenBlock *current;
+    LONG block_size;
+} GenArena;
+
+/* Interned strings - equal strings share one copy in the arena, so they
+ * can be compared by pointer */
+typedef struct GenString {
+    struct GenString *next;
+    ULONG hash;
+    LONG length;
+    char text[1];
+} GenString;
+
+typedef struct {
+    GenArena *arena;
+    GenString **buckets;
+    LONG bucket_count;  /* power of two */
+    LONG count;
+} GenStrings;
+
+/* Block-buffered line reader - lines are handed out as slices of the
+ * block buffer, so there is no DOS call or copy per line. A returned
+ * line stays valid until the next call on the same reader. */
+typedef struct {
+    BPTR file;
+    STRPTR buffer;
+    LONG buffer_size;   /* allocated size, excluding the terminator byte */
+    LONG data_len;      /* bytes of file data currently in buffer */
+    LONG pos;           /* start of the next line within buffer */
+    LONG line_number;   /* number of the line last returned */
+    UBYTE saved_char;   /* byte overwritten by the last line terminator */
+    LONG saved_pos;     /* position of saved_char, -1 if none */
+    BOOL eof;
+} GenReader;
+
+/* Output collected in memory and written with Write() in large pieces.
+ * A write error is kept until the flush. */
+typedef struct {
+    BPTR file;
+    STRPTR data;
+    LONG length;
+    LONG size;
+    BOOL failed;
+} GenWriter;
+
+/* E-clock timer on timer.device. The tools open one clock at most; it
+ * sets TimerBase for ReadEClock(). Times are kept as E-clock ticks so
+ * phases can be added up without rounding, and converted at the end. */
+typedef struct {
+    struct MsgPort *port;
+    struct timerequest *request;
+    ULONG frequency;    /* ticks per second, 0 if the clock is not open */
+} GenClock;
+
+/* Running totals kept by the arena, reader and writer. Tools doing
+ * their own I/O add to read and written themselves. */
+typedef struct {
+    ULONG allocations;  /* arena allocations */
+    ULONG allocated;    /* bytes handed out by arenas */
+    ULONG read;         /* bytes read from files */
+    ULONG written;      /* bytes written to files */
+} GenCounters;
+
+extern GenCounters gen_counters;
+
+/* One phase of a run - time and counters are added up over every call */
+typedef struct {
+    STRPTR name;
+    LONG calls;
+    LONG items;
+    struct EClockVal ticks;
+    struct EClockVal start;
+    GenCounters totals;
+    GenCounters at_start;
+} GenPhase;
+
+/* Statistics of a run, collected only when enabled so that a run
+ * without STATS pays no more than a test per phase. STATSFILE alone
+ * collects them without printing, keeping them out of the output. */
+typedef struct {
+    STRPTR tool;
+    BOOL enabled;
+    BOOL print;         /* STATS - print the table at the end */
+    GenClock clock;
+    LONG phase_count;
+    GenPhase phases[GEN_MAX_PHASES];
+} GenStats;
+
+/* Arena */
+void gen_arena_init(GenArena *arena, LONG block_size);
+APTR gen_alloc(GenArena *arena, LONG size);
+APTR gen_alloc_clear(GenArena *arena, LONG size);
+STRPTR gen_arena_string(GenArena *arena, const char *text, LONG length);
+void gen_arena_reset(GenArena *arena);
+void gen_arena_free(GenArena *arena);
+STRPTR gen_read_file(GenArena *arena, STRPTR filename, LONG *length);
+
+/* Interned strings */
+BOOL gen_strings_init(GenStrings *strings, GenArena *arena, LONG bucket_count);
+STRPTR gen_intern(GenStrings *strings, const char *text, LONG length);
+
+/* Reader */
+BOOL gen_reader_init(GenReader *reader, LONG block_size);
+BOOL gen_reader_open(GenReader *reader, STRPTR filename);
+STRPTR gen_reader_next_line(GenReader *reader, LONG *length);
+void gen_reader_close(GenReader *reader);
+void gen_reader_free(GenReader *reader);
+
+/* Writer */
+void gen_writer_init(GenWriter *writer);
+BOOL gen_writer_open(GenWriter *writer, BPTR file);
+void gen_write(GenWriter *writer, const char *text, LONG length);
+void gen_write_string(GenWriter *writer, const char *text);
+BOOL gen_writer_flush(GenWriter *writer);
+void gen_writer_free(GenWriter *writer);
+
+/* Clock */
+BOOL gen_clock_open(GenClock *clock);
+void gen_clock_close(GenClock *clock);
+void gen_clock_now(GenClock *clock, struct EClockVal *now);
+void gen_clock_add(struct EClockVal *total, struct EClockVal *start, struct EClockVal *end);
+ULONG gen_clock_ms(GenClock *clock, struct EClockVal *ticks, ULONG *micros);
+
+/* Statistics */
+void gen_stats_init(GenStats *stats, STRPTR tool, STRPTR *names, LONG count, BOOL enabled, BOOL print);
+void gen_stats_begin(GenStats *stats, LONG phase);
+void gen_stats_end(GenStats *stats, LONG phase, LONG items);
+void gen_stats_print(GenStats *stats);
+BOOL gen_stats_write(GenStats *stats, STRPTR filename);
+void gen_stats_free(GenStats *stats);
+
+/* Strings */
+LONG gen_strlen(const char *str);
+void gen_strcpy(char *dest, const char *src);
+STRPTR gen_strdup(const char *str);
+char *gen_trim(char *str);
+char *gen_skip_blanks(char *str);
+ULONG gen_hash(const char *text, LONG length);
+ULONG gen_hash_nocase(const char *text, LONG length);
+
+#endif /* GENLIB_H */
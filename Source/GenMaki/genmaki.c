@@ -19,6 +19,7 @@
 #include <exec/memory.h>
 #include <dos/dos.h>
 #include <dos/dosextens.h>
+#include <dos/dostags.h>
 #include <utility/tagitem.h>
 #include <utility/utility.h>
 #include <ctype.h>
@@ -28,6 +29,8 @@
 #include <proto/dos.h>
 #include <proto/utility.h>
 
+#include "genlib.h"
+
 /* Version and stack information - referenced to avoid warnings */
 static const char *verstag = "$VER: GenMaki 1.0 (01/09/25)";
 static const char *stack_cookie = "$STACK: 4096";
@@ -38,11 +41,34 @@ struct Library *UtilityBase = NULL;
 /* Version strings are referenced by the linker */
 
 /* Maximum sizes and limits */
-#define MAX_LINE_LENGTH 512
 #define MAX_FILENAME_LENGTH 256
-#define MAX_VARIABLES 64
-#define MAX_RULES 128
-#define MAX_COMMANDS 256
+#define POOL_PUDDLE_SIZE 8192
+#define ARENA_BLOCK_SIZE 8192
+#define MAX_PATTERN_LENGTH 256
+#define VARIABLE_BUCKETS 64
+#define EXPAND_BUFFER_SIZE 256
+#define MAX_OPTION_LENGTH 256
+#define HEADER_BUCKETS 128
+#define DEPEND_DB_NAME ".genmaki.db"
+#define DEPEND_DB_MAGIC "GENMAKIDB 1"
+#define TARGET_BUCKETS 128
+#define MAX_BUILD_JOBS 16
+#define DETECT_LINES 50
+
+/* Phases timed by STATS */
+#define PHASE_READ 0
+#define PHASE_DETECT 1
+#define PHASE_PARSE 2
+#define PHASE_DEPEND 3
+#define PHASE_CONVERT 4
+#define PHASE_BUILD 5
+#define PHASE_COUNT 6
+
+/* Syntax markers collected while detecting the makefile format */
+#define SYNTAX_GNU 1
+#define SYNTAX_DICE 2
+#define SYNTAX_SAS 4
+#define SYNTAX_LATTICE 8
 
 /* Makefile format types */
 typedef enum {
@@ -53,41 +79,223 @@ typedef enum {
     FORMAT_LATTICE
 } MakefileFormat;
 
-/* Variable structure */
+#define FORMAT_COUNT 5
+
+/* Makefile text loaded into memory once, shared by detection and parsing.
+ * The buffers are kept between loads and only grown when a file needs it. */
 typedef struct {
+    STRPTR data;        /* file contents, lines split in place */
+    LONG length;
+    LONG data_size;
+    STRPTR *lines;      /* start of each line, without its terminator */
+    LONG line_count;
+    LONG lines_size;
+} MakefileText;
+
+/* Variable structure */
+typedef struct Variable {
+    struct Variable *next;       /* definition order */
+    struct Variable *hash_next;  /* same bucket, newest definition first */
     STRPTR name;
     STRPTR value;
-    BOOL is_immediate;  /* For DICE immediate resolution */
+    STRPTR expanded;    /* value with references expanded, NULL until needed */
+    LONG expanded_at;   /* variable_count when expanded was made */
+    BOOL is_immediate;  /* For DICE immediate resolution, and GNU := */
+    BOOL expanding;     /* set while expanding, to stop recursive loops */
 } Variable;
 
-/* Command structure */
+/* Growable buffer used while expanding variable references */
 typedef struct {
+    STRPTR data;
+    LONG length;
+    LONG size;
+    BOOL failed;
+} ExpandBuffer;
+
+/* Command structure */
+typedef struct Command {
+    struct Command *next;
     STRPTR command;
     BOOL is_continuation;
 } Command;
 
 /* Rule structure */
-typedef struct {
+typedef struct Rule {
+    struct Rule *next;
     STRPTR targets;
     STRPTR dependencies;
-    Command *commands;
+    Command *first_command;
+    Command *last_command;
     LONG command_count;
     BOOL is_pattern_rule;
     BOOL is_dice_form4;  /* DICE :: syntax */
 } Rule;
 
-/* Makefile structure */
+/* Comment structure */
+typedef struct Comment {
+    struct Comment *next;
+    STRPTR text;
+} Comment;
+
+/* Makefile structure - everything below lives in one arena, kept in
+ * lists in source order so nothing is limited by a fixed array size */
 typedef struct {
     MakefileFormat format;
     STRPTR filename;
-    Variable *variables;
+    GenArena *arena;
+    GenStrings names;       /* variable names, one copy of each */
+    Variable *first_variable;
+    Variable *last_variable;
     LONG variable_count;
-    Rule *rules;
+    Variable **buckets;     /* VARIABLE_BUCKETS chains for lookup by name */
+    Rule *first_rule;
+    Rule *last_rule;
     LONG rule_count;
-    STRPTR *comments;
+    Comment *first_comment;
+    Comment *last_comment;
     LONG comment_count;
 } Makefile;
 
+/* Translation of one compiler option from the compiler of one format.
+ * The pattern is an option such as "-O", matched without regard to case,
+ * or PREFIX*SUFFIX such as "INCLUDEDIR=*:", matching any option that
+ * starts with PREFIX; the rest of it, less SUFFIX, replaces the '*' of
+ * the replacement. An empty replacement drops the option. */
+typedef struct {
+    const char *pattern;
+    MakefileFormat from;
+    const char *to[FORMAT_COUNT];   /* replacement per target, NULL if not mapped */
+} OptionMapping;
+
+/* Option mappings sorted for lookup: exact patterns by name for binary
+ * search, then prefix patterns longest first, for each source format */
+typedef struct {
+    OptionMapping **index;
+    LONG count;
+    LONG exact_first[FORMAT_COUNT];
+    LONG exact_count[FORMAT_COUNT];
+    LONG prefix_first[FORMAT_COUNT];
+    LONG prefix_count[FORMAT_COUNT];
+    GenArena arena;                 /* mappings loaded with OPTIONMAP */
+    OptionMapping *loaded;
+    LONG loaded_count;
+} OptionTable;
+
+/* A source or header file seen by DEPEND, with the files its #include
+ * lines resolved to - each file is read at most once per run */
+typedef struct Header {
+    struct Header *hash_next;
+    struct Header *next_source;     /* list of sources named in the rules */
+    STRPTR path;
+    struct Header **includes;
+    LONG include_count;
+    BOOL scanned;
+    BOOL is_source;
+    Rule *object_rule;              /* existing rule for the source's object */
+    ULONG visit;                    /* number of the source that last listed it */
+    struct DateStamp date;          /* on disk, once dated */
+    struct DateStamp db_date;       /* when the database entry was scanned */
+    BOOL dated;                     /* looked for on disk this run */
+    BOOL exists;
+    BOOL in_db;                     /* includes loaded from the database */
+    BOOL valid;                     /* includes known, to be saved */
+} Header;
+
+/* What an #include name resolved to, by spelling and including directory */
+typedef struct Resolution {
+    struct Resolution *hash_next;
+    STRPTR key;
+    Header *header;                 /* NULL if it is not on any include path */
+} Resolution;
+
+/* Directory from an -I or INCLUDEDIR= option */
+typedef struct IncludePath {
+    struct IncludePath *next;
+    STRPTR path;
+} IncludePath;
+
+/* State of one DEPEND run, allocated in the makefile's arena */
+typedef struct {
+    Makefile *makefile;
+    Header **headers;               /* HEADER_BUCKETS chains by path */
+    Resolution **resolutions;       /* HEADER_BUCKETS chains by key */
+    IncludePath *first_path;
+    IncludePath *last_path;
+    LONG path_count;
+    Header *first_source;
+    Header *last_source;
+    LONG source_count;
+    LONG scanned_count;
+    LONG reused_count;              /* unchanged files taken from the database */
+    ULONG visit;
+    struct FileInfoBlock *fib;
+    MakefileText text;              /* read buffer shared by every file scanned */
+    BOOL verbose;
+} DependScanner;
+
+/* Where a BUILD target is on its way to being made */
+#define TARGET_NEW 0            /* not yet ordered */
+#define TARGET_VISITING 1       /* its prerequisites are being ordered */
+#define TARGET_WAITING 2        /* ordered, waiting for its prerequisites */
+#define TARGET_RUNNING 3
+#define TARGET_DONE 4
+#define TARGET_FAILED 5
+
+/* A prerequisite of a target, in the order the rules list it */
+typedef struct Prerequisite {
+    struct Prerequisite *next;
+    struct Target *target;
+} Prerequisite;
+
+/* A file or name BUILD can make, with the rule that makes it */
+typedef struct Target {
+    struct Target *hash_next;
+    struct Target *next_ordered;    /* build order, prerequisites first */
+    STRPTR name;
+    Rule *rule;                     /* rule whose commands make it, NULL if none */
+    STRPTR stem;                    /* $* when a pattern rule makes it */
+    STRPTR source;                  /* $< and %(right), NULL for the first prerequisite */
+    Prerequisite *first_prerequisite;
+    Prerequisite *last_prerequisite;
+    struct DateStamp date;
+    BOOL exists;
+    BOOL phony;                     /* listed by .PHONY, never a file */
+    BOOL rebuilt;                   /* made this run, so whatever uses it is out of date */
+    LONG state;                     /* TARGET_* */
+} Target;
+
+/* A target whose commands are running, one command at a time. For an
+ * asynchronous command, job_exit() fills in return_code and done. */
+typedef struct {
+    Target *target;
+    Command *command;               /* command running, the next one follows it */
+    volatile LONG return_code;
+    volatile BOOL done;
+    BOOL ignore_errors;             /* command started with '-' */
+    struct Task *task;
+    ULONG signal_mask;
+} Job;
+
+/* State of one BUILD run, allocated in the makefile's arena */
+typedef struct {
+    Makefile *makefile;
+    Target **targets;               /* TARGET_BUCKETS chains by name */
+    Target *first_ordered;
+    Target *last_ordered;
+    Target *first_pending;          /* first ordered target not yet finished */
+    Job jobs[MAX_BUILD_JOBS];
+    LONG job_count;
+    LONG running;
+    LONG made_count;
+    BYTE signal;                    /* signalled by finished jobs, -1 when serial */
+    BOOL failed;
+    BOOL stopped;                   /* Ctrl-C - nothing more is started */
+    BOOL verbose;
+    struct FileInfoBlock *fib;
+    ExpandBuffer substituted;       /* command with $@ and friends replaced */
+    ExpandBuffer line;              /* command with variables expanded, as run */
+} Builder;
+
 /* Conversion configuration */
 typedef struct {
     STRPTR input_file;
@@ -96,72 +304,144 @@ typedef struct {
     MakefileFormat target_format;
     BOOL save_to_file;  /* Derived from presence of output_file */
     BOOL verbose;
+    STRPTR option_map;  /* OPTIONMAP file of extra option mappings */
+    BOOL depend;        /* Scan #include lines for object dependencies */
+    STRPTR depend_db;   /* DB file keeping DEPEND results between runs */
+    BOOL check;         /* Only report whether the output is out of date */
+    BOOL all;           /* Convert makefiles in all subdirectories */
+    BOOL batch;         /* Several makefiles, each converted next to itself */
+    BOOL build;         /* Run the commands of out of date targets instead */
+    LONG jobs;          /* Commands BUILD runs at once */
+    STRPTR goal;        /* Target BUILD makes, the first rule's by default */
+    STRPTR directory;   /* Directory of the makefile in a batch, for messages */
+    GenStats stats;     /* Enabled by STATS or STATSFILE */
+    STRPTR stats_file;  /* STATSFILE to write the figures to */
 } Config;
 
+/* Compiler option mappings, built once by init_option_table() */
+static OptionTable option_table;
+
 /* Function prototypes */
-LONG my_strlen(const char *str);
-STRPTR my_strdup(const char *str);
-void my_strcpy(char *dest, const char *src);
 LONG my_strcmp(const char *s1, const char *s2);
 LONG my_stricmp(const char *s1, const char *s2);
-char *trim_whitespace(char *str);
-char *skip_whitespace(char *str);
+char *find_assignment(char *line);
 
 /* File detection and format identification */
 STRPTR find_makefile(void);
-MakefileFormat detect_format(STRPTR filename);
+void init_makefile_text(MakefileText *text);
+BOOL load_makefile_text(STRPTR filename, MakefileText *text);
+void free_makefile_text(MakefileText *text);
+LONG detect_line_syntax(const char *line);
+MakefileFormat detect_format(MakefileText *text);
 MakefileFormat parse_filetype_string(STRPTR filetype);
 STRPTR format_to_string(MakefileFormat format);
 
 /* Parsing functions */
-BOOL parse_makefile(STRPTR filename, Makefile *makefile);
-BOOL parse_gnu_makefile(BPTR file, Makefile *makefile);
-BOOL parse_sas_makefile(BPTR file, Makefile *makefile);
-BOOL parse_dice_makefile(BPTR file, Makefile *makefile);
-BOOL parse_lattice_makefile(BPTR file, Makefile *makefile);
+BOOL parse_makefile(STRPTR filename, MakefileText *text, Makefile *makefile);
+BOOL parse_gnu_makefile(MakefileText *text, Makefile *makefile);
+BOOL parse_sas_makefile(MakefileText *text, Makefile *makefile);
+BOOL parse_dice_makefile(MakefileText *text, Makefile *makefile);
+BOOL parse_lattice_makefile(MakefileText *text, Makefile *makefile);
 
 /* Conversion functions */
-BOOL convert_makefile(Makefile *source, MakefileFormat target_format, STRPTR output_file);
-BOOL convert_to_gnu_make(Makefile *source, BPTR output);
-BOOL convert_to_sas_make(Makefile *source, BPTR output);
-BOOL convert_to_dice_make(Makefile *source, BPTR output);
-BOOL convert_to_lattice_make(Makefile *source, BPTR output);
+BOOL convert_makefile(Makefile *source, MakefileFormat target_format, STRPTR output_file,
+                      GenWriter *out);
+BOOL convert_to_gnu_make(Makefile *source, GenWriter *out);
+BOOL convert_to_sas_make(Makefile *source, GenWriter *out);
+BOOL convert_to_dice_make(Makefile *source, GenWriter *out);
+BOOL convert_to_lattice_make(Makefile *source, GenWriter *out);
+
+/* Output buffer */
+void output_pair(GenWriter *out, const char *left, const char *separator, const char *right);
+
+/* Makefile model */
+BOOL init_makefile(Makefile *makefile);
+APTR makefile_alloc(Makefile *makefile, LONG size);
+STRPTR makefile_strdup(Makefile *makefile, const char *str);
+Variable *add_variable(Makefile *makefile, const char *name, const char *value, BOOL is_immediate);
+Rule *add_rule(Makefile *makefile, const char *targets, const char *dependencies,
+               BOOL is_pattern_rule, BOOL is_dice_form4);
+BOOL add_command(Makefile *makefile, Rule *rule, const char *command);
+BOOL add_comment(Makefile *makefile, const char *text);
+
+/* Variable lookup and expansion */
+Variable *find_variable(Makefile *makefile, const char *name, LONG length);
+STRPTR variable_value(Makefile *makefile, Variable *variable);
+STRPTR expand_variables(Makefile *makefile, const char *text);
+BOOL expand_into(Makefile *makefile, const char *text, ExpandBuffer *buffer);
+BOOL expand_buffer_add(ExpandBuffer *buffer, const char *text, LONG length);
+BOOL expand_substitution(ExpandBuffer *buffer, const char *value, const char *from, LONG from_len,
+                         const char *to, LONG to_len);
 
 /* Utility functions */
 void cleanup_makefile(Makefile *makefile);
 void cleanup_config(Config *config);
 void print_usage(void);
 BOOL validate_config(Config *config);
-STRPTR map_compiler_option(STRPTR option, MakefileFormat from, MakefileFormat to);
-STRPTR map_command(STRPTR command, MakefileFormat from, MakefileFormat to);
+void map_command(GenWriter *out, STRPTR command, MakefileFormat from, MakefileFormat to);
 STRPTR convert_cflags(STRPTR flags, MakefileFormat from, MakefileFormat to);
 
-/* Simple string functions since utility.library doesn't have all we need */
-LONG my_strlen(const char *str)
-{
-    const char *s = str;
-    while (*s) s++;
-    return s - str;
-}
+/* Conversion of one or many makefiles */
+LONG process_makefile(Config *config, GenArena *arena, MakefileText *text, GenWriter *out);
+BOOL depend_makefile(Config *config, Makefile *makefile);
+LONG convert_batch(Config *config, STRPTR *patterns, GenArena *arena,
+                   MakefileText *text, GenWriter *out);
+LONG convert_in_directory(Config *config, STRPTR path, GenArena *arena,
+                          MakefileText *text, GenWriter *out);
+BOOL is_makefile_name(const char *name);
+STRPTR default_output_name(MakefileFormat format);
 
-STRPTR my_strdup(const char *str)
-{
-    LONG len = my_strlen(str);
-    STRPTR result = AllocVec(len + 1, MEMF_CLEAR);
-    if (result) {
-        my_strcpy((char *)result, str);
-    }
-    return result;
-}
+/* Freshness check */
+LONG check_makefile(Config *config, Makefile *source, STRPTR output);
+BOOL file_date(STRPTR path, struct DateStamp *date);
 
-void my_strcpy(char *dest, const char *src)
-{
-    while (*src) {
-        *dest++ = *src++;
-    }
-    *dest = '\0';
-}
+/* Dependency scanning */
+BOOL generate_dependencies(Makefile *makefile, STRPTR db_file, BOOL save_db, BOOL verbose,
+                           LONG *changed);
+BOOL header_date(DependScanner *scanner, Header *header);
+BOOL load_depend_db(DependScanner *scanner, STRPTR db_file);
+BOOL save_depend_db(DependScanner *scanner, STRPTR db_file);
+BOOL has_word(const char *list, const char *word);
+Header *find_header(DependScanner *scanner, const char *path, BOOL create);
+BOOL add_include_paths(DependScanner *scanner, const char *flags);
+BOOL add_sources(DependScanner *scanner, const char *words, Rule *rule);
+BOOL include_name(const char *line, const char **name, LONG *length, BOOL *quoted);
+Header *resolve_include(DependScanner *scanner, Header *from, const char *name, LONG length, BOOL quoted);
+BOOL scan_header(DependScanner *scanner, Header *header);
+BOOL add_header_dependencies(DependScanner *scanner, Header *header, ExpandBuffer *deps,
+                             const char *existing);
+
+/* Building */
+LONG build_makefile(Config *config, Makefile *makefile);
+const char *next_word(const char *text, const char **word, LONG *length);
+const char *find_wildcard(const char *word, LONG length);
+Target *find_target(Builder *builder, const char *name, LONG length, BOOL create);
+Target *pattern_target(Builder *builder, const char *pattern, LONG length,
+                       const char *stem, LONG stem_length);
+BOOL add_prerequisite(Builder *builder, Target *target, Target *prerequisite);
+BOOL add_build_rule(Builder *builder, Rule *rule, Target **first);
+BOOL apply_pattern_rule(Builder *builder, Target *target);
+const char *suffix_rule(const char *targets, const char *dependencies);
+BOOL order_targets(Builder *builder, Target *target);
+BOOL target_date(Builder *builder, Target *target);
+BOOL target_out_of_date(Target *target);
+BOOL add_prerequisite_names(ExpandBuffer *buffer, Target *target, BOOL newer);
+STRPTR prepare_command(Builder *builder, Job *job, BOOL *silent);
+void start_command(Builder *builder, Job *job);
+void finish_job(Builder *builder, Job *job);
+void start_ready_targets(Builder *builder);
+void __saveds __asm job_exit(register __d0 LONG return_code, register __d1 Job *job);
 
+/* Compiler option translation */
+BOOL init_option_table(STRPTR map_file);
+void free_option_table(void);
+BOOL load_option_map(STRPTR map_file);
+LONG option_pattern_compare(const OptionMapping *a, const OptionMapping *b);
+const char *option_prefix_end(const char *pattern);
+LONG map_compiler_option(const char *option, LONG length, MakefileFormat from, MakefileFormat to,
+                         char *out, LONG out_size);
+
+/* Simple string functions since utility.library doesn't have all we need */
 LONG my_strcmp(const char *s1, const char *s2)
 {
     while (*s1 && (*s1 == *s2)) {
@@ -180,29 +460,34 @@ LONG my_stricmp(const char *s1, const char *s2)
     return tolower(*(unsigned char *)s1) - tolower(*(unsigned char *)s2);
 }
 
-char *trim_whitespace(char *str)
+/* Return the '=' of a variable assignment, NULL if the line is not one.
+ * The '=' must come before any ':' of a rule, so values may hold volume
+ * names such as sc:lib/sc.lib */
+char *find_assignment(char *line)
 {
-    char *end;
-    while (*str == ' ' || *str == '\t') str++;
-    if (*str == 0) return str;
-    end = str + my_strlen(str) - 1;
-    while (end > str && (*end == ' ' || *end == '\t')) end--;
-    *(end+1) = 0;
-    return str;
-}
-
-char *skip_whitespace(char *str)
-{
-    while (*str == ' ' || *str == '\t') str++;
-    return str;
+    char *p;
+    
+    for (p = line; *p; p++) {
+        if (*p == '=') {
+            return p;
+        }
+        if (*p == ':' && p[1] != '=') {
+            return NULL;
+        }
+    }
+    return NULL;
 }
 
 int main(int argc, char *argv[])
 {
     struct RDArgs *rda;
     Config config;
-    Makefile source_makefile;
+    GenArena arena;
+    MakefileText text;
+    GenWriter output;
+    STRPTR *from_files = NULL;
     STRPTR found_file = NULL;
+    UBYTE pattern[MAX_PATTERN_LENGTH];
     LONG retcode = RETURN_OK;
     
     /* Basic debug output - will be controlled by verbose flag after parsing */
@@ -216,19 +501,16 @@ int main(int argc, char *argv[])
         }
     }
     
-    /* Initialize makefile structure */
-    {
-        UBYTE *ptr = (UBYTE *)&source_makefile;
-        LONG i;
-        for (i = 0; i < sizeof(Makefile); i++) {
-            ptr[i] = 0;
-        }
-    }
+    /* One arena, one read buffer and one write buffer serve every makefile converted */
+    gen_arena_init(&arena, ARENA_BLOCK_SIZE);
+    init_makefile_text(&text);
+    gen_writer_init(&output);
     
     /* Parse command line arguments */
     {
-        static UBYTE template[] = "FROM/K,TO/K,FILETYPE/K,VERBOSE/S,HELP/S";
-        LONG args[5] = {0, 0, 0, 0, 0}; /* from, to, filetype, verbose, help */
+        static UBYTE template[] = "FROM/M,TO/K,FILETYPE/K,VERBOSE/S,HELP/S,OPTIONMAP/K,DEPEND/S,DB/K,CHECK/S,ALL/S,BUILD/S,JOBS/K/N,TARGET/K,STATS/S,STATSFILE/K";
+        static STRPTR phase_names[PHASE_COUNT] = { "read", "detect", "parse", "depend", "convert", "build" };
+        LONG args[15] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; /* from, to, filetype, verbose, help, optionmap, depend, db, check, all, build, jobs, target, stats, statsfile */
         rda = ReadArgs(template, args, NULL);
         
         /* Check if help was requested */
@@ -243,10 +525,22 @@ int main(int argc, char *argv[])
             return RETURN_ERROR;
         }
         
-        config.input_file = (STRPTR)args[0];
+        from_files = (STRPTR *)args[0];
+        config.input_file = (from_files && from_files[0]) ? from_files[0] : NULL;
         config.output_file = (STRPTR)args[1];
         config.filetype = (STRPTR)args[2];
         config.verbose = (args[3] != 0);
+        config.option_map = (STRPTR)args[5];
+        config.depend = (args[6] != 0);
+        config.depend_db = args[7] ? (STRPTR)args[7] : (STRPTR)DEPEND_DB_NAME;
+        config.check = (args[8] != 0);
+        config.all = (args[9] != 0);
+        config.build = (args[10] != 0);
+        config.jobs = args[11] ? *(LONG *)args[11] : 1;
+        config.goal = (STRPTR)args[12];
+        config.directory = "";
+        config.stats_file = (STRPTR)args[14];
+        gen_stats_init(&config.stats, "GenMaki", phase_names, PHASE_COUNT, (BOOL)(args[13] || args[14]), (BOOL)(args[13] != 0));
         
         if (config.verbose) {
             Printf("GenMaki: ReadArgs successful\n");
@@ -261,6 +555,12 @@ int main(int argc, char *argv[])
         }
         /* Save to file is implied by presence of TO argument */
         config.save_to_file = (args[1] != 0);
+        
+        /* More than one makefile, a pattern or ALL makes a batch */
+        config.batch = config.all ||
+            (from_files && from_files[0] && from_files[1]) ||
+            (config.input_file &&
+             ParsePatternNoCase(config.input_file, pattern, sizeof(pattern)) == 1);
     }
     
     /* Open required libraries */
@@ -278,6 +578,39 @@ int main(int argc, char *argv[])
         Printf("GenMaki: Library opened successfully\n");
     }
     
+    /* Index the built-in option mappings, plus any from OPTIONMAP */
+    if (!init_option_table(config.option_map)) {
+        retcode = RETURN_ERROR;
+        goto cleanup;
+    }
+    
+    if (config.build && config.check) {
+        Printf("GenMaki: BUILD and CHECK can not be used together\n");
+        retcode = RETURN_ERROR;
+        goto cleanup;
+    }
+    if (config.jobs < 1 || config.jobs > MAX_BUILD_JOBS) {
+        Printf("GenMaki: JOBS must be from 1 to %ld\n", (LONG)MAX_BUILD_JOBS);
+        retcode = RETURN_ERROR;
+        goto cleanup;
+    }
+    
+    if (config.batch) {
+        /* Every makefile name matches, so which way to convert must be given */
+        if (config.all && !config.input_file && config.build) {
+            Printf("GenMaki: ALL BUILD needs FROM=pattern naming the makefiles\n");
+            retcode = RETURN_ERROR;
+            goto cleanup;
+        }
+        if (config.all && !config.input_file && !config.filetype) {
+            Printf("GenMaki: ALL without FROM needs FILETYPE=format\n");
+            retcode = RETURN_ERROR;
+            goto cleanup;
+        }
+        retcode = convert_batch(&config, from_files, &arena, &text, &output);
+        goto cleanup;
+    }
+    
     /* Find input makefile if not specified */
     if (!config.input_file) {
         if (config.verbose) {
@@ -296,123 +629,396 @@ int main(int argc, char *argv[])
         }
     }
     
+    retcode = process_makefile(&config, &arena, &text, &output);
+    
+cleanup:
+    /* Statistics cover every makefile handled, even if one failed */
+    gen_stats_print(&config.stats);
+    if (config.stats_file && !gen_stats_write(&config.stats, config.stats_file)) {
+        retcode = RETURN_ERROR;
+    }
+    
+    /* Cleanup */
+    gen_arena_free(&arena);
+    free_makefile_text(&text);
+    gen_writer_free(&output);
+    cleanup_config(&config);
+    
+    if (found_file) {
+        FreeVec(found_file);
+    }
+    
+    if (rda) {
+        FreeArgs(rda);
+    }
+    
+    free_option_table();
+    
+    if (UtilityBase) CloseLibrary(UtilityBase);
+    
+    return retcode;
+}
+
+/* Convert config->input_file, using arena for its model, text to read
+ * it and out to write it. Returns the DOS return code for this makefile. */
+LONG process_makefile(Config *config, GenArena *arena, MakefileText *text, GenWriter *out)
+{
+    Makefile source_makefile;
+    STRPTR output_file = config->output_file;
+    LONG retcode = RETURN_OK;
+    BOOL success;
+    
+    /* Initialize makefile structure */
+    {
+        UBYTE *ptr = (UBYTE *)&source_makefile;
+        LONG i;
+        for (i = 0; i < sizeof(Makefile); i++) {
+            ptr[i] = 0;
+        }
+    }
+    source_makefile.arena = arena;
+    
+    /* Read the makefile once - detection and parsing both work on this copy */
+    gen_stats_begin(&config->stats, PHASE_READ);
+    success = load_makefile_text(config->input_file, text);
+    gen_stats_end(&config->stats, PHASE_READ, 1);
+    if (!success) {
+        Printf("GenMaki: Failed to read makefile '%s'\n", config->input_file);
+        retcode = RETURN_ERROR;
+        goto done;
+    }
+    
     /* Detect source format */
-    if (config.verbose) {
-        Printf("GenMaki: Detecting format of '%s'...\n", config.input_file);
+    if (config->verbose) {
+        Printf("GenMaki: Detecting format of '%s'...\n", config->input_file);
     }
-    source_makefile.format = detect_format(config.input_file);
+    gen_stats_begin(&config->stats, PHASE_DETECT);
+    source_makefile.format = detect_format(text);
+    gen_stats_end(&config->stats, PHASE_DETECT, 1);
     if (source_makefile.format == FORMAT_UNKNOWN) {
-        Printf("GenMaki: Unable to determine makefile format for '%s'\n", config.input_file);
+        Printf("GenMaki: Unable to determine makefile format for '%s'\n", config->input_file);
         retcode = RETURN_ERROR;
-        goto cleanup;
+        goto done;
     }
     
-    if (config.verbose) {
+    if (config->verbose) {
         Printf("GenMaki: Detected source format: %s\n", format_to_string(source_makefile.format));
-        Printf("GenMaki: Found %ld variables, %ld rules\n", 
-               source_makefile.variable_count, source_makefile.rule_count);
     }
     
     /* Determine target format */
-    if (config.filetype) {
-        config.target_format = parse_filetype_string(config.filetype);
-        if (config.target_format == FORMAT_UNKNOWN) {
-            Printf("GenMaki: Unknown target format '%s'\n", config.filetype);
+    if (config->filetype) {
+        config->target_format = parse_filetype_string(config->filetype);
+        if (config->target_format == FORMAT_UNKNOWN) {
+            Printf("GenMaki: Unknown target format '%s'\n", config->filetype);
             retcode = RETURN_ERROR;
-            goto cleanup;
+            goto done;
         }
     } else {
         /* Use default conversion targets */
         switch (source_makefile.format) {
             case FORMAT_GNU_MAKE:
             case FORMAT_LATTICE:
-                config.target_format = FORMAT_SAS_C;
+                config->target_format = FORMAT_SAS_C;
                 break;
             case FORMAT_DICE:
             case FORMAT_SAS_C:
-                config.target_format = FORMAT_GNU_MAKE;
+                config->target_format = FORMAT_GNU_MAKE;
                 break;
             default:
                 Printf("GenMaki: No default target format for source format\n");
                 retcode = RETURN_ERROR;
-                goto cleanup;
+                goto done;
         }
     }
     
-    if (config.verbose) {
-        Printf("GenMaki: Target format: %s\n", format_to_string(config.target_format));
+    if (config->verbose) {
+        Printf("GenMaki: Target format: %s\n", format_to_string(config->target_format));
+    }
+    
+    /* A batch leaves makefiles that are already in the target format alone,
+     * such as the output of an earlier run */
+    if (config->batch && !config->build && source_makefile.format == config->target_format) {
+        if (config->verbose) {
+            Printf("GenMaki: Skipping '%s', it is already in the target format\n", config->input_file);
+        }
+        goto done;
     }
     
     /* Parse source makefile */
-    if (!parse_makefile(config.input_file, &source_makefile)) {
-        Printf("GenMaki: Failed to parse makefile '%s'\n", config.input_file);
+    gen_stats_begin(&config->stats, PHASE_PARSE);
+    success = parse_makefile(config->input_file, text, &source_makefile);
+    gen_stats_end(&config->stats, PHASE_PARSE, source_makefile.rule_count);
+    if (!success) {
+        Printf("GenMaki: Failed to parse makefile '%s'\n", config->input_file);
         retcode = RETURN_ERROR;
-        goto cleanup;
+        goto done;
     }
     
-    if (config.verbose) {
+    if (config->verbose) {
         Printf("GenMaki: Parsed %ld variables and %ld rules\n", 
                source_makefile.variable_count, source_makefile.rule_count);
     }
     
-    /* Determine output file */
-    if (config.save_to_file && !config.output_file) {
-        /* Generate default output filename based on target format */
-        /* Note: Amiga filesystems are case insensitive, so exact case doesn't matter */
-        STRPTR default_name = NULL;
-        switch (config.target_format) {
-            case FORMAT_GNU_MAKE:
-                default_name = "Makefile";
-                break;
-            case FORMAT_SAS_C:
-                default_name = "smakefile";
-                break;
-            case FORMAT_DICE:
-                default_name = "dmakefile";
-                break;
-            case FORMAT_LATTICE:
-                default_name = "lmkfile";
-                break;
+    /* BUILD runs the makefile's commands instead of converting it */
+    if (config->build) {
+        if (config->batch) {
+            Printf("GenMaki: Building '%s'%s%s\n", config->input_file,
+                   *config->directory ? " in " : "", config->directory);
+        }
+        if (config->depend && !depend_makefile(config, &source_makefile)) {
+            Printf("GenMaki: Failed to generate dependencies\n");
+            retcode = RETURN_ERROR;
+            goto done;
         }
-        config.output_file = default_name;
+        gen_stats_begin(&config->stats, PHASE_BUILD);
+        retcode = build_makefile(config, &source_makefile);
+        gen_stats_end(&config->stats, PHASE_BUILD, 1);
+        goto done;
+    }
+    
+    /* In a batch each makefile is converted next to itself */
+    if (config->batch && !output_file) {
+        output_file = default_output_name(config->target_format);
+    }
+    
+    /* CHECK only reports, it writes nothing */
+    if (config->check) {
+        retcode = check_makefile(config, &source_makefile, output_file);
+        goto done;
+    }
+    
+    if (config->batch && my_stricmp(output_file, config->input_file) == 0) {
+        Printf("GenMaki: Skipping '%s', the output would replace it\n", config->input_file);
+        retcode = RETURN_WARN;
+        goto done;
+    }
+    
+    /* Add to the dependencies of each object what its source includes */
+    if (config->depend && !depend_makefile(config, &source_makefile)) {
+        Printf("GenMaki: Failed to generate dependencies\n");
+        retcode = RETURN_ERROR;
+        goto done;
     }
     
     /* Convert makefile */
-    if (config.verbose) {
+    if (config->verbose) {
         Printf("GenMaki: Starting conversion...\n");
     }
     
-    if (!convert_makefile(&source_makefile, config.target_format, config.output_file)) {
+    gen_stats_begin(&config->stats, PHASE_CONVERT);
+    success = convert_makefile(&source_makefile, config->target_format, output_file, out);
+    gen_stats_end(&config->stats, PHASE_CONVERT, source_makefile.rule_count);
+    if (!success) {
         Printf("GenMaki: Failed to convert makefile\n");
         retcode = RETURN_ERROR;
-        goto cleanup;
+        goto done;
     }
     
-    if (config.verbose) {
+    if (config->verbose) {
         Printf("GenMaki: Conversion completed successfully\n");
     }
     
-    if (config.save_to_file) {
-        Printf("GenMaki: Successfully converted to '%s'\n", config.output_file);
+    if (config->batch) {
+        Printf("GenMaki: Converted '%s' to '%s'%s%s\n", config->input_file, output_file,
+               *config->directory ? " in " : "", config->directory);
+    } else if (output_file) {
+        Printf("GenMaki: Successfully converted to '%s'\n", output_file);
     } else {
         Printf("GenMaki: Conversion completed\n");
     }
     
-cleanup:
-    /* Cleanup */
+done:
     cleanup_makefile(&source_makefile);
-    cleanup_config(&config);
+    return retcode;
+}
+
+/* DEPEND for one makefile, timed as a phase of its own */
+BOOL depend_makefile(Config *config, Makefile *makefile)
+{
+    BOOL success;
     
-    if (found_file) {
-        FreeVec(found_file);
+    gen_stats_begin(&config->stats, PHASE_DEPEND);
+    success = generate_dependencies(makefile, config->depend_db, TRUE, config->verbose, NULL);
+    gen_stats_end(&config->stats, PHASE_DEPEND, makefile->rule_count);
+    return success;
+}
+
+/* Standard makefile names, as find_makefile() looks for them */
+BOOL is_makefile_name(const char *name)
+{
+    static const char *names[] = {
+        "makefile", "GNUmakefile", "smakefile", "dmakefile", "lmkfile"
+    };
+    LONG i;
+    
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (my_stricmp(name, names[i]) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Default name of a converted makefile */
+STRPTR default_output_name(MakefileFormat format)
+{
+    /* Note: Amiga filesystems are case insensitive, so exact case doesn't matter */
+    switch (format) {
+        case FORMAT_GNU_MAKE:
+            return "Makefile";
+        case FORMAT_SAS_C:
+            return "smakefile";
+        case FORMAT_DICE:
+            return "dmakefile";
+        case FORMAT_LATTICE:
+            return "lmkfile";
+        default:
+            return NULL;
     }
+}
+
+/* Convert one makefile of a batch from inside its own directory, so its
+ * sources, DEPEND database and output all sit next to it */
+LONG convert_in_directory(Config *config, STRPTR path, GenArena *arena,
+                          MakefileText *text, GenWriter *out)
+{
+    char directory[MAX_FILENAME_LENGTH];
+    LONG length = PathPart(path) - path;
+    BPTR lock = 0;
+    BPTR old_dir = 0;
+    LONG retcode;
     
-    if (rda) {
-        FreeArgs(rda);
+    if (length >= sizeof(directory)) {
+        Printf("GenMaki: Path too long: %s\n", path);
+        return RETURN_ERROR;
     }
+    CopyMem(path, directory, length);
+    directory[length] = '\0';
     
-    if (UtilityBase) CloseLibrary(UtilityBase);
+    if (length > 0) {
+        lock = Lock(directory, ACCESS_READ);
+        if (!lock) {
+            Printf("GenMaki: Cannot enter '%s' (Error: %ld)\n", directory, IoErr());
+            return RETURN_ERROR;
+        }
+        old_dir = CurrentDir(lock);
+    }
+    
+    if (config->verbose) {
+        Printf("GenMaki: Processing '%s'\n", path);
+    }
+    config->input_file = FilePart(path);
+    config->directory = directory;
+    
+    /* Everything the last makefile allocated is free for this one */
+    gen_arena_reset(arena);
+    retcode = process_makefile(config, arena, text, out);
+    
+    config->directory = "";
+    if (lock) {
+        CurrentDir(old_dir);
+        UnLock(lock);
+    }
+    return retcode;
+}
+
+/* Convert each makefile the FROM patterns match, or with ALL each file in
+ * the current directory tree whose name matches them - any standard
+ * makefile name without FROM. The worst return code is returned. */
+LONG convert_batch(Config *config, STRPTR *patterns, GenArena *arena,
+                   MakefileText *text, GenWriter *out)
+{
+    struct AnchorPath *anchor;
+    UBYTE *parsed = NULL;
+    LONG pattern_count = 0;
+    LONG converted = 0;
+    LONG retcode = RETURN_OK;
+    LONG result;
+    LONG error = 0;
+    LONG i;
+    
+    anchor = AllocVec(sizeof(struct AnchorPath) + MAX_FILENAME_LENGTH, MEMF_CLEAR);
+    if (!anchor) {
+        Printf("GenMaki: Out of memory\n");
+        return RETURN_ERROR;
+    }
+    anchor->ap_Strlen = MAX_FILENAME_LENGTH;
+    anchor->ap_BreakBits = SIGBREAKF_CTRL_C;
+    
+    while (patterns && patterns[pattern_count]) pattern_count++;
+    
+    if (config->all) {
+        /* Parse each FROM pattern once, to match names in every directory */
+        if (pattern_count > 0) {
+            parsed = AllocVec(pattern_count * MAX_PATTERN_LENGTH, MEMF_ANY);
+            if (!parsed) {
+                FreeVec(anchor);
+                Printf("GenMaki: Out of memory\n");
+                return RETURN_ERROR;
+            }
+            for (i = 0; i < pattern_count; i++) {
+                if (ParsePatternNoCase(patterns[i], parsed + i * MAX_PATTERN_LENGTH, MAX_PATTERN_LENGTH) < 0) {
+                    Printf("GenMaki: Bad pattern '%s'\n", patterns[i]);
+                    FreeVec(parsed);
+                    FreeVec(anchor);
+                    return RETURN_ERROR;
+                }
+            }
+        }
+        
+        error = MatchFirst("#?", anchor);
+        while (!error) {
+            if (anchor->ap_Info.fib_DirEntryType > 0) {
+                /* Enter each directory once, skip it on the way back out */
+                if (anchor->ap_Flags & APF_DIDDIR) {
+                    anchor->ap_Flags &= ~APF_DIDDIR;
+                } else {
+                    anchor->ap_Flags |= APF_DODIR;
+                }
+            } else {
+                BOOL matched = (pattern_count == 0 && is_makefile_name(anchor->ap_Info.fib_FileName));
+                
+                for (i = 0; !matched && i < pattern_count; i++) {
+                    matched = MatchPatternNoCase(parsed + i * MAX_PATTERN_LENGTH, anchor->ap_Info.fib_FileName);
+                }
+                if (matched) {
+                    result = convert_in_directory(config, (STRPTR)anchor->ap_Buf, arena, text, out);
+                    if (result > retcode) retcode = result;
+                    converted++;
+                }
+            }
+            error = MatchNext(anchor);
+        }
+        MatchEnd(anchor);
+    } else {
+        for (i = 0; i < pattern_count && error != ERROR_BREAK; i++) {
+            error = MatchFirst(patterns[i], anchor);
+            if (error && error != ERROR_BREAK) {
+                Printf("GenMaki: No makefile matches '%s'\n", patterns[i]);
+                if (RETURN_WARN > retcode) retcode = RETURN_WARN;
+            }
+            while (!error) {
+                if (anchor->ap_Info.fib_DirEntryType < 0) {
+                    result = convert_in_directory(config, (STRPTR)anchor->ap_Buf, arena, text, out);
+                    if (result > retcode) retcode = result;
+                    converted++;
+                }
+                error = MatchNext(anchor);
+            }
+            MatchEnd(anchor);
+        }
+    }
+    
+    if (error == ERROR_BREAK) {
+        Printf("GenMaki: ***Break\n");
+        if (RETURN_WARN > retcode) retcode = RETURN_WARN;
+    }
+    if (config->verbose) {
+        Printf("GenMaki: %s %ld makefiles\n", config->check ? "Checked" : "Processed", converted);
+    }
     
+    if (parsed) FreeVec(parsed);
+    FreeVec(anchor);
     return retcode;
 }
 
@@ -443,7 +1049,7 @@ STRPTR find_makefile(void)
         if (file) {
             Close(file);
             if (found_count < 16) {
-                found_files[found_count] = my_strdup(candidates[i]);
+                found_files[found_count] = gen_strdup(candidates[i]);
                 found_count++;
             }
         }
@@ -471,75 +1077,227 @@ STRPTR find_makefile(void)
     return NULL;
 }
 
-MakefileFormat detect_format(STRPTR filename)
+void init_makefile_text(MakefileText *text)
+{
+    text->data = NULL;
+    text->length = 0;
+    text->data_size = 0;
+    text->lines = NULL;
+    text->line_count = 0;
+    text->lines_size = 0;
+}
+
+BOOL load_makefile_text(STRPTR filename, MakefileText *text)
 {
     BPTR file;
-    UBYTE line[MAX_LINE_LENGTH];
-    MakefileFormat format = FORMAT_UNKNOWN;
-    BOOL found_gnu_syntax = FALSE;
-    BOOL found_dice_syntax = FALSE;
-    BOOL found_sas_syntax = FALSE;
-    BOOL found_lattice_syntax = FALSE;
-    LONG line_count = 0;
-    char *trimmed;
+    LONG length;
+    LONG count;
+    LONG i;
+    STRPTR p;
+    STRPTR end;
     
     file = Open(filename, MODE_OLDFILE);
     if (!file) {
-        return FORMAT_UNKNOWN;
+        return FALSE;
     }
     
-    /* Scan first 50 lines for format-specific syntax */
-    while (FGets(file, line, sizeof(line)) && line_count < 50) {
-        trimmed = trim_whitespace((char *)line);
-        
-        /* Skip empty lines and comments */
-        if (*trimmed == '\0' || *trimmed == '#') {
-            line_count++;
-            continue;
-        }
-        
-        /* Check for GNU Make specific syntax */
-        if (strstr(trimmed, "%.o:") || strstr(trimmed, "$@") || 
-            strstr(trimmed, "$<") || strstr(trimmed, "$^") ||
-            strstr(trimmed, "CC=gcc") || strstr(trimmed, "CC = gcc")) {
-            found_gnu_syntax = TRUE;
-        }
-        
-        /* Check for DICE specific syntax */
-        if (strstr(trimmed, "%(left)") || strstr(trimmed, "%(right)") ||
-            strstr(trimmed, "::")) {
-            found_dice_syntax = TRUE;
-        }
-        
-        /* Check for SAS/C specific syntax */
-        if (strstr(trimmed, ".c.o:") || strstr(trimmed, "$*.o") ||
-            strstr(trimmed, "OBJNAME=") || strstr(trimmed, "slink")) {
-            found_sas_syntax = TRUE;
-        }
-        
-        /* Check for Lattice specific syntax */
-        if (strstr(trimmed, "blink") || strstr(trimmed, "lc ") ||
-            strstr(trimmed, "WITH")) {
-            found_lattice_syntax = TRUE;
-        }
-        
-        line_count++;
+    /* Read the whole file with a single Read() */
+    Seek(file, 0, OFFSET_END);
+    length = Seek(file, 0, OFFSET_BEGINNING);
+    if (length < 0) {
+        Close(file);
+        return FALSE;
     }
     
-    Close(file);
+    text->line_count = 0;
+    if (length + 1 > text->data_size) {
+        if (text->data) FreeVec(text->data);
+        text->data_size = 0;
+        text->data = AllocVec(length + 1, MEMF_ANY);
+        if (!text->data) {
+            Close(file);
+            return FALSE;
+        }
+        text->data_size = length + 1;
+    }
+    
+    if (Read(file, text->data, length) != length) {
+        Close(file);
+        return FALSE;
+    }
+    Close(file);
+    text->data[length] = '\0';
+    text->length = length;
+    gen_counters.read += length;
+    
+    /* Count lines so the index can be allocated in one go */
+    count = 1;
+    for (i = 0; i < length; i++) {
+        if (text->data[i] == '\n') count++;
+    }
+    
+    if (count > text->lines_size) {
+        if (text->lines) FreeVec(text->lines);
+        text->lines_size = 0;
+        text->lines = AllocVec(sizeof(STRPTR) * count, MEMF_ANY);
+        if (!text->lines) {
+            return FALSE;
+        }
+        text->lines_size = count;
+    }
+    
+    /* Split lines in place, dropping LF and CR LF terminators and joining
+     * backslash continuations into one line - the result never grows, so
+     * it is written over the text as it is read */
+    p = text->data;
+    end = text->data + length;
+    text->line_count = 0;
+    while (p < end) {
+        STRPTR line = p;
+        STRPTR out = p;
+        while (p < end && *p != '\n') {
+            if (*p == '\\' && (p + 1 == end || p[1] == '\n' ||
+                (p[1] == '\r' && (p + 2 == end || p[2] == '\n')))) {
+                /* Continuation - the break becomes a single space */
+                p++;
+                if (p < end && *p == '\r') p++;
+                if (p < end) p++;
+                while (p < end && (*p == ' ' || *p == '\t')) p++;
+                while (out > line && (out[-1] == ' ' || out[-1] == '\t')) out--;
+                *out++ = ' ';
+                continue;
+            }
+            *out++ = *p++;
+        }
+        if (out > line && out[-1] == '\r') out--;
+        *out = '\0';
+        p++;
+        text->lines[text->line_count++] = line;
+    }
+    
+    return TRUE;
+}
+
+void free_makefile_text(MakefileText *text)
+{
+    if (text->lines) {
+        FreeVec(text->lines);
+    }
+    if (text->data) {
+        FreeVec(text->data);
+    }
+    init_makefile_text(text);
+}
+
+/* Collect the format specific syntax markers of one line in a single pass */
+LONG detect_line_syntax(const char *line)
+{
+    const char *p = line;
+    const char *word;
+    LONG word_len;
+    LONG word_index = 0;
+    BOOL cc_assignment = FALSE;
+    LONG syntax = 0;
+    
+    while (*p) {
+        /* Operators and automatic variables */
+        switch (*p) {
+            case '%':
+                if (strncmp(p, "%.o:", 4) == 0) {
+                    syntax |= SYNTAX_GNU;
+                } else if (strncmp(p, "%(left)", 7) == 0 || strncmp(p, "%(right)", 8) == 0) {
+                    syntax |= SYNTAX_DICE;
+                }
+                break;
+            case '$':
+                if (p[1] == '@' || p[1] == '<' || p[1] == '^') {
+                    syntax |= SYNTAX_GNU;
+                } else if (strncmp(p + 1, "*.o", 3) == 0) {
+                    syntax |= SYNTAX_SAS;
+                }
+                break;
+            case ':':
+                if (p[1] == ':') {
+                    syntax |= SYNTAX_DICE;
+                }
+                break;
+            case '.':
+                if (strncmp(p, ".c.o:", 5) == 0) {
+                    syntax |= SYNTAX_SAS;
+                }
+                break;
+        }
+        
+        /* Words, delimited by white space and '=' */
+        if (*p == ' ' || *p == '\t' || *p == '=') {
+            p++;
+            continue;
+        }
+        if (p != line && p[-1] != ' ' && p[-1] != '\t' && p[-1] != '=') {
+            p++;
+            continue;
+        }
+        
+        word = p;
+        while (word[0] && word[0] != ' ' && word[0] != '\t' && word[0] != '=') word++;
+        word_len = word - p;
+        
+        if (word_index == 0 && word_len == 2 && strncmp(p, "CC", 2) == 0) {
+            const char *after = gen_skip_blanks((char *)word);
+            cc_assignment = (*after == '=');
+        } else if (word_len == 3 && strncmp(p, "gcc", 3) == 0) {
+            if (cc_assignment && word_index == 1) syntax |= SYNTAX_GNU;
+        } else if (word_len == 5 && strncmp(p, "slink", 5) == 0) {
+            syntax |= SYNTAX_SAS;
+        } else if (word_len == 7 && strncmp(p, "OBJNAME", 7) == 0 && *word == '=') {
+            syntax |= SYNTAX_SAS;
+        } else if (word_len == 5 && strncmp(p, "blink", 5) == 0) {
+            syntax |= SYNTAX_LATTICE;
+        } else if (word_len == 2 && strncmp(p, "lc", 2) == 0) {
+            syntax |= SYNTAX_LATTICE;
+        } else if (word_len == 4 && strncmp(p, "WITH", 4) == 0) {
+            syntax |= SYNTAX_LATTICE;
+        }
+        word_index++;
+        
+        p++;
+    }
+    
+    return syntax;
+}
+
+MakefileFormat detect_format(MakefileText *text)
+{
+    LONG syntax = 0;
+    LONG line_count;
+    LONG i;
+    char *trimmed;
+    
+    /* Scan first lines for format-specific syntax */
+    line_count = text->line_count < DETECT_LINES ? text->line_count : DETECT_LINES;
+    for (i = 0; i < line_count; i++) {
+        trimmed = gen_skip_blanks((char *)text->lines[i]);
+        
+        /* Skip empty lines and comments */
+        if (*trimmed == '\0' || *trimmed == '#') {
+            continue;
+        }
+        
+        syntax |= detect_line_syntax(trimmed);
+    }
     
     /* Determine format based on found syntax */
-    if (found_dice_syntax) {
-        format = FORMAT_DICE;
-    } else if (found_gnu_syntax) {
-        format = FORMAT_GNU_MAKE;
-    } else if (found_sas_syntax) {
-        format = FORMAT_SAS_C;
-    } else if (found_lattice_syntax) {
-        format = FORMAT_LATTICE;
+    if (syntax & SYNTAX_DICE) {
+        return FORMAT_DICE;
+    } else if (syntax & SYNTAX_GNU) {
+        return FORMAT_GNU_MAKE;
+    } else if (syntax & SYNTAX_SAS) {
+        return FORMAT_SAS_C;
+    } else if (syntax & SYNTAX_LATTICE) {
+        return FORMAT_LATTICE;
     }
     
-    return format;
+    return FORMAT_UNKNOWN;
 }
 
 MakefileFormat parse_filetype_string(STRPTR filetype)
@@ -579,51 +1337,45 @@ STRPTR format_to_string(MakefileFormat format)
     }
 }
 
-BOOL parse_makefile(STRPTR filename, Makefile *makefile)
+BOOL parse_makefile(STRPTR filename, MakefileText *text, Makefile *makefile)
 {
-    BPTR file;
     BOOL success = FALSE;
     
-    file = Open(filename, MODE_OLDFILE);
-    if (!file) {
+    if (!init_makefile(makefile)) {
         return FALSE;
     }
     
-    makefile->filename = my_strdup(filename);
-    makefile->variables = AllocVec(sizeof(Variable) * MAX_VARIABLES, MEMF_CLEAR);
-    makefile->rules = AllocVec(sizeof(Rule) * MAX_RULES, MEMF_CLEAR);
-    
-    if (!makefile->variables || !makefile->rules) {
-        Close(file);
+    makefile->filename = makefile_strdup(makefile, filename);
+    if (!makefile->filename) {
         return FALSE;
     }
     
     /* Parse based on detected format */
     switch (makefile->format) {
         case FORMAT_GNU_MAKE:
-            success = parse_gnu_makefile(file, makefile);
+            success = parse_gnu_makefile(text, makefile);
             break;
         case FORMAT_SAS_C:
-            success = parse_sas_makefile(file, makefile);
+            success = parse_sas_makefile(text, makefile);
             break;
         case FORMAT_DICE:
-            success = parse_dice_makefile(file, makefile);
+            success = parse_dice_makefile(text, makefile);
             break;
         case FORMAT_LATTICE:
-            success = parse_lattice_makefile(file, makefile);
+            success = parse_lattice_makefile(text, makefile);
             break;
         default:
             success = FALSE;
             break;
     }
     
-    Close(file);
     return success;
 }
 
-BOOL parse_gnu_makefile(BPTR file, Makefile *makefile)
+BOOL parse_gnu_makefile(MakefileText *text, Makefile *makefile)
 {
-    UBYTE line[MAX_LINE_LENGTH];
+    LONG line_index;
+    char *line;
     BOOL in_rule = FALSE;
     Rule *current_rule = NULL;
     char *trimmed;
@@ -635,8 +1387,9 @@ BOOL parse_gnu_makefile(BPTR file, Makefile *makefile)
     char *deps;
     char *command;
     
-    while (FGets(file, line, sizeof(line))) {
-        trimmed = trim_whitespace((char *)line);
+    for (line_index = 0; line_index < text->line_count; line_index++) {
+        line = (char *)text->lines[line_index];
+        trimmed = gen_trim(line);
         
         /* Skip empty lines */
         if (*trimmed == '\0') {
@@ -648,36 +1401,63 @@ BOOL parse_gnu_makefile(BPTR file, Makefile *makefile)
         /* Handle comments */
         if (*trimmed == '#') {
             /* Store comment */
-            if (makefile->comment_count < MAX_COMMANDS) {
-                makefile->comments = AllocVec(sizeof(STRPTR) * MAX_COMMANDS, MEMF_CLEAR);
-                if (makefile->comments) {
-                    makefile->comments[makefile->comment_count] = my_strdup(trimmed);
-                    makefile->comment_count++;
-                }
+            if (!add_comment(makefile, trimmed)) {
+                return FALSE;
+            }
+            continue;
+        }
+        
+        /* Handle command lines (must start with tab) - before assignments, as commands often contain '=' */
+        if (in_rule && current_rule && (*line == '\t' || *line == ' ')) {
+            command = trimmed;
+            if (!add_command(makefile, current_rule, command)) {
+                return FALSE;
             }
             continue;
         }
         
         /* Check for variable assignment */
-        if (strchr(trimmed, '=') && !strchr(trimmed, ':')) {
-            equals = strchr(trimmed, '=');
-            if (equals) {
-                *equals = '\0';
-                name = trim_whitespace(trimmed);
-                value = trim_whitespace(equals + 1);
+        equals = find_assignment(trimmed);
+        if (equals) {
+            Variable *previous;
+            char op = (equals > trimmed) ? equals[-1] : '\0';
+            
+            /* := expands immediately, += appends, ?= only sets an undefined variable */
+            if (op == ':' || op == '+' || op == '?') {
+                equals[-1] = ' ';
+            }
+            *equals = '\0';
+            name = gen_trim(trimmed);
+            value = gen_trim(equals + 1);
+            
+            /* Remove quotes if present */
+            if (*value == '"' && strlen(value) > 1 && value[strlen(value)-1] == '"') {
+                value[strlen(value)-1] = '\0';
+                value++;
+            }
+            
+            previous = find_variable(makefile, name, gen_strlen(name));
+            if (op == '?' && previous) {
+                /* Already set */
+            } else if (op == '+' && previous) {
+                /* Keep the flavour of the first definition */
+                STRPTR old_value = previous->is_immediate ? previous->expanded : previous->value;
+                LONG old_len = gen_strlen(old_value);
+                STRPTR combined = makefile_alloc(makefile, old_len + gen_strlen(value) + 2);
                 
-                /* Remove quotes if present */
-                if (*value == '"' && value[strlen(value)-1] == '"') {
-                    value[strlen(value)-1] = '\0';
-                    value++;
+                if (!combined) {
+                    return FALSE;
                 }
-                
-                if (makefile->variable_count < MAX_VARIABLES) {
-                    makefile->variables[makefile->variable_count].name = my_strdup(name);
-                    makefile->variables[makefile->variable_count].value = my_strdup(value);
-                    makefile->variables[makefile->variable_count].is_immediate = FALSE;
-                    makefile->variable_count++;
+                gen_strcpy((char *)combined, old_value);
+                if (old_len > 0 && *value) {
+                    combined[old_len++] = ' ';
                 }
+                gen_strcpy((char *)combined + old_len, value);
+                if (!add_variable(makefile, name, combined, previous->is_immediate)) {
+                    return FALSE;
+                }
+            } else if (!add_variable(makefile, name, value, (BOOL)(op == ':'))) {
+                return FALSE;
             }
             in_rule = FALSE;
             current_rule = NULL;
@@ -689,44 +1469,30 @@ BOOL parse_gnu_makefile(BPTR file, Makefile *makefile)
             colon = strchr(trimmed, ':');
             if (colon) {
                 *colon = '\0';
-                targets = trim_whitespace(trimmed);
-                deps = trim_whitespace(colon + 1);
+                targets = gen_trim(trimmed);
+                deps = gen_trim(colon + 1);
                 
-                if (makefile->rule_count < MAX_RULES) {
-                    current_rule = &makefile->rules[makefile->rule_count];
-                    current_rule->targets = my_strdup(targets);
-                    current_rule->dependencies = my_strdup(deps);
-                    current_rule->commands = AllocVec(sizeof(Command) * MAX_COMMANDS, MEMF_CLEAR);
-                    current_rule->command_count = 0;
-                    current_rule->is_pattern_rule = (strchr(targets, '%') != NULL);
-                    current_rule->is_dice_form4 = FALSE;
-                    makefile->rule_count++;
-                    in_rule = TRUE;
+                current_rule = add_rule(makefile, targets, deps, (strchr(targets, '%') != NULL), FALSE);
+                if (!current_rule) {
+                    return FALSE;
                 }
+                in_rule = TRUE;
             }
             continue;
         }
         
-        /* Handle command lines (must start with tab) */
-        if (in_rule && current_rule && (*trimmed == '\t' || *trimmed == ' ')) {
-            command = skip_whitespace(trimmed);
-            if (*command && current_rule->command_count < MAX_COMMANDS) {
-                current_rule->commands[current_rule->command_count].command = my_strdup(command);
-                current_rule->commands[current_rule->command_count].is_continuation = FALSE;
-                current_rule->command_count++;
-            }
-        } else {
-            in_rule = FALSE;
-            current_rule = NULL;
-        }
+        /* Anything else ends the rule */
+        in_rule = FALSE;
+        current_rule = NULL;
     }
     
     return TRUE;
 }
 
-BOOL parse_sas_makefile(BPTR file, Makefile *makefile)
+BOOL parse_sas_makefile(MakefileText *text, Makefile *makefile)
 {
-    UBYTE line[MAX_LINE_LENGTH];
+    LONG line_index;
+    char *line;
     BOOL in_rule = FALSE;
     Rule *current_rule = NULL;
     char *trimmed;
@@ -738,8 +1504,9 @@ BOOL parse_sas_makefile(BPTR file, Makefile *makefile)
     char *deps;
     char *command;
     
-    while (FGets(file, line, sizeof(line))) {
-        trimmed = trim_whitespace((char *)line);
+    for (line_index = 0; line_index < text->line_count; line_index++) {
+        line = (char *)text->lines[line_index];
+        trimmed = gen_trim(line);
         
         /* Skip empty lines */
         if (*trimmed == '\0') {
@@ -748,33 +1515,37 @@ BOOL parse_sas_makefile(BPTR file, Makefile *makefile)
             continue;
         }
         
-        /* Handle comments */
-        if (*trimmed == ';') {
+        /* Handle comments - '#' is accepted as well as ';' */
+        if (*trimmed == ';' || *trimmed == '#') {
             /* Store comment */
-            if (makefile->comment_count < MAX_COMMANDS) {
-                makefile->comments = AllocVec(sizeof(STRPTR) * MAX_COMMANDS, MEMF_CLEAR);
-                if (makefile->comments) {
-                    makefile->comments[makefile->comment_count] = my_strdup(trimmed);
-                    makefile->comment_count++;
-                }
+            if (!add_comment(makefile, trimmed)) {
+                return FALSE;
+            }
+            continue;
+        }
+        
+        /* Handle command lines (must start with tab) - before assignments, as commands often contain '=' */
+        if (in_rule && current_rule && (*line == '\t' || *line == ' ')) {
+            command = trimmed;
+            if (!add_command(makefile, current_rule, command)) {
+                return FALSE;
             }
             continue;
         }
         
         /* Check for variable assignment */
-        if (strchr(trimmed, '=') && !strchr(trimmed, ':')) {
-            equals = strchr(trimmed, '=');
-            if (equals) {
-                *equals = '\0';
-                name = trim_whitespace(trimmed);
-                value = trim_whitespace(equals + 1);
-                
-                if (makefile->variable_count < MAX_VARIABLES) {
-                    makefile->variables[makefile->variable_count].name = my_strdup(name);
-                    makefile->variables[makefile->variable_count].value = my_strdup(value);
-                    makefile->variables[makefile->variable_count].is_immediate = FALSE;
-                    makefile->variable_count++;
-                }
+        equals = find_assignment(trimmed);
+        if (equals) {
+            /* GNU := assigns as well */
+            if (equals > trimmed && equals[-1] == ':') {
+                equals[-1] = ' ';
+            }
+            *equals = '\0';
+            name = gen_trim(trimmed);
+            value = gen_trim(equals + 1);
+            
+            if (!add_variable(makefile, name, value, FALSE)) {
+                return FALSE;
             }
             in_rule = FALSE;
             current_rule = NULL;
@@ -783,17 +1554,11 @@ BOOL parse_sas_makefile(BPTR file, Makefile *makefile)
         
         /* Check for SAS/C pattern rule (.c.o:) */
         if (strstr(trimmed, ".c.o:") || strstr(trimmed, ".s.o:")) {
-            if (makefile->rule_count < MAX_RULES) {
-                current_rule = &makefile->rules[makefile->rule_count];
-                current_rule->targets = my_strdup("*.o");
-                current_rule->dependencies = my_strdup("*.c");
-                current_rule->commands = AllocVec(sizeof(Command) * MAX_COMMANDS, MEMF_CLEAR);
-                current_rule->command_count = 0;
-                current_rule->is_pattern_rule = TRUE;
-                current_rule->is_dice_form4 = FALSE;
-                makefile->rule_count++;
-                in_rule = TRUE;
+            current_rule = add_rule(makefile, "*.o", "*.c", TRUE, FALSE);
+            if (!current_rule) {
+                return FALSE;
             }
+            in_rule = TRUE;
             continue;
         }
         
@@ -802,44 +1567,30 @@ BOOL parse_sas_makefile(BPTR file, Makefile *makefile)
             colon = strchr(trimmed, ':');
             if (colon) {
                 *colon = '\0';
-                targets = trim_whitespace(trimmed);
-                deps = trim_whitespace(colon + 1);
+                targets = gen_trim(trimmed);
+                deps = gen_trim(colon + 1);
                 
-                if (makefile->rule_count < MAX_RULES) {
-                    current_rule = &makefile->rules[makefile->rule_count];
-                    current_rule->targets = my_strdup(targets);
-                    current_rule->dependencies = my_strdup(deps);
-                    current_rule->commands = AllocVec(sizeof(Command) * MAX_COMMANDS, MEMF_CLEAR);
-                    current_rule->command_count = 0;
-                    current_rule->is_pattern_rule = FALSE;
-                    current_rule->is_dice_form4 = FALSE;
-                    makefile->rule_count++;
-                    in_rule = TRUE;
+                current_rule = add_rule(makefile, targets, deps, FALSE, FALSE);
+                if (!current_rule) {
+                    return FALSE;
                 }
+                in_rule = TRUE;
             }
             continue;
         }
         
-        /* Handle command lines (must start with tab) */
-        if (in_rule && current_rule && (*trimmed == '\t' || *trimmed == ' ')) {
-            command = skip_whitespace(trimmed);
-            if (*command && current_rule->command_count < MAX_COMMANDS) {
-                current_rule->commands[current_rule->command_count].command = my_strdup(command);
-                current_rule->commands[current_rule->command_count].is_continuation = FALSE;
-                current_rule->command_count++;
-            }
-        } else {
-            in_rule = FALSE;
-            current_rule = NULL;
-        }
+        /* Anything else ends the rule */
+        in_rule = FALSE;
+        current_rule = NULL;
     }
     
     return TRUE;
 }
 
-BOOL parse_dice_makefile(BPTR file, Makefile *makefile)
+BOOL parse_dice_makefile(MakefileText *text, Makefile *makefile)
 {
-    UBYTE line[MAX_LINE_LENGTH];
+    LONG line_index;
+    char *line;
     BOOL in_rule = FALSE;
     Rule *current_rule = NULL;
     char *trimmed;
@@ -853,8 +1604,9 @@ BOOL parse_dice_makefile(BPTR file, Makefile *makefile)
     char *double_colon;
     BOOL is_immediate;
     
-    while (FGets(file, line, sizeof(line))) {
-        trimmed = trim_whitespace((char *)line);
+    for (line_index = 0; line_index < text->line_count; line_index++) {
+        line = (char *)text->lines[line_index];
+        trimmed = gen_trim(line);
         
         /* Skip empty lines */
         if (*trimmed == '\0') {
@@ -866,33 +1618,37 @@ BOOL parse_dice_makefile(BPTR file, Makefile *makefile)
         /* Handle comments */
         if (*trimmed == '#') {
             /* Store comment */
-            if (makefile->comment_count < MAX_COMMANDS) {
-                makefile->comments = AllocVec(sizeof(STRPTR) * MAX_COMMANDS, MEMF_CLEAR);
-                if (makefile->comments) {
-                    makefile->comments[makefile->comment_count] = my_strdup(trimmed);
-                    makefile->comment_count++;
-                }
+            if (!add_comment(makefile, trimmed)) {
+                return FALSE;
+            }
+            continue;
+        }
+        
+        /* Handle command lines (must start with tab) - before assignments, as commands often contain '=' */
+        if (in_rule && current_rule && (*line == '\t' || *line == ' ')) {
+            command = trimmed;
+            if (!add_command(makefile, current_rule, command)) {
+                return FALSE;
             }
             continue;
         }
         
         /* Check for variable assignment */
-        if (strchr(trimmed, '=') && !strchr(trimmed, ':')) {
-            equals = strchr(trimmed, '=');
-            if (equals) {
-                *equals = '\0';
-                name = trim_whitespace(trimmed);
-                value = trim_whitespace(equals + 1);
-                
-                /* DICE has immediate variable resolution */
-                is_immediate = TRUE;
-                
-                if (makefile->variable_count < MAX_VARIABLES) {
-                    makefile->variables[makefile->variable_count].name = my_strdup(name);
-                    makefile->variables[makefile->variable_count].value = my_strdup(value);
-                    makefile->variables[makefile->variable_count].is_immediate = is_immediate;
-                    makefile->variable_count++;
-                }
+        equals = find_assignment(trimmed);
+        if (equals) {
+            /* GNU := assigns as well */
+            if (equals > trimmed && equals[-1] == ':') {
+                equals[-1] = ' ';
+            }
+            *equals = '\0';
+            name = gen_trim(trimmed);
+            value = gen_trim(equals + 1);
+            
+            /* DICE has immediate variable resolution */
+            is_immediate = TRUE;
+            
+            if (!add_variable(makefile, name, value, is_immediate)) {
+                return FALSE;
             }
             in_rule = FALSE;
             current_rule = NULL;
@@ -904,20 +1660,14 @@ BOOL parse_dice_makefile(BPTR file, Makefile *makefile)
             double_colon = strstr(trimmed, "::");
             if (double_colon) {
                 *double_colon = '\0';
-                targets = trim_whitespace(trimmed);
-                deps = trim_whitespace(double_colon + 2);
+                targets = gen_trim(trimmed);
+                deps = gen_trim(double_colon + 2);
                 
-                if (makefile->rule_count < MAX_RULES) {
-                    current_rule = &makefile->rules[makefile->rule_count];
-                    current_rule->targets = my_strdup(targets);
-                    current_rule->dependencies = my_strdup(deps);
-                    current_rule->commands = AllocVec(sizeof(Command) * MAX_COMMANDS, MEMF_CLEAR);
-                    current_rule->command_count = 0;
-                    current_rule->is_pattern_rule = FALSE;
-                    current_rule->is_dice_form4 = TRUE;
-                    makefile->rule_count++;
-                    in_rule = TRUE;
+                current_rule = add_rule(makefile, targets, deps, FALSE, TRUE);
+                if (!current_rule) {
+                    return FALSE;
                 }
+                in_rule = TRUE;
             }
             continue;
         }
@@ -927,48 +1677,32 @@ BOOL parse_dice_makefile(BPTR file, Makefile *makefile)
             colon = strchr(trimmed, ':');
             if (colon) {
                 *colon = '\0';
-                targets = trim_whitespace(trimmed);
-                deps = trim_whitespace(colon + 1);
+                targets = gen_trim(trimmed);
+                deps = gen_trim(colon + 1);
                 
-                if (makefile->rule_count < MAX_RULES) {
-                    current_rule = &makefile->rules[makefile->rule_count];
-                    current_rule->targets = my_strdup(targets);
-                    current_rule->dependencies = my_strdup(deps);
-                    current_rule->commands = AllocVec(sizeof(Command) * MAX_COMMANDS, MEMF_CLEAR);
-                    current_rule->command_count = 0;
-                    current_rule->is_pattern_rule = FALSE;
-                    current_rule->is_dice_form4 = FALSE;
-                    makefile->rule_count++;
-                    in_rule = TRUE;
+                current_rule = add_rule(makefile, targets, deps, FALSE, FALSE);
+                if (!current_rule) {
+                    return FALSE;
                 }
+                in_rule = TRUE;
             }
             continue;
         }
         
-        /* Handle command lines (must start with tab) */
-        if (in_rule && current_rule && (*trimmed == '\t' || *trimmed == ' ')) {
-            command = skip_whitespace(trimmed);
-            if (*command && current_rule->command_count < MAX_COMMANDS) {
-                current_rule->commands[current_rule->command_count].command = my_strdup(command);
-                current_rule->commands[current_rule->command_count].is_continuation = FALSE;
-                current_rule->command_count++;
-            }
-        } else {
-            in_rule = FALSE;
-            current_rule = NULL;
-        }
+        /* Anything else ends the rule */
+        in_rule = FALSE;
+        current_rule = NULL;
     }
     
     return TRUE;
 }
 
-BOOL parse_lattice_makefile(BPTR file, Makefile *makefile)
+BOOL parse_lattice_makefile(MakefileText *text, Makefile *makefile)
 {
-    UBYTE line[MAX_LINE_LENGTH];
-    UBYTE full_line[MAX_LINE_LENGTH * 4]; /* Buffer for multi-line variables */
+    LONG line_index;
+    char *line;
     BOOL in_rule = FALSE;
     BOOL in_with_block = FALSE;
-    BOOL in_continuation = FALSE;
     Rule *current_rule = NULL;
     char *trimmed;
     char *equals;
@@ -978,39 +1712,11 @@ BOOL parse_lattice_makefile(BPTR file, Makefile *makefile)
     char *targets;
     char *deps;
     char *command;
-    LONG line_len;
-    LONG full_line_len;
-    
-    full_line[0] = '\0';
-    full_line_len = 0;
-    
-    while (FGets(file, line, sizeof(line))) {
-        line_len = strlen((char *)line);
-        
-        /* Handle line continuations */
-        if (line_len > 0 && line[line_len - 1] == '\\') {
-            /* Remove the backslash and append to full_line */
-            line[line_len - 1] = '\0';
-            if (full_line_len + line_len < sizeof(full_line) - 1) {
-                strcat((char *)full_line, (char *)line);
-                full_line_len += line_len - 1;
-                in_continuation = TRUE;
-                continue;
-            }
-        } else if (in_continuation) {
-            /* End of continuation, append this line too */
-            if (full_line_len + line_len < sizeof(full_line) - 1) {
-                strcat((char *)full_line, (char *)line);
-                full_line_len += line_len;
-            }
-            in_continuation = FALSE;
-        } else {
-            /* Regular line, use it directly */
-            strcpy((char *)full_line, (char *)line);
-            full_line_len = line_len;
-        }
-        
-        trimmed = trim_whitespace((char *)full_line);
+    
+    /* Continuation lines are already joined by load_makefile_text() */
+    for (line_index = 0; line_index < text->line_count; line_index++) {
+        line = (char *)text->lines[line_index];
+        trimmed = gen_trim(line);
         
         /* Skip empty lines */
         if (*trimmed == '\0') {
@@ -1023,15 +1729,11 @@ BOOL parse_lattice_makefile(BPTR file, Makefile *makefile)
             continue;
         }
         
-        /* Handle comments */
-        if (*trimmed == ';') {
+        /* Handle comments - '#' is accepted as well as ';' */
+        if (*trimmed == ';' || *trimmed == '#') {
             /* Store comment */
-            if (makefile->comment_count < MAX_COMMANDS) {
-                makefile->comments = AllocVec(sizeof(STRPTR) * MAX_COMMANDS, MEMF_CLEAR);
-                if (makefile->comments) {
-                    makefile->comments[makefile->comment_count] = my_strdup(trimmed);
-                    makefile->comment_count++;
-                }
+            if (!add_comment(makefile, trimmed)) {
+                return FALSE;
             }
             continue;
         }
@@ -1042,22 +1744,28 @@ BOOL parse_lattice_makefile(BPTR file, Makefile *makefile)
             continue;
         }
         
+        /* Handle command lines (must start with tab) - before assignments, as commands often contain '=' */
+        if (in_rule && current_rule && !in_with_block && (*line == '\t' || *line == ' ')) {
+            command = trimmed;
+            if (!add_command(makefile, current_rule, command)) {
+                return FALSE;
+            }
+            continue;
+        }
+        
         /* Check for variable assignment */
-        if (strchr(trimmed, '=') && !strchr(trimmed, ':')) {
-            equals = strchr(trimmed, '=');
-            if (equals) {
-                *equals = '\0';
-                name = trim_whitespace(trimmed);
-                value = trim_whitespace(equals + 1);
-                
-                if (makefile->variable_count < MAX_VARIABLES) {
-                    makefile->variables[makefile->variable_count].name = my_strdup(name);
-                    makefile->variables[makefile->variable_count].value = my_strdup(value);
-                    makefile->variables[makefile->variable_count].is_immediate = FALSE;
-                    makefile->variable_count++;
-                    
-                    /* Debug output removed for production */
-                }
+        equals = find_assignment(trimmed);
+        if (equals) {
+            /* GNU := assigns as well */
+            if (equals > trimmed && equals[-1] == ':') {
+                equals[-1] = ' ';
+            }
+            *equals = '\0';
+            name = gen_trim(trimmed);
+            value = gen_trim(equals + 1);
+            
+            if (!add_variable(makefile, name, value, FALSE)) {
+                return FALSE;
             }
             in_rule = FALSE;
             current_rule = NULL;
@@ -1066,17 +1774,11 @@ BOOL parse_lattice_makefile(BPTR file, Makefile *makefile)
         
         /* Check for Lattice pattern rule (.c.o:) */
         if (strstr(trimmed, ".c.o:") || strstr(trimmed, ".s.o:")) {
-            if (makefile->rule_count < MAX_RULES) {
-                current_rule = &makefile->rules[makefile->rule_count];
-                current_rule->targets = my_strdup("*.o");
-                current_rule->dependencies = my_strdup("*.c");
-                current_rule->commands = AllocVec(sizeof(Command) * MAX_COMMANDS, MEMF_CLEAR);
-                current_rule->command_count = 0;
-                current_rule->is_pattern_rule = TRUE;
-                current_rule->is_dice_form4 = FALSE;
-                makefile->rule_count++;
-                in_rule = TRUE;
+            current_rule = add_rule(makefile, "*.o", "*.c", TRUE, FALSE);
+            if (!current_rule) {
+                return FALSE;
             }
+            in_rule = TRUE;
             continue;
         }
         
@@ -1085,58 +1787,38 @@ BOOL parse_lattice_makefile(BPTR file, Makefile *makefile)
             colon = strchr(trimmed, ':');
             if (colon) {
                 *colon = '\0';
-                targets = trim_whitespace(trimmed);
-                deps = trim_whitespace(colon + 1);
+                targets = gen_trim(trimmed);
+                deps = gen_trim(colon + 1);
                 
-                if (makefile->rule_count < MAX_RULES) {
-                    current_rule = &makefile->rules[makefile->rule_count];
-                    current_rule->targets = my_strdup(targets);
-                    current_rule->dependencies = my_strdup(deps);
-                    current_rule->commands = AllocVec(sizeof(Command) * MAX_COMMANDS, MEMF_CLEAR);
-                    current_rule->command_count = 0;
-                    current_rule->is_pattern_rule = FALSE;
-                    current_rule->is_dice_form4 = FALSE;
-                    makefile->rule_count++;
-                    in_rule = TRUE;
+                current_rule = add_rule(makefile, targets, deps, FALSE, FALSE);
+                if (!current_rule) {
+                    return FALSE;
                 }
+                in_rule = TRUE;
             }
             continue;
         }
         
-        /* Handle command lines (must start with tab) */
-        if (in_rule && current_rule && (*trimmed == '\t' || *trimmed == ' ')) {
-            command = skip_whitespace(trimmed);
-            if (*command && current_rule->command_count < MAX_COMMANDS) {
-                current_rule->commands[current_rule->command_count].command = my_strdup(command);
-                current_rule->commands[current_rule->command_count].is_continuation = FALSE;
-                current_rule->command_count++;
-                
-                /* Debug output removed for production */
-            }
-        } else if (in_with_block) {
+        /* Handle WITH block content */
+        if (in_with_block) {
             /* Handle WITH block content */
-            if (makefile->rule_count > 0) {
-                current_rule = &makefile->rules[makefile->rule_count - 1];
-                if (current_rule->command_count < MAX_COMMANDS) {
-                    current_rule->commands[current_rule->command_count].command = my_strdup(trimmed);
-                    current_rule->commands[current_rule->command_count].is_continuation = FALSE;
-                    current_rule->command_count++;
+            if (makefile->last_rule) {
+                current_rule = makefile->last_rule;
+                if (!add_command(makefile, current_rule, trimmed)) {
+                    return FALSE;
                 }
             }
         } else {
             in_rule = FALSE;
             current_rule = NULL;
         }
-        
-        /* Reset buffer for next line */
-        full_line[0] = '\0';
-        full_line_len = 0;
     }
     
     return TRUE;
 }
 
-BOOL convert_makefile(Makefile *source, MakefileFormat target_format, STRPTR output_file)
+BOOL convert_makefile(Makefile *source, MakefileFormat target_format, STRPTR output_file,
+                      GenWriter *out)
 {
     BPTR output;
     BOOL success = FALSE;
@@ -1151,25 +1833,42 @@ BOOL convert_makefile(Makefile *source, MakefileFormat target_format, STRPTR out
         output = Output();
     }
     
+    if (!gen_writer_open(out, output)) {
+        Printf("GenMaki: Out of memory for output buffer\n");
+        if (output_file) {
+            Close(output);
+        }
+        return FALSE;
+    }
+    
     /* Convert based on target format */
     switch (target_format) {
         case FORMAT_GNU_MAKE:
-            success = convert_to_gnu_make(source, output);
+            success = convert_to_gnu_make(source, out);
             break;
         case FORMAT_SAS_C:
-            success = convert_to_sas_make(source, output);
+            success = convert_to_sas_make(source, out);
             break;
         case FORMAT_DICE:
-            success = convert_to_dice_make(source, output);
+            success = convert_to_dice_make(source, out);
             break;
         case FORMAT_LATTICE:
-            success = convert_to_lattice_make(source, output);
+            success = convert_to_lattice_make(source, out);
             break;
         default:
             success = FALSE;
             break;
     }
     
+    if (!gen_writer_flush(out) && success) {
+        if (output_file) {
+            Printf("GenMaki: Failed to write output file '%s'\n", output_file);
+        } else {
+            Printf("GenMaki: Failed to write output\n");
+        }
+        success = FALSE;
+    }
+    
     if (output_file) {
         Close(output);
     }
@@ -1177,1220 +1876,2854 @@ BOOL convert_makefile(Makefile *source, MakefileFormat target_format, STRPTR out
     return success;
 }
 
-BOOL convert_to_gnu_make(Makefile *source, BPTR output)
+/* Write "left<separator>right" as a line */
+void output_pair(GenWriter *out, const char *left, const char *separator, const char *right)
 {
-    LONG i, j;
+    gen_write_string(out, left);
+    gen_write_string(out, separator);
+    gen_write_string(out, right);
+    gen_write(out, "\n", 1);
+}
+
+BOOL convert_to_gnu_make(Makefile *source, GenWriter *out)
+{
+    Variable *variable;
+    Rule *rule;
+    Command *entry;
     
     /* Write header comment */
-    FPrintf(output, "# Converted to GNU Make format from %s\n", format_to_string(source->format));
-    FPrintf(output, "# Generated by GenMaki\n\n");
+    gen_write_string(out, "# Converted to GNU Make format from ");
+    gen_write_string(out, format_to_string(source->format));
+    gen_write_string(out, "\n# Generated by GenMaki\n\n");
     
     /* Convert variables */
-    for (i = 0; i < source->variable_count; i++) {
-        STRPTR name = source->variables[i].name;
-        STRPTR value = source->variables[i].value;
+    for (variable = source->first_variable; variable; variable = variable->next) {
+        STRPTR name = variable->name;
+        STRPTR value = variable->value;
+        STRPTR resolved = variable_value(source, variable);
+        
+        /* Compiler names and flags are mapped on their expanded values */
+        if (!resolved) resolved = value;
         
         /* Map compiler variables */
         if (my_stricmp(name, "CC") == 0) {
-            if (my_stricmp(value, "sc") == 0 || my_stricmp(value, "lc") == 0) {
-                FPrintf(output, "CC = cc\n");
-            } else if (my_stricmp(value, "dcc") == 0) {
-                FPrintf(output, "CC = cc\n");
+            if (my_stricmp(resolved, "sc") == 0 || my_stricmp(resolved, "lc") == 0) {
+                gen_write_string(out, "CC = cc\n");
+            } else if (my_stricmp(resolved, "dcc") == 0) {
+                gen_write_string(out, "CC = cc\n");
             } else {
-                FPrintf(output, "CC = %s\n", value);
+                output_pair(out, "CC", " = ", value);
+            }
+        } else if (my_stricmp(name, "CFLAGS") == 0) {
+            /* Convert CFLAGS from source format to GNU make */
+            STRPTR converted_flags = convert_cflags(resolved, source->format, FORMAT_GNU_MAKE);
+            output_pair(out, "CFLAGS", " = ", converted_flags ? converted_flags : value);
+            if (converted_flags) {
+                FreeVec(converted_flags);
             }
         } else {
-            FPrintf(output, "%s = %s\n", name, value);
+            output_pair(out, name, " = ", value);
         }
     }
     
     if (source->variable_count > 0) {
-        FPrintf(output, "\n");
+        gen_write_string(out, "\n");
     }
     
     /* Convert rules */
-    for (i = 0; i < source->rule_count; i++) {
-        Rule *rule = &source->rules[i];
+    for (rule = source->first_rule; rule; rule = rule->next) {
         
         if (rule->is_pattern_rule) {
             /* Convert pattern rules */
             if (source->format == FORMAT_SAS_C || source->format == FORMAT_LATTICE) {
                 /* .c.o: -> %.o: %.c */
-                FPrintf(output, "%.o: %.c\n");
+                gen_write_string(out, "%.o: %.c\n");
             } else if (source->format == FORMAT_DICE) {
                 /* DICE pattern rules need special handling */
-                FPrintf(output, "%.o: %.c\n");
+                gen_write_string(out, "%.o: %.c\n");
             }
         } else {
             /* Regular rules */
-            FPrintf(output, "%s: %s\n", rule->targets, rule->dependencies);
+            output_pair(out, rule->targets, ": ", rule->dependencies);
         }
         
         /* Convert commands */
-        for (j = 0; j < rule->command_count; j++) {
-            STRPTR command = rule->commands[j].command;
-            STRPTR converted_cmd = map_command(command, source->format, FORMAT_GNU_MAKE);
-            
-            FPrintf(output, "\t%s\n", converted_cmd);
+        for (entry = rule->first_command; entry; entry = entry->next) {
+            STRPTR command = entry->command;
+            gen_write_string(out, "\t");
+            map_command(out, command, source->format, FORMAT_GNU_MAKE);
+            gen_write_string(out, "\n");
         }
         
-        FPrintf(output, "\n");
+        gen_write_string(out, "\n");
     }
     
     return TRUE;
 }
 
-BOOL convert_to_sas_make(Makefile *source, BPTR output)
+BOOL convert_to_sas_make(Makefile *source, GenWriter *out)
 {
-    LONG i, j;
+    Variable *variable;
+    Rule *rule;
+    Command *entry;
     
     /* Write header comment */
-    FPrintf(output, "; Converted to SAS/C SMakefile format from %s\n", format_to_string(source->format));
-    FPrintf(output, "; Generated by GenMaki\n\n");
+    gen_write_string(out, "; Converted to SAS/C SMakefile format from ");
+    gen_write_string(out, format_to_string(source->format));
+    gen_write_string(out, "\n; Generated by GenMaki\n\n");
     
     /* Convert variables */
-    for (i = 0; i < source->variable_count; i++) {
-        STRPTR name = source->variables[i].name;
-        STRPTR value = source->variables[i].value;
+    for (variable = source->first_variable; variable; variable = variable->next) {
+        STRPTR name = variable->name;
+        STRPTR value = variable->value;
+        STRPTR resolved = variable_value(source, variable);
+        
+        /* Compiler names and flags are mapped on their expanded values */
+        if (!resolved) resolved = value;
         
         /* Map compiler variables */
         if (my_stricmp(name, "CC") == 0) {
-            if (my_stricmp(value, "gcc") == 0 || my_stricmp(value, "cc") == 0) {
-                FPrintf(output, "CC = sc\n");
-            } else if (my_stricmp(value, "dcc") == 0) {
-                FPrintf(output, "CC = sc\n");
-            } else if (my_stricmp(value, "lc") == 0) {
-                FPrintf(output, "CC = sc\n");
+            if (my_stricmp(resolved, "gcc") == 0 || my_stricmp(resolved, "cc") == 0) {
+                gen_write_string(out, "CC = sc\n");
+            } else if (my_stricmp(resolved, "dcc") == 0) {
+                gen_write_string(out, "CC = sc\n");
+            } else if (my_stricmp(resolved, "lc") == 0) {
+                gen_write_string(out, "CC = sc\n");
             } else {
-                FPrintf(output, "CC = %s\n", value);
+                output_pair(out, "CC", " = ", value);
             }
         } else if (my_stricmp(name, "CFLAGS") == 0) {
             /* Convert CFLAGS from source format to SAS/C */
-            STRPTR converted_flags = convert_cflags(value, source->format, FORMAT_SAS_C);
-            FPrintf(output, "CFLAGS = %s\n", converted_flags);
-            if (converted_flags != value) {
+            STRPTR converted_flags = convert_cflags(resolved, source->format, FORMAT_SAS_C);
+            output_pair(out, "CFLAGS", " = ", converted_flags ? converted_flags : value);
+            if (converted_flags) {
                 FreeVec(converted_flags);
             }
         } else {
-            FPrintf(output, "%s = %s\n", name, value);
+            output_pair(out, name, " = ", value);
         }
     }
     
     if (source->variable_count > 0) {
-        FPrintf(output, "\n");
+        gen_write_string(out, "\n");
     }
     
     /* Convert rules */
-    for (i = 0; i < source->rule_count; i++) {
-        Rule *rule = &source->rules[i];
+    for (rule = source->first_rule; rule; rule = rule->next) {
         
         if (rule->is_pattern_rule) {
             /* Convert pattern rules to SAS/C format */
             if (source->format == FORMAT_GNU_MAKE) {
                 /* %.o: %.c -> .c.o: */
-                FPrintf(output, ".c.o:\n");
+                gen_write_string(out, ".c.o:\n");
             } else if (source->format == FORMAT_DICE) {
                 /* DICE pattern rules -> .c.o: */
-                FPrintf(output, ".c.o:\n");
+                gen_write_string(out, ".c.o:\n");
             } else {
-                FPrintf(output, ".c.o:\n");
+                gen_write_string(out, ".c.o:\n");
             }
         } else {
             /* Regular rules */
-            FPrintf(output, "%s: %s\n", rule->targets, rule->dependencies);
+            output_pair(out, rule->targets, ": ", rule->dependencies);
         }
         
         /* Convert commands */
         if (rule->command_count > 0) {
-            for (j = 0; j < rule->command_count; j++) {
-                STRPTR command = rule->commands[j].command;
-                STRPTR converted_cmd = map_command(command, source->format, FORMAT_SAS_C);
-                
-                FPrintf(output, "\t%s\n", converted_cmd);
+            for (entry = rule->first_command; entry; entry = entry->next) {
+                STRPTR command = entry->command;
+                gen_write_string(out, "\t");
+                map_command(out, command, source->format, FORMAT_SAS_C);
+                gen_write_string(out, "\n");
             }
         } else {
             /* Add a comment for rules without commands */
-            FPrintf(output, "\t; No commands specified - may need manual conversion\n");
+            gen_write_string(out, "\t; No commands specified - may need manual conversion\n");
         }
         
-        FPrintf(output, "\n");
+        gen_write_string(out, "\n");
     }
     
     return TRUE;
 }
 
-BOOL convert_to_dice_make(Makefile *source, BPTR output)
+BOOL convert_to_dice_make(Makefile *source, GenWriter *out)
 {
-    LONG i, j;
+    Variable *variable;
+    Rule *rule;
+    Command *entry;
     
     /* Write header comment */
-    FPrintf(output, "# Converted to DICE dmakefile format from %s\n", format_to_string(source->format));
-    FPrintf(output, "# Generated by GenMaki\n\n");
+    gen_write_string(out, "# Converted to DICE dmakefile format from ");
+    gen_write_string(out, format_to_string(source->format));
+    gen_write_string(out, "\n# Generated by GenMaki\n\n");
     
     /* Convert variables */
-    for (i = 0; i < source->variable_count; i++) {
-        STRPTR name = source->variables[i].name;
-        STRPTR value = source->variables[i].value;
+    for (variable = source->first_variable; variable; variable = variable->next) {
+        STRPTR name = variable->name;
+        STRPTR value = variable->value;
+        STRPTR resolved = variable_value(source, variable);
+        
+        /* Compiler names and flags are mapped on their expanded values */
+        if (!resolved) resolved = value;
         
         /* Map compiler variables */
         if (my_stricmp(name, "CC") == 0) {
-            if (my_stricmp(value, "gcc") == 0 || my_stricmp(value, "cc") == 0) {
-                FPrintf(output, "CC = dcc\n");
-            } else if (my_stricmp(value, "sc") == 0) {
-                FPrintf(output, "CC = dcc\n");
-            } else if (my_stricmp(value, "lc") == 0) {
-                FPrintf(output, "CC = dcc\n");
+            if (my_stricmp(resolved, "gcc") == 0 || my_stricmp(resolved, "cc") == 0) {
+                gen_write_string(out, "CC = dcc\n");
+            } else if (my_stricmp(resolved, "sc") == 0) {
+                gen_write_string(out, "CC = dcc\n");
+            } else if (my_stricmp(resolved, "lc") == 0) {
+                gen_write_string(out, "CC = dcc\n");
             } else {
-                FPrintf(output, "CC = %s\n", value);
+                output_pair(out, "CC", " = ", value);
+            }
+        } else if (my_stricmp(name, "CFLAGS") == 0) {
+            /* Convert CFLAGS from source format to DICE */
+            STRPTR converted_flags = convert_cflags(resolved, source->format, FORMAT_DICE);
+            output_pair(out, "CFLAGS", " = ", converted_flags ? converted_flags : value);
+            if (converted_flags) {
+                FreeVec(converted_flags);
             }
         } else {
-            FPrintf(output, "%s = %s\n", name, value);
+            output_pair(out, name, " = ", value);
         }
     }
     
     if (source->variable_count > 0) {
-        FPrintf(output, "\n");
+        gen_write_string(out, "\n");
     }
     
     /* Convert rules */
-    for (i = 0; i < source->rule_count; i++) {
-        Rule *rule = &source->rules[i];
+    for (rule = source->first_rule; rule; rule = rule->next) {
         
         if (rule->is_pattern_rule) {
             /* Convert pattern rules to DICE format */
             if (source->format == FORMAT_GNU_MAKE) {
                 /* %.o: %.c -> %(left): %(right) */
-                FPrintf(output, "%(left): %(right)\n");
+                gen_write_string(out, "%(left): %(right)\n");
             } else if (source->format == FORMAT_SAS_C || source->format == FORMAT_LATTICE) {
                 /* .c.o: -> %(left): %(right) */
-                FPrintf(output, "%(left): %(right)\n");
+                gen_write_string(out, "%(left): %(right)\n");
             } else {
-                FPrintf(output, "%(left): %(right)\n");
+                gen_write_string(out, "%(left): %(right)\n");
             }
         } else if (rule->is_dice_form4) {
             /* DICE Form 4 rule (:: syntax) */
-            FPrintf(output, "%s :: %s\n", rule->targets, rule->dependencies);
+            output_pair(out, rule->targets, " :: ", rule->dependencies);
         } else {
             /* Regular rules */
-            FPrintf(output, "%s: %s\n", rule->targets, rule->dependencies);
+            output_pair(out, rule->targets, ": ", rule->dependencies);
         }
         
         /* Convert commands */
-        for (j = 0; j < rule->command_count; j++) {
-            STRPTR command = rule->commands[j].command;
-            STRPTR converted_cmd = map_command(command, source->format, FORMAT_DICE);
-            
-            FPrintf(output, "\t%s\n", converted_cmd);
+        for (entry = rule->first_command; entry; entry = entry->next) {
+            STRPTR command = entry->command;
+            gen_write_string(out, "\t");
+            map_command(out, command, source->format, FORMAT_DICE);
+            gen_write_string(out, "\n");
         }
         
-        FPrintf(output, "\n");
+        gen_write_string(out, "\n");
     }
     
     return TRUE;
 }
 
-BOOL convert_to_lattice_make(Makefile *source, BPTR output)
+BOOL convert_to_lattice_make(Makefile *source, GenWriter *out)
 {
-    LONG i, j;
+    Variable *variable;
+    Rule *rule;
+    Command *entry;
     
     /* Write header comment */
-    FPrintf(output, "; Converted to Lattice lmkfile format from %s\n", format_to_string(source->format));
-    FPrintf(output, "; Generated by GenMaki\n\n");
+    gen_write_string(out, "; Converted to Lattice lmkfile format from ");
+    gen_write_string(out, format_to_string(source->format));
+    gen_write_string(out, "\n; Generated by GenMaki\n\n");
     
     /* Convert variables */
-    for (i = 0; i < source->variable_count; i++) {
-        STRPTR name = source->variables[i].name;
-        STRPTR value = source->variables[i].value;
+    for (variable = source->first_variable; variable; variable = variable->next) {
+        STRPTR name = variable->name;
+        STRPTR value = variable->value;
+        STRPTR resolved = variable_value(source, variable);
+        
+        /* Compiler names and flags are mapped on their expanded values */
+        if (!resolved) resolved = value;
         
         /* Map compiler variables */
         if (my_stricmp(name, "CC") == 0) {
-            if (my_stricmp(value, "gcc") == 0 || my_stricmp(value, "cc") == 0) {
-                FPrintf(output, "CC = lc\n");
-            } else if (my_stricmp(value, "sc") == 0) {
-                FPrintf(output, "CC = lc\n");
-            } else if (my_stricmp(value, "dcc") == 0) {
-                FPrintf(output, "CC = lc\n");
+            if (my_stricmp(resolved, "gcc") == 0 || my_stricmp(resolved, "cc") == 0) {
+                gen_write_string(out, "CC = lc\n");
+            } else if (my_stricmp(resolved, "sc") == 0) {
+                gen_write_string(out, "CC = lc\n");
+            } else if (my_stricmp(resolved, "dcc") == 0) {
+                gen_write_string(out, "CC = lc\n");
             } else {
-                FPrintf(output, "CC = %s\n", value);
+                output_pair(out, "CC", " = ", value);
+            }
+        } else if (my_stricmp(name, "CFLAGS") == 0) {
+            /* Convert CFLAGS from source format to Lattice */
+            STRPTR converted_flags = convert_cflags(resolved, source->format, FORMAT_LATTICE);
+            output_pair(out, "CFLAGS", " = ", converted_flags ? converted_flags : value);
+            if (converted_flags) {
+                FreeVec(converted_flags);
             }
         } else {
-            FPrintf(output, "%s = %s\n", name, value);
+            output_pair(out, name, " = ", value);
         }
     }
     
     if (source->variable_count > 0) {
-        FPrintf(output, "\n");
+        gen_write_string(out, "\n");
     }
     
     /* Convert rules */
-    for (i = 0; i < source->rule_count; i++) {
-        Rule *rule = &source->rules[i];
+    for (rule = source->first_rule; rule; rule = rule->next) {
         
         if (rule->is_pattern_rule) {
             /* Convert pattern rules to Lattice format */
             if (source->format == FORMAT_GNU_MAKE) {
                 /* %.o: %.c -> .c.o: */
-                FPrintf(output, ".c.o:\n");
+                gen_write_string(out, ".c.o:\n");
             } else if (source->format == FORMAT_SAS_C) {
                 /* .c.o: -> .c.o: (same) */
-                FPrintf(output, ".c.o:\n");
+                gen_write_string(out, ".c.o:\n");
             } else if (source->format == FORMAT_DICE) {
                 /* %(left): %(right) -> .c.o: */
-                FPrintf(output, ".c.o:\n");
+                gen_write_string(out, ".c.o:\n");
             } else {
-                FPrintf(output, ".c.o:\n");
+                gen_write_string(out, ".c.o:\n");
             }
         } else {
             /* Regular rules */
-            FPrintf(output, "%s: %s\n", rule->targets, rule->dependencies);
+            output_pair(out, rule->targets, ": ", rule->dependencies);
         }
         
         /* Convert commands */
-        for (j = 0; j < rule->command_count; j++) {
-            STRPTR command = rule->commands[j].command;
-            STRPTR converted_cmd = map_command(command, source->format, FORMAT_LATTICE);
-            
-            FPrintf(output, "\t%s\n", converted_cmd);
+        for (entry = rule->first_command; entry; entry = entry->next) {
+            STRPTR command = entry->command;
+            gen_write_string(out, "\t");
+            map_command(out, command, source->format, FORMAT_LATTICE);
+            gen_write_string(out, "\n");
         }
         
-        FPrintf(output, "\n");
+        gen_write_string(out, "\n");
     }
     
     return TRUE;
 }
 
-void cleanup_makefile(Makefile *makefile)
+BOOL init_makefile(Makefile *makefile)
 {
-    LONG i;
+    makefile->filename = NULL;
+    makefile->first_variable = NULL;
+    makefile->last_variable = NULL;
+    makefile->variable_count = 0;
+    makefile->buckets = NULL;
+    makefile->first_rule = NULL;
+    makefile->last_rule = NULL;
+    makefile->rule_count = 0;
+    makefile->first_comment = NULL;
+    makefile->last_comment = NULL;
+    makefile->comment_count = 0;
+    if (!makefile->arena) {
+        return FALSE;
+    }
+    
+    makefile->buckets = makefile_alloc(makefile, sizeof(Variable *) * VARIABLE_BUCKETS);
+    return (BOOL)(makefile->buckets != NULL &&
+                  gen_strings_init(&makefile->names, makefile->arena, VARIABLE_BUCKETS));
+}
+
+/* Cleared memory from the makefile's arena */
+APTR makefile_alloc(Makefile *makefile, LONG size)
+{
+    return gen_alloc_clear(makefile->arena, size);
+}
+
+STRPTR makefile_strdup(Makefile *makefile, const char *str)
+{
+    return gen_arena_string(makefile->arena, str, gen_strlen(str));
+}
+
+Variable *add_variable(Makefile *makefile, const char *name, const char *value, BOOL is_immediate)
+{
+    Variable *variable = makefile_alloc(makefile, sizeof(Variable));
+    if (!variable) {
+        return NULL;
+    }
     
-    if (makefile->filename) FreeVec(makefile->filename);
+    variable->name = gen_intern(&makefile->names, name, gen_strlen(name));
+    variable->value = makefile_strdup(makefile, value);
+    if (!variable->name || !variable->value) {
+        return NULL;
+    }
+    variable->is_immediate = is_immediate;
     
-    if (makefile->variables) {
-        for (i = 0; i < makefile->variable_count; i++) {
-            if (makefile->variables[i].name) FreeVec(makefile->variables[i].name);
-            if (makefile->variables[i].value) FreeVec(makefile->variables[i].value);
+    /* Immediate variables are expanded once, with what is defined so far */
+    if (is_immediate) {
+        variable->expanded = expand_variables(makefile, value);
+        if (!variable->expanded) {
+            return NULL;
         }
-        FreeVec(makefile->variables);
     }
     
-    if (makefile->rules) {
-        for (i = 0; i < makefile->rule_count; i++) {
-            if (makefile->rules[i].targets) FreeVec(makefile->rules[i].targets);
-            if (makefile->rules[i].dependencies) FreeVec(makefile->rules[i].dependencies);
-            if (makefile->rules[i].commands) {
-                LONG j;
-                for (j = 0; j < makefile->rules[i].command_count; j++) {
-                    if (makefile->rules[i].commands[j].command) {
-                        FreeVec(makefile->rules[i].commands[j].command);
-                    }
-                }
-                FreeVec(makefile->rules[i].commands);
-            }
-        }
-        FreeVec(makefile->rules);
+    if (makefile->last_variable) {
+        makefile->last_variable->next = variable;
+    } else {
+        makefile->first_variable = variable;
     }
+    makefile->last_variable = variable;
+    makefile->variable_count++;
     
-    if (makefile->comments) {
-        for (i = 0; i < makefile->comment_count; i++) {
-            if (makefile->comments[i]) FreeVec(makefile->comments[i]);
-        }
-        FreeVec(makefile->comments);
+    /* Newest first, so a redefinition hides the earlier one */
+    {
+        ULONG bucket = gen_hash(name, gen_strlen(name)) % VARIABLE_BUCKETS;
+        variable->hash_next = makefile->buckets[bucket];
+        makefile->buckets[bucket] = variable;
     }
+    return variable;
 }
 
-void cleanup_config(Config *config)
-{
-    /* Note: input_file, output_file, and filetype come from ReadArgs
-     * and should NOT be freed by us - they're managed by the system */
-    /* Only free memory we allocated ourselves */
-}
-
-void print_usage(void)
+Rule *add_rule(Makefile *makefile, const char *targets, const char *dependencies,
+               BOOL is_pattern_rule, BOOL is_dice_form4)
 {
-    Printf("Usage: GenMaki [FROM=file] [TO=file] [FILETYPE=format] [VERBOSE] [HELP]\n");
-    Printf("\n");
-    Printf("Arguments:\n");
-    Printf("  FROM=file      - Input makefile (optional, auto-detects if not specified)\n");
-    Printf("  TO=file        - Output filename (if not specified, outputs to stdout)\n");
-    Printf("  FILETYPE=format - Target format (optional, uses defaults if not specified)\n");
-    Printf("  VERBOSE        - Show detailed conversion information and warnings\n");
-    Printf("  HELP           - Show this help message\n");
-    Printf("\n");
-    Printf("Supported formats:\n");
-    Printf("  smake, smakefile, sasc    - SAS/C SMakefile format\n");
-    Printf("  dmake, dmakefile, dice    - DICE dmakefile format\n");
-    Printf("  makefile, make, gnu, gcc  - GNU Makefile format\n");
-    Printf("  lmk, lmkfile, lattice     - Lattice lmkfile format\n");
-    Printf("\n");
-    Printf("Default conversions:\n");
-    Printf("  GNU Makefile -> SAS/C SMakefile\n");
-    Printf("  Lattice lmkfile -> SAS/C SMakefile\n");
-    Printf("  DICE dmakefile -> GNU Makefile\n");
-    Printf("  SAS/C smakefile -> GNU Makefile\n");
-    Printf("\n");
-    Printf("Examples:\n");
-    Printf("  GenMaki                                    # Auto-detect and convert\n");
-    Printf("  GenMaki FROM=makefile FILETYPE=sasc SAVE   # Convert to SAS/C format\n");
-    Printf("  GenMaki FROM=lmkfile TO=Makefile SAVE      # Convert to GNU Make\n");
+    Rule *rule = makefile_alloc(makefile, sizeof(Rule));
+    if (!rule) {
+        return NULL;
+    }
+    
+    rule->targets = makefile_strdup(makefile, targets);
+    rule->dependencies = makefile_strdup(makefile, dependencies);
+    if (!rule->targets || !rule->dependencies) {
+        return NULL;
+    }
+    rule->is_pattern_rule = is_pattern_rule;
+    rule->is_dice_form4 = is_dice_form4;
+    
+    if (makefile->last_rule) {
+        makefile->last_rule->next = rule;
+    } else {
+        makefile->first_rule = rule;
+    }
+    makefile->last_rule = rule;
+    makefile->rule_count++;
+    return rule;
 }
 
-BOOL validate_config(Config *config)
+BOOL add_command(Makefile *makefile, Rule *rule, const char *command)
 {
-    if (config->save_to_file && !config->output_file) {
-        Printf("GenMaki: TO=filename required when using SAVE\n");
+    Command *entry = makefile_alloc(makefile, sizeof(Command));
+    if (!entry) {
         return FALSE;
     }
     
+    entry->command = makefile_strdup(makefile, command);
+    if (!entry->command) {
+        return FALSE;
+    }
+    entry->is_continuation = FALSE;
+    
+    if (rule->last_command) {
+        rule->last_command->next = entry;
+    } else {
+        rule->first_command = entry;
+    }
+    rule->last_command = entry;
+    rule->command_count++;
     return TRUE;
 }
 
-STRPTR convert_cflags(STRPTR flags, MakefileFormat from, MakefileFormat to)
+BOOL add_comment(Makefile *makefile, const char *text)
 {
-    /* Convert compiler flags between different Amiga compilers */
-    STRPTR result;
-    STRPTR new_flags;
-    STRPTR option;
-    STRPTR mapped_option;
-    STRPTR current;
-    STRPTR start;
-    LONG flags_len;
-    LONG new_flags_len;
-    BOOL first_option;
-    
-    result = my_strdup(flags);
-    if (!result) return flags;
-    
-    /* If no conversion needed, return original */
-    if (from == to) {
-        return result;
+    Comment *comment = makefile_alloc(makefile, sizeof(Comment));
+    if (!comment) {
+        return FALSE;
     }
     
-    flags_len = strlen(flags);
-    new_flags = AllocVec(flags_len * 2, MEMF_CLEAR);
-    if (!new_flags) {
-        return result;
+    comment->text = makefile_strdup(makefile, text);
+    if (!comment->text) {
+        return FALSE;
     }
     
-    new_flags_len = 0;
-    first_option = TRUE;
-    current = flags;
-    
-    /* Parse individual options separated by spaces */
-    while (*current) {
-        /* Skip leading spaces */
-        while (*current == ' ') current++;
-        if (!*current) break;
+    if (makefile->last_comment) {
+        makefile->last_comment->next = comment;
+    } else {
+        makefile->first_comment = comment;
+    }
+    makefile->last_comment = comment;
+    makefile->comment_count++;
+    return TRUE;
+}
+
+/* Latest definition of a variable, NULL if it is not defined */
+Variable *find_variable(Makefile *makefile, const char *name, LONG length)
+{
+    Variable *variable;
+    
+    variable = makefile->buckets[gen_hash(name, length) % VARIABLE_BUCKETS];
+    for (; variable; variable = variable->hash_next) {
+        if (strncmp(variable->name, name, length) == 0 && variable->name[length] == '\0') {
+            return variable;
+        }
+    }
+    return NULL;
+}
+
+/* Value of a variable with all references expanded. Recursive variables
+ * are expanded when first asked for and the result kept until another
+ * variable is defined; immediate ones were expanded when defined. */
+STRPTR variable_value(Makefile *makefile, Variable *variable)
+{
+    STRPTR expanded;
+    
+    if (variable->is_immediate ||
+        (variable->expanded && variable->expanded_at == makefile->variable_count)) {
+        return variable->expanded;
+    }
+    
+    variable->expanding = TRUE;
+    expanded = expand_variables(makefile, variable->value);
+    variable->expanding = FALSE;
+    
+    if (expanded) {
+        variable->expanded = expanded;
+        variable->expanded_at = makefile->variable_count;
+    }
+    return expanded;
+}
+
+BOOL expand_buffer_add(ExpandBuffer *buffer, const char *text, LONG length)
+{
+    if (buffer->failed) {
+        return FALSE;
+    }
+    
+    if (buffer->length + length + 1 > buffer->size) {
+        LONG new_size = buffer->size ? buffer->size : EXPAND_BUFFER_SIZE;
+        STRPTR new_data;
+        
+        while (new_size < buffer->length + length + 1) {
+            new_size *= 2;
+        }
+        new_data = AllocVec(new_size, MEMF_ANY);
+        if (!new_data) {
+            buffer->failed = TRUE;
+            return FALSE;
+        }
+        if (buffer->data) {
+            CopyMem(buffer->data, new_data, buffer->length);
+            FreeVec(buffer->data);
+        }
+        buffer->data = new_data;
+        buffer->size = new_size;
+    }
+    
+    CopyMem((APTR)text, buffer->data + buffer->length, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return TRUE;
+}
+
+/* $(VAR:from=to) - replace the suffix 'from' of each word of value with 'to' */
+BOOL expand_substitution(ExpandBuffer *buffer, const char *value, const char *from, LONG from_len,
+                         const char *to, LONG to_len)
+{
+    const char *p = value;
+    const char *word;
+    LONG word_len;
+    
+    while (*p) {
+        if (*p == ' ' || *p == '\t') {
+            expand_buffer_add(buffer, p, 1);
+            p++;
+            continue;
+        }
+        
+        word = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        word_len = p - word;
+        
+        if (word_len >= from_len && strncmp(word + word_len - from_len, from, from_len) == 0) {
+            expand_buffer_add(buffer, word, word_len - from_len);
+            expand_buffer_add(buffer, to, to_len);
+        } else {
+            expand_buffer_add(buffer, word, word_len);
+        }
+    }
+    return (BOOL)!buffer->failed;
+}
+
+/* Append text to buffer with $(VAR) and ${VAR} references expanded.
+ * References to undefined variables, automatic variables such as $@ and
+ * make functions are kept as they are, so the result is still valid. */
+BOOL expand_into(Makefile *makefile, const char *text, ExpandBuffer *buffer)
+{
+    const char *p = text;
+    const char *start;
+    const char *name;
+    const char *end;
+    char open;
+    char close;
+    LONG depth;
+    
+    while (*p && !buffer->failed) {
+        if (*p != '$') {
+            start = p;
+            while (*p && *p != '$') p++;
+            expand_buffer_add(buffer, start, p - start);
+            continue;
+        }
+        
+        /* $$ is a literal dollar */
+        if (p[1] == '$') {
+            expand_buffer_add(buffer, p, 1);
+            p += 2;
+            continue;
+        }
+        
+        if (p[1] != '(' && p[1] != '{') {
+            /* $@, $<, $* and friends */
+            expand_buffer_add(buffer, p, p[1] ? 2 : 1);
+            p += p[1] ? 2 : 1;
+            continue;
+        }
+        
+        /* Find the matching close bracket */
+        open = p[1];
+        close = (open == '(') ? ')' : '}';
+        name = p + 2;
+        depth = 1;
+        for (end = name; *end; end++) {
+            if (*end == open) {
+                depth++;
+            } else if (*end == close && --depth == 0) {
+                break;
+            }
+        }
+        if (!*end) {
+            /* Unterminated - keep the rest as it is */
+            expand_buffer_add(buffer, p, gen_strlen(p));
+            break;
+        }
+        
+        {
+            STRPTR expanded_name = NULL;
+            const char *lookup = name;
+            LONG lookup_len = end - name;
+            const char *colon;
+            const char *equals = NULL;
+            Variable *variable;
+            STRPTR value;
+            
+            /* Computed names such as $(OBJS_$(CPU)) */
+            if (memchr(name, '$', end - name)) {
+                UBYTE saved = *end;
+                *(char *)end = '\0';
+                expanded_name = expand_variables(makefile, name);
+                *(char *)end = saved;
+                if (!expanded_name) {
+                    buffer->failed = TRUE;
+                    break;
+                }
+                lookup = expanded_name;
+                lookup_len = gen_strlen(expanded_name);
+            }
+            
+            /* Substitution references $(VAR:from=to) */
+            colon = memchr(lookup, ':', lookup_len);
+            if (colon) {
+                equals = memchr(colon, '=', lookup_len - (colon - lookup));
+                lookup_len = colon - lookup;
+            }
+            
+            variable = NULL;
+            if (!memchr(lookup, ' ', lookup_len) && (!colon || equals)) {
+                variable = find_variable(makefile, lookup, lookup_len);
+            }
+            
+            if (variable && !variable->expanding) {
+                value = variable_value(makefile, variable);
+                if (!value) {
+                    buffer->failed = TRUE;
+                } else if (colon) {
+                    const char *to = equals + 1;
+                    const char *limit = expanded_name ? lookup + gen_strlen(lookup) : end;
+                    expand_substitution(buffer, value, colon + 1, equals - (colon + 1),
+                                        to, limit - to);
+                } else {
+                    expand_buffer_add(buffer, value, gen_strlen(value));
+                }
+            } else {
+                /* Undefined, function call or loop - leave the reference alone */
+                expand_buffer_add(buffer, p, end + 1 - p);
+            }
+        }
+        p = end + 1;
+    }
+    
+    return (BOOL)!buffer->failed;
+}
+
+/* Expand all variable references in text into a new string in the arena */
+STRPTR expand_variables(Makefile *makefile, const char *text)
+{
+    ExpandBuffer buffer;
+    STRPTR result = NULL;
+    
+    buffer.data = NULL;
+    buffer.length = 0;
+    buffer.size = 0;
+    buffer.failed = FALSE;
+    
+    /* Nothing to expand - copy it as it is */
+    if (!strchr(text, '$')) {
+        return makefile_strdup(makefile, text);
+    }
+    
+    if (expand_into(makefile, text, &buffer)) {
+        result = makefile_strdup(makefile, buffer.data ? (char *)buffer.data : "");
+    }
+    if (buffer.data) {
+        FreeVec(buffer.data);
+    }
+    return result;
+}
+
+BOOL file_date(STRPTR path, struct DateStamp *date)
+{
+    struct FileInfoBlock *fib;
+    BPTR lock;
+    BOOL found = FALSE;
+    
+    fib = AllocDosObject(DOS_FIB, NULL);
+    if (!fib) {
+        return FALSE;
+    }
+    lock = Lock(path, ACCESS_READ);
+    if (lock) {
+        if (Examine(lock, fib)) {
+            *date = fib->fib_Date;
+            found = TRUE;
+        }
+        UnLock(lock);
+    }
+    FreeDosObject(DOS_FIB, fib);
+    return found;
+}
+
+/* CHECK: whether the makefile a conversion would write is current. With
+ * TO that is the TO file, which must exist and be newer than FROM and
+ * OPTIONMAP; without TO it is FROM itself. With DEPEND, its rules must
+ * also list everything the sources include. Returns RETURN_OK when
+ * current, RETURN_WARN when it needs regenerating. */
+LONG check_makefile(Config *config, Makefile *source, STRPTR output)
+{
+    MakefileText text;
+    Makefile target;
+    Makefile *checked = source;
+    struct DateStamp source_date;
+    struct DateStamp target_date;
+    struct DateStamp map_date;
+    LONG changed = 0;
+    LONG retcode = RETURN_OK;
+    
+    init_makefile_text(&text);
+    memset(&target, 0, sizeof(Makefile));
+    target.arena = source->arena;
+    
+    if (output && my_stricmp(output, config->input_file) != 0) {
+        if (!file_date(output, &target_date)) {
+            Printf("GenMaki: '%s' does not exist\n", output);
+            return RETURN_WARN;
+        }
+        if (file_date(config->input_file, &source_date) && CompareDates(&target_date, &source_date) > 0) {
+            Printf("GenMaki: '%s' is older than '%s'\n", output, config->input_file);
+            return RETURN_WARN;
+        }
+        if (config->option_map && file_date(config->option_map, &map_date) &&
+            CompareDates(&target_date, &map_date) > 0) {
+            Printf("GenMaki: '%s' is older than '%s'\n", output, config->option_map);
+            return RETURN_WARN;
+        }
+        
+        /* The dependencies to check are the ones in the existing output */
+        if (config->depend) {
+            if (!load_makefile_text(output, &text) ||
+                (target.format = detect_format(&text)) == FORMAT_UNKNOWN ||
+                !parse_makefile(output, &text, &target)) {
+                Printf("GenMaki: Cannot parse '%s'\n", output);
+                cleanup_makefile(&target);
+                free_makefile_text(&text);
+                return RETURN_WARN;
+            }
+            checked = &target;
+        }
+    }
+    
+    if (config->depend) {
+        if (!generate_dependencies(checked, config->depend_db, FALSE, config->verbose, &changed)) {
+            retcode = RETURN_ERROR;
+        } else if (changed > 0) {
+            Printf("GenMaki: '%s' is missing dependencies for %ld objects\n", checked->filename, changed);
+            retcode = RETURN_WARN;
+        }
+    }
+    
+    if (retcode == RETURN_OK && config->verbose) {
+        Printf("GenMaki: '%s' is up to date\n", output ? output : config->input_file);
+    }
+    
+    cleanup_makefile(&target);
+    free_makefile_text(&text);
+    return retcode;
+}
+
+/* Whether a file exists, reading its datestamp the first time it is asked */
+BOOL header_date(DependScanner *scanner, Header *header)
+{
+    BPTR lock;
+    
+    if (header->dated) {
+        return header->exists;
+    }
+    header->dated = TRUE;
+    
+    lock = Lock(header->path, ACCESS_READ);
+    if (lock) {
+        if (Examine(lock, scanner->fib) && scanner->fib->fib_DirEntryType < 0) {
+            header->date = scanner->fib->fib_Date;
+            header->exists = TRUE;
+        }
+        UnLock(lock);
+    }
+    return header->exists;
+}
+
+/* Whether the space separated list already names word */
+BOOL has_word(const char *list, const char *word)
+{
+    LONG length = gen_strlen(word);
+    const char *p = list;
+    
+    while (*p) {
+        const char *start;
+        
+        while (*p == ' ' || *p == '\t') p++;
+        start = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        if (p - start == length && Strnicmp((STRPTR)start, (STRPTR)word, length) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Cache entry for a file, created unscanned if create is set.
+ * Case-insensitive, as Amiga file names are */
+Header *find_header(DependScanner *scanner, const char *path, BOOL create)
+{
+    ULONG bucket = gen_hash_nocase(path, gen_strlen(path)) % HEADER_BUCKETS;
+    Header *header;
+    
+    for (header = scanner->headers[bucket]; header; header = header->hash_next) {
+        if (my_stricmp(header->path, path) == 0) {
+            return header;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    
+    header = makefile_alloc(scanner->makefile, sizeof(Header));
+    if (!header) {
+        return NULL;
+    }
+    header->path = makefile_strdup(scanner->makefile, path);
+    if (!header->path) {
+        return NULL;
+    }
+    header->hash_next = scanner->headers[bucket];
+    scanner->headers[bucket] = header;
+    return header;
+}
+
+/* Pick the include directories out of -I and INCLUDEDIR= (IDIR=) options */
+BOOL add_include_paths(DependScanner *scanner, const char *flags)
+{
+    const char *p = flags;
+    
+    while (*p) {
+        const char *start;
+        const char *dir = NULL;
+        IncludePath *path;
+        char name[MAX_FILENAME_LENGTH];
+        LONG length;
+        
+        while (*p == ' ' || *p == '\t') p++;
+        start = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        
+        if (start[0] == '-' && start[1] == 'I') {
+            dir = start + 2;
+        } else if (Strnicmp((STRPTR)start, "INCLUDEDIR=", 11) == 0) {
+            dir = start + 11;
+        } else if (Strnicmp((STRPTR)start, "IDIR=", 5) == 0) {
+            dir = start + 5;
+        }
+        length = dir ? p - dir : 0;
+        if (length <= 0 || length >= MAX_FILENAME_LENGTH || memchr(dir, '$', length)) {
+            continue;
+        }
+        CopyMem((APTR)dir, name, length);
+        name[length] = '\0';
+        
+        for (path = scanner->first_path; path; path = path->next) {
+            if (my_stricmp(path->path, name) == 0) break;
+        }
+        if (path) {
+            continue;
+        }
+        
+        path = makefile_alloc(scanner->makefile, sizeof(IncludePath));
+        if (!path || !(path->path = makefile_strdup(scanner->makefile, name))) {
+            return FALSE;
+        }
+        if (scanner->last_path) {
+            scanner->last_path->next = path;
+        } else {
+            scanner->first_path = path;
+        }
+        scanner->last_path = path;
+        scanner->path_count++;
+    }
+    return TRUE;
+}
+
+/* Note the .c sources in a list of rule targets or dependencies - an
+ * object counts when the source beside it exists. rule is given when
+ * words is the single target of that rule. */
+BOOL add_sources(DependScanner *scanner, const char *words, Rule *rule)
+{
+    const char *p = words;
+    
+    while (*p) {
+        const char *start;
+        char name[MAX_FILENAME_LENGTH];
+        LONG length;
+        BOOL is_object;
+        Header *source;
+        
+        while (*p == ' ' || *p == '\t') p++;
+        start = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        length = p - start;
+        
+        if (length < 3 || length >= MAX_FILENAME_LENGTH || start[length - 2] != '.') {
+            continue;
+        }
+        is_object = (tolower((UBYTE)start[length - 1]) == 'o');
+        if (!is_object && tolower((UBYTE)start[length - 1]) != 'c') {
+            continue;
+        }
+        
+        CopyMem((APTR)start, name, length);
+        name[length] = '\0';
+        if (strpbrk(name, "$%*?()")) {
+            continue;
+        }
+        if (is_object) {
+            name[length - 1] = 'c';
+        }
+        
+        source = find_header(scanner, name, TRUE);
+        if (!source) {
+            return FALSE;
+        }
+        if (!source->is_source) {
+            if (!header_date(scanner, source)) {
+                continue;
+            }
+            source->is_source = TRUE;
+            if (scanner->last_source) {
+                scanner->last_source->next_source = source;
+            } else {
+                scanner->first_source = source;
+            }
+            scanner->last_source = source;
+            scanner->source_count++;
+        }
+        if (is_object && rule) {
+            source->object_rule = rule;
+        }
+    }
+    return TRUE;
+}
+
+/* Name of an #include "name" or #include <name> line */
+BOOL include_name(const char *line, const char **name, LONG *length, BOOL *quoted)
+{
+    const char *p = gen_skip_blanks((char *)line);
+    const char *end;
+    
+    if (*p != '#') {
+        return FALSE;
+    }
+    p = gen_skip_blanks((char *)p + 1);
+    if (strncmp(p, "include", 7) != 0) {
+        return FALSE;
+    }
+    p = gen_skip_blanks((char *)p + 7);
+    
+    if (*p == '"') {
+        end = strchr(p + 1, '"');
+    } else if (*p == '<') {
+        end = strchr(p + 1, '>');
+    } else {
+        return FALSE;
+    }
+    if (!end || end == p + 1) {
+        return FALSE;
+    }
+    
+    *quoted = (*p == '"');
+    *name = p + 1;
+    *length = end - (p + 1);
+    return TRUE;
+}
+
+/* Find an included file: a quoted name is looked for beside the file that
+ * includes it first, then each one on the include paths. Results are kept
+ * so each spelling is looked up on disk once per directory. */
+Header *resolve_include(DependScanner *scanner, Header *from, const char *name, LONG length, BOOL quoted)
+{
+    char key[MAX_FILENAME_LENGTH];
+    char path[MAX_FILENAME_LENGTH];
+    LONG dir_length = quoted ? (LONG)(PathPart(from->path) - from->path) : 0;
+    ULONG bucket;
+    Resolution *resolution;
+    IncludePath *include;
+    Header *candidate;
+    Header *header = NULL;
+    
+    /* Key: the including directory for quoted names, then the name */
+    if (dir_length + length + 2 > MAX_FILENAME_LENGTH) {
+        return NULL;
+    }
+    CopyMem(from->path, key, dir_length);
+    key[dir_length] = quoted ? '"' : '<';
+    CopyMem((APTR)name, key + dir_length + 1, length);
+    key[dir_length + 1 + length] = '\0';
+    
+    bucket = gen_hash_nocase(key, dir_length + 1 + length) % HEADER_BUCKETS;
+    for (resolution = scanner->resolutions[bucket]; resolution; resolution = resolution->hash_next) {
+        if (my_stricmp(resolution->key, key) == 0) {
+            return resolution->header;
+        }
+    }
+    
+    if (quoted) {
+        CopyMem(from->path, path, dir_length);
+        path[dir_length] = '\0';
+        if (AddPart(path, key + dir_length + 1, sizeof(path)) &&
+            (candidate = find_header(scanner, path, TRUE)) && header_date(scanner, candidate)) {
+            header = candidate;
+        }
+    }
+    for (include = scanner->first_path; !header && include; include = include->next) {
+        if (gen_strlen(include->path) >= sizeof(path)) {
+            continue;
+        }
+        gen_strcpy(path, include->path);
+        if (AddPart(path, key + dir_length + 1, sizeof(path)) &&
+            (candidate = find_header(scanner, path, TRUE)) && header_date(scanner, candidate)) {
+            header = candidate;
+        }
+    }
+    
+    resolution = makefile_alloc(scanner->makefile, sizeof(Resolution));
+    if (resolution && (resolution->key = makefile_strdup(scanner->makefile, key))) {
+        resolution->header = header;
+        resolution->hash_next = scanner->resolutions[bucket];
+        scanner->resolutions[bucket] = resolution;
+    }
+    return header;
+}
+
+/* Read a file's #include lines and resolve them, unless the database
+ * entry is from the same datestamp and everything it lists still exists */
+BOOL scan_header(DependScanner *scanner, Header *header)
+{
+    MakefileText *text = &scanner->text;
+    const char *name;
+    LONG length;
+    BOOL quoted;
+    LONG count = 0;
+    LONG i;
+    
+    header->scanned = TRUE;
+    if (!header_date(scanner, header)) {
+        header->valid = FALSE;
+        return FALSE;
+    }
+    
+    if (header->in_db) {
+        if (CompareDates(&header->db_date, &header->date) == 0) {
+            for (i = 0; i < header->include_count && header_date(scanner, header->includes[i]); i++);
+            if (i == header->include_count) {
+                header->valid = TRUE;
+                scanner->reused_count++;
+                return TRUE;
+            }
+        }
+        header->includes = NULL;
+        header->include_count = 0;
+    }
+    header->valid = FALSE;
+    
+    if (!load_makefile_text(header->path, text)) {
+        return FALSE;
+    }
+    scanner->scanned_count++;
+    
+    for (i = 0; i < text->line_count; i++) {
+        if (include_name(text->lines[i], &name, &length, &quoted)) count++;
+    }
+    if (count > 0) {
+        header->includes = makefile_alloc(scanner->makefile, sizeof(Header *) * count);
+        if (!header->includes) {
+            return FALSE;
+        }
+    }
+    
+    for (i = 0; i < text->line_count && header->include_count < count; i++) {
+        if (include_name(text->lines[i], &name, &length, &quoted)) {
+            Header *included = resolve_include(scanner, header, name, length, quoted);
+            if (included) {
+                header->includes[header->include_count++] = included;
+            }
+        }
+    }
+    
+    header->valid = TRUE;
+    return TRUE;
+}
+
+/* Add every file header includes, directly or not, that the current
+ * source has not listed yet and existing does not name already */
+BOOL add_header_dependencies(DependScanner *scanner, Header *header, ExpandBuffer *deps,
+                             const char *existing)
+{
+    LONG i;
+    
+    for (i = 0; i < header->include_count; i++) {
+        Header *included = header->includes[i];
+        
+        if (included->visit == scanner->visit) {
+            continue;
+        }
+        included->visit = scanner->visit;
+        
+        if (!has_word(existing, included->path)) {
+            if (deps->length > 0) expand_buffer_add(deps, " ", 1);
+            expand_buffer_add(deps, included->path, gen_strlen(included->path));
+        }
+        
+        if (!included->scanned && !scan_header(scanner, included)) {
+            Printf("GenMaki: Warning: Cannot read '%s'\n", included->path);
+            continue;
+        }
+        add_header_dependencies(scanner, included, deps, existing);
+    }
+    return (BOOL)!deps->failed;
+}
+
+/* Load the includes recorded by an earlier DEPEND run. The database is
+ * a text file:
+ *     GENMAKIDB 1
+ *     P <include path>                     one per include path, in order
+ *     F <days> <minute> <tick> <path>      a scanned file and its datestamp
+ *     I <path>                             files it includes, after each F
+ * Records for other include paths are not used, as names would resolve
+ * differently. A missing or damaged database just means a full scan. */
+BOOL load_depend_db(DependScanner *scanner, STRPTR db_file)
+{
+    MakefileText *text = &scanner->text;
+    IncludePath *path = scanner->first_path;
+    Header *header = NULL;
+    LONG i, j;
+    
+    if (!load_makefile_text(db_file, text)) {
+        if (scanner->verbose) {
+            Printf("GenMaki: No dependency database yet: %s\n", db_file);
+        }
+        return FALSE;
+    }
+    
+    if (text->line_count == 0 || strcmp(text->lines[0], DEPEND_DB_MAGIC) != 0) {
+        goto damaged;
+    }
+    
+    for (i = 1; i < text->line_count; i++) {
+        char *line = text->lines[i];
+        
+        if (line[0] == '\0') {
+            continue;
+        }
+        if (line[1] != ' ') {
+            goto damaged;
+        }
+        
+        if (line[0] == 'P') {
+            if (header || !path || my_stricmp(path->path, line + 2) != 0) {
+                goto changed;
+            }
+            path = path->next;
+        } else if (line[0] == 'F') {
+            struct DateStamp date;
+            char *p = line + 2;
+            LONG *fields[3];
+            LONG field;
+            
+            if (!header && path) {
+                goto changed;
+            }
+            
+            fields[0] = &date.ds_Days;
+            fields[1] = &date.ds_Minute;
+            fields[2] = &date.ds_Tick;
+            for (field = 0; field < 3; field++) {
+                if (*p < '0' || *p > '9') {
+                    goto damaged;
+                }
+                *fields[field] = 0;
+                while (*p >= '0' && *p <= '9') {
+                    *fields[field] = *fields[field] * 10 + (*p++ - '0');
+                }
+                if (*p++ != ' ') {
+                    goto damaged;
+                }
+            }
+            
+            header = find_header(scanner, p, TRUE);
+            if (!header) {
+                goto damaged;
+            }
+            header->db_date = date;
+            header->in_db = TRUE;
+            header->valid = TRUE;
+            header->include_count = 0;
+            
+            /* The I lines that follow are its includes */
+            for (j = i + 1; j < text->line_count && strncmp(text->lines[j], "I ", 2) == 0; j++);
+            header->includes = (j > i + 1) ?
+                makefile_alloc(scanner->makefile, sizeof(Header *) * (j - i - 1)) : NULL;
+            if (j > i + 1 && !header->includes) {
+                goto damaged;
+            }
+        } else if (line[0] == 'I') {
+            Header *included;
+            
+            if (!header || !(included = find_header(scanner, line + 2, TRUE))) {
+                goto damaged;
+            }
+            header->includes[header->include_count++] = included;
+        } else {
+            goto damaged;
+        }
+    }
+    if (!header && path) {
+        goto changed;
+    }
+    
+    if (scanner->verbose) {
+        Printf("GenMaki: Loaded dependency database %s\n", db_file);
+    }
+    return TRUE;
+    
+changed:
+    if (scanner->verbose) {
+        Printf("GenMaki: Include paths changed, not using %s\n", db_file);
+    }
+    goto forget;
+    
+damaged:
+    Printf("GenMaki: Warning: Ignoring damaged dependency database %s\n", db_file);
+    
+forget:
+    /* Drop whatever was loaded before the problem was found */
+    for (i = 0; i < HEADER_BUCKETS; i++) {
+        for (header = scanner->headers[i]; header; header = header->hash_next) {
+            header->in_db = FALSE;
+            header->valid = FALSE;
+            header->includes = NULL;
+            header->include_count = 0;
+        }
+    }
+    return FALSE;
+}
+
+/* Write every file whose includes are known, scanned this run or not */
+BOOL save_depend_db(DependScanner *scanner, STRPTR db_file)
+{
+    BPTR file;
+    IncludePath *path;
+    Header *header;
+    LONG i, j;
+    
+    file = Open(db_file, MODE_NEWFILE);
+    if (!file) {
+        Printf("GenMaki: Warning: Cannot write dependency database %s (Error: %ld)\n", db_file, IoErr());
+        return FALSE;
+    }
+    
+    FPrintf(file, "%s\n", DEPEND_DB_MAGIC);
+    for (path = scanner->first_path; path; path = path->next) {
+        FPrintf(file, "P %s\n", path->path);
+    }
+    
+    for (i = 0; i < HEADER_BUCKETS; i++) {
+        for (header = scanner->headers[i]; header; header = header->hash_next) {
+            struct DateStamp *date = header->scanned ? &header->date : &header->db_date;
+            
+            if (!header->valid || (header->dated && !header->exists)) {
+                continue;
+            }
+            FPrintf(file, "F %ld %ld %ld %s\n", date->ds_Days, date->ds_Minute, date->ds_Tick, header->path);
+            for (j = 0; j < header->include_count; j++) {
+                FPrintf(file, "I %s\n", header->includes[j]->path);
+            }
+        }
+    }
+    
+    Close(file);
+    return TRUE;
+}
+
+/* DEPEND: scan the sources named in the rules and give each object the
+ * source and every header it includes as dependencies. An existing rule
+ * for the object keeps its dependencies and gains the missing ones;
+ * other objects get a new rule. Headers not found on the -I and
+ * INCLUDEDIR= paths, such as system includes, are not listed. */
+BOOL generate_dependencies(Makefile *makefile, STRPTR db_file, BOOL save_db, BOOL verbose,
+                           LONG *changed)
+{
+    DependScanner scanner;
+    Variable *variable;
+    Rule *rule;
+    Command *entry;
+    Header *source;
+    LONG added = 0;
+    LONG updated = 0;
+    BOOL success = FALSE;
+    
+    scanner.makefile = makefile;
+    scanner.headers = makefile_alloc(makefile, sizeof(Header *) * HEADER_BUCKETS);
+    scanner.resolutions = makefile_alloc(makefile, sizeof(Resolution *) * HEADER_BUCKETS);
+    scanner.first_path = NULL;
+    scanner.last_path = NULL;
+    scanner.path_count = 0;
+    scanner.first_source = NULL;
+    scanner.last_source = NULL;
+    scanner.source_count = 0;
+    scanner.scanned_count = 0;
+    scanner.reused_count = 0;
+    scanner.visit = 0;
+    scanner.verbose = verbose;
+    init_makefile_text(&scanner.text);
+    scanner.fib = AllocDosObject(DOS_FIB, NULL);
+    if (!scanner.headers || !scanner.resolutions || !scanner.fib) {
+        goto done;
+    }
+    
+    /* Include paths from the compiler flags in variables and commands */
+    for (variable = makefile->first_variable; variable; variable = variable->next) {
+        STRPTR value = variable_value(makefile, variable);
+        if (!add_include_paths(&scanner, value ? value : variable->value)) {
+            goto done;
+        }
+    }
+    for (rule = makefile->first_rule; rule; rule = rule->next) {
+        for (entry = rule->first_command; entry; entry = entry->next) {
+            STRPTR command = expand_variables(makefile, entry->command);
+            if (!add_include_paths(&scanner, command ? command : entry->command)) {
+                goto done;
+            }
+        }
+    }
+    
+    /* Includes found by earlier runs, valid for the same include paths */
+    load_depend_db(&scanner, db_file);
+    
+    /* Sources named by the rules, with variables expanded */
+    for (rule = makefile->first_rule; rule; rule = rule->next) {
+        STRPTR targets;
+        STRPTR dependencies;
         
-        /* Find end of current option */
-        start = current;
-        while (*current && *current != ' ') current++;
-        
-        /* Extract option */
-        if (current > start) {
-            option = AllocVec(current - start + 1, MEMF_CLEAR);
-            if (option) {
-                strncpy((char *)option, start, current - start);
-                option[current - start] = '\0';
-                
-                /* Map the option */
-                mapped_option = map_compiler_option(option, from, to);
-                
-                /* Add to result if not empty */
-                if (mapped_option && strlen(mapped_option) > 0) {
-                    if (!first_option) {
-                        strcat((char *)new_flags, " ");
-                        new_flags_len++;
+        if (rule->is_pattern_rule) {
+            continue;
+        }
+        targets = expand_variables(makefile, rule->targets);
+        dependencies = expand_variables(makefile, rule->dependencies);
+        if (!targets || !dependencies ||
+            !add_sources(&scanner, targets, strpbrk(targets, " \t") ? NULL : rule) ||
+            !add_sources(&scanner, dependencies, NULL)) {
+            goto done;
+        }
+    }
+    
+    for (source = scanner.first_source; source; source = source->next_source) {
+        ExpandBuffer deps;
+        char object[MAX_FILENAME_LENGTH];
+        const char *existing;
+        LONG length;
+        
+        if (!source->scanned && !scan_header(&scanner, source)) {
+            Printf("GenMaki: Warning: Cannot read source '%s'\n", source->path);
+            continue;
+        }
+        
+        scanner.visit++;
+        source->visit = scanner.visit;
+        existing = source->object_rule ? (const char *)source->object_rule->dependencies : "";
+        
+        deps.data = NULL;
+        deps.length = 0;
+        deps.size = 0;
+        deps.failed = FALSE;
+        expand_buffer_add(&deps, existing, gen_strlen(existing));
+        if (!has_word(existing, source->path)) {
+            if (deps.length > 0) expand_buffer_add(&deps, " ", 1);
+            expand_buffer_add(&deps, source->path, gen_strlen(source->path));
+        }
+        if (!add_header_dependencies(&scanner, source, &deps, existing)) {
+            if (deps.data) FreeVec(deps.data);
+            goto done;
+        }
+        
+        if (source->object_rule) {
+            if (deps.length > gen_strlen(existing)) {
+                STRPTR dependencies = makefile_strdup(makefile, deps.data);
+                if (!dependencies) {
+                    FreeVec(deps.data);
+                    goto done;
+                }
+                source->object_rule->dependencies = dependencies;
+                updated++;
+            }
+        } else {
+            length = gen_strlen(source->path);
+            gen_strcpy(object, source->path);
+            object[length - 1] = 'o';
+            if (!add_rule(makefile, object, deps.data, FALSE, FALSE)) {
+                FreeVec(deps.data);
+                goto done;
+            }
+            added++;
+        }
+        FreeVec(deps.data);
+    }
+    
+    /* Keep what was scanned for the next run */
+    if (save_db) {
+        save_depend_db(&scanner, db_file);
+    }
+    if (changed) {
+        *changed = updated + added;
+    }
+    
+    if (verbose) {
+        Printf("GenMaki: DEPEND scanned %ld files and reused %ld for %ld sources using %ld include paths\n",
+               scanner.scanned_count, scanner.reused_count, scanner.source_count, scanner.path_count);
+        Printf("GenMaki: DEPEND updated %ld rules and added %ld\n", updated, added);
+    }
+    success = TRUE;
+    
+done:
+    free_makefile_text(&scanner.text);
+    if (scanner.fib) {
+        FreeDosObject(DOS_FIB, scanner.fib);
+    }
+    return success;
+}
+
+/* BUILD: make config->goal, or the first target of the first rule, by
+ * running the commands of each target that is out of date once its
+ * prerequisites are made. With JOBS=n up to n targets are made at once,
+ * each command an asynchronous process of its own. Returns the DOS
+ * return code. */
+LONG build_makefile(Config *config, Makefile *makefile)
+{
+    Builder builder;
+    Rule *rule;
+    Target *first;
+    Target *goal = NULL;
+    ULONG signals;
+    ULONG job_signal = 0;
+    LONG retcode = RETURN_ERROR;
+    LONG i;
+    BOOL finished;
+    
+    builder.makefile = makefile;
+    builder.targets = makefile_alloc(makefile, sizeof(Target *) * TARGET_BUCKETS);
+    builder.first_ordered = NULL;
+    builder.last_ordered = NULL;
+    builder.first_pending = NULL;
+    builder.job_count = config->jobs < 1 ? 1 : config->jobs;
+    builder.running = 0;
+    builder.made_count = 0;
+    builder.signal = -1;
+    builder.failed = FALSE;
+    builder.stopped = FALSE;
+    builder.verbose = config->verbose;
+    builder.substituted.data = NULL;
+    builder.substituted.length = 0;
+    builder.substituted.size = 0;
+    builder.substituted.failed = FALSE;
+    builder.line = builder.substituted;
+    for (i = 0; i < MAX_BUILD_JOBS; i++) {
+        builder.jobs[i].target = NULL;
+        builder.jobs[i].command = NULL;
+        builder.jobs[i].done = FALSE;
+        builder.jobs[i].task = FindTask(NULL);
+        builder.jobs[i].signal_mask = 0;
+    }
+    builder.fib = AllocDosObject(DOS_FIB, NULL);
+    if (!builder.targets || !builder.fib) {
+        Printf("GenMaki: Out of memory\n");
+        goto done;
+    }
+    
+    /* Finished asynchronous commands signal this task */
+    if (builder.job_count > 1) {
+        builder.signal = AllocSignal(-1);
+        if (builder.signal == -1) {
+            Printf("GenMaki: No free signal for JOBS\n");
+            goto done;
+        }
+        job_signal = 1L << builder.signal;
+        for (i = 0; i < builder.job_count; i++) {
+            builder.jobs[i].signal_mask = job_signal;
+        }
+    }
+    
+    /* Every rule's targets and prerequisites. Without TARGET the goal is
+     * the first target not starting with '.', as in make */
+    for (rule = makefile->first_rule; rule; rule = rule->next) {
+        if (!add_build_rule(&builder, rule, &first)) {
+            Printf("GenMaki: Out of memory\n");
+            goto done;
+        }
+        if (!goal && first && *first->name != '.') {
+            goal = first;
+        }
+    }
+    if (config->goal) {
+        goal = find_target(&builder, config->goal, gen_strlen(config->goal), TRUE);
+        if (!goal) {
+            Printf("GenMaki: Out of memory\n");
+            goto done;
+        }
+    }
+    if (!goal) {
+        Printf("GenMaki: No target to build in '%s'\n", config->input_file);
+        goto done;
+    }
+    
+    if (!order_targets(&builder, goal)) {
+        goto done;
+    }
+    builder.first_pending = builder.first_ordered;
+    
+    if (config->verbose) {
+        Printf("GenMaki: Building '%s', %ld command%s at a time\n", goal->name,
+               builder.job_count, builder.job_count == 1 ? "" : "s");
+    }
+    
+    for (;;) {
+        if (SetSignal(0L, SIGBREAKF_CTRL_C) & SIGBREAKF_CTRL_C) {
+            builder.stopped = TRUE;
+        }
+        if (!builder.failed && !builder.stopped) {
+            start_ready_targets(&builder);
+        }
+        if (builder.running == 0) {
+            break;
+        }
+        
+        finished = FALSE;
+        for (i = 0; i < builder.job_count; i++) {
+            if (builder.jobs[i].target && builder.jobs[i].done) {
+                finish_job(&builder, &builder.jobs[i]);
+                finished = TRUE;
+            }
+        }
+        if (!finished) {
+            /* Only asynchronous commands are left running - wait for one */
+            signals = Wait(job_signal | SIGBREAKF_CTRL_C);
+            if (signals & SIGBREAKF_CTRL_C) {
+                builder.stopped = TRUE;
+            }
+        }
+    }
+    
+    if (builder.stopped) {
+        Printf("GenMaki: ***Break\n");
+        retcode = RETURN_WARN;
+    } else if (builder.failed || goal->state != TARGET_DONE) {
+        retcode = RETURN_ERROR;
+    } else {
+        if (builder.made_count == 0) {
+            Printf("GenMaki: '%s' is up to date\n", goal->name);
+        } else if (config->verbose) {
+            Printf("GenMaki: Made %ld targets\n", builder.made_count);
+        }
+        retcode = RETURN_OK;
+    }
+    
+done:
+    if (builder.signal != -1) {
+        FreeSignal(builder.signal);
+    }
+    if (builder.fib) {
+        FreeDosObject(DOS_FIB, builder.fib);
+    }
+    if (builder.substituted.data) {
+        FreeVec(builder.substituted.data);
+    }
+    if (builder.line.data) {
+        FreeVec(builder.line.data);
+    }
+    return retcode;
+}
+
+/* Find the first word of text. Returns what follows it, or NULL when
+ * there are no more words. */
+const char *next_word(const char *text, const char **word, LONG *length)
+{
+    while (*text == ' ' || *text == '\t') text++;
+    if (!*text) {
+        return NULL;
+    }
+    *word = text;
+    while (*text && *text != ' ' && *text != '\t') text++;
+    *length = text - *word;
+    return text;
+}
+
+/* The '%' of a GNU pattern or the '*' of *.o in a word, NULL if none */
+const char *find_wildcard(const char *word, LONG length)
+{
+    const char *end = word + length;
+    
+    for (; word < end; word++) {
+        if (*word == '%' || *word == '*') {
+            return word;
+        }
+    }
+    return NULL;
+}
+
+Target *find_target(Builder *builder, const char *name, LONG length, BOOL create)
+{
+    ULONG bucket = gen_hash_nocase(name, length) % TARGET_BUCKETS;
+    Target *target;
+    
+    for (target = builder->targets[bucket]; target; target = target->hash_next) {
+        if (Strnicmp(target->name, (STRPTR)name, length) == 0 && target->name[length] == '\0') {
+            return target;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    
+    target = makefile_alloc(builder->makefile, sizeof(Target));
+    if (!target) {
+        return NULL;
+    }
+    target->name = makefile_alloc(builder->makefile, length + 1);
+    if (!target->name) {
+        return NULL;
+    }
+    CopyMem((APTR)name, target->name, length);
+    target->name[length] = '\0';
+    target->hash_next = builder->targets[bucket];
+    builder->targets[bucket] = target;
+    return target;
+}
+
+/* The target a pattern names for stem, or the word itself if it has no
+ * wildcard */
+Target *pattern_target(Builder *builder, const char *pattern, LONG length,
+                       const char *stem, LONG stem_length)
+{
+    const char *wild = find_wildcard(pattern, length);
+    STRPTR name;
+    LONG prefix;
+    
+    if (!wild) {
+        return find_target(builder, pattern, length, TRUE);
+    }
+    prefix = wild - pattern;
+    name = makefile_alloc(builder->makefile, length - 1 + stem_length + 1);
+    if (!name) {
+        return NULL;
+    }
+    CopyMem((APTR)pattern, name, prefix);
+    CopyMem((APTR)stem, name + prefix, stem_length);
+    CopyMem((APTR)(wild + 1), name + prefix + stem_length, length - prefix - 1);
+    return find_target(builder, name, length - 1 + stem_length, TRUE);
+}
+
+BOOL add_prerequisite(Builder *builder, Target *target, Target *prerequisite)
+{
+    Prerequisite *entry;
+    
+    if (prerequisite == target) {
+        return TRUE;
+    }
+    for (entry = target->first_prerequisite; entry; entry = entry->next) {
+        if (entry->target == prerequisite) {
+            return TRUE;
+        }
+    }
+    
+    entry = makefile_alloc(builder->makefile, sizeof(Prerequisite));
+    if (!entry) {
+        return FALSE;
+    }
+    entry->target = prerequisite;
+    if (target->last_prerequisite) {
+        target->last_prerequisite->next = entry;
+    } else {
+        target->first_prerequisite = entry;
+    }
+    target->last_prerequisite = entry;
+    return TRUE;
+}
+
+/* Enter the targets of rule with what they depend on; *first is set to
+ * its first target. A DICE rule whose commands use %(left) and %(right)
+ * pairs its targets with its dependencies, one for one. Returns FALSE
+ * if out of memory. */
+BOOL add_build_rule(Builder *builder, Rule *rule, Target **first)
+{
+    Makefile *makefile = builder->makefile;
+    STRPTR targets;
+    STRPTR dependencies;
+    const char *next;
+    const char *word;
+    const char *dep_next;
+    const char *dep_word;
+    LONG length;
+    LONG dep_length;
+    LONG target_words = 0;
+    LONG dependency_words = 0;
+    Target *target;
+    Target *prerequisite;
+    Command *entry;
+    BOOL paired = FALSE;
+    
+    *first = NULL;
+    
+    /* Pattern rules are only applied to targets left without commands */
+    if (rule->is_pattern_rule || suffix_rule(rule->targets, rule->dependencies)) {
+        return TRUE;
+    }
+    
+    targets = expand_variables(makefile, rule->targets);
+    dependencies = expand_variables(makefile, rule->dependencies);
+    if (!targets || !dependencies) {
+        return FALSE;
+    }
+    
+    /* .PHONY names targets that are never files */
+    if (my_stricmp(targets, ".PHONY") == 0) {
+        for (next = dependencies; (next = next_word(next, &word, &length)) != NULL; ) {
+            target = find_target(builder, word, length, TRUE);
+            if (!target) {
+                return FALSE;
+            }
+            target->phony = TRUE;
+        }
+        return TRUE;
+    }
+    
+    for (entry = rule->first_command; entry; entry = entry->next) {
+        if (strstr(entry->command, "%(left)") || strstr(entry->command, "%(right)")) {
+            paired = TRUE;
+        }
+    }
+    if (paired) {
+        for (next = targets; (next = next_word(next, &word, &length)) != NULL; ) target_words++;
+        for (next = dependencies; (next = next_word(next, &word, &length)) != NULL; ) dependency_words++;
+        paired = (target_words == dependency_words);
+    }
+    
+    dep_next = dependencies;
+    for (next = targets; (next = next_word(next, &word, &length)) != NULL; ) {
+        target = find_target(builder, word, length, TRUE);
+        if (!target) {
+            return FALSE;
+        }
+        if (!*first) {
+            *first = target;
+        }
+        
+        if (rule->command_count > 0) {
+            if (target->rule && target->rule != rule && builder->verbose) {
+                Printf("GenMaki: Warning - '%s' has commands in two rules, using the last\n",
+                       target->name);
+            }
+            target->rule = rule;
+        }
+        
+        if (paired) {
+            dep_next = next_word(dep_next, &dep_word, &dep_length);
+            prerequisite = find_target(builder, dep_word, dep_length, TRUE);
+            if (!prerequisite || !add_prerequisite(builder, target, prerequisite)) {
+                return FALSE;
+            }
+            target->source = prerequisite->name;
+        } else {
+            for (dep_next = dependencies; (dep_next = next_word(dep_next, &dep_word, &dep_length)) != NULL; ) {
+                prerequisite = find_target(builder, dep_word, dep_length, TRUE);
+                if (!prerequisite || !add_prerequisite(builder, target, prerequisite)) {
+                    return FALSE;
+                }
+            }
+        }
+    }
+    return TRUE;
+}
+
+/* The second suffix of a suffix rule such as .c.o: with no
+ * dependencies, which makes x.o from x.c; NULL for any other rule */
+const char *suffix_rule(const char *targets, const char *dependencies)
+{
+    const char *second;
+    const char *p;
+    
+    if (*targets != '.' || *dependencies) {
+        return NULL;
+    }
+    second = strchr(targets + 1, '.');
+    if (!second || second == targets + 1 || !second[1]) {
+        return NULL;
+    }
+    for (p = targets + 1; *p; p++) {
+        if (*p == ' ' || *p == '\t' || *p == '/' || *p == ':' || (*p == '.' && p != second)) {
+            return NULL;
+        }
+    }
+    return second;
+}
+
+/* Give a target without commands those of the first pattern rule that
+ * fits its name - %.o: %.c in GNU make, .c.o (kept as *.o: *.c) in the
+ * others, or a GNU suffix rule .c.o - as long as the source that rule
+ * names exists or can be made. Returns FALSE if out of memory. */
+BOOL apply_pattern_rule(Builder *builder, Target *target)
+{
+    Makefile *makefile = builder->makefile;
+    Rule *rule;
+    STRPTR patterns;
+    STRPTR dependencies;
+    const char *next;
+    const char *word;
+    const char *wild;
+    const char *dep_next;
+    const char *dep_word;
+    LONG length;
+    LONG dep_length;
+    LONG name_length = gen_strlen(target->name);
+    LONG prefix;
+    LONG suffix;
+    LONG stem_length;
+    Target *source;
+    Target *prerequisite;
+    
+    for (rule = makefile->first_rule; rule; rule = rule->next) {
+        if (rule->command_count == 0) {
+            continue;
+        }
+        if (rule->is_pattern_rule) {
+            patterns = expand_variables(makefile, rule->targets);
+            dependencies = expand_variables(makefile, rule->dependencies);
+            if (!patterns || !dependencies) {
+                return FALSE;
+            }
+        } else {
+            /* .c.o: is %.o: %.c */
+            const char *second = suffix_rule(rule->targets, rule->dependencies);
+            LONG from_length;
+            
+            if (!second) {
+                continue;
+            }
+            from_length = second - (char *)rule->targets;
+            patterns = makefile_alloc(makefile, gen_strlen(second) + 2);
+            dependencies = makefile_alloc(makefile, from_length + 2);
+            if (!patterns || !dependencies) {
+                return FALSE;
+            }
+            patterns[0] = '%';
+            gen_strcpy((char *)patterns + 1, second);
+            dependencies[0] = '%';
+            CopyMem(rule->targets, dependencies + 1, from_length);
+        }
+        
+        for (next = patterns; (next = next_word(next, &word, &length)) != NULL; ) {
+            wild = find_wildcard(word, length);
+            if (!wild) {
+                continue;
+            }
+            prefix = wild - word;
+            suffix = length - prefix - 1;
+            stem_length = name_length - prefix - suffix;
+            if (stem_length < 1 ||
+                Strnicmp(target->name, (STRPTR)word, prefix) != 0 ||
+                Strnicmp(target->name + name_length - suffix, (STRPTR)(wild + 1), suffix) != 0) {
+                continue;
+            }
+            
+            /* The first dependency with a wildcard is the source, $< */
+            source = NULL;
+            for (dep_next = dependencies; (dep_next = next_word(dep_next, &dep_word, &dep_length)) != NULL; ) {
+                if (find_wildcard(dep_word, dep_length)) {
+                    source = pattern_target(builder, dep_word, dep_length,
+                                            target->name + prefix, stem_length);
+                    if (!source) {
+                        return FALSE;
                     }
-                    strcat((char *)new_flags, mapped_option);
-                    new_flags_len += strlen(mapped_option);
-                    first_option = FALSE;
+                    break;
                 }
-                
-                /* Clean up */
-                FreeVec(option);
-                if (mapped_option != option) {
-                    FreeVec(mapped_option);
+            }
+            if (source && !target_date(builder, source) && !source->rule &&
+                !source->first_prerequisite) {
+                continue;
+            }
+            
+            target->rule = rule;
+            target->stem = makefile_alloc(makefile, stem_length + 1);
+            if (!target->stem) {
+                return FALSE;
+            }
+            CopyMem(target->name + prefix, target->stem, stem_length);
+            target->stem[stem_length] = '\0';
+            target->source = source ? source->name : NULL;
+            
+            for (dep_next = dependencies; (dep_next = next_word(dep_next, &dep_word, &dep_length)) != NULL; ) {
+                prerequisite = pattern_target(builder, dep_word, dep_length,
+                                              target->name + prefix, stem_length);
+                if (!prerequisite || !add_prerequisite(builder, target, prerequisite)) {
+                    return FALSE;
                 }
             }
+            return TRUE;
         }
     }
+    return TRUE;
+}
+
+/* Add target to the build order after everything it needs */
+BOOL order_targets(Builder *builder, Target *target)
+{
+    Prerequisite *entry;
     
-    FreeVec(result);
-    return new_flags;
-}
-
-STRPTR map_compiler_option(STRPTR option, MakefileFormat from, MakefileFormat to)
-{
-    /* Map compiler options between different Amiga compilers */
-    STRPTR result;
-    STRPTR new_option;
-    LONG option_len;
-    
-    result = my_strdup(option);
-    if (!result) return option;
-    
-    option_len = strlen(option);
-    
-    /* Lattice C to SAS/C mapping */
-    if (from == FORMAT_LATTICE && to == FORMAT_SAS_C) {
-        if (my_stricmp(option, "-O") == 0) {
-            new_option = my_strdup("OPTIMIZE");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-DNONAMES") == 0) {
-            new_option = my_strdup("NOSTANDARDIO");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (strstr(option, "-DDEFBLOCKING=")) {
-            /* Remove this option as it's not applicable to SAS/C */
-            FreeVec(result);
-            return my_strdup("");
-        } else if (strstr(option, "-I")) {
-            /* Convert -Ipath to INCLUDEDIR=path: */
-            new_option = AllocVec(option_len + 20, MEMF_CLEAR);
-            if (new_option) {
-                strcpy((char *)new_option, "INCLUDEDIR=");
-                strcat((char *)new_option, option + 2); /* Skip "-I" */
-                strcat((char *)new_option, ":");
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-v") == 0) {
-            new_option = my_strdup("VERBOSE");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-d2") == 0 || my_stricmp(option, "-y") == 0) {
-            new_option = my_strdup("DEBUG=L");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-ms") == 0) {
-            new_option = my_strdup("DATA=NEAR");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (strstr(option, "-D")) {
-            /* Convert -DNAME=VALUE to DEF=NAME=VALUE or DEF=NAME */
-            new_option = AllocVec(option_len + 10, MEMF_CLEAR);
-            if (new_option) {
-                strcpy((char *)new_option, "DEF=");
-                strcat((char *)new_option, option + 2); /* Skip "-D" */
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-w") == 0) {
-            new_option = my_strdup("IGN=A");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-g") == 0) {
-            new_option = my_strdup("DEBUG=FF");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-c") == 0) {
-            new_option = my_strdup("OBJNAME");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-E") == 0) {
-            new_option = my_strdup("PPONLY");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-a") == 0) {
-            new_option = my_strdup("DISASM");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        }
-    }
-    
-    /* Lattice C to DICE mapping */
-    if (from == FORMAT_LATTICE && to == FORMAT_DICE) {
-        if (my_stricmp(option, "-O") == 0) {
-            new_option = my_strdup("-O");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-DNONAMES") == 0) {
-            /* Remove this option as it's not applicable to DICE */
-            FreeVec(result);
-            return my_strdup("");
-        } else if (strstr(option, "-DDEFBLOCKING=")) {
-            /* Remove this option as it's not applicable to DICE */
-            FreeVec(result);
-            return my_strdup("");
-        } else if (strstr(option, "-I")) {
-            /* Keep -I format for DICE */
-            return result;
-        } else if (my_stricmp(option, "-v") == 0) {
-            new_option = my_strdup("-v");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-d2") == 0 || my_stricmp(option, "-y") == 0) {
-            new_option = my_strdup("-d1");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-ms") == 0) {
-            new_option = my_strdup("-ms");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (strstr(option, "-D")) {
-            /* Keep -D format for DICE */
-            return result;
-        } else if (my_stricmp(option, "-w") == 0) {
-            /* DICE doesn't support -w, remove it */
-            FreeVec(result);
-            return my_strdup("");
-        } else if (my_stricmp(option, "-g") == 0) {
-            new_option = my_strdup("-s -d1");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-c") == 0) {
-            new_option = my_strdup("-c");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-E") == 0) {
-            /* DICE uses dcpp for preprocessing */
-            new_option = my_strdup("-E");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-a") == 0) {
-            new_option = my_strdup("-a");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        }
-    }
-    
-    /* Lattice C to GNU Make mapping */
-    if (from == FORMAT_LATTICE && to == FORMAT_GNU_MAKE) {
-        if (my_stricmp(option, "-O") == 0) {
-            new_option = my_strdup("-O2");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-DNONAMES") == 0) {
-            /* Remove this option as it's not applicable to GCC */
-            FreeVec(result);
-            return my_strdup("");
-        } else if (strstr(option, "-DDEFBLOCKING=")) {
-            /* Remove this option as it's not applicable to GCC */
-            FreeVec(result);
-            return my_strdup("");
-        } else if (strstr(option, "-I")) {
-            /* Keep -I format for GCC */
-            return result;
-        } else if (my_stricmp(option, "-v") == 0) {
-            new_option = my_strdup("-v");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-d2") == 0 || my_stricmp(option, "-y") == 0) {
-            new_option = my_strdup("-g");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-ms") == 0) {
-            new_option = my_strdup("-m68000");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (strstr(option, "-D")) {
-            /* Keep -D format for GCC */
-            return result;
-        } else if (my_stricmp(option, "-w") == 0) {
-            new_option = my_strdup("-w");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-g") == 0) {
-            new_option = my_strdup("-g");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-c") == 0) {
-            new_option = my_strdup("-c");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-E") == 0) {
-            new_option = my_strdup("-E");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-a") == 0) {
-            /* GCC doesn't have -a, use -S for assembly output */
-            new_option = my_strdup("-S");
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        }
-    }
-    
-    /* SAS/C to other formats */
-    if (from == FORMAT_SAS_C) {
-        if (my_stricmp(option, "OPTIMIZE") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-O2");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-O");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-O");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "NOSTANDARDIO") == 0) {
-            /* Remove this option as it's SAS/C specific */
-            FreeVec(result);
-            return my_strdup("");
-        } else if (strstr(option, "INCLUDEDIR=")) {
-            /* Convert INCLUDEDIR=path: to -Ipath */
-            new_option = AllocVec(option_len + 5, MEMF_CLEAR);
-            if (new_option) {
-                strcpy((char *)new_option, "-I");
-                strcat((char *)new_option, option + 11); /* Skip "INCLUDEDIR=" */
-                /* Remove trailing colon if present */
-                if (new_option[strlen((char *)new_option) - 1] == ':') {
-                    new_option[strlen((char *)new_option) - 1] = '\0';
+    if (target->state == TARGET_VISITING) {
+        Printf("GenMaki: Circular dependency on '%s'\n", target->name);
+        return FALSE;
+    }
+    if (target->state != TARGET_NEW) {
+        return TRUE;
+    }
+    target->state = TARGET_VISITING;
+    
+    if (!target->rule && !apply_pattern_rule(builder, target)) {
+        Printf("GenMaki: Out of memory\n");
+        return FALSE;
+    }
+    for (entry = target->first_prerequisite; entry; entry = entry->next) {
+        if (!order_targets(builder, entry->target)) {
+            return FALSE;
+        }
+    }
+    
+    if (!target_date(builder, target) && !target->rule && !target->first_prerequisite &&
+        !target->phony) {
+        Printf("GenMaki: Don't know how to make '%s'\n", target->name);
+        return FALSE;
+    }
+    
+    target->state = TARGET_WAITING;
+    if (builder->last_ordered) {
+        builder->last_ordered->next_ordered = target;
+    } else {
+        builder->first_ordered = target;
+    }
+    builder->last_ordered = target;
+    return TRUE;
+}
+
+/* Look for target on disk, noting its datestamp */
+BOOL target_date(Builder *builder, Target *target)
+{
+    BPTR lock;
+    
+    target->exists = FALSE;
+    if (target->phony) {
+        return FALSE;
+    }
+    lock = Lock(target->name, ACCESS_READ);
+    if (lock) {
+        if (Examine(lock, builder->fib)) {
+            target->date = builder->fib->fib_Date;
+            target->exists = TRUE;
+        }
+        UnLock(lock);
+    }
+    return target->exists;
+}
+
+/* Whether target needs making: it is missing, phony, or one of its
+ * prerequisites was just made or is newer than it */
+BOOL target_out_of_date(Target *target)
+{
+    Prerequisite *entry;
+    
+    if (!target->exists) {
+        return TRUE;
+    }
+    for (entry = target->first_prerequisite; entry; entry = entry->next) {
+        if (entry->target->rebuilt ||
+            (entry->target->exists && CompareDates(&target->date, &entry->target->date) > 0)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Append the names of target's prerequisites, or with newer only those
+ * that are out of date against it - $^ and $? */
+BOOL add_prerequisite_names(ExpandBuffer *buffer, Target *target, BOOL newer)
+{
+    Prerequisite *entry;
+    BOOL first = TRUE;
+    
+    for (entry = target->first_prerequisite; entry; entry = entry->next) {
+        if (newer && target->exists && !entry->target->rebuilt &&
+            !(entry->target->exists && CompareDates(&target->date, &entry->target->date) > 0)) {
+            continue;
+        }
+        if (!first) {
+            expand_buffer_add(buffer, " ", 1);
+        }
+        expand_buffer_add(buffer, entry->target->name, gen_strlen(entry->target->name));
+        first = FALSE;
+    }
+    return (BOOL)!buffer->failed;
+}
+
+/* The job's command as it is run: $@, $<, $^, $?, $*, %(left) and
+ * %(right) replaced, variables expanded, lines ending in '\' joined to
+ * the next, and the '@' (silent) and '-' (ignore errors) prefixes taken
+ * off. Returns NULL if out of memory. */
+STRPTR prepare_command(Builder *builder, Job *job, BOOL *silent)
+{
+    Target *target = job->target;
+    ExpandBuffer *buffer = &builder->substituted;
+    const char *p;
+    const char *start;
+    const char *name;
+    STRPTR command;
+    
+    buffer->length = 0;
+    buffer->failed = FALSE;
+    for (;;) {
+        p = job->command->command;
+        while (*p) {
+            if (*p == '$' && p[1] && strchr("@<^?*", p[1])) {
+                switch (p[1]) {
+                    case '@':
+                        expand_buffer_add(buffer, target->name, gen_strlen(target->name));
+                        break;
+                    case '<':
+                        name = target->source;
+                        if (!name && target->first_prerequisite) {
+                            name = target->first_prerequisite->target->name;
+                        }
+                        if (name) {
+                            expand_buffer_add(buffer, name, gen_strlen(name));
+                        }
+                        break;
+                    case '^':
+                    case '?':
+                        add_prerequisite_names(buffer, target, (BOOL)(p[1] == '?'));
+                        break;
+                    case '*':
+                        if (target->stem) {
+                            expand_buffer_add(buffer, target->stem, gen_strlen(target->stem));
+                        } else {
+                            /* The name without its suffix */
+                            name = strrchr(target->name, '.');
+                            if (!name || strchr(name, '/') || strchr(name, ':')) {
+                                name = target->name + gen_strlen(target->name);
+                            }
+                            expand_buffer_add(buffer, target->name, name - (char *)target->name);
+                        }
+                        break;
+                }
+                p += 2;
+            } else if (*p == '$' && p[1]) {
+                /* $$ and references are expanded below */
+                expand_buffer_add(buffer, p, 2);
+                p += 2;
+            } else if (strncmp(p, "%(left)", 7) == 0) {
+                expand_buffer_add(buffer, target->name, gen_strlen(target->name));
+                p += 7;
+            } else if (strncmp(p, "%(right)", 8) == 0) {
+                if (target->source) {
+                    expand_buffer_add(buffer, target->source, gen_strlen(target->source));
+                } else {
+                    add_prerequisite_names(buffer, target, FALSE);
                 }
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "DEBUG=L") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-g");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-d1");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-d2");
+                p += 8;
             } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "DATA=NEAR") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-m68000");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-ms");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-ms");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "VERBOSE") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-v");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-v");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-v");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "IGN=A") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-w");
-            } else if (to == FORMAT_DICE) {
-                /* DICE doesn't support -w, remove it */
-                FreeVec(result);
-                return my_strdup("");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-w");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (strstr(option, "DEF=")) {
-            /* Convert DEF=NAME=VALUE to -DNAME=VALUE or DEF=NAME to -DNAME */
-            new_option = AllocVec(option_len + 5, MEMF_CLEAR);
-            if (new_option) {
-                strcpy((char *)new_option, "-D");
-                strcat((char *)new_option, option + 4); /* Skip "DEF=" */
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "OBJNAME") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-c");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-c");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-c");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "PPONLY") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-E");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-E");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-E");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "DISASM") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-S");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-a");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-a");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
+                start = p++;
+                while (*p && *p != '$' && *p != '%') p++;
+                expand_buffer_add(buffer, start, p - start);
             }
         }
+        
+        /* A trailing '\' continues the command on the next line */
+        if (buffer->length > 0 && buffer->data[buffer->length - 1] == '\\' && job->command->next) {
+            buffer->data[buffer->length - 1] = ' ';
+            job->command = job->command->next;
+            continue;
+        }
+        break;
+    }
+    if (buffer->failed) {
+        return NULL;
     }
     
-    /* DICE to other formats */
-    if (from == FORMAT_DICE) {
-        if (my_stricmp(option, "-O") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-O2");
-            } else if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("OPTIMIZE");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-O");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-d1") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-g");
-            } else if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("DEBUG=L");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-d2");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-ms") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-m68000");
-            } else if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("DATA=NEAR");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-ms");
-            } else {
-                return result;
+    builder->line.length = 0;
+    builder->line.failed = FALSE;
+    if (buffer->length > 0 && !expand_into(builder->makefile, buffer->data, &builder->line)) {
+        return NULL;
+    }
+    command = builder->line.length > 0 ? builder->line.data : (STRPTR)"";
+    
+    *silent = FALSE;
+    job->ignore_errors = FALSE;
+    while (*command == '@' || *command == '-' || *command == ' ' || *command == '\t') {
+        if (*command == '@') {
+            *silent = TRUE;
+        } else if (*command == '-') {
+            job->ignore_errors = TRUE;
+        }
+        command++;
+    }
+    return command;
+}
+
+/* Run the job's command, skipping empty ones. Without JOBS it runs to
+ * the end here; with JOBS it is started as a process of its own and
+ * job_exit() reports when it has ended. Either way job->done is set
+ * once job->return_code holds its result. */
+void start_command(Builder *builder, Job *job)
+{
+    STRPTR command = NULL;
+    BPTR input;
+    BPTR output;
+    BOOL silent;
+    
+    job->done = FALSE;
+    job->return_code = 0;
+    while (job->command) {
+        command = prepare_command(builder, job, &silent);
+        if (!command) {
+            Printf("GenMaki: Out of memory\n");
+            job->return_code = -1;
+            job->done = TRUE;
+            return;
+        }
+        if (*command || !job->command->next) {
+            break;
+        }
+        job->command = job->command->next;
+    }
+    if (!command || !*command) {
+        job->done = TRUE;
+        return;
+    }
+    
+    if (!silent) {
+        Printf("%s\n", command);
+    }
+    
+    if (builder->signal == -1) {
+        job->return_code = SystemTags(command, SYS_UserShell, TRUE, TAG_DONE);
+        if (job->return_code == -1) {
+            Printf("GenMaki: Unable to run '%s'\n", command);
+        }
+        job->done = TRUE;
+        return;
+    }
+    
+    /* The process closes its input and output as it ends */
+    input = Open("NIL:", MODE_OLDFILE);
+    output = Open("*", MODE_NEWFILE);
+    if (input && output &&
+        SystemTags(command,
+                   SYS_Input, input,
+                   SYS_Output, output,
+                   SYS_Asynch, TRUE,
+                   SYS_UserShell, TRUE,
+                   NP_ExitCode, (ULONG)job_exit,
+                   NP_ExitData, (ULONG)job,
+                   TAG_DONE) != -1) {
+        return;
+    }
+    if (input) Close(input);
+    if (output) Close(output);
+    Printf("GenMaki: Unable to run '%s'\n", command);
+    job->return_code = -1;
+    job->done = TRUE;
+}
+
+/* NP_ExitCode of an asynchronous command, called as its process ends
+ * with the return code in D0 and NP_ExitData in D1. It runs on that
+ * process but in our seglist; the Forbid() is broken when it exits. */
+void __saveds __asm job_exit(register __d0 LONG return_code, register __d1 Job *job)
+{
+    Forbid();
+    job->return_code = return_code;
+    job->done = TRUE;
+    Signal(job->task, job->signal_mask);
+}
+
+/* A job's command has ended: start its next command or finish its
+ * target. As with the shell's FAILAT, ERROR or worse fails the target
+ * unless the command started with '-'. */
+void finish_job(Builder *builder, Job *job)
+{
+    Target *target = job->target;
+    LONG return_code = job->return_code;
+    BOOL more = (job->command && job->command->next);
+    
+    job->done = FALSE;
+    if ((return_code >= RETURN_ERROR || return_code < 0) && !job->ignore_errors) {
+        Printf("GenMaki: Making '%s' failed, return code %ld\n", target->name, return_code);
+        builder->failed = TRUE;
+        target->state = TARGET_FAILED;
+    } else if (more && !builder->failed && !builder->stopped) {
+        job->command = job->command->next;
+        start_command(builder, job);
+        return;
+    } else if (more) {
+        /* Stopped before its last command */
+        target->state = TARGET_FAILED;
+    } else {
+        target->state = TARGET_DONE;
+        target->rebuilt = TRUE;
+        target_date(builder, target);
+        builder->made_count++;
+    }
+    job->target = NULL;
+    builder->running--;
+}
+
+/* Start each waiting target whose prerequisites are made, while a job is
+ * free. Targets that are up to date or have no commands are finished at
+ * once. Prerequisites come first in the order, so one pass sees them. */
+void start_ready_targets(Builder *builder)
+{
+    Target *target;
+    Prerequisite *entry;
+    Job *job;
+    LONG i;
+    BOOL ready;
+    BOOL rebuilt;
+    
+    for (target = builder->first_pending; target; target = target->next_ordered) {
+        if (target->state != TARGET_WAITING) {
+            continue;
+        }
+        
+        ready = TRUE;
+        rebuilt = FALSE;
+        for (entry = target->first_prerequisite; entry; entry = entry->next) {
+            if (entry->target->state != TARGET_DONE) {
+                ready = FALSE;
+                break;
             }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
+            if (entry->target->rebuilt) {
+                rebuilt = TRUE;
             }
-        } else if (strstr(option, "-D")) {
-            /* Keep -D format for other compilers */
-            return result;
-        } else if (my_stricmp(option, "-v") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-v");
-            } else if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("VERBOSE");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-v");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-c") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-c");
-            } else if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("OBJNAME");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-c");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-E") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-E");
-            } else if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("PPONLY");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-E");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-a") == 0) {
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-S");
-            } else if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("DISASM");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-a");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-s") == 0) {
-            /* DICE -s is for debug symbols, map to appropriate debug options */
-            if (to == FORMAT_GNU_MAKE) {
-                new_option = my_strdup("-g");
-            } else if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("DEBUG=FF");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-g");
-            } else {
-                return result;
+        }
+        if (!ready) {
+            continue;
+        }
+        
+        if (!target->rule || target->rule->command_count == 0) {
+            /* Nothing to run - it is as new as what it depends on */
+            target->rebuilt = rebuilt;
+            target->state = TARGET_DONE;
+            continue;
+        }
+        if (!target_out_of_date(target)) {
+            if (builder->verbose) {
+                Printf("GenMaki: '%s' is up to date\n", target->name);
             }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
+            target->state = TARGET_DONE;
+            continue;
+        }
+        
+        job = NULL;
+        for (i = 0; i < builder->job_count; i++) {
+            if (!builder->jobs[i].target) {
+                job = &builder->jobs[i];
+                break;
             }
         }
+        if (!job) {
+            break;
+        }
+        
+        target->state = TARGET_RUNNING;
+        job->target = target;
+        job->command = target->rule->first_command;
+        builder->running++;
+        start_command(builder, job);
     }
     
-    /* GNU Make to other formats */
-    if (from == FORMAT_GNU_MAKE) {
-        if (my_stricmp(option, "-O2") == 0) {
-            if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("OPTIMIZE");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-O");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-O");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-g") == 0) {
-            if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("DEBUG=L");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-d1");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-d2");
+    while (builder->first_pending &&
+           (builder->first_pending->state == TARGET_DONE ||
+            builder->first_pending->state == TARGET_FAILED)) {
+        builder->first_pending = builder->first_pending->next_ordered;
+    }
+}
+
+void cleanup_makefile(Makefile *makefile)
+{
+    /* The whole model lives in the arena, which its owner resets or frees */
+    makefile->first_variable = NULL;
+    makefile->last_variable = NULL;
+    makefile->variable_count = 0;
+    makefile->buckets = NULL;
+    makefile->names.buckets = NULL;
+    makefile->first_rule = NULL;
+    makefile->last_rule = NULL;
+    makefile->rule_count = 0;
+    makefile->first_comment = NULL;
+    makefile->last_comment = NULL;
+    makefile->comment_count = 0;
+}
+
+void cleanup_config(Config *config)
+{
+    /* Note: input_file, output_file, and filetype come from ReadArgs
+     * and should NOT be freed by us - they're managed by the system */
+    /* Only free memory we allocated ourselves */
+    gen_stats_free(&config->stats);
+}
+
+void print_usage(void)
+{
+    Printf("Usage: GenMaki [FROM=file|pattern ...] [TO=file] [FILETYPE=format] [OPTIONMAP=file] [DEPEND] [DB=file] [CHECK] [ALL]\n");
+    Printf("               [BUILD] [JOBS=n] [TARGET=name] [STATS] [STATSFILE=file] [VERBOSE] [HELP]\n");
+    Printf("\n");
+    Printf("Arguments:\n");
+    Printf("  FROM=file      - Input makefile (optional, auto-detects if not specified);\n");
+    Printf("                   several files or a pattern convert each one next to itself\n");
+    Printf("  TO=file        - Output filename (if not specified, outputs to stdout); for\n");
+    Printf("                   several makefiles the name used beside each (default per format)\n");
+    Printf("  FILETYPE=format - Target format (optional, uses defaults if not specified)\n");
+    Printf("  OPTIONMAP=file - Extra compiler option mappings, one per line:\n");
+    Printf("                   from option to replacement, e.g. sasc CPU=* gnu -m*\n");
+    Printf("  DEPEND         - Scan the #include lines of each source in the rules and\n");
+    Printf("                   write its object's dependencies, e.g. foo.o: foo.c foo.h\n");
+    Printf("  DB=file        - DEPEND database of scanned files (default %s);\n", DEPEND_DB_NAME);
+    Printf("                   only files whose datestamp changed are scanned again\n");
+    Printf("  CHECK          - Write nothing, return WARN if the TO file is missing or older\n");
+    Printf("                   than FROM or OPTIONMAP, or with DEPEND if its dependencies\n");
+    Printf("                   (FROM's without TO) are incomplete; OK if it is up to date\n");
+    Printf("  ALL            - Convert the makefiles in this directory and every one below\n");
+    Printf("                   it, those FROM names or patterns match or, with FILETYPE,\n");
+    Printf("                   any standard name; those already in the target format are skipped\n");
+    Printf("  BUILD          - Convert nothing, run the commands of each target that is\n");
+    Printf("                   missing or older than what it depends on, in any format\n");
+    Printf("  JOBS=n         - With BUILD, make up to n targets at once (1 to %ld)\n", (LONG)MAX_BUILD_JOBS);
+    Printf("  TARGET=name    - With BUILD, the target to make instead of the first one\n");
+    Printf("  STATS          - Print time and counters per phase (read, detect, parse,\n");
+    Printf("                   depend, convert, build) at the end\n");
+    Printf("  STATSFILE=file - Write them to file as comma separated lines\n");
+    Printf("  VERBOSE        - Show detailed conversion information and warnings\n");
+    Printf("  HELP           - Show this help message\n");
+    Printf("\n");
+    Printf("Supported formats:\n");
+    Printf("  smake, smakefile, sasc    - SAS/C SMakefile format\n");
+    Printf("  dmake, dmakefile, dice    - DICE dmakefile format\n");
+    Printf("  makefile, make, gnu, gcc  - GNU Makefile format\n");
+    Printf("  lmk, lmkfile, lattice     - Lattice lmkfile format\n");
+    Printf("\n");
+    Printf("Default conversions:\n");
+    Printf("  GNU Makefile -> SAS/C SMakefile\n");
+    Printf("  Lattice lmkfile -> SAS/C SMakefile\n");
+    Printf("  DICE dmakefile -> GNU Makefile\n");
+    Printf("  SAS/C smakefile -> GNU Makefile\n");
+    Printf("\n");
+    Printf("Examples:\n");
+    Printf("  GenMaki                                    # Auto-detect and convert\n");
+    Printf("  GenMaki FROM=makefile FILETYPE=sasc SAVE   # Convert to SAS/C format\n");
+    Printf("  GenMaki FROM=lmkfile TO=Makefile SAVE      # Convert to GNU Make\n");
+    Printf("  GenMaki FROM=smakefile FILETYPE=sasc DEPEND TO=smakefile.new\n");
+    Printf("  GenMaki FROM=smakefile TO=Makefile DEPEND CHECK   # IF WARN, regenerate\n");
+    Printf("  GenMaki FROM=smakefile FILETYPE=gnu ALL    # Every smakefile in the tree\n");
+    Printf("  GenMaki FROM=dmakefile BUILD JOBS=4        # Make it, four targets at once\n");
+}
+
+BOOL validate_config(Config *config)
+{
+    if (config->save_to_file && !config->output_file) {
+        Printf("GenMaki: TO=filename required when using SAVE\n");
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+/* Built-in option mappings between the compilers of each format.
+ * Replacements are indexed by target format: unknown (always NULL), GNU,
+ * SAS/C, DICE, Lattice. */
+static OptionMapping builtin_options[] = {
+    /* Lattice C */
+    { "-O",              FORMAT_LATTICE, { NULL, "-O2",     "OPTIMIZE",      "-O",     NULL } },
+    { "-DNONAMES",       FORMAT_LATTICE, { NULL, "",        "NOSTANDARDIO",  "",       NULL } },
+    { "-DDEFBLOCKING=*", FORMAT_LATTICE, { NULL, "",        "",              "",       NULL } },
+    { "-I*",             FORMAT_LATTICE, { NULL, "-I*",     "INCLUDEDIR=*:", "-I*",    NULL } },
+    { "-v",              FORMAT_LATTICE, { NULL, "-v",      "VERBOSE",       "-v",     NULL } },
+    { "-d2",             FORMAT_LATTICE, { NULL, "-g",      "DEBUG=L",       "-d1",    NULL } },
+    { "-y",              FORMAT_LATTICE, { NULL, "-g",      "DEBUG=L",       "-d1",    NULL } },
+    { "-ms",             FORMAT_LATTICE, { NULL, "-m68000", "DATA=NEAR",     "-ms",    NULL } },
+    { "-D*",             FORMAT_LATTICE, { NULL, "-D*",     "DEF=*",         "-D*",    NULL } },
+    { "-w",              FORMAT_LATTICE, { NULL, "-w",      "IGN=A",         "",       NULL } },
+    { "-g",              FORMAT_LATTICE, { NULL, "-g",      "DEBUG=FF",      "-s -d1", NULL } },
+    { "-c",              FORMAT_LATTICE, { NULL, "-c",      "OBJNAME",       "-c",     NULL } },
+    { "-E",              FORMAT_LATTICE, { NULL, "-E",      "PPONLY",        "-E",     NULL } },
+    { "-a",              FORMAT_LATTICE, { NULL, "-S",      "DISASM",        "-a",     NULL } },
+    
+    /* SAS/C */
+    { "OPTIMIZE",        FORMAT_SAS_C,   { NULL, "-O2",     NULL,            "-O",     "-O"  } },
+    { "NOSTANDARDIO",    FORMAT_SAS_C,   { NULL, "",        NULL,            "",       ""    } },
+    { "INCLUDEDIR=*:",   FORMAT_SAS_C,   { NULL, "-I*",     NULL,            "-I*",    "-I*" } },
+    { "DEBUG=L",         FORMAT_SAS_C,   { NULL, "-g",      NULL,            "-d1",    "-d2" } },
+    { "DATA=NEAR",       FORMAT_SAS_C,   { NULL, "-m68000", NULL,            "-ms",    "-ms" } },
+    { "VERBOSE",         FORMAT_SAS_C,   { NULL, "-v",      NULL,            "-v",     "-v"  } },
+    { "IGN=A",           FORMAT_SAS_C,   { NULL, "-w",      NULL,            "",       "-w"  } },
+    { "DEF=*",           FORMAT_SAS_C,   { NULL, "-D*",     NULL,            "-D*",    "-D*" } },
+    { "OBJNAME",         FORMAT_SAS_C,   { NULL, "-c",      NULL,            "-c",     "-c"  } },
+    { "PPONLY",          FORMAT_SAS_C,   { NULL, "-E",      NULL,            "-E",     "-E"  } },
+    { "DISASM",          FORMAT_SAS_C,   { NULL, "-S",      NULL,            "-a",     "-a"  } },
+    
+    /* DICE */
+    { "-O",              FORMAT_DICE,    { NULL, "-O2",     "OPTIMIZE",      NULL,     "-O"  } },
+    { "-d1",             FORMAT_DICE,    { NULL, "-g",      "DEBUG=L",       NULL,     "-d2" } },
+    { "-ms",             FORMAT_DICE,    { NULL, "-m68000", "DATA=NEAR",     NULL,     "-ms" } },
+    { "-v",              FORMAT_DICE,    { NULL, "-v",      "VERBOSE",       NULL,     "-v"  } },
+    { "-c",              FORMAT_DICE,    { NULL, "-c",      "OBJNAME",       NULL,     "-c"  } },
+    { "-E",              FORMAT_DICE,    { NULL, "-E",      "PPONLY",        NULL,     "-E"  } },
+    { "-a",              FORMAT_DICE,    { NULL, "-S",      "DISASM",        NULL,     "-a"  } },
+    { "-s",              FORMAT_DICE,    { NULL, "-g",      "DEBUG=FF",      NULL,     "-g"  } },
+    
+    /* GNU C */
+    { "-O2",             FORMAT_GNU_MAKE, { NULL, NULL,     "OPTIMIZE",      "-O",     "-O"  } },
+    { "-g",              FORMAT_GNU_MAKE, { NULL, NULL,     "DEBUG=L",       "-d1",    "-d2" } },
+    { "-m68000",         FORMAT_GNU_MAKE, { NULL, NULL,     "DATA=NEAR",     "-ms",    "-ms" } },
+    { "-v",              FORMAT_GNU_MAKE, { NULL, NULL,     "VERBOSE",       "-v",     "-v"  } },
+    { "-w",              FORMAT_GNU_MAKE, { NULL, NULL,     "IGN=A",         "",       "-w"  } },
+    { "-c",              FORMAT_GNU_MAKE, { NULL, NULL,     "OBJNAME",       "-c",     "-c"  } },
+    { "-E",              FORMAT_GNU_MAKE, { NULL, NULL,     "PPONLY",        "-E",     "-E"  } },
+    { "-S",              FORMAT_GNU_MAKE, { NULL, NULL,     "DISASM",        "-a",     "-a"  } }
+};
+
+/* Start of the '*' in a prefix pattern, NULL for an exact pattern */
+const char *option_prefix_end(const char *pattern)
+{
+    return strchr(pattern, '*');
+}
+
+/* Sort order of the table: by source format, exact patterns before
+ * prefix ones, exact by name and prefixes longest first. Mappings that
+ * compare equal keep their order, so OPTIONMAP entries come first. */
+LONG option_pattern_compare(const OptionMapping *a, const OptionMapping *b)
+{
+    const char *a_star = option_prefix_end(a->pattern);
+    const char *b_star = option_prefix_end(b->pattern);
+    
+    if (a->from != b->from) {
+        return (LONG)a->from - (LONG)b->from;
+    }
+    if ((a_star != NULL) != (b_star != NULL)) {
+        return a_star ? 1 : -1;
+    }
+    if (a_star) {
+        return (LONG)(b_star - b->pattern) - (LONG)(a_star - a->pattern);
+    }
+    return my_stricmp(a->pattern, b->pattern);
+}
+
+/* Read "from option to replacement" lines from an OPTIONMAP file */
+BOOL load_option_map(STRPTR map_file)
+{
+    MakefileText text;
+    LONG i;
+    LONG field;
+    
+    init_makefile_text(&text);
+    if (!load_makefile_text(map_file, &text)) {
+        Printf("GenMaki: Cannot read option map '%s'\n", map_file);
+        free_makefile_text(&text);
+        return FALSE;
+    }
+    
+    option_table.loaded = gen_alloc(&option_table.arena, sizeof(OptionMapping) * (text.line_count + 1));
+    if (!option_table.loaded) {
+        Printf("GenMaki: Out of memory\n");
+        free_makefile_text(&text);
+        return FALSE;
+    }
+    
+    for (i = 0; i < text.line_count; i++) {
+        char *p = gen_skip_blanks((char *)text.lines[i]);
+        char *fields[4];
+        OptionMapping *mapping;
+        MakefileFormat from;
+        MakefileFormat to;
+        LONG j;
+        
+        /* Blank lines and comments */
+        if (*p == '\0' || *p == ';' || *p == '#') {
+            continue;
+        }
+        
+        /* Four fields, the replacement may be quoted to hold spaces or be empty */
+        for (field = 0; field < 4 && *p; field++) {
+            if (*p == '"') {
+                fields[field] = ++p;
+                while (*p && *p != '"') p++;
             } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-m68000") == 0) {
-            if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("DATA=NEAR");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-ms");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-ms");
+                fields[field] = p;
+                while (*p && *p != ' ' && *p != '\t') p++;
+            }
+            if (*p) *p++ = '\0';
+            p = gen_skip_blanks(p);
+        }
+        
+        if (field < 4 ||
+            (from = parse_filetype_string(fields[0])) == FORMAT_UNKNOWN ||
+            (to = parse_filetype_string(fields[2])) == FORMAT_UNKNOWN) {
+            Printf("GenMaki: %s line %ld: expected 'from option to replacement'\n", map_file, i + 1);
+            free_makefile_text(&text);
+            return FALSE;
+        }
+        
+        mapping = &option_table.loaded[option_table.loaded_count++];
+        mapping->pattern = gen_arena_string(&option_table.arena, fields[1], gen_strlen(fields[1]));
+        mapping->from = from;
+        for (j = 0; j < FORMAT_COUNT; j++) {
+            mapping->to[j] = NULL;
+        }
+        mapping->to[to] = gen_arena_string(&option_table.arena, fields[3], gen_strlen(fields[3]));
+        if (!mapping->pattern || !mapping->to[to]) {
+            Printf("GenMaki: Out of memory\n");
+            free_makefile_text(&text);
+            return FALSE;
+        }
+    }
+    
+    free_makefile_text(&text);
+    return TRUE;
+}
+
+/* Build the sorted option index from the built-in and loaded mappings */
+BOOL init_option_table(STRPTR map_file)
+{
+    LONG builtin_count = sizeof(builtin_options) / sizeof(builtin_options[0]);
+    LONG i, j;
+    
+    option_table.index = NULL;
+    option_table.count = 0;
+    gen_arena_init(&option_table.arena, POOL_PUDDLE_SIZE);
+    option_table.loaded = NULL;
+    option_table.loaded_count = 0;
+    
+    if (map_file && !load_option_map(map_file)) {
+        return FALSE;
+    }
+    
+    option_table.index = AllocVec(sizeof(OptionMapping *) * (builtin_count + option_table.loaded_count), MEMF_ANY);
+    if (!option_table.index) {
+        Printf("GenMaki: Out of memory\n");
+        return FALSE;
+    }
+    
+    /* Loaded mappings first, so they are found before built-in ones */
+    for (i = 0; i < option_table.loaded_count; i++) {
+        option_table.index[option_table.count++] = &option_table.loaded[i];
+    }
+    for (i = 0; i < builtin_count; i++) {
+        option_table.index[option_table.count++] = &builtin_options[i];
+    }
+    
+    /* Insertion sort - stable, and the table is small */
+    for (i = 1; i < option_table.count; i++) {
+        OptionMapping *mapping = option_table.index[i];
+        for (j = i; j > 0 && option_pattern_compare(option_table.index[j - 1], mapping) > 0; j--) {
+            option_table.index[j] = option_table.index[j - 1];
+        }
+        option_table.index[j] = mapping;
+    }
+    
+    /* Ranges of exact and prefix patterns for each source format */
+    for (i = 0; i < FORMAT_COUNT; i++) {
+        option_table.exact_first[i] = 0;
+        option_table.exact_count[i] = 0;
+        option_table.prefix_first[i] = 0;
+        option_table.prefix_count[i] = 0;
+    }
+    for (i = option_table.count - 1; i >= 0; i--) {
+        OptionMapping *mapping = option_table.index[i];
+        if (option_prefix_end(mapping->pattern)) {
+            option_table.prefix_first[mapping->from] = i;
+            option_table.prefix_count[mapping->from]++;
+        } else {
+            option_table.exact_first[mapping->from] = i;
+            option_table.exact_count[mapping->from]++;
+        }
+    }
+    
+    return TRUE;
+}
+
+void free_option_table(void)
+{
+    if (option_table.index) {
+        FreeVec(option_table.index);
+        option_table.index = NULL;
+    }
+    gen_arena_free(&option_table.arena);
+    option_table.count = 0;
+}
+
+/* Translate one compiler option into out, returning its length - zero when
+ * the option is dropped - or -1 if out is too small. Options without a
+ * mapping are copied unchanged. */
+LONG map_compiler_option(const char *option, LONG length, MakefileFormat from, MakefileFormat to,
+                         char *out, LONG out_size)
+{
+    char name[MAX_OPTION_LENGTH];
+    const char *replacement = NULL;
+    const char *rest = option;
+    LONG rest_len = length;
+    LONG low, high, mid, result, i;
+    LONG written;
+    
+    if (length < MAX_OPTION_LENGTH && from > FORMAT_UNKNOWN && from < FORMAT_COUNT) {
+        CopyMem((APTR)option, name, length);
+        name[length] = '\0';
+        
+        /* Exact patterns - binary search for the first one with this name */
+        low = option_table.exact_first[from];
+        high = low + option_table.exact_count[from];
+        while (low < high) {
+            mid = (low + high) / 2;
+            result = my_stricmp(option_table.index[mid]->pattern, name);
+            if (result < 0) {
+                low = mid + 1;
             } else {
-                return result;
+                high = mid;
             }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
+        }
+        for (i = low; i < option_table.exact_first[from] + option_table.exact_count[from] &&
+                      my_stricmp(option_table.index[i]->pattern, name) == 0; i++) {
+            if (option_table.index[i]->to[to]) {
+                replacement = option_table.index[i]->to[to];
+                break;
             }
-        } else if (strstr(option, "-D")) {
-            /* Keep -D format for other compilers */
-            return result;
-        } else if (my_stricmp(option, "-v") == 0) {
-            if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("VERBOSE");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-v");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-v");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-w") == 0) {
-            if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("IGN=A");
-            } else if (to == FORMAT_DICE) {
-                /* DICE doesn't support -w, remove it */
-                FreeVec(result);
-                return my_strdup("");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-w");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-c") == 0) {
-            if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("OBJNAME");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-c");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-c");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-E") == 0) {
-            if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("PPONLY");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-E");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-E");
-            } else {
-                return result;
-            }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
-            }
-        } else if (my_stricmp(option, "-S") == 0) {
-            if (to == FORMAT_SAS_C) {
-                new_option = my_strdup("DISASM");
-            } else if (to == FORMAT_DICE) {
-                new_option = my_strdup("-a");
-            } else if (to == FORMAT_LATTICE) {
-                new_option = my_strdup("-a");
-            } else {
-                return result;
+        }
+        
+        /* Prefix patterns, longest first */
+        for (i = option_table.prefix_first[from];
+             !replacement && i < option_table.prefix_first[from] + option_table.prefix_count[from]; i++) {
+            OptionMapping *mapping = option_table.index[i];
+            const char *star = option_prefix_end(mapping->pattern);
+            LONG prefix_len = star - mapping->pattern;
+            
+            if (mapping->to[to] && prefix_len <= length &&
+                strncmp(mapping->pattern, name, prefix_len) == 0) {
+                LONG suffix_len = gen_strlen(star + 1);
+                
+                replacement = mapping->to[to];
+                rest = option + prefix_len;
+                rest_len = length - prefix_len;
+                if (suffix_len > 0 && rest_len >= suffix_len &&
+                    strncmp(rest + rest_len - suffix_len, star + 1, suffix_len) == 0) {
+                    rest_len -= suffix_len;
+                }
+            }
+        }
+    }
+    
+    /* No mapping - keep the option */
+    if (!replacement) {
+        replacement = "*";
+    }
+    
+    /* Write the replacement with '*' standing for the rest of the option */
+    written = 0;
+    for (; *replacement; replacement++) {
+        if (*replacement == '*') {
+            if (written + rest_len >= out_size) {
+                return -1;
             }
-            if (new_option) {
-                FreeVec(result);
-                return new_option;
+            CopyMem((APTR)rest, out + written, rest_len);
+            written += rest_len;
+        } else {
+            if (written + 1 >= out_size) {
+                return -1;
             }
+            out[written++] = *replacement;
         }
     }
+    out[written] = '\0';
+    return written;
+}
+
+/* Convert compiler flags between different Amiga compilers, one table
+ * lookup per option. The result is allocated with AllocVec(). */
+STRPTR convert_cflags(STRPTR flags, MakefileFormat from, MakefileFormat to)
+{
+    ExpandBuffer buffer;
+    char mapped[MAX_OPTION_LENGTH];
+    const char *current = flags;
+    const char *start;
+    LONG length;
     
-    /* If no mapping found, return original option */
-    return result;
+    buffer.data = NULL;
+    buffer.length = 0;
+    buffer.size = 0;
+    buffer.failed = FALSE;
+    
+    /* If no conversion needed, return a copy of the original */
+    if (from == to) {
+        return gen_strdup(flags);
+    }
+    
+    /* Parse individual options separated by spaces */
+    while (*current) {
+        /* Skip leading spaces */
+        while (*current == ' ' || *current == '\t') current++;
+        if (!*current) break;
+        
+        /* Find end of current option */
+        start = current;
+        while (*current && *current != ' ' && *current != '\t') current++;
+        
+        length = map_compiler_option(start, current - start, from, to, mapped, sizeof(mapped));
+        if (length < 0) {
+            /* Too long to translate, keep it as it is */
+            if (buffer.length > 0) expand_buffer_add(&buffer, " ", 1);
+            expand_buffer_add(&buffer, start, current - start);
+        } else if (length > 0) {
+            if (buffer.length > 0) expand_buffer_add(&buffer, " ", 1);
+            expand_buffer_add(&buffer, mapped, length);
+        }
+    }
+    
+    if (buffer.failed) {
+        if (buffer.data) FreeVec(buffer.data);
+        return gen_strdup(flags);
+    }
+    if (!buffer.data) {
+        return gen_strdup("");
+    }
+    return buffer.data;
 }
 
-STRPTR map_command(STRPTR command, MakefileFormat from, MakefileFormat to)
+/* Write command as it runs under the target format's tools. Nothing is
+ * allocated: the parts kept are written straight from the command. */
+void map_command(GenWriter *out, STRPTR command, MakefileFormat from, MakefileFormat to)
 {
     /* Basic command mapping - more sophisticated mapping can be added later */
-    STRPTR result;
-    STRPTR new_cmd;
+    LONG length = gen_strlen(command);
     STRPTR args;
-    STRPTR arg_start;
-    
-    result = my_strdup(command);
-    if (!result) return command;
     
     /* Map compiler commands */
     if (strstr(command, "gcc") && to != FORMAT_GNU_MAKE) {
+        /* Skip "gcc " */
+        args = command + (length < 4 ? length : 4);
         if (to == FORMAT_SAS_C) {
             /* Replace gcc with sc and add OBJNAME parameter */
-            new_cmd = AllocVec(strlen(command) + 50, MEMF_CLEAR);
-            if (new_cmd) {
-                strcpy((char *)new_cmd, "sc ");
-                strcat((char *)new_cmd, command + 4); /* Skip "gcc " */
-                strcat((char *)new_cmd, " OBJNAME=$*.o");
-                FreeVec(result);
-                return new_cmd;
-            }
+            gen_write_string(out, "sc ");
+            gen_write_string(out, args);
+            gen_write_string(out, " OBJNAME=$*.o");
+            return;
         } else if (to == FORMAT_DICE) {
             /* Replace gcc with dcc */
-            new_cmd = AllocVec(strlen(command) + 10, MEMF_CLEAR);
-            if (new_cmd) {
-                strcpy((char *)new_cmd, "dcc ");
-                strcat((char *)new_cmd, command + 4); /* Skip "gcc " */
-                FreeVec(result);
-                return new_cmd;
-            }
+            gen_write_string(out, "dcc ");
+            gen_write_string(out, args);
+            return;
         } else if (to == FORMAT_LATTICE) {
             /* Replace gcc with lc */
-            new_cmd = AllocVec(strlen(command) + 10, MEMF_CLEAR);
-            if (new_cmd) {
-                strcpy((char *)new_cmd, "lc ");
-                strcat((char *)new_cmd, command + 4); /* Skip "gcc " */
-                FreeVec(result);
-                return new_cmd;
-            }
+            gen_write_string(out, "lc ");
+            gen_write_string(out, args);
+            return;
         }
     }
     
     /* Map linker commands */
     if (strstr(command, "blink") && to == FORMAT_SAS_C) {
-        /* Convert blink to slink */
-        new_cmd = AllocVec(strlen(command) + 10, MEMF_CLEAR);
-        if (new_cmd) {
-            strcpy((char *)new_cmd, "slink ");
-            strcat((char *)new_cmd, command + 6); /* Skip "blink " */
-            FreeVec(result);
-            return new_cmd;
-        }
+        /* Convert blink to slink, skipping "blink " */
+        gen_write_string(out, "slink ");
+        gen_write_string(out, command + (length < 6 ? length : 6));
+        return;
     } else if (strstr(command, "slink") && to != FORMAT_SAS_C) {
         if (to == FORMAT_GNU_MAKE) {
             /* Convert slink to gcc link command */
-            new_cmd = AllocVec(strlen(command) + 50, MEMF_CLEAR);
-            if (new_cmd) {
-                strcpy((char *)new_cmd, "cc ");
-                /* Extract object files and output name from slink command */
-                strcat((char *)new_cmd, "-o program"); /* Simplified */
-                FreeVec(result);
-                return new_cmd;
-            }
+            /* Extract object files and output name from slink command */
+            gen_write_string(out, "cc -o program"); /* Simplified */
+            return;
         }
     }
     
     /* Map file operations */
     if (strstr(command, "rm") && to != FORMAT_GNU_MAKE) {
+        /* Keep only the file names: skip "rm" and flags like -f */
+        args = command;
+        while (*args && *args != ' ') args++;
+        while (*args == ' ') args++;
+        while (*args == '-') {
+            while (*args && *args != ' ') args++;
+            while (*args == ' ') args++;
+        }
         if (to == FORMAT_SAS_C) {
-            new_cmd = AllocVec(strlen(command) + 20, MEMF_CLEAR);
-            if (new_cmd) {
-                strcpy((char *)new_cmd, "delete ");
-                /* Remove wildcards and -f flag, keep only specific filenames */
-                args = command;
-                while (*args && *args != ' ') args++; /* Skip "rm" */
-                while (*args == ' ') args++; /* Skip spaces */
-                while (*args == '-') { /* Skip flags like -f */
-                    while (*args && *args != ' ') args++;
-                    while (*args == ' ') args++;
-                }
-                /* Copy remaining arguments, but remove wildcards */
-                arg_start = args;
-                while (*args) {
-                    if (*args == '*' || *args == '?') {
-                        /* Skip wildcard patterns - Amiga doesn't support them in delete */
-                        while (*args && *args != ' ') args++;
-                        while (*args == ' ') args++;
-                    } else {
-                        args++;
-                    }
-                }
-                if (arg_start < args) {
-                    strncat((char *)new_cmd, arg_start, args - arg_start);
-                }
-                strcat((char *)new_cmd, " QUIET");
-                FreeVec(result);
-                return new_cmd;
-            }
+            gen_write_string(out, "delete ");
+            gen_write_string(out, args);
+            gen_write_string(out, " QUIET");
+            return;
         } else if (to == FORMAT_DICE) {
-            new_cmd = AllocVec(strlen(command) + 10, MEMF_CLEAR);
-            if (new_cmd) {
-                strcpy((char *)new_cmd, "delete ");
-                /* Similar processing for DICE */
-                args = command;
-                while (*args && *args != ' ') args++;
-                while (*args == ' ') args++;
-                while (*args == '-') {
-                    while (*args && *args != ' ') args++;
-                    while (*args == ' ') args++;
-                }
-                strcat((char *)new_cmd, args);
-                FreeVec(result);
-                return new_cmd;
-            }
+            gen_write_string(out, "delete ");
+            gen_write_string(out, args);
+            return;
         } else if (to == FORMAT_LATTICE) {
-            new_cmd = AllocVec(strlen(command) + 10, MEMF_CLEAR);
-            if (new_cmd) {
-                strcpy((char *)new_cmd, "Delete ");
-                /* Similar processing for Lattice */
-                args = command;
-                while (*args && *args != ' ') args++;
-                while (*args == ' ') args++;
-                while (*args == '-') {
-                    while (*args && *args != ' ') args++;
-                    while (*args == ' ') args++;
-                }
-                strcat((char *)new_cmd, args);
-                FreeVec(result);
-                return new_cmd;
-            }
+            gen_write_string(out, "Delete ");
+            gen_write_string(out, args);
+            return;
         }
     }
     
-    return result;
+    gen_write_string(out, command);
 }